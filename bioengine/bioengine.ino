@@ -7,41 +7,138 @@
 #include "src/engine_map/engine_map.h"
 // Library containing methods for determining instructions from the computer
 #include "src/messages/messages.h"
+// Library containing the Timer1 time base
+#include "src/timer/timer.h"
+// Library containing methods for switching the coils/injectors from the timer
+#include "src/scheduler/scheduler.h"
+// Library containing the interrupt-driven serial port
+#include "src/serial_port/serial_port.h"
+// Library containing the binary command frames
+#include "src/frames/frames.h"
+// Library containing the ring of IPG pulses handed from the interrupt to the loop
+#include "src/pulse_ring/pulse_ring.h"
+// Library containing the timing histograms of the stages of the loop
+#include "src/profiler/profiler.h"
+// Library containing the usage of SRAM and the stack canary
+#include "src/memory/memory.h"
+// Library containing the reply to STATUS, sent a line per pass of the loop
+#include "src/status_report/status_report.h"
+// Library containing the state machine placing the crank angle from the CPG pulses
+#include "src/crank_sync/crank_sync.h"
+// Library containing the ring of fault and sync events, and its snapshot in the EEPROM
+#include "src/flight_recorder/flight_recorder.h"
+// Library containing the free-running, oversampled ADC reading the thermistor
+#include "src/adc_sampler/adc_sampler.h"
 
 // Maximum internal temperature of control system allowed, in deg C
 #define MAX_TEMP        80
 // The initial target RPM of the system upon start-up
 #define TARGET_RPM      1000
+// The baud rate of the serial port
+#define SERIAL_BAUD     115200
 
 // The number of crankshaft rotations before the timings and temperatures are recalculated
+// The timings are only found again once the speed or temperature leaves its band, so they are checked every cycle
 #define TACHO_MODULO    1000
-#define TIMINGS_TACHO   10
+#define TIMINGS_TACHO   1
 #define TEMP_TACHO      50
 
 //#define SPEED_TEST
 //#define SHUTDOWN_TEST
 
+// Switch the coils/injectors from the loop instead of from the timer
+//#define POLLED_ACTUATION
+
+// Time each stage of the loop, for STATUS --PROFILE. Comment out to remove the probes
+#define LOOP_PROFILE
+
 // Struct that selects the optimal GT Power 
 operating_point o;
 // Struct containing information about the optimal fuel/spark timings calculated from the engine speed
 timings t;
 // Struct containing information about the state of the engine
 engine e;
+// Struct extending Timer1 to a 32 bit time base
+timer tm;
+// Struct containing the queue of coil/injector edges waiting for the timer
+scheduler s;
+// Struct containing the rings of bytes waiting to be sent and read
+serial_port sp;
+// Struct decoding binary command frames from the serial port
+frame_decoder fd;
+// Struct containing the IPG pulses not yet seen by the loop
+pulse_ring pr;
+// Struct containing the line of the STATUS reply to send next
+status_report sr;
+// Struct containing the sync of the crank angle to the CPG pulses
+crank_sync cs;
+// Struct containing the last fault and sync events
+flight_recorder fr;
+// Struct containing the samples of the thermistor taken by the ADC
+adc_sampler as;
+
+#ifdef LOOP_PROFILE
+    // Struct containing the timing histograms of the stages of the loop
+    profiler pf;
+    // The stage of the profile to print next, while it is held
+    uint8_t profile_line;
+
+    // Reads the timer at the start of the pass, and at the end of each stage
+    #define PROBE_START()   uint32_t pass_start = timer_ticks(&tm), probe = pass_start
+    #define PROBE(stage)    probe = profile_stage(&pf, stage, probe, timer_ticks(&tm))
+    #define PROBE_END()     profile_stage(&pf, STAGE_LOOP, pass_start, probe)
+#else
+    #define PROBE_START()
+    #define PROBE(stage)
+    #define PROBE_END()
+#endif
+
+/*
+    Parameters of the control system that can be written with a PARAM
+    frame, by id, each with the range of values it accepts. The table
+    is held in flash, and read with pgm_read_*.
+*/
+int16_t max_temp = MAX_TEMP;
+int16_t timings_tacho = TIMINGS_TACHO;
+int16_t temp_tacho = TEMP_TACHO;
+int16_t sync_tolerance = SYNC_TOLERANCE;
+
+typedef struct parameter {
+    int16_t* value;
+    int16_t min, max;
+} parameter;
+
+#define MAX_TEMP_PARAM          0
+#define TIMINGS_TACHO_PARAM     1
+#define TEMP_TACHO_PARAM        2
+#define SYNC_TOLERANCE_PARAM    3
+#define RPM_BAND_PARAM          4
+#define TEMP_BAND_PARAM         5
+
+const parameter parameters[] PROGMEM = {
+    {&max_temp, 0, 120},
+    {&timings_tacho, 1, TACHO_MODULO},
+    {&temp_tacho, 1, TACHO_MODULO},
+    {&sync_tolerance, 0, MAX_SYNC_TOLERANCE},
+    {&(t.rpm_band), 0, 1000},
+    {&(t.temp_band), 0, 50},
+};
+
+#define PARAMETERS (sizeof(parameters) / sizeof(parameters[0]))
 
 // A variable counting the microseconds since the last observed pulse
 // Used to determine the shaft speed and the crankshaft angle between pulses
 unsigned long tacho = 0;
 
-// Counter for the number of IPG pulses between successive CPG pulses
+// Counter for the number of IPG pulses between successive CPG pulses, kept by the interrupt
 volatile char pulses = 1;
-// Variables that record the number of pulses and the crankshaft angle when the CPG last pulsed
-volatile int saved_pulses, saved_crank;
-//
-volatile unsigned long current_pulse;
-volatile unsigned long last_pulse;
+// The times of the last two IPG pulses in timer ticks, as captured
+volatile uint32_t current_tick;
+volatile uint32_t last_tick;
 
-volatile bool cpg_pulsed = false;
-volatile bool ipg_pulsed = false;
+// The last IPG pulse taken from the ring by the loop
+pulse_record pulse;
+bool pulse_seen = false;
 
 bool update_temperature = false;
 bool update_timings = false;
@@ -52,25 +149,132 @@ size_t buffer = 0;
 
 char message[MESSAGE_SIZE];
 bool message_available = false;
+bool frame_available = false;
 
 bool user_run = false;
 
-void ipg_pulse(void){
+// The timer ticks at start-up, and whether the timings have been valid since
+uint32_t boot_tick;
+bool first_valid = false;
+
+void ipg_pulse(uint32_t tick){
     increment_crank(&e, IPG_PULSE_ANGLE);
     pulses++;
 
-    if(pin_state(&(e.cpg))){
-        saved_pulses = pulses;
-        pulses = 0;
+    // New timings are put in force at TDC, and each output is handed over to them at the TDC of its cylinder
+    if(e.crank == 0) swap_timings(&t);
+
+    bool cpg = pin_state(&(e.cpg));
+
+    if(!push_pulse(&pr, tick, e.crank, pulses, cpg)){
+        record_event(&fr, EVENT_PULSE_OVERRUN, tick, e.crank, e.rpm, e.temp);
+    }
+
+    if(cpg) pulses = 0;
+
+    last_tick = current_tick;
+    current_tick = tick;
+
+    #ifndef POLLED_ACTUATION
+    // Queue the coil/injector edges up to the next IPG pulse, while the crank angle is known
+    if(e.is_running && crank_synced(&cs)){
+        // As predicted by the tracker, or the last interval alone if the loop has not caught up
+        uint32_t period = current_tick - last_tick;
+        int32_t bend = 0;
+        take_prediction(&e, pr.sequence, &period, &bend);
+
+        schedule_actuations(&s, &tm, &(timings_in_force(&t)->table), timings_replaced(&t), e.crank, current_tick, period, bend);
+    }
+    #endif
+}
+
+// The rising edge of the IPG, timestamped by the input capture unit
+ISR(TIMER1_CAPT_vect){
+    ipg_pulse(timer_capture(&tm));
+}
+
+ISR(TIMER1_OVF_vect){
+    timer_overflow(&tm);
+}
+
+ISR(TIMER1_COMPA_vect){
+    run_actuations(&s, &tm);
+}
+
+ISR(ADC_vect){
+    adc_sample(&as);
+}
+
+ISR(USART1_UDRE_vect){
+    serial_transmit(&sp);
+}
+
+ISR(USART1_RX_vect){
+    serial_receive(&sp);
+}
+
+void print_profile(void){
+    #ifdef LOOP_PROFILE
+    serial_println_P(&sp, PSTR("loop profile:"));
+
+    // The stages are sent by stream_profile, a line per pass, as they stood when the command was read
+    pf.held = true;
+    profile_line = 0;
+    #else
+    serial_println_P(&sp, PSTR("Loop profiling is not compiled in.\n"));
+    #endif
+}
+
+/* Method called on every pass of the loop to send the next line of the profile, once the transmit ring has room for the longest */
+void stream_profile(void){
+    #ifdef LOOP_PROFILE
+    if(!pf.held || serial_tx_space(&sp) < MESSAGE_SIZE + 2) return;
+
+    // Formatted apart from the message buffer, which may be holding a command as it is read
+    char line[MESSAGE_SIZE];
 
-        saved_crank = e.crank;
-        cpg_pulsed = true;
+    if(profile_line < PROFILE_STAGES){
+        get_profile_info(&pf, profile_line++, line);
+        serial_println(&sp, line);
+        return;
     }
 
-    last_pulse = current_pulse;
-    current_pulse = micros();
+    serial_println_P(&sp, PSTR(""));
 
-    ipg_pulsed = true;
+    // Each dump covers the passes since the last
+    init_profiler(&pf);
+    #endif
+}
+
+/*
+    Writes the spark and fuel cells of the map given by SET, at the
+    speed of --RPM and the temperature of --TEMP. The timings are found
+    again at once, so an edit is put in force at the next TDC, or the
+    one after if the outputs are still being handed over.
+*/
+void set_map_cells(instr* i){
+    int err = 0;
+
+    if(i->spark != NOT_GIVEN) err = set_map_cell(&live_map, SPARK_CELL, i->speed, i->temp, i->spark);
+    if(!err && i->fuel != NOT_GIVEN) err = set_map_cell(&live_map, FUEL_CELL, i->speed, i->temp, i->fuel);
+
+    if(err == MAP_NO_CELL){
+        serial_println_P(&sp, PSTR("No cell of the map at that speed and temperature.\n"));
+        return;
+    }
+
+    if(err == MAP_OUT_OF_RANGE){
+        serial_println_P(&sp, PSTR("Angle is out of range.\n"));
+        return;
+    }
+
+    // A stopped engine finds its timings when it turns
+    if(e.rpm != 0 && new_operating_point(e.rpm, &o, &t, &e, NULL)){
+        shutdown_and_print(EVENT_TIMINGS_ERROR, PSTR("Error occurred when updating timings.\n"));
+        return;
+    }
+
+    serial_println_P(&sp, PSTR("Map cell updated.\n"));
 }
 
 void handle_new_instruction(instr* i){
@@ -79,41 +283,174 @@ void handle_new_instruction(instr* i){
             if(!e.is_running) user_run = true;
             break;
         case STOP_CODE:
-            shutdown_and_print("User-prompted shutdown.\n");
+            shutdown_and_print(EVENT_STOP, PSTR("User-prompted shutdown.\n"));
             break;
         case STATUS_CODE:
-            get_engine_info(&e, message);
-            Serial.println(message);
-            get_timing_info(&t, message);
-            Serial.println(message);
+            if(i->profile){
+                print_profile();
+                break;
+            }
+
+            if(i->memory){
+                get_memory_info(message);
+                serial_println(&sp, message);
+                break;
+            }
+
+            // Sent over the next passes of the loop
+            start_status_report(&sr);
             break;
         case SET_CODE:
+            if(i->spark != NOT_GIVEN || i->fuel != NOT_GIVEN){
+                set_map_cells(i);
+                break;
+            }
+
             new_operating_point(i->speed, &o, &t, &e, message);
-            Serial.println(message);
+            serial_println(&sp, message);
+            break;
+        case DUMP_CODE:
+            // Sent over the next passes of the loop
+            start_flight_dump(&fr, i->eeprom);
     }
 }
 
-void shutdown_and_print(char* cause){
+void send_frame(uint8_t type, const uint8_t* payload, uint8_t length){
+    uint8_t out[FRAME_MAX_SIZE];
+    serial_write(&sp, (const char*) out, encode_frame(out, type, payload, length));
+}
+
+void send_result_frame(uint8_t type, bool rejected){
+    uint8_t result = rejected ? FRAME_REJECTED : FRAME_OK;
+    send_frame(type | FRAME_REPLY, &result, 1);
+}
+
+/*
+    The payload of the reply to a STATUS frame, little-endian:
+
+        0   int16   crank angle in deg
+        2   int16   speed in RPM
+        4   int16   temperature in deg C
+        6   uint8   bit 0: engine running, bit 1: timings valid, bit 2: crank synced
+        7   int32   spark start angle in force, Q16.16 deg
+        11  int32   spark end angle
+        15  int32   fuel start angle
+        19  int32   fuel end angle
+        23  uint16  serial messages dropped
+        25  uint16  serial bytes received dropped
+        27  uint16  frames rejected
+        29  uint16  IPG pulse overruns
+*/
+void send_status_frame(void){
+    uint8_t payload[STATUS_PAYLOAD];
+    uint16_t rx_dropped;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        rx_dropped = sp.rx_dropped;
+    }
+
+    uint8_t* p = payload;
+    p = put_uint16(p, get_crank(&e));
+    p = put_uint16(p, e.rpm);
+    p = put_uint16(p, e.temp);
+    *p++ = (e.is_running ? 1 : 0) | (t.is_valid ? 2 : 0) | (crank_synced(&cs) ? 4 : 0);
+
+    const timing_buffer* b = timings_in_force(&t);
+
+    for(int i = 0; i < 2; i++) p = put_uint32(p, b->spark[i]);
+    for(int i = 0; i < 2; i++) p = put_uint32(p, b->fuel[i]);
+
+    p = put_uint16(p, sp.tx_dropped);
+    p = put_uint16(p, rx_dropped);
+    p = put_uint16(p, fd.rejected);
+    p = put_uint16(p, pulse_overruns(&pr));
+
+    send_frame(STATUS_CODE | FRAME_REPLY, payload, STATUS_PAYLOAD);
+}
+
+void handle_new_frame(const frame* f){
+    switch(f->type){
+        case START_CODE:
+            if(!e.is_running) user_run = true;
+            send_result_frame(f->type, false);
+            break;
+        case STOP_CODE:
+            cancel_actuations(&s);
+            shutdown(&e);
+            log_event(EVENT_STOP);
+            send_result_frame(f->type, false);
+            break;
+        case STATUS_CODE:
+            send_status_frame();
+            break;
+        case SET_CODE: {
+            int16_t rpm = get_uint16(f->payload);
+            send_result_frame(f->type, rpm <= 0 || new_operating_point(rpm, &o, &t, &e, NULL));
+            break;
+        }
+        case PARAM_CODE: {
+            uint8_t id = f->payload[0];
+            int16_t value = get_uint16(f->payload + 1);
+            bool rejected = id >= PARAMETERS
+                || value < (int16_t) pgm_read_word(&(parameters[id].min))
+                || value > (int16_t) pgm_read_word(&(parameters[id].max));
+
+            if(!rejected) *((int16_t*) pgm_read_ptr(&(parameters[id].value))) = value;
+            send_result_frame(f->type, rejected);
+        }
+    }
+}
+
+/* Records an event in the flight recorder, with the state of the engine now */
+void log_event(uint8_t code){
+    record_event(&fr, code, timer_ticks(&tm), get_crank(&e), e.rpm, e.temp);
+}
+
+/*
+    Shuts the engine down and reports why, given its event and a cause
+    held in flash. Unless it was asked for, the flight log leading up
+    to it is saved to the EEPROM.
+*/
+void shutdown_and_print(uint8_t event, PGM_P cause){
+    cancel_actuations(&s);
     shutdown(&e);
 
-    Serial.println(cause);
-    Serial.println("Shutting Down...\n");
+    log_event(event);
+    if(event != EVENT_STOP) snapshot_flight_log(&fr, event);
+
+    serial_println_P(&sp, cause);
+    serial_println_P(&sp, PSTR("Shutting Down...\n"));
 
     get_engine_info(&e, message);
-    Serial.println(message);
+    serial_println(&sp, message);
+}
+
+/* Reports the time from start-up to the first valid timings */
+void print_first_valid(void){
+    formatter f;
+    init_formatter(&f, message, MESSAGE_SIZE);
+
+    put_P(&f, PSTR("Timings valid "));
+    put_uint(&f, (timer_ticks(&tm) - boot_tick) / (TICKS_PER_US * 1000UL));
+    put_P(&f, PSTR(" ms after start-up.\n"));
+
+    serial_println(&sp, message);
 }
 
 #ifdef SPEED_TEST
     #define REPORT_TEST_TACHO 20
-    float prev_estimated_crank = 0;
+    angle_t prev_estimated_crank = 0;
 
-    void print_angle(char* m, float d){
-        int diff_integer = (int) d;
-        int diff_decimal = (int) 10 * (d - diff_integer);
+    void print_angle(PGM_P m, angle_t d){
+        formatter f;
+        init_formatter(&f, message, MESSAGE_SIZE);
 
-        sprintf(message, "%s ~%i.%i deg", m, diff_integer, diff_decimal);
+        put_P(&f, m);
+        put_P(&f, PSTR(" ~"));
+        put_fixed(&f, d, 16, 1);
+        put_P(&f, PSTR(" deg"));
 
-        Serial.println(message);
+        serial_println(&sp, message);
     }
 #endif
 
@@ -125,115 +462,229 @@ void shutdown_and_print(char* cause){
     bool update_test_report = false;
 #endif
 
+void handle_cpg_pulse(pulse_record* p){
+    bool was_synced = crank_synced(&cs);
+    int true_crank = sync_cpg_pulse(&cs, p->pulses, sync_tolerance);
+    bool corrected = true_crank != -1 && p->crank != true_crank;
+
+    // Recorded rather than printed, so the faults are seen without holding up the pulses after them
+    if(was_synced && !crank_synced(&cs)){
+        log_event(EVENT_SYNC_LOST);
+    } else if(true_crank == -1){
+        log_event(EVENT_MISSED_PULSE);
+    } else if(!was_synced && crank_synced(&cs)){
+        log_event(EVENT_SYNC_LOCKED);
+    }
+
+    if(corrected){
+        log_event(EVENT_CRANK_CORRECTED);
+
+        // The interrupt may have counted more pulses since, so the correction is added to them
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            set_crank(&e, e.crank + true_crank - p->crank + 720);
+            shift_pulse_cranks(&pr, true_crank - p->crank);
+        }
+
+        p->crank = true_crank;
+    } else if(user_run && t.is_valid && crank_synced(&cs)){
+        serial_println_P(&sp, PSTR("Control System is running.\n"));
+        e.is_running = true;
+        user_run = false;
+
+        log_event(EVENT_START);
+    }
+
+    // A fault is ridden through as long as the pattern is locked again within a cycle
+    if(e.is_running && cs.unlocked > CPG_PULSES){
+        shutdown_and_print(EVENT_SIGNAL_MISMATCH, PSTR("CPG and IPG signals don't match.\n"));
+    } else if(e.is_running && (corrected || !crank_synced(&cs))){
+        // The edges queued were placed at a wrong angle, so they are dropped until the next pulse schedules afresh
+        cancel_actuations(&s);
+        open_all_circuits(&e);
+    }
+
+    if(p->crank == 0){
+        tacho = (tacho + 1) % TACHO_MODULO;
+        if(!(tacho % timings_tacho)) update_timings = true;
+        if(!(tacho % temp_tacho)) update_temperature = true;
+
+        #if defined(SPEED_TEST) || defined(SHUTDOWN_TEST)
+        if(!(tacho % REPORT_TEST_TACHO)){
+            update_test_report = true;
+        }
+        #endif
+    }
+}
+
 void setup(void){
+    // Before anything else runs, so the stack peak counts from here
+    paint_stack();
+
     // Open Serial Communication
-    Serial.begin(9600);
+    init_serial_port(&sp, SERIAL_BAUD);
+    init_frame_decoder(&fd);
+    init_pulse_ring(&pr);
+    init_status_report(&sr, &e, &t, &sp, &pr, &cs, &s);
+    init_crank_sync(&cs);
+    init_flight_recorder(&fr);
+
+    #ifdef LOOP_PROFILE
+    init_profiler(&pf);
+    #endif
 
-    // Set the engine parameters
+    // Set the engine parameters, with one conversion of the thermistor before the ADC is left to run
     init_engine(&e);
     init_timings(&t);
+    init_adc_sampler(&as, THERMISTOR_CHANNEL);
+
+    init_timer(&tm);
+    init_scheduler(&s);
+    boot_tick = timer_ticks(&tm);
+
+    bool loaded = load_operating_map(&live_map);
+    uint32_t load_ticks = timer_ticks(&tm) - boot_tick;
 
     new_operating_point(TARGET_RPM, &o, &t, &e, message);
 
-    attachInterrupt(digitalPinToInterrupt(e.ipg.pin), ipg_pulse, RISING);
+    init_capture();
+
+    log_event(EVENT_BOOT);
+
+    flight_snapshot fs;
+    if(read_flight_snapshot(&fs)) serial_println_P(&sp, PSTR("The log of the last fault is held, see DUMP --EEPROM.\n"));
 
-    Serial.println("Setup successful.\n");
+    formatter f;
+    init_formatter(&f, message, MESSAGE_SIZE);
+
+    put_P(&f, loaded ? PSTR("Map loaded from EEPROM in ") : PSTR("No map held in EEPROM, defaults loaded in "));
+    put_uint(&f, load_ticks / TICKS_PER_US);
+    put_P(&f, PSTR(" us.\n"));
+    serial_println(&sp, message);
+
+    serial_println_P(&sp, PSTR("Setup successful.\n"));
 }
 
 void loop(void){
-    if(Serial.available() > 0){
-        message[buffer] = Serial.read();
+    PROBE_START();
+
+    // Read every byte received since the last pass, up to the end of a message or frame, once the replies to the last have been sent
+    bool replied = serial_tx_space(&sp) == SERIAL_TX_SIZE - 1;
+    int c;
+
+    while(replied && !message_available && !frame_available && (c = serial_read(&sp)) != -1){
+        // A frame can only start between text messages
+        if(!frame_idle(&fd) || (buffer == 0 && c == FRAME_SYNC)){
+            frame_available = decode_frame_byte(&fd, c);
+            continue;
+        }
+
+        message[buffer] = c;
         if(message[buffer] == '\n'){
             message[buffer + 1] = '\0';
             message_available = true;
             buffer = 0;
         } else if(buffer == MESSAGE_SIZE - 1){
-            Serial.println("Message is too long.\n");
+            serial_println_P(&sp, PSTR("Message is too long.\n"));
             buffer = 0;
         } else {
             buffer++;
         }
-    } else if(message_available){
-        Serial.print(message);
+    }
+
+    if(message_available){
+        serial_print(&sp, message);
 
         instr i = get_instruction(message);
         
         get_instruction_message(&i, message);
-        Serial.println(message);
+        serial_println(&sp, message);
 
         handle_new_instruction(&i);
 
         message_available = false;
     }
 
-    if(cpg_pulsed){
-        int true_crank = get_true_crank_angle(saved_pulses);
+    if(frame_available){
+        handle_new_frame(&(fd.f));
+        frame_available = false;
+    }
 
-        if(true_crank == -1){
-            Serial.println("Missed pulse.\n");
-        } else if(true_crank != -1 && saved_crank != true_crank){
-            if(e.is_running){
-                shutdown_and_print("CPG and IPG signals don't match.\n");
-            } else {
-                Serial.println("Correcting crankshaft angle.\n");
-                set_crank(&e, true_crank);
-            }
-        } else if(user_run && t.is_valid){
-            Serial.println("Control System is running.\n");
-            e.is_running = true;
-            user_run = false;
-        }
+    stream_status_report(&sr);
+    stream_profile();
+    stream_flight_dump(&fr, &sp);
+    save_flight_log(&fr);
+    save_operating_map(&live_map);
 
-        if(e.crank == 0){
-            tacho = (tacho + 1) % TACHO_MODULO;
-            if(!(tacho % TIMINGS_TACHO)) update_timings = true;
-            if(!(tacho % TEMP_TACHO)) update_temperature = true;
+    PROBE(STAGE_SERIAL);
 
-            #if defined(SPEED_TEST) || defined(SHUTDOWN_TEST)
-            if(!(tacho % REPORT_TEST_TACHO)){
-                update_test_report = true;
-            }
-            #endif
+    // Take every IPG pulse since the last pass, in order
+    pulse_record p;
+
+    while(pop_pulse(&pr, &p)){
+        // A pulse dropped from a full ring leaves a gap, across which there is no interval to measure
+        if(pulse_seen && (uint8_t) (p.sequence - pulse.sequence) == 1){
+            update_velocity(&e, p.time - pulse.time);
+
+            // The segment after the next pulse is the one that pulse will schedule
+            publish_prediction(&e, p.sequence + 1);
         }
 
-        cpg_pulsed = false;
-        ipg_pulsed = false;
+        pulse = p;
+        pulse_seen = true;
 
-    } else if(ipg_pulsed){
-        unsigned long pulse_width = current_pulse - last_pulse;
-        update_velocity(&e, pulse_width);
-        ipg_pulsed = false;
+        if(pulse.cpg) handle_cpg_pulse(&pulse);
     }
 
-    // Set the operating point for the correct timings every revolution of the crank
+    PROBE(STAGE_PULSES);
+
+    // Timings deferred while the outputs were handed over are found once the handover ends
+    if(t.deferred && !t.handover) update_timings = true;
+
+    // Set the operating point for the measured speed and temperature every few revolutions of the crank
     if(update_timings){
         update_timings = false;
-        int err = set_engine_timings(&t, &o, &e);
+        int err = update_operating_point(&o, &t, &e);
 
         if(err){
-            shutdown_and_print("Error occurred when updating timings.\n");
+            shutdown_and_print(EVENT_TIMINGS_ERROR, PSTR("Error occurred when updating timings.\n"));
         }
+
+        PROBE(STAGE_TIMINGS);
     } else if(update_temperature){
         update_temperature = false;
-        get_internal_temp(&e);
 
-        if(e.is_running && e.temp > MAX_TEMP){
-            shutdown_and_print("Internal temperature exceeded maximum.\n");
+        // The last block of samples the ADC interrupt has finished, so the loop never waits on a conversion
+        uint16_t count;
+        if(take_adc_sample(&as, &count)) set_internal_temp(&e, thermistor_temperature_fine(count, ADC_SAMPLER_BITS));
+
+        // Checked in 1/16 deg C, so the limit is not rounded
+        if(e.is_running && e.fine_temp > (max_temp << THERMISTOR_SCALE_BITS)){
+            shutdown_and_print(EVENT_OVER_TEMPERATURE, PSTR("Internal temperature exceeded maximum.\n"));
         }
+
+        PROBE(STAGE_TEMPERATURE);
     }
 
+    // Once, however the timings were found
+    if(!first_valid && t.is_valid){
+        first_valid = true;
+        print_first_valid();
+    }
+
+    #if defined(POLLED_ACTUATION) || defined(SPEED_TEST)
     // Estimate the crankshaft angle between pulses using linear interpolation
-    float estimated_crank = estimate_angle(&e, current_pulse);
+    angle_t estimated_crank = estimate_angle(&e, pulse.crank, timer_ticks(&tm) - pulse.time);
+    #endif
 
     #ifdef SPEED_TEST
-    float angle_difference = estimated_crank - prev_estimated_crank;
-    if(angle_difference < 0) angle_difference += 720;
+    angle_t angle_difference = estimated_crank - prev_estimated_crank;
+    if(angle_difference < 0) angle_difference += FULL_CYCLE;
 
     if(update_test_report){
-        print_angle("Esimated crank:", estimated_crank);
-        print_angle("Previous estimated crank:", prev_estimated_crank);
-        print_angle("   Loop angle difference:", angle_difference);
-        Serial.println();
+        print_angle(PSTR("Esimated crank:"), estimated_crank);
+        print_angle(PSTR("Previous estimated crank:"), prev_estimated_crank);
+        print_angle(PSTR("   Loop angle difference:"), angle_difference);
+        serial_println_P(&sp, PSTR(""));
         update_test_report = false;
     }
 
@@ -244,26 +695,33 @@ void loop(void){
         
         #ifdef SHUTDOWN_TEST
         if(update_test_report){
-            Serial.println("Engine is running.\n");
+            serial_println_P(&sp, PSTR("Engine is running.\n"));
             update_test_report = false;
         }
         #endif
 
-        for(int c = 0; c < 4; c++){
-            // Calculate the phase of each cylinder based off the estimated crankshaft angle
-            float a = fmod(estimated_crank + cylinder_phases[c], 720);
+        #ifdef POLLED_ACTUATION
+        // Look up the state of every coil and injector at the estimated crankshaft angle, while it is known
+        const action_table* a;
+        const action_table* before;
 
-            if(should_open_circuit(a, t.spark, &(e.coils[c]))){
-                open_circuit(&(e.coils[c]));
-            } else if(should_close_circuit(a, t.spark, &(e.coils[c]))){
-                close_circuit(&(e.coils[c]));
-            }
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            a = &(timings_in_force(&t)->table);
+            before = timings_replaced(&t);
+        }
 
-            if(should_open_circuit(a, t.fuel, &(e.injs[c]))){
-                open_circuit(&(e.injs[c]));
-            } else if(should_close_circuit(a, t.fuel, &(e.injs[c]))){
-                close_circuit(&(e.injs[c]));
+        if(crank_synced(&cs)){
+            if(before){
+                uint8_t state[MAX_TABLE_PORTS];
+                handover_state(a, before, ANGLE_TO_TABLE(estimated_crank), state);
+                write_action_state(a, state);
+            } else {
+                write_action_state(a, action_state(a, ANGLE_TO_TABLE(estimated_crank)));
             }
         }
+        #endif
     }
+
+    PROBE(STAGE_ACTUATION);
+    PROBE_END();
 }
\ No newline at end of file
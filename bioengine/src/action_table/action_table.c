@@ -0,0 +1,148 @@
+#include "action_table.h"
+
+static angle_t wrap_angle(angle_t a){
+    a %= FULL_CYCLE;
+    return a < 0 ? a + FULL_CYCLE : a;
+}
+
+void init_action_table(action_table* a){
+    a->port_count = 0;
+    a->edge_count = 0;
+
+    for(size_t k = 0; k <= SEGMENTS; k++){
+        a->first[k] = 0;
+    }
+}
+
+/* Returns the index of the port of a pin in the table, adding it if needed, or -1 if the table is full. */
+static int8_t table_port(action_table* a, const pin* p){
+    for(uint8_t i = 0; i < a->port_count; i++){
+        if(a->ports[i] == p->reg) return i;
+    }
+
+    if(a->port_count == MAX_TABLE_PORTS) return -1;
+
+    a->ports[a->port_count] = p->reg;
+    a->managed[a->port_count] = 0;
+
+    return a->port_count++;
+}
+
+/*
+    Adds the close and open edges of a circuit to the table, which is kept
+    sorted by angle, and sets its initial state in states[0].
+*/
+static int add_circuit(action_table* a, uint32_t* angles, const angle_t bounds[2], int phase, const pin* p){
+    int8_t port = table_port(a, p);
+    if(port < 0) return 1;
+
+    uint8_t mask = 1 << p->num;
+    a->managed[port] |= mask;
+
+    angle_t close_angle = wrap_angle(bounds[0] - ANGLE(phase));
+    angle_t open_angle = wrap_angle(bounds[1] - ANGLE(phase));
+
+    // The TDC of the cylinder, 0 in its own frame
+    uint8_t handover = ANGLE_TO_TABLE(wrap_angle(-ANGLE(phase))) >> 16;
+
+    // The circuit is closed at 0 if 0 lies in the window, modulo 720
+    if(wrap_angle(-close_angle) < wrap_angle(open_angle - close_angle)){
+        a->states[0][port] |= mask;
+    }
+
+    for(uint8_t k = 0; k < 2; k++){
+        uint32_t angle = ANGLE_TO_TABLE(k == 0 ? close_angle : open_angle);
+
+        uint8_t i = a->edge_count;
+
+        while(i > 0 && angles[i - 1] > angle){
+            a->edges[i] = a->edges[i - 1];
+            angles[i] = angles[i - 1];
+            i--;
+        }
+
+        a->edges[i].fraction = (uint16_t) angle;
+        a->edges[i].port = port;
+        a->edges[i].mask = mask;
+        a->edges[i].close = k == 0;
+        a->edges[i].handover = handover;
+        angles[i] = angle;
+
+        a->edge_count++;
+    }
+
+    return 0;
+}
+
+int compile_action_table(action_table* a, const angle_t spark[2], const angle_t fuel[2], const int phases[CYLINDERS], const engine* e){
+    uint32_t angles[TABLE_EDGES];
+
+    init_action_table(a);
+
+    for(size_t p = 0; p < MAX_TABLE_PORTS; p++){
+        a->states[0][p] = 0;
+    }
+
+    for(uint8_t c = 0; c < CYLINDERS; c++){
+        if(add_circuit(a, angles, spark, phases[c], &(e->coils[c]))) return 1;
+        if(add_circuit(a, angles, fuel, phases[c], &(e->injs[c]))) return 1;
+    }
+
+    uint8_t i = 0;
+
+    for(uint8_t k = 0; k < SEGMENTS; k++){
+        a->first[k] = i;
+        while(i < a->edge_count && (angles[i] >> 16) == k) i++;
+    }
+
+    a->first[SEGMENTS] = a->edge_count;
+
+    for(i = 0; i < a->edge_count; i++){
+        const table_edge* edge = &(a->edges[i]);
+
+        for(uint8_t p = 0; p < a->port_count; p++){
+            a->states[i + 1][p] = a->states[i][p];
+        }
+
+        if(edge->close){
+            a->states[i + 1][edge->port] |= edge->mask;
+        } else {
+            a->states[i + 1][edge->port] &= ~(edge->mask);
+        }
+    }
+
+    return 0;
+}
+
+const uint8_t* action_state(const action_table* a, uint32_t angle){
+    uint8_t segment = (angle >> 16) % SEGMENTS;
+    uint16_t fraction = angle & 0xFFFF;
+
+    uint8_t i = a->first[segment];
+
+    while(i < a->first[segment + 1] && a->edges[i].fraction <= fraction) i++;
+
+    return a->states[i];
+}
+
+void handover_state(const action_table* a, const action_table* before, uint32_t angle, uint8_t state[MAX_TABLE_PORTS]){
+    uint8_t segment = (angle >> 16) % SEGMENTS;
+    uint8_t handed[MAX_TABLE_PORTS] = {0};
+
+    for(uint8_t i = 0; i < a->edge_count; i++){
+        if(a->edges[i].handover <= segment) handed[a->edges[i].port] |= a->edges[i].mask;
+    }
+
+    const uint8_t* after = action_state(a, angle);
+    const uint8_t* replaced = action_state(before, angle);
+
+    for(uint8_t p = 0; p < a->port_count; p++){
+        state[p] = (after[p] & handed[p]) | (replaced[p] & ~handed[p]);
+    }
+}
+
+void write_action_state(const action_table* a, const uint8_t* state){
+    for(uint8_t p = 0; p < a->port_count; p++){
+        *(a->ports[p]) = (*(a->ports[p]) & ~(a->managed[p])) | state[p];
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef ACTION_TABLE_H
+    #define ACTION_TABLE_H
+
+    #include <Arduino.h>
+
+    // Library containing basic methods for opening/closing circuits or measuring pulses
+    #include "../control_system/control_system.h"
+
+    /*
+        The spark and fuel windows of every cylinder, compiled into a 
+        table of the state the coil and injector ports should be in at
+        each crank angle.
+
+        Angles are given in table units, of which there are 65536 per IPG
+        segment, so the top bits of an angle index the segment and the
+        bottom 16 bits are the fraction of the way through it. The table
+        holds every edge of every output, sorted by angle and indexed by 
+        segment, and the state of each port after each edge. Looking up
+        the state at an angle is then one index into the segment and a 
+        scan over the (at most few) edges within it.
+
+        Windows are handled modulo 720 degrees, so a window that wraps 
+        past the end of the cycle is closed from its start, through 0, 
+        to its end.
+
+        When a new table replaces the one in force, each output is handed
+        over to it at the segment holding the TDC of its own cylinder, 
+        where neither its spark window nor its fuel window can be open, 
+        so no window is switched with one edge from each table. Until 
+        then it keeps following the table it is replaced from. Each edge
+        carries the segment its output is handed over at.
+    */
+
+    // Number of edges per engine cycle: an open and close for each coil and injector
+    #define TABLE_EDGES             (4 * CYLINDERS)
+
+    // Number of IPG segments per engine cycle
+    #define SEGMENTS                (720 / IPG_PULSE_ANGLE)
+
+    // Most output ports the coils and injectors can be spread across
+    #define MAX_TABLE_PORTS         4
+
+    #define TABLE_UNITS_PER_SEGMENT 65536UL
+
+    // Converts a fixed point angle between 0 and 720 degrees to table units
+    #define ANGLE_TO_TABLE(A)       ((uint32_t) (A) / IPG_PULSE_ANGLE)
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct table_edge {
+        // Fraction of the way through the segment, out of 65536
+        uint16_t fraction;
+        // Index of the port in the table
+        uint8_t port;
+        uint8_t mask;
+        bool close;
+        // The segment the output is handed over to a new table at
+        uint8_t handover;
+    } table_edge;
+
+    typedef struct action_table {
+        volatile uint8_t* ports[MAX_TABLE_PORTS];
+        // The bits of each port driven by the table
+        uint8_t managed[MAX_TABLE_PORTS];
+        uint8_t port_count;
+
+        table_edge edges[TABLE_EDGES];
+        uint8_t edge_count;
+
+        // The edges of segment k are edges[first[k]] to edges[first[k + 1] - 1]
+        uint8_t first[SEGMENTS + 1];
+
+        // states[i] is the state of each port after the first i edges of the cycle
+        uint8_t states[TABLE_EDGES + 1][MAX_TABLE_PORTS];
+    } action_table;
+
+    /* Method to set up an empty table, which drives no outputs. */
+    void init_action_table(action_table* a);
+
+    /*
+        Method to compile the spark and fuel windows, given in the frame
+        of each cylinder, into the table. Returns 1 if the outputs are
+        spread across more than MAX_TABLE_PORTS ports.
+    */
+    int compile_action_table(action_table* a, const angle_t spark[2], const angle_t fuel[2], const int phases[CYLINDERS], const engine* e);
+
+    /* Method to look up the state of each port at an angle given in table units. */
+    const uint8_t* action_state(const action_table* a, uint32_t angle);
+
+    /*
+        Method to look up the state of each port at an angle given in 
+        table units, in the cycle a table is handed over from before: 
+        the state in a of the outputs handed over by then, and the state
+        in before of the rest.
+    */
+    void handover_state(const action_table* a, const action_table* before, uint32_t angle, uint8_t state[MAX_TABLE_PORTS]);
+
+    /* Method to write a state to the driven bits of each port. */
+    void write_action_state(const action_table* a, const uint8_t* state);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
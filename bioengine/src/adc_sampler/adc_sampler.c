@@ -0,0 +1,45 @@
+#include "adc_sampler.h"
+
+void init_adc_sampler(adc_sampler* a, uint8_t channel){
+    a->sum = 0;
+    a->samples = 0;
+    a->value = 0;
+    a->fresh = false;
+
+    // AVcc reference, right adjusted, and channels above 7 selected with MUX5
+    ADMUX = _BV(REFS0) | (channel & 0x07);
+    ADCSRB = channel > 7 ? _BV(MUX5) : 0;
+
+    if(channel < 8) DIDR0 |= _BV(channel);
+
+    // Free running (ADTS = 0), at F_CPU / 128
+    ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIF) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+}
+
+void adc_sample(adc_sampler* a){
+    a->sum += ADC;
+
+    if(++(a->samples) < ADC_SAMPLER_SAMPLES) return;
+
+    // The sum of 4^n samples has 2n more bits, of which n are kept
+    a->value = a->sum >> ADC_SAMPLER_BITS;
+    a->fresh = true;
+
+    a->sum = 0;
+    a->samples = 0;
+}
+
+bool take_adc_sample(adc_sampler* a, uint16_t* value){
+    bool fresh;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        fresh = a->fresh;
+
+        if(fresh){
+            *value = a->value;
+            a->fresh = false;
+        }
+    }
+
+    return fresh;
+}
@@ -0,0 +1,66 @@
+#ifndef ADC_SAMPLER_H
+    #define ADC_SAMPLER_H
+
+    #include <Arduino.h>
+    #include <util/atomic.h>
+
+    /*
+        The ADC run freely on one channel, a conversion every 13 ADC
+        clocks, with its conversion complete interrupt summing the
+        samples into blocks.
+
+        Each block of ADC_SAMPLER_SAMPLES samples is decimated to a value
+        with ADC_SAMPLER_BITS more bits than a single conversion, so the
+        loop reads a value that is ready and has been filtered, in place
+        of waiting 104 us for analogRead to convert one noisy sample. The
+        extra bits are only real when the input carries at least an LSB
+        of noise, which the thermistor's does.
+
+        At the 125 kHz ADC clock, the widest prescaler at 16 MHz, a
+        conversion takes 104 us and a block 1.7 ms. The interrupt only
+        adds the sample and counts, so it holds off the Timer1 compare
+        interrupt that switches the coils and injectors for a few
+        microseconds at most.
+    */
+
+    // Extra bits of each value, which take 4 samples apiece
+    #define ADC_SAMPLER_BITS        2
+    #define ADC_SAMPLER_SAMPLES     (1 << (2 * ADC_SAMPLER_BITS))
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct adc_sampler {
+        // The sum of the samples of the block being taken, and how many it holds
+        uint16_t sum;
+        uint8_t samples;
+
+        // The last whole block decimated, in 1/(2^ADC_SAMPLER_BITS) counts
+        volatile uint16_t value;
+        // Whether it has been taken since the block was finished
+        volatile bool fresh;
+    } adc_sampler;
+
+    /*
+        Starts the ADC converting a channel freely against AVcc, with the
+        conversion complete interrupt enabled, and disables the digital
+        input buffer of the channel.
+    */
+    void init_adc_sampler(adc_sampler* a, uint8_t channel);
+
+    /* Method called by the conversion complete interrupt. */
+    void adc_sample(adc_sampler* a);
+
+    /*
+        Method to take the last block, in 1/(2^ADC_SAMPLER_BITS) counts.
+        Returns false, leaving the value unchanged, if no block has been
+        finished since the last was taken.
+    */
+    bool take_adc_sample(adc_sampler* a, uint16_t* value);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
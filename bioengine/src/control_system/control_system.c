@@ -1,7 +1,7 @@
 #include "control_system.h"
 
 void init_pin_modes(engine* e){
-    for(size_t i = 0; i < 4; i++){
+    for(uint8_t i = 0; i < CYLINDERS; i++){
         pinMode(e->coils[i].pin, OUTPUT);
         pinMode(e->injs[i].pin, OUTPUT);
     }
@@ -15,15 +15,13 @@ void init_pin_modes(engine* e){
 void init_engine(engine* e){
     if(!e) return;
 
-    e->coils[0] = COIL_1;
-    e->coils[1] = COIL_2;
-    e->coils[2] = COIL_3;
-    e->coils[3] = COIL_4;
+    const pin coils[CYLINDERS] = COIL_PINS;
+    const pin injs[CYLINDERS] = INJECTOR_PINS;
 
-    e->injs[0] = INJECTOR_1;
-    e->injs[1] = INJECTOR_2;
-    e->injs[2] = INJECTOR_3;
-    e->injs[3] = INJECTOR_4;
+    for(uint8_t i = 0; i < CYLINDERS; i++){
+        e->coils[i] = coils[i];
+        e->injs[i] = injs[i];
+    }
 
     e->thermistor = THERMISTOR;
 
@@ -34,127 +32,285 @@ void init_engine(engine* e){
 
     e->crank = 0;
 
+    e->period = 0;
     e->speed = 0;
+    e->bend = 0;
     e->rpm = 0;
 
-    e->temp = get_internal_temp(e);
+    e->ahead_change = 0;
+    e->ahead_bend = 0;
+    e->ahead_sequence = 0;
+    e->ahead_ready = false;
+
+    init_speed_tracker(&(e->tracker));
+
+    get_internal_temp(e);
 
     e->is_running = false;
 }
 
 void shutdown(engine* e){
-    for(size_t i = 0; i < 4; i++){
-        open_circuit(&(e->injs[i]));
-        open_circuit(&(e->coils[i]));
+    open_all_circuits(e);
+    e->is_running = false;
+}
+
+void open_all_circuits(engine* e){
+    port_batch b;
+    init_port_batch(&b);
+
+    for(uint8_t i = 0; i < CYLINDERS; i++){
+        batch_open(&b, &(e->injs[i]));
+        batch_open(&b, &(e->coils[i]));
     }
 
-    e->is_running = false;
+    commit_port_batch(&b);
 }
 
-char pin_state(pin* target){
+char pin_state(const pin* target){
     return (*(target->reg) >> target->num) & 1;
 }
 
-void open_circuit(pin* target){
+void open_circuit(const pin* target){
     *(target->reg) &= ~(1 << target->num);
 }
 
-void close_circuit(pin* target){
+void close_circuit(const pin* target){
     *(target->reg) |= 1 << target->num;
 }
 
+void init_port_batch(port_batch* b){
+    b->count = 0;
+}
+
+void batch_write(port_batch* b, volatile uint8_t* reg, uint8_t mask, bool close){
+    uint8_t i = 0;
+
+    while(i < b->count && b->reg[i] != reg) i++;
+
+    if(i == MAX_BATCH_PORTS){
+        // Make room by writing out what has been gathered so far
+        commit_port_batch(b);
+        i = 0;
+    }
+
+    if(i == b->count){
+        b->reg[i] = reg;
+        b->set[i] = 0;
+        b->clear[i] = 0;
+        b->count++;
+    }
+
+    if(close){
+        b->set[i] |= mask;
+        b->clear[i] &= ~mask;
+    } else {
+        b->clear[i] |= mask;
+        b->set[i] &= ~mask;
+    }
+}
+
+void batch_open(port_batch* b, const pin* target){
+    batch_write(b, target->reg, 1 << target->num, false);
+}
+
+void batch_close(port_batch* b, const pin* target){
+    batch_write(b, target->reg, 1 << target->num, true);
+}
+
+void commit_port_batch(port_batch* b){
+    // The compare interrupt writes the same ports, so each write must not be split by it
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        for(uint8_t i = 0; i < b->count; i++){
+            *(b->reg[i]) = (*(b->reg[i]) & ~(b->clear[i])) | b->set[i];
+        }
+    }
+
+    b->count = 0;
+}
+
 
 int get_internal_temp(engine* e){
-    float pin_voltage = (float) SUPPLY * analogRead(e->thermistor.pin) / ADC_MAX;
-    e->temp = (int) TEMPERATURE((float) pin_voltage);
+    set_internal_temp(e, thermistor_temperature(analogRead(e->thermistor.pin)));
     return e->temp;
 }
 
+void set_internal_temp(engine* e, int16_t fine_temp){
+    e->fine_temp = fine_temp;
+    e->temp = (fine_temp + (1 << (THERMISTOR_SCALE_BITS - 1))) >> THERMISTOR_SCALE_BITS;
+}
+
 void set_crank(engine* e, int angle){
     e->crank = angle % 720;
 }
 
+int get_crank(engine* e){
+    int crank;
+
+    // The crank is advanced by the IPG interrupt, and takes two reads on the board
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        crank = e->crank;
+    }
+
+    return crank;
+}
+
 void increment_crank(engine* e, int angle){
     e->crank = (e->crank + angle) % 720;
 }
 
+/*
+    With constant acceleration, a pulse of length T2 following one of
+    length T1 is covered as a fraction of the way through it, u, goes:
+
+        f(u) = u - k * u * (1 - u),  where k = (T1 - T2) * T2 / (T1 * (T1 + T2))
+
+    This returns k out of 65536, given both lengths in 1/256 tick. The
+    ratio is taken in whole ticks, and limited to a quarter either way,
+    an acceleration far beyond that of the engine.
+*/
+static int32_t segment_bend(uint32_t last, uint32_t next){
+    int32_t t1 = last >> 8;
+    int32_t t2 = next >> 8;
+    int32_t change = (int32_t) last - (int32_t) next;
+
+    int32_t ratio = (change << 8) / (t1 + t2);
+    if(ratio > 16384) ratio = 16384;
+    if(ratio < -16384) ratio = -16384;
+
+    return ratio * t2 / t1;
+}
+
 /*
     Method to update the shaft speed of the engine, given the time
-    between successive IPG pulses in microseconds. 
-    
-    This method currently only approximates across a single pulse. 
-    However there will be another implementation where the shaft 
-    speed is approximated over several pulses.
+    between successive IPG pulses in timer ticks, as captured. The interval is
+    added to the speed tracker, and the period to the next pulse is
+    predicted from the speed and acceleration it has fitted over 
+    the last few pulses. The reciprocal of the period is taken here,
+    once per pulse, so that estimating the angle between pulses 
+    needs only multiplications.
 */
-void update_velocity(engine* e, unsigned long pulse_width){
-    e->speed = (float) IPG_PULSE_ANGLE / pulse_width;
-    e->rpm = pow(10, 6) * e->speed * 60 / 360;
+void update_velocity(engine* e, uint32_t pulse_width){
+    if(pulse_width == 0) return;
+
+    speed_tracker* tr = &(e->tracker);
+    track_interval(tr, pulse_width);
+
+    // The predicted period is kept in 1/256 tick, so its reciprocal is taken in two steps
+    uint32_t next = tr->next;
+    uint32_t q = 0xFFFFFFFFUL / next;
+    uint32_t r = 0xFFFFFFFFUL % next;
+
+    e->period = next >> 8;
+    e->speed = (q << 8) + (r << 8) / next;
+    e->rpm = RPM_PERIOD_PRODUCT / e->period;
+
+    e->bend = segment_bend(tr->last, tr->next);
+}
+
+void publish_prediction(engine* e, uint8_t sequence){
+    const speed_tracker* tr = &(e->tracker);
+    if(tr->count == 0) return;
+
+    // The divisions are done before the interrupt is held off
+    int32_t change = ((int32_t) tr->ahead - (int32_t) tr->next) / 256;
+    int32_t bend = segment_bend(tr->next, tr->ahead);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        e->ahead_change = change;
+        e->ahead_bend = bend;
+        e->ahead_sequence = sequence;
+        e->ahead_ready = true;
+    }
+}
+
+bool take_prediction(engine* e, uint8_t sequence, uint32_t* period, int32_t* bend){
+    if(!e->ahead_ready || e->ahead_sequence != sequence) return false;
+
+    int32_t next = (int32_t) *period + e->ahead_change;
+
+    // As in the tracker, a segment less than half the last is not to be trusted
+    *period = next < (int32_t) (*period / 2) ? *period / 2 : (uint32_t) next;
+    *bend = e->ahead_bend;
+
+    return true;
 }
 
 /*
-    Method to estimate the crankshaft angle between pulses using 
-    linear interpolation of the last known angle, the shaft speed 
-    and the time since the last known angle.
+    Method to estimate the crankshaft angle between pulses from the
+    last known angle, the shaft speed and acceleration, and the time
+    since the last known angle.
 
-    Such that: theta(t) ~= theta_i + (w * (t - t_i))
+    Such that: theta(t) ~= theta_i + (w * (t - t_i)) + (a * (t - t_i)^2 / 2)
     
-    Where last_pulse is the time recorded of the last known angle in
-    microseconds.
+    Where elapsed is the time since the pulse of the last known angle
+    in timer ticks. The angle is returned in fixed point.
 
     Note that angle change cannot exceed IPG_PULSE_ANGLE, as a new 
     pulse will have been observed.
 */
-float estimate_angle(engine* e, unsigned long current_pulse){
+angle_t estimate_angle(engine* e, int crank, uint32_t elapsed){
     if(!e) return -1;
 
-    return e->crank + (e->speed * (micros() - current_pulse));
-    /*
-    return angle_change < IPG_PULSE_ANGLE
-        ? e->crank + angle_change
-        : e->crank + IPG_PULSE_ANGLE;
-    */
-}
+    // Limiting the time to one period also keeps the product within 32 bits
+    if(elapsed > e->period) elapsed = e->period;
 
-/*
-    Method to return the true crankshaft angle based on the number 
-    of IPG pulses between successive CPG pulses.
-    
-    The CPG sends three pulses per cycle:
-    - At the start of the cycle, when cylinder 1 is at TDC 
-      before the intake stroke.
-    - A reference pulse shortly after the start of the cycle.
-    - At the midpoint of the cycle, when cylinder 1 reaches
-      TDC before the power stroke.
-
-    If the number of pulses found does not match any of these, 
-    the function will return -1.
-*/
-int get_true_crank_angle(char pulses){
-    switch(pulses){
-        case START_OF_CYCLE_PULSES:
-            return 0;
-        case REFERENCE_PULSES:
-            return 60;
-        case MID_CYCLE_PULSES:
-            return 360;
-        default:
-            return -1;
-    }
+    // Fraction of the time to the next pulse, out of 65536
+    int32_t u = (elapsed * e->speed) >> 16;
+
+    // Fraction of the angle to the next pulse, allowing for the acceleration
+    int32_t bow = (int32_t) (((uint32_t) u * (65536 - u)) >> 16);
+    int32_t fraction = u - ((e->bend * bow) >> 16);
+
+    if(fraction < 0) fraction = 0;
+    if(fraction > 0xFFFF) fraction = 0xFFFF;
+
+    return ((angle_t) crank << 16) + (angle_t) (fraction * IPG_PULSE_ANGLE);
 }
 
-bool within_interval(float angle, float bounds[2]){
+bool within_interval(angle_t angle, const angle_t bounds[2]){
     return angle < bounds[1] && angle > bounds[0];
 }
 
-bool should_open_circuit(float angle, float bounds[2], pin* p){
+bool should_open_circuit(angle_t angle, const angle_t bounds[2], const pin* p){
     return pin_state(p) && !within_interval(angle, bounds);
 }
 
-bool should_close_circuit(float angle, float bounds[2], pin* p){
+bool should_close_circuit(angle_t angle, const angle_t bounds[2], const pin* p){
     return !pin_state(p) && within_interval(angle, bounds);
 }
 
+bool put_engine_info(formatter* f, engine* e, uint8_t line){
+    switch(line){
+        case 0:
+            put_P(f, PSTR("engine status:"));
+            return true;
+        case 1:
+            put_P(f, PSTR("    crank angle: "));
+            put_int(f, get_crank(e));
+            put_P(f, PSTR(" deg"));
+            return true;
+        case 2:
+            put_P(f, PSTR("    speed: "));
+            put_int(f, e->rpm);
+            put_P(f, PSTR(" RPM"));
+            return true;
+        case 3:
+            put_P(f, PSTR("    temp: "));
+            put_int(f, e->temp);
+            put_P(f, PSTR(" deg C"));
+            return true;
+        case 4:
+            put_P(f, PSTR("    is running: "));
+            put_bool(f, e->is_running);
+            return true;
+    }
+
+    return false;
+}
+
 void get_engine_info(engine* e, char message[150]){
-    sprintf(message, "engine status:\n    crank angle: %i deg\n    speed: %i RPM\n    temp: %i deg C\n    is running: %s\n", 
-        e->crank, e->rpm, e->temp, e->is_running ? "true" : "false");
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    for(uint8_t line = 0; put_engine_info(&f, e, line); line++) put_char(&f, '\n');
 }
\ No newline at end of file
@@ -3,93 +3,62 @@
 
     #include <Arduino.h>
     #include <stdio.h>
-
-    /*
-        Macros defining the pins on the Arduino each 
-        sensor/actuator corresponds to.
-    */
-
-   #define PROGRAM_TEST
-
+    #include <util/atomic.h>
+    #include <avr/pgmspace.h>
+
+    // Library containing the multi-pulse shaft speed tracker
+    #include "../speed_tracker/speed_tracker.h"
+    // Library containing the thermistor conversion table
+    #include "../thermistor/thermistor.h"
+    // Library containing the text formatter
+    #include "../formatter/formatter.h"
+    // Library containing the Timer1 time base, in whose ticks pulses are timed
+    #include "../timer/timer.h"
+
+   /*
+       Each pin is described by the register it is read or written 
+       through, its bit in that register and its Arduino pin number. The
+       name is kept in flash, so it must be read with pgm_read_byte() or
+       strcpy_P() rather than directly.
+   */
    typedef struct pin {
-       char name[15];
-       char* reg;
-       char num;
-       int pin;
+       const char* name;
+       volatile uint8_t* reg;
+       uint8_t num;
+       uint8_t pin;
    } pin;
 
-    #ifdef PROGRAM_TEST
-        /* Sensor pins: Read-only therefore PIN register */
-        #define CRANKSHAFT ((pin) {"CRANKSHAFT", &PIND, 2, 2})     // Pin A0 (PF7)
-        #define CAMSHAFT   ((pin) {"CAMSHAFT", &PIND, 3, 3})       // Pin A1 (PF6)
-
-        #define THERMISTOR ((pin) {"THERMISTOR", &PINC, 5, A5})     // Pin A5 (PF0)
+    // Library containing the pins, cylinders and trigger wheels of the engine
+    #include "../engine_layout/engine_layout.h"
 
-        /* Actuator pins: Write-only therefore PORT register */
-
-        #define INJECTOR_1 ((pin) {"INJECTOR 1", &PORTB, 2, 10})    // Pin D5 (PC6)
-        #define INJECTOR_2 ((pin) {"INJECTOR 2", &PORTB, 3, 11})    // Pin D6 (PD7)
-        #define INJECTOR_3 ((pin) {"INJECTOR 3", &PORTB, 4, 12})    // Pin D7 (PE6)
-        #define INJECTOR_4 ((pin) {"INJECTOR 4", &PORTB, 5, 13})    // Pin D8 (PB4)
-
-        #define COIL_1 ((pin) {"COIL 1", &PORTB, 2, 10})            // Pin D12 (PD6)
-        #define COIL_2 ((pin) {"COIL 2", &PORTB, 3, 11})            // Pin D11 (PB7)
-        #define COIL_3 ((pin) {"COIL 3", &PORTB, 4, 12})            // Pin D10 (PB6)
-        #define COIL_4 ((pin) {"COIL 4", &PORTB, 5, 13})            // Pin D9 (PB5)
-    #else
-        /* Sensor pins: Read-only therefore PIN register */
-        #define CRANKSHAFT ((pin) {"CRANKSHAFT", &PINF, 7, A0})     // Pin A0 (PF7)
-        #define CAMSHAFT   ((pin) {"CAMSHAFT", &PINF, 6, A1})       // Pin A1 (PF6)
+    /*
+        Crank angles are held in fixed point, as Q16.16 degrees: the top 
+        16 bits are whole degrees and the bottom 16 bits the fraction of 
+        a degree. This keeps the angle arithmetic of the loop and the 
+        interrupts in integers, as the board has no floating point unit.
+    */
+    typedef int32_t angle_t;
 
-        #define THERMISTOR ((pin) {"THERMISTOR", &PINF, 0, A5})     // Pin A5 (PF0)
+    #define ANGLE_ONE               65536L
 
-        /* Actuator pins: Write-only therefore PORT register */
+    // Converts a constant or float angle in degrees to fixed point
+    #define ANGLE(D)                ((angle_t) ((D) * ANGLE_ONE))
+    // Whole degrees of a fixed point angle, rounded down
+    #define ANGLE_DEGREES(A)        ((int) ((A) >> 16))
+    // Converts a fixed point angle to degrees, e.g. for printing
+    #define ANGLE_TO_FLOAT(A)       ((float) (A) / ANGLE_ONE)
 
-        #define INJECTOR_1 ((pin) {"INJECTOR 1", &PORTC, 6, 5})     // Pin D5 (PC6)
-        #define INJECTOR_2 ((pin) {"INJECTOR 2", &PORTD, 7, 6})     // Pin D6 (PD7)
-        #define INJECTOR_3 ((pin) {"INJECTOR 3", &PORTE, 6, 7})     // Pin D7 (PE6)
-        #define INJECTOR_4 ((pin) {"INJECTOR 4", &PORTB, 4, 8})     // Pin D8 (PB4)
+    #define FULL_CYCLE              ANGLE(720)
 
-        #define COIL_1 ((pin) {"COIL 1", &PORTD, 6, 12})            // Pin D12 (PD6)
-        #define COIL_2 ((pin) {"COIL 2", &PORTB, 7, 11})            // Pin D11 (PB7)
-        #define COIL_3 ((pin) {"COIL 3", &PORTB, 6, 10})            // Pin D10 (PB6)
-        #define COIL_4 ((pin) {"COIL 4", &PORTB, 5, 9})             // Pin D9 (PB5)
-    #endif
+    // Timer ticks per minute over IPG pulses per revolution: RPM = RPM_PERIOD_PRODUCT / period
+    #define RPM_PERIOD_PRODUCT      (60000000UL * TICKS_PER_US / (360 / IPG_PULSE_ANGLE))
 
-    // The change in crankshaft angle between IPG pulses
-    #define IPG_PULSE_ANGLE         30
-
-    /*
-        The number of IPG pulses between the last and current 
-        CPG pulses, based on the camshaft angle.
-    */
-
-    #define START_OF_CYCLE_PULSES   12
-    #define REFERENCE_PULSES        2
-    #define MID_CYCLE_PULSES        10
+    // Most ports the coils and injectors a batch changes can be spread across
+    #define MAX_BATCH_PORTS         4
 
     #define SUPPLY                  5
     #define ADC_MAX                 1024
 
-    /*
-    Internal temperature given by analog-in voltage, based off thermistor datasheet.
-    By polynomial approximation, the temperature is equal to:
-
-        T(v) = 0.3721v^6 - 4.2202v^5 
-             + 15.53v^4 - 13.148v^3 
-             - 36.986v^2 + 91.9v 
-             - 54.71
-    */
-    #define TEMPERATURE(V) \
-        + (0.4393133 * pow(V, 7)) \
-        - (7.3529790 * pow(V, 6)) \
-        + (49.330662 * pow(V, 5)) \
-        - (169.47025 * pow(V, 4)) \
-        + (317.72894 * pow(V, 3)) \
-        - (324.00960 * pow(V, 2)) \
-        + (190.78360 * V) \
-        -  62.689252
-
     #ifdef __cplusplus
     extern "C" {
     #endif
@@ -100,7 +69,9 @@
 
         - The crank angle in degrees.
         - The last state of the CPG and IPG signals.
-        - The shaft speed of the engine.
+        - The shaft speed of the engine, as the time between IPG pulses
+          in timer ticks and its reciprocal, tracked over several pulses along with its
+          acceleration.
         - The internal temperature of the control system.
         - An array of pointers to the pins controlling each coil and injector.
         - A flag determine whether all engine data is valid, allowing the 
@@ -110,74 +81,144 @@
         volatile int crank;
         int temp, rpm;
 
-        float speed;
+        // The internal temperature in 1/16 deg C, of which temp is the nearest degree
+        int16_t fine_temp;
+
+        // Predicted time between the last IPG pulse and the next in timer ticks
+        uint32_t period;
+        // Reciprocal of the period, (2^32 - 1) / period, so that a time 
+        // multiplied by it gives the fraction of a pulse it spans
+        uint32_t speed;
+        // How far the angle falls behind a constant speed midway between
+        // pulses due to acceleration, as a fraction of a pulse out of 65536
+        int32_t bend;
+
+        // The change in period and the bend predicted for the segment begun by
+        // the IPG pulse of sequence number ahead_sequence, handed to the 
+        // interrupt by the loop, and whether any have been
+        int32_t ahead_change;
+        int32_t ahead_bend;
+        uint8_t ahead_sequence;
+        bool ahead_ready;
+
+        speed_tracker tracker;
 
         bool is_running;
 
-        pin coils[4], injs[4];
+        pin coils[CYLINDERS], injs[CYLINDERS];
         pin thermistor, cpg, ipg;
     } engine;
 
+    /*
+        Changes to the coils and injectors, gathered into the bits to 
+        set and to clear on each port so that every port is written once
+        when they are committed, rather than once for each circuit. A 
+        later change to a bit overrides an earlier one, as it would have
+        if each had been written in turn.
+    */
+    typedef struct port_batch {
+        volatile uint8_t* reg[MAX_BATCH_PORTS];
+        uint8_t set[MAX_BATCH_PORTS], clear[MAX_BATCH_PORTS];
+        uint8_t count;
+    } port_batch;
+
     /* Function prototypes, some of which are yet to be defined */
 
     void init_engine(engine* e);
 
     void shutdown(engine* e);
 
-    char pin_state(pin *target);
+    /* Method to open every coil and injector together, leaving the engine running. */
+    void open_all_circuits(engine* e);
+
+    char pin_state(const pin* target);
+
+    void open_circuit(const pin* target);
+    void close_circuit(const pin* target);
+
+    void init_port_batch(port_batch* b);
+
+    /* Method to add a change to the bits of mask on a port to a batch. */
+    void batch_write(port_batch* b, volatile uint8_t* reg, uint8_t mask, bool close);
 
-    void open_circuit(pin* target);
-    void close_circuit(pin* target);
+    void batch_open(port_batch* b, const pin* target);
+    void batch_close(port_batch* b, const pin* target);
 
+    /*
+        Method to write the changes of a batch with one atomic write per
+        port, and empty it.
+    */
+    void commit_port_batch(port_batch* b);
+
+    /* Method to read the internal temperature with a single conversion, which waits on the ADC. */
     int get_internal_temp(engine* e);
 
+    /* Method to set the internal temperature, in 1/16 deg C. */
+    void set_internal_temp(engine* e, int16_t fine_temp);
+
     void set_crank(engine* e, int angle);
+
+    /* Method for the loop to read the crank angle, which the IPG interrupt may be writing. */
+    int get_crank(engine* e);
     void increment_crank(engine* e, int angle);
 
     /*
         Method to update the shaft speed of the engine, given the time
-        between successive IPG pulses in microseconds. 
-        
-        This method currently only approximates across a single pulse. 
-        However there will be another implementation where the shaft 
-        speed is approximated over several pulses.
+        between successive IPG pulses in timer ticks, as captured. The interval is
+        added to the speed tracker, and the period to the next pulse is
+        predicted from the speed and acceleration it has fitted over 
+        the last few pulses. The reciprocal of the period is taken here,
+        once per pulse, so that estimating the angle between pulses 
+        needs only multiplications.
     */
-    void update_velocity(engine* e, unsigned long pulse_width);
+    void update_velocity(engine* e, uint32_t pulse_width);
 
     /*
-        Method to estimate the crankshaft angle between pulses using 
-        linear interpolation of the last known angle, the shaft speed 
-        and the time since the last known angle.
+        Method for the loop to hand the IPG interrupt the change in period
+        and the bend of the segment after the next pulse, as the tracker 
+        predicts them once update_velocity has been given the interval up
+        to the last. The next pulse is the one of the given sequence 
+        number, which begins that segment.
+    */
+    void publish_prediction(engine* e, uint8_t sequence);
+
+    /*
+        Method for the IPG interrupt to predict the period and bend of the
+        segment its pulse begins, given the length of the segment it ends
+        in period. The change the tracker fitted is added to that length,
+        rather than the fitted period taken as it is, as the fit lags 
+        several pulses behind a change in acceleration. Returns false, 
+        leaving both as they are, if the loop has not yet published the
+        prediction for that pulse.
+    */
+    bool take_prediction(engine* e, uint8_t sequence, uint32_t* period, int32_t* bend);
+
+    /*
+        Method to estimate the crankshaft angle between pulses from the
+        last known angle, the shaft speed and acceleration, and the time
+        since the last known angle.
 
-        Such that: theta(t) ~ theta_i + (w * (t - t_i))
+        Such that: theta(t) ~ theta_i + (w * (t - t_i)) + (a * (t - t_i)^2 / 2)
         
-        Where last_pulse is the time recorded of the last known angle in
-        microseconds.
+        Where crank is the last known angle in degrees and elapsed the
+        time since the pulse it was recorded at, in timer ticks. The 
+        angle is returned in fixed point.
 
         Note that angle change cannot exceed IPG_PULSE_ANGLE, as a new 
         pulse will have been observed.
     */
-    float estimate_angle(engine* e, unsigned long last_pulse);
+    angle_t estimate_angle(engine* e, int crank, uint32_t elapsed);
 
-    /*
-        Method to return the true crankshaft angle based on the number 
-        of IPG pulses between successive CPG pulses.
-        
-        The CPG sends three pulses per cycle:
-        - At the start of the cycle, when cylinder 1 is at TDC 
-        before the intake stroke.
-        - A reference pulse shortly after the start of the cycle.
-        - At the midpoint of the cycle, when cylinder 1 reaches
-        TDC before the power stroke.
-
-        If the number of pulses found does not match any of these, 
-        the function will return -1.
-    */
-    int get_true_crank_angle(char pulses);
+    bool should_open_circuit(angle_t angle, const angle_t bounds[2], const pin* p);
 
-    bool should_open_circuit(float angle, float bounds[2], pin* p);
+    bool should_close_circuit(angle_t angle, const angle_t bounds[2], const pin* p);
 
-    bool should_close_circuit(float angle, float bounds[2], pin* p);
+    /*
+        Method to append one line of the engine status, without its
+        ending, so that the status can be sent a line at a time. Returns
+        false, appending nothing, past the last line.
+    */
+    bool put_engine_info(formatter* f, engine* e, uint8_t line);
 
     void get_engine_info(engine* e, char message[150]);
 
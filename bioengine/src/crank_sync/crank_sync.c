@@ -0,0 +1,105 @@
+#include "crank_sync.h"
+
+typedef struct cpg_pulse {
+    uint8_t pulses;
+    int16_t angle;
+} cpg_pulse;
+
+// The CPG pulses of a cycle in order, by the IPG pulses since the one before
+static const cpg_pulse pattern[CPG_PULSES] PROGMEM = {
+    {START_OF_CYCLE_PULSES, 0},
+    {REFERENCE_PULSES, 60},
+    {MID_CYCLE_PULSES, 360},
+};
+
+static const char state_none[] PROGMEM = "none";
+static const char state_pending[] PROGMEM = "pending";
+static const char state_locked[] PROGMEM = "locked";
+
+static PGM_P const state_names[] PROGMEM = {state_none, state_pending, state_locked};
+
+static uint8_t pattern_pulses(uint8_t k){
+    return pgm_read_byte(&(pattern[k].pulses));
+}
+
+static int pattern_angle(uint8_t k){
+    return (int16_t) pgm_read_word(&(pattern[k].angle));
+}
+
+void init_crank_sync(crank_sync* c){
+    c->state = SYNC_NONE;
+    c->position = 0;
+    c->unlocked = 0;
+
+    c->corrections = 0;
+    c->losses = 0;
+}
+
+/* Places a pulse by its count alone, or loses sync if no entry has it */
+static int place(crank_sync* c, uint8_t pulses){
+    if(c->state == SYNC_LOCKED) c->losses++;
+
+    if(c->unlocked < UINT8_MAX) c->unlocked++;
+
+    for(uint8_t k = 0; k < CPG_PULSES; k++){
+        if(pattern_pulses(k) == pulses){
+            c->state = SYNC_PENDING;
+            c->position = k;
+            return pattern_angle(k);
+        }
+    }
+
+    c->state = SYNC_NONE;
+    return -1;
+}
+
+int sync_cpg_pulse(crank_sync* c, uint8_t pulses, uint8_t tolerance){
+    if(c->state == SYNC_NONE) return place(c, pulses);
+
+    uint8_t next = c->position + 1 == CPG_PULSES ? 0 : c->position + 1;
+    uint8_t expected = pattern_pulses(next);
+    uint8_t error = pulses > expected ? pulses - expected : expected - pulses;
+
+    if(error == 0 || (c->state == SYNC_LOCKED && error <= tolerance)){
+        if(error) c->corrections++;
+
+        c->state = SYNC_LOCKED;
+        c->position = next;
+        c->unlocked = 0;
+
+        return pattern_angle(next);
+    }
+
+    return place(c, pulses);
+}
+
+bool crank_synced(const crank_sync* c){
+    return c->state == SYNC_LOCKED;
+}
+
+bool put_sync_info(formatter* f, crank_sync* c, uint8_t line){
+    switch(line){
+        case 0:
+            put_P(f, PSTR("crank sync:"));
+            return true;
+        case 1:
+            put_P(f, PSTR("    state: "));
+            put_P(f, (PGM_P) pgm_read_ptr(&(state_names[c->state])));
+            return true;
+        case 2:
+            put_P(f, PSTR("    corrected: "));
+            put_uint(f, c->corrections);
+            put_P(f, PSTR(", lost: "));
+            put_uint(f, c->losses);
+            return true;
+    }
+
+    return false;
+}
+
+void get_sync_info(crank_sync* c, char message[150]){
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    for(uint8_t line = 0; put_sync_info(&f, c, line); line++) put_char(&f, '\n');
+}
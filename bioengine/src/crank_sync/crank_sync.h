@@ -0,0 +1,89 @@
+#ifndef CRANK_SYNC_H
+    #define CRANK_SYNC_H
+
+    #include <Arduino.h>
+    #include <stdio.h>
+    #include <avr/pgmspace.h>
+
+    // Library containing the pins, cylinders and trigger wheels of the engine
+    #include "../engine_layout/engine_layout.h"
+    // Library containing the text formatter
+    #include "../formatter/formatter.h"
+
+    /*
+        State machine placing the crank angle from the CPG pulses.
+
+        The CPG sends three pulses per cycle, each told apart by the
+        number of IPG pulses since the last:
+
+        - At the start of the cycle, when cylinder 1 is at TDC before
+          the intake stroke, after START_OF_CYCLE_PULSES.
+        - A reference pulse shortly after the start of the cycle, after
+          REFERENCE_PULSES.
+        - At the midpoint of the cycle, when cylinder 1 reaches TDC
+          before the power stroke, after MID_CYCLE_PULSES.
+
+        The machine walks a table of these pulses in order:
+
+        - Without sync, a count that matches one entry of the table
+          places the pulse there, pending.
+        - Pending, the next pulse must have the count of the entry after
+          it, which locks sync. Otherwise the pulse is placed afresh.
+        - Locked, the next pulse is taken as the entry after the last
+          even if its count is out by up to a tolerance of missing or
+          extra teeth, and the crank angle is corrected to it. A count
+          out by more is placed afresh, and sync is lost.
+
+        A clean pulse pattern is placed by its first pulse and locked by
+        its second, so sync is regained within one engine cycle of a
+        fault. The crank angle is only known from the CPG while locked,
+        so nothing should be actuated otherwise.
+    */
+
+    #define SYNC_NONE           0
+    #define SYNC_PENDING        1
+    #define SYNC_LOCKED         2
+
+    // CPG pulses per engine cycle
+    #define CPG_PULSES          3
+
+    // Teeth a count may be out by while locked, by default, and at most
+    #define SYNC_TOLERANCE      1
+    #define MAX_SYNC_TOLERANCE  3
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct crank_sync {
+        uint8_t state;
+        // The entry of the table the last pulse was placed at
+        uint8_t position;
+        // CPG pulses since sync was last locked, which is 0 while it is
+        uint8_t unlocked;
+
+        // Counts taken within the tolerance, and times sync was lost
+        uint16_t corrections, losses;
+    } crank_sync;
+
+    void init_crank_sync(crank_sync* c);
+
+    /*
+        Method to take a CPG pulse, given the IPG pulses counted since the
+        last one and the teeth a count may be out by. Returns the crank
+        angle in degrees the pulse is at, or -1 if it cannot be placed.
+    */
+    int sync_cpg_pulse(crank_sync* c, uint8_t pulses, uint8_t tolerance);
+
+    bool crank_synced(const crank_sync* c);
+
+    /* As put_engine_info, for the sync and its counters. */
+    bool put_sync_info(formatter* f, crank_sync* c, uint8_t line);
+
+    void get_sync_info(crank_sync* c, char message[150]);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef ENGINE_LAYOUT_H
+    #define ENGINE_LAYOUT_H
+
+    /*
+        The layout of the engine, fixed at compile time: the pins on the
+        Arduino each sensor/actuator corresponds to, the cylinders and
+        the angles they fire at, and the teeth of the crank and cam
+        wheels. Everything that depends on the engine is sized from the
+        constants here, so a layout costs nothing at run time and the
+        loops over the cylinders run a constant number of times.
+
+        ENGINE_LAYOUT selects the cylinders, and may be given as a build
+        flag instead of here, e.g. -DENGINE_LAYOUT=LAYOUT_TWIN. Every
+        layout uses the first cylinders of the pin set, and the same 
+        trigger wheels.
+    */
+
+    #define LAYOUT_INLINE_FOUR      1
+    #define LAYOUT_TWIN             2
+    #define LAYOUT_SINGLE           3
+
+    #ifndef ENGINE_LAYOUT
+        #define ENGINE_LAYOUT       LAYOUT_INLINE_FOUR
+    #endif
+
+    /*
+        Macros defining the pins on the Arduino each 
+        sensor/actuator corresponds to.
+
+        Each sensor is given by the letter of its port and its bit, from
+        which its pin is made, so that the preprocessor can check where
+        it lies (see the end of this file).
+    */
+
+    // The input register of a port given by its letter, e.g. PIND for D
+    #define INPUT_REGISTER(P)       INPUT_REGISTER_(P)
+    #define INPUT_REGISTER_(P)      PIN##P
+
+    #define SENSOR_PIN(NAME, P, BIT, NUM) ((pin) {PSTR(NAME), &INPUT_REGISTER(P), BIT, NUM})
+
+    #define PROGRAM_TEST
+
+    #ifdef PROGRAM_TEST
+        /* Sensor pins: Read-only therefore PIN register */
+        #define CRANKSHAFT_PORT     D
+        #define CRANKSHAFT_BIT      4
+        #define CAMSHAFT_PORT       F
+        #define CAMSHAFT_BIT        6
+        #define THERMISTOR_PORT     C
+        #define THERMISTOR_BIT      5
+
+        #define CRANKSHAFT SENSOR_PIN("CRANKSHAFT", CRANKSHAFT_PORT, CRANKSHAFT_BIT, 4)   // Pin D4 (PD4, ICP1)
+        #define CAMSHAFT   SENSOR_PIN("CAMSHAFT", CAMSHAFT_PORT, CAMSHAFT_BIT, A1)        // Pin A1 (PF6)
+
+        #define THERMISTOR SENSOR_PIN("THERMISTOR", THERMISTOR_PORT, THERMISTOR_BIT, A5)  // Pin A5 (PF0)
+        #define THERMISTOR_CHANNEL 0                                                    // ADC0, sampled freely by the ADC
+
+        /* Actuator pins: Write-only therefore PORT register */
+
+        #define INJECTOR_1 ((pin) {PSTR("INJECTOR 1"), &PORTB, 2, 10})  // Pin D5 (PC6)
+        #define INJECTOR_2 ((pin) {PSTR("INJECTOR 2"), &PORTB, 3, 11})  // Pin D6 (PD7)
+        #define INJECTOR_3 ((pin) {PSTR("INJECTOR 3"), &PORTB, 4, 12})  // Pin D7 (PE6)
+        #define INJECTOR_4 ((pin) {PSTR("INJECTOR 4"), &PORTB, 5, 13})  // Pin D8 (PB4)
+
+        #define COIL_1 ((pin) {PSTR("COIL 1"), &PORTB, 2, 10})          // Pin D12 (PD6)
+        #define COIL_2 ((pin) {PSTR("COIL 2"), &PORTB, 3, 11})          // Pin D11 (PB7)
+        #define COIL_3 ((pin) {PSTR("COIL 3"), &PORTB, 4, 12})          // Pin D10 (PB6)
+        #define COIL_4 ((pin) {PSTR("COIL 4"), &PORTB, 5, 13})          // Pin D9 (PB5)
+    #else
+        /* Sensor pins: Read-only therefore PIN register */
+        #define CRANKSHAFT_PORT     D
+        #define CRANKSHAFT_BIT      4
+        #define CAMSHAFT_PORT       F
+        #define CAMSHAFT_BIT        6
+        #define THERMISTOR_PORT     F
+        #define THERMISTOR_BIT      0
+
+        #define CRANKSHAFT SENSOR_PIN("CRANKSHAFT", CRANKSHAFT_PORT, CRANKSHAFT_BIT, 4)   // Pin D4 (PD4, ICP1)
+        #define CAMSHAFT   SENSOR_PIN("CAMSHAFT", CAMSHAFT_PORT, CAMSHAFT_BIT, A1)        // Pin A1 (PF6)
+
+        #define THERMISTOR SENSOR_PIN("THERMISTOR", THERMISTOR_PORT, THERMISTOR_BIT, A5)  // Pin A5 (PF0)
+        #define THERMISTOR_CHANNEL 0                                                    // ADC0, sampled freely by the ADC
+
+        /* Actuator pins: Write-only therefore PORT register */
+
+        #define INJECTOR_1 ((pin) {PSTR("INJECTOR 1"), &PORTC, 6, 5})   // Pin D5 (PC6)
+        #define INJECTOR_2 ((pin) {PSTR("INJECTOR 2"), &PORTD, 7, 6})   // Pin D6 (PD7)
+        #define INJECTOR_3 ((pin) {PSTR("INJECTOR 3"), &PORTE, 6, 7})   // Pin D7 (PE6)
+        #define INJECTOR_4 ((pin) {PSTR("INJECTOR 4"), &PORTB, 4, 8})   // Pin D8 (PB4)
+
+        #define COIL_1 ((pin) {PSTR("COIL 1"), &PORTD, 6, 12})          // Pin D12 (PD6)
+        #define COIL_2 ((pin) {PSTR("COIL 2"), &PORTB, 7, 11})          // Pin D11 (PB7)
+        #define COIL_3 ((pin) {PSTR("COIL 3"), &PORTB, 6, 10})          // Pin D10 (PB6)
+        #define COIL_4 ((pin) {PSTR("COIL 4"), &PORTB, 5, 9})           // Pin D9 (PB5)
+    #endif
+
+
+    /*
+        The number of cylinders, and the crank angle of TDC before the
+        power stroke of each after cylinder 1.
+    */
+    #if ENGINE_LAYOUT == LAYOUT_INLINE_FOUR
+        #define CYLINDERS           4
+        // The firing order of the engine cylinders (1-4-2-3)
+        #define CYLINDER_PHASES     {0, 180, 270, 90}
+
+        #define COIL_PINS           {COIL_1, COIL_2, COIL_3, COIL_4}
+        #define INJECTOR_PINS       {INJECTOR_1, INJECTOR_2, INJECTOR_3, INJECTOR_4}
+    #elif ENGINE_LAYOUT == LAYOUT_TWIN
+        // A parallel twin, firing once a revolution
+        #define CYLINDERS           2
+        #define CYLINDER_PHASES     {0, 360}
+
+        #define COIL_PINS           {COIL_1, COIL_2}
+        #define INJECTOR_PINS       {INJECTOR_1, INJECTOR_2}
+    #elif ENGINE_LAYOUT == LAYOUT_SINGLE
+        #define CYLINDERS           1
+        #define CYLINDER_PHASES     {0}
+
+        #define COIL_PINS           {COIL_1}
+        #define INJECTOR_PINS       {INJECTOR_1}
+    #else
+        #error "ENGINE_LAYOUT is not a known layout"
+    #endif
+
+    // The change in crankshaft angle between IPG pulses
+    #define IPG_PULSE_ANGLE         30
+
+    /*
+        The number of IPG pulses between the last and current 
+        CPG pulses, based on the camshaft angle.
+    */
+
+    #define START_OF_CYCLE_PULSES   12
+    #define REFERENCE_PULSES        2
+    #define MID_CYCLE_PULSES        10
+
+    /*
+        The console is the serial port on USART1 (serial_port), whose 
+        RXD1 and TXD1 are PD2 and PD3, pins 0 and 1. A sensor on either
+        would read the serial line rather than the engine.
+    */
+    #define PORT_NUMBER(P)          PORT_NUMBER_(P)
+    #define PORT_NUMBER_(P)         PORT_NUMBER_##P
+    #define PORT_NUMBER_B           1
+    #define PORT_NUMBER_C           2
+    #define PORT_NUMBER_D           3
+    #define PORT_NUMBER_E           4
+    #define PORT_NUMBER_F           5
+
+    #define ON_USART1(P, BIT)       (PORT_NUMBER(P) == PORT_NUMBER_D && ((BIT) == 2 || (BIT) == 3))
+
+    #if ON_USART1(CRANKSHAFT_PORT, CRANKSHAFT_BIT) || ON_USART1(CAMSHAFT_PORT, CAMSHAFT_BIT) \
+        || ON_USART1(THERMISTOR_PORT, THERMISTOR_BIT)
+        #error "A sensor pin is on PD2/PD3, the RXD1/TXD1 of the serial port"
+    #endif
+
+#endif
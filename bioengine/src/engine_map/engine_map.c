@@ -1,71 +1,397 @@
 #include "engine_map.h"
 
+const int cylinder_phases[CYLINDERS] = CYLINDER_PHASES;
+
+const int16_t map_speeds[MAP_SPEEDS] PROGMEM = {1000, 2000, 3000, 4000, 5000, 6000, 6250};
+
+const uint32_t map_speed_spans[MAP_SPEEDS - 1] PROGMEM = {
+    MAP_SPAN(1000, 2000), MAP_SPAN(2000, 3000), MAP_SPAN(3000, 4000),
+    MAP_SPAN(4000, 5000), MAP_SPAN(5000, 6000), MAP_SPAN(6000, 6250)
+};
+
+const int16_t map_temps[MAP_TEMPS] PROGMEM = {0, 25, 50, 80};
+
+const uint32_t map_temp_spans[MAP_TEMPS - 1] PROGMEM = {
+    MAP_SPAN(0, 25), MAP_SPAN(25, 50), MAP_SPAN(50, 80)
+};
+
+/*
+    The engine has only been mapped against speed so far, so every 
+    temperature repeats the same calibration until it is mapped hot 
+    and cold.
+*/
+#define SPARK_ROW { \
+    MAP_ANGLE( 7.50), MAP_ANGLE(15.00), MAP_ANGLE(20.00), MAP_ANGLE(23.13), \
+    MAP_ANGLE(26.25), MAP_ANGLE(29.38), MAP_ANGLE(32.50) \
+}
+
+#define FUEL_ROW { \
+    MAP_ANGLE( 4.15), MAP_ANGLE( 9.57), MAP_ANGLE(23.45), MAP_ANGLE(38.46), \
+    MAP_ANGLE(44.64), MAP_ANGLE(51.24), MAP_ANGLE(57.90) \
+}
+
+const int16_t spark_map[MAP_TEMPS][MAP_SPEEDS] PROGMEM = {SPARK_ROW, SPARK_ROW, SPARK_ROW, SPARK_ROW};
+const int16_t fuel_map[MAP_TEMPS][MAP_SPEEDS] PROGMEM = {FUEL_ROW, FUEL_ROW, FUEL_ROW, FUEL_ROW};
+
+// The defaults are in force until the map is loaded
+operating_map live_map = {
+    {SPARK_ROW, SPARK_ROW, SPARK_ROW, SPARK_ROW},
+    {FUEL_ROW, FUEL_ROW, FUEL_ROW, FUEL_ROW},
+    false, false, 0, 0
+};
+
+// The bytes of the map in the EEPROM: its version and dimensions, then the spark and fuel cells, then the CRC
+#define MAP_HEADER_SIZE 3
+#define MAP_CELLS_SIZE (2 * sizeof(live_map.spark))
+#define MAP_IMAGE_SIZE (MAP_HEADER_SIZE + MAP_CELLS_SIZE)
+
+/* Returns byte k of the map as it is held in the EEPROM, short of the CRC */
+static uint8_t map_image_byte(const operating_map* m, uint8_t k){
+    switch(k){
+        case 0: return MAP_VERSION;
+        case 1: return MAP_SPEEDS;
+        case 2: return MAP_TEMPS;
+    }
+
+    k -= MAP_HEADER_SIZE;
+
+    if(k < sizeof(m->spark)) return ((const uint8_t*) m->spark)[k];
+    return ((const uint8_t*) m->fuel)[k - sizeof(m->spark)];
+}
+
+bool load_operating_map(operating_map* m){
+    const uint8_t* address = (const uint8_t*) MAP_EEPROM_ADDRESS;
+    uint16_t crc = 0xFFFF;
+    bool whole = true;
+
+    // The cells are read straight into the map, and the defaults copied over them if the CRC does not match
+    for(uint8_t k = 0; k < MAP_IMAGE_SIZE; k++){
+        uint8_t b = eeprom_read_byte(address + k);
+        crc = _crc_ccitt_update(crc, b);
+
+        if(k < MAP_HEADER_SIZE){
+            if(b != map_image_byte(m, k)) whole = false;
+        } else if(k < MAP_HEADER_SIZE + sizeof(m->spark)){
+            ((uint8_t*) m->spark)[k - MAP_HEADER_SIZE] = b;
+        } else {
+            ((uint8_t*) m->fuel)[k - MAP_HEADER_SIZE - sizeof(m->spark)] = b;
+        }
+    }
+
+    crc = _crc_ccitt_update(crc, eeprom_read_byte(address + MAP_IMAGE_SIZE));
+    crc = _crc_ccitt_update(crc, eeprom_read_byte(address + MAP_IMAGE_SIZE + 1));
+
+    // The CRC taken over a message and its own CRC, least significant byte first, is 0
+    m->from_eeprom = whole && crc == 0;
+
+    if(!m->from_eeprom){
+        memcpy_P(m->spark, spark_map, sizeof(m->spark));
+        memcpy_P(m->fuel, fuel_map, sizeof(m->fuel));
+    }
+
+    m->unsaved = false;
+
+    return m->from_eeprom;
+}
+
+/* Returns the index of a breakpoint equal to x, or n if there is none */
+static uint8_t find_breakpoint(const int16_t* breakpoints, uint8_t n, int x){
+    uint8_t i = 0;
+    while(i < n && (int16_t) pgm_read_word(&(breakpoints[i])) != x) i++;
+
+    return i;
+}
+
+int set_map_cell(operating_map* m, uint8_t which, int rpm, int temp, int16_t angle){
+    uint8_t c = find_breakpoint(map_speeds, MAP_SPEEDS, rpm);
+    uint8_t r = find_breakpoint(map_temps, MAP_TEMPS, temp);
+
+    if(c == MAP_SPEEDS || r == MAP_TEMPS) return MAP_NO_CELL;
+    if(angle < 0 || angle > (which == SPARK_CELL ? MAX_SPARK_CELL : MAX_FUEL_CELL)) return MAP_OUT_OF_RANGE;
+
+    if(which == SPARK_CELL){
+        m->spark[r][c] = angle;
+    } else {
+        m->fuel[r][c] = angle;
+    }
+
+    // A save in progress starts again, so the CRC covers the cell
+    m->unsaved = true;
+    m->save_byte = 0;
+    m->save_crc = 0xFFFF;
+
+    return 0;
+}
+
+bool save_operating_map(operating_map* m){
+    if(!m->unsaved || !eeprom_is_ready()) return false;
+
+    uint8_t k = m->save_byte++;
+    uint8_t* address = (uint8_t*) MAP_EEPROM_ADDRESS + k;
+
+    if(k < MAP_IMAGE_SIZE){
+        uint8_t b = map_image_byte(m, k);
+
+        m->save_crc = _crc_ccitt_update(m->save_crc, b);
+        eeprom_update_byte(address, b);
+    } else if(k == MAP_IMAGE_SIZE){
+        eeprom_update_byte(address, m->save_crc & 0xFF);
+    } else {
+        eeprom_update_byte(address, m->save_crc >> 8);
+        m->unsaved = false;
+    }
+
+    return true;
+}
+
 void init_timings(timings* t){
-    t->spark[0] = 0;
-    t->spark[1] = 0;
+    for(uint8_t i = 0; i < 2; i++){
+        timing_buffer* b = &(t->buffers[i]);
+
+        b->spark[0] = 0;
+        b->spark[1] = 0;
 
-    t->fuel[0] = 0;
-    t->fuel[1] = 0;
+        b->fuel[0] = 0;
+        b->fuel[1] = 0;
+
+        init_action_table(&(b->table));
+    }
+
+    t->active = 0;
+    t->pending = false;
+    t->handover = false;
+    t->deferred = false;
 
     t->o = NULL;
     t->is_valid = false;
+
+    t->rpm = 0;
+    t->temp = 0;
+
+    t->rpm_band = RPM_HYSTERESIS;
+    t->temp_band = TEMP_HYSTERESIS;
+
+    t->recomputes = 0;
+    t->skips = 0;
 }
 
-operating_point get_operating_point(unsigned int target_speed){
-    for(size_t i = 0; i < MAP_SIZE; i++){
-        if(target_speed == operating_map[i].speed){
-            return operating_map[i];
+/* Returns the index of the breakpoint at or below x, so that x lies between it and the next. */
+static uint8_t find_span(const int16_t* breakpoints, uint8_t n, int16_t x){
+    uint8_t low = 0, high = n - 1;
+
+    while(high - low > 1){
+        uint8_t mid = (low + high) / 2;
+
+        if(x < (int16_t) pgm_read_word(&(breakpoints[mid]))){
+            high = mid;
+        } else {
+            low = mid;
         }
     }
 
-    return INVALID_OPERATING_POINT;
+    return low;
+}
+
+/* Returns how far x lies from breakpoint i to the next, out of 65536. */
+static uint32_t span_weight(const int16_t* breakpoints, const uint32_t* spans, uint8_t i, int16_t x){
+    int16_t start = pgm_read_word(&(breakpoints[i]));
+    if(x <= start) return 0;
+
+    uint32_t weight = ((uint32_t) (x - start) * pgm_read_dword(&(spans[i]))) >> 8;
+    return weight > 65536 ? 65536 : weight;
+}
+
+static int32_t lerp(int32_t a, int32_t b, uint32_t weight){
+    return a + (((b - a) * (int32_t) weight) >> 16);
+}
+
+/* Interpolates a map between rows r and r + 1 and columns c and c + 1. */
+static int32_t interpolate(const int16_t map[MAP_TEMPS][MAP_SPEEDS], uint8_t r, uint8_t c, uint32_t row_weight, uint32_t column_weight){
+    int32_t low = lerp(map[r][c], map[r][c + 1], column_weight);
+    int32_t high = lerp(map[r + 1][c], map[r + 1][c + 1], column_weight);
+
+    return lerp(low, high, row_weight);
+}
+
+operating_point lookup_operating_point(int rpm, int temp){
+    uint8_t c = find_span(map_speeds, MAP_SPEEDS, rpm);
+    uint8_t r = find_span(map_temps, MAP_TEMPS, temp);
+
+    uint32_t column_weight = span_weight(map_speeds, map_speed_spans, c, rpm);
+    uint32_t row_weight = span_weight(map_temps, map_temp_spans, r, temp);
+
+    operating_point o;
+
+    o.speed = constrain(rpm, (int16_t) pgm_read_word(&(map_speeds[0])), (int16_t) pgm_read_word(&(map_speeds[MAP_SPEEDS - 1])));
+    o.spark_btdc = MAP_TO_ANGLE(interpolate(live_map.spark, r, c, row_weight, column_weight));
+    o.inj_duration = MAP_TO_ANGLE(interpolate(live_map.fuel, r, c, row_weight, column_weight));
+
+    return o;
 }
 
 int set_engine_timings(timings* t, const operating_point* o, const engine* e){
-    if(!o || !e || e->rpm == 0){
+    // The interrupt only swaps a pending buffer, so once none is pending the other buffer is left alone
+    t->pending = false;
+
+    if(!o || !e || e->rpm == 0 || e->period == 0){
         t->is_valid = false;
         return 1;
     }
 
     t->o = o;
+    t->rpm = e->rpm;
+    t->temp = e->temp;
+
+    // The angle turned while the coil charges, from the time between IPG pulses
+    angle_t dwell = (angle_t) ((DWELL_TIME * TICKS_PER_US * ANGLE_ONE / e->period) * IPG_PULSE_ANGLE);
+
+    angle_t spark_end = ANGLE(360) - o->spark_btdc;
+    angle_t fuel_end = ANGLE(MIN_FUEL_START_ANGLE) + o->inj_duration;
+
+    if(fuel_end > ANGLE(MAX_FUEL_END_ANGLE) || spark_end - dwell < ANGLE(MIN_CHARGE_ANGLE)){
+        t->is_valid = false;
+        return 1;
+    }
+
+    // The other buffer is still read until the handover ends
+    if(e->is_running && t->handover){
+        t->deferred = true;
+        return 0;
+    }
+
+    t->deferred = false;
+    t->handover = false;
+    t->recomputes++;
 
-    t->spark[1] = 360 - o->spark_btdc;
-    t->spark[0] = t->spark[1] - (e->speed * DWELL_TIME);
+    uint8_t next = t->active ^ 1;
+    timing_buffer* b = &(t->buffers[next]);
 
-    t->fuel[0] = MIN_FUEL_START_ANGLE;
-    t->fuel[1] = MIN_FUEL_START_ANGLE + o->inj_duration;
+    b->spark[1] = spark_end;
+    b->spark[0] = spark_end - dwell;
 
-    if(t->fuel[1] > MAX_FUEL_END_ANGLE || t->spark[0] < MIN_CHARGE_ANGLE){
+    b->fuel[0] = ANGLE(MIN_FUEL_START_ANGLE);
+    b->fuel[1] = fuel_end;
+
+    if(compile_action_table(&(b->table), b->spark, b->fuel, cylinder_phases, e)){
         t->is_valid = false;
         return 1;
     }
 
+    // A stopped engine has no TDC to wait for
+    if(e->is_running){
+        t->pending = true;
+    } else {
+        t->active = next;
+    }
+
     t->is_valid = true;
 
     return 0;
 }
 
-void new_operating_point(unsigned int rpm, operating_point* o, timings* t, engine* e, char* message){
-    *o = get_operating_point(rpm);
+const timing_buffer* timings_in_force(const timings* t){
+    return &(t->buffers[t->active]);
+}
+
+const action_table* timings_replaced(const timings* t){
+    return t->handover ? &(t->buffers[t->active ^ 1].table) : NULL;
+}
+
+void swap_timings(timings* t){
+    // Every output has passed the TDC of its cylinder since the last swap
+    t->handover = false;
+
+    if(!t->pending) return;
+
+    t->active ^= 1;
+    t->pending = false;
+    t->handover = true;
+}
+
+static bool within_band(int a, int b, int band){
+    return a - b < band && b - a < band;
+}
+
+int update_operating_point(operating_point* o, timings* t, const engine* e){
+    // Timings deferred by the handover are found for the operating point they were set for
+    if(t->deferred) return set_engine_timings(t, t->o, e);
 
-    if(o->speed == -1){
-        sprintf(message, "Could not find target RPM.\n");
+    // Timings set for a target speed are kept too, until the engine moves away from the speed it was at
+    if(t->is_valid && within_band(e->rpm, t->rpm, t->rpm_band) && within_band(e->temp, t->temp, t->temp_band)){
+        t->skips++;
+        return 0;
     }
 
+    *o = lookup_operating_point(e->rpm, e->temp);
+    return set_engine_timings(t, o, e);
+}
+
+int new_operating_point(unsigned int rpm, operating_point* o, timings* t, engine* e, char* message){
+    *o = lookup_operating_point(rpm, e->temp);
+
     int err = set_engine_timings(t, o, e);
 
+    if(!message) return err;
+
     if(err){
-        sprintf(message, "Timings are invalid.\n");
+        strcpy_P(message, PSTR("Timings are invalid.\n"));
     } else {
-        sprintf(message, "Engine operating point and timings updated.\n");
+        strcpy_P(message, PSTR("Engine operating point and timings updated.\n"));
     }
+
+    return err;
 }
 
-void get_timing_info(timings* t, char message[150]){
+/* Appends the bounds of a window of crank angle, to a tenth of a degree */
+static void put_window(formatter* f, const angle_t bounds[2]){
+    put_fixed(f, bounds[0], 16, 1);
+    put_P(f, PSTR(" to "));
+    put_fixed(f, bounds[1], 16, 1);
+    put_P(f, PSTR(" deg"));
+}
+
+bool put_timing_info(formatter* f, timings* t, uint8_t line){
     if(!t->is_valid){
-        sprintf(message, "timings not valid.\n");
-    } else {
-        sprintf(message, "timings:\n    target RPM: %i\n    spark: ~%i to ~%i deg\n    fuel: ~%i to ~%i deg\n    is valid: %s\n",
-            t->o->speed, (int) t->spark[0], (int) t->spark[1], (int) t->fuel[0], (int) t->fuel[1], t->is_valid ? "true" : "false");
+        if(line == 0) put_P(f, PSTR("timings not valid."));
+        return line == 0;
+    }
+
+    const timing_buffer* b = timings_in_force(t);
+
+    switch(line){
+        case 0:
+            put_P(f, PSTR("timings:"));
+            return true;
+        case 1:
+            put_P(f, PSTR("    map RPM: "));
+            put_int(f, t->o->speed);
+            return true;
+        case 2:
+            put_P(f, PSTR("    spark: "));
+            put_window(f, b->spark);
+            return true;
+        case 3:
+            put_P(f, PSTR("    fuel: "));
+            put_window(f, b->fuel);
+            return true;
+        case 4:
+            put_P(f, PSTR("    is valid: "));
+            put_bool(f, t->is_valid);
+            return true;
+        case 5:
+            put_P(f, PSTR("    found: "));
+            put_uint(f, t->recomputes);
+            put_P(f, PSTR(", kept: "));
+            put_uint(f, t->skips);
+            return true;
     }
+
+    return false;
+}
+
+void get_timing_info(timings* t, char message[150]){
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    for(uint8_t line = 0; put_timing_info(&f, t, line); line++) put_char(&f, '\n');
 }
\ No newline at end of file
@@ -4,8 +4,15 @@
     #include <Arduino.h>
     #include <stdio.h>
 
+    #include <avr/pgmspace.h>
+    #include <avr/eeprom.h>
+    #include <util/atomic.h>
+    #include <util/crc16.h>
+
     // Library containing basic methods for opening/closing circuits or measuring pulses
     #include "../control_system/control_system.h"
+    // Library containing the table of output states by crank angle
+    #include "../action_table/action_table.h"
 
     // The duration a coil should charge for in microseconds
     // This needs to be replaced with a timer interrupt for greater accuracy
@@ -17,8 +24,32 @@
 
     #define MIN_CHARGE_ANGLE 180
 
-    // The size of the fuel/ignition map
-    #define MAP_SIZE 7
+    // The size of the fuel/ignition map: engine speeds by internal temperatures
+    #define MAP_SPEEDS 7
+    #define MAP_TEMPS 4
+
+    // Angles in the map are held in 1/256 of a degree, to fit 16 bits of flash
+    #define MAP_ANGLE(D) ((int16_t) ((D) * 256 + 0.5))
+    #define MAP_TO_ANGLE(M) ((angle_t) (M) << 8)
+
+    // Reciprocal of the span between two breakpoints, out of 2^24
+    #define MAP_SPAN(A, B) ((uint32_t) ((16777216UL + ((B) - (A)) / 2) / ((B) - (A))))
+
+    // The cells of the map SET can write, and the largest angle each takes, short of the 128 deg a cell can hold
+    #define SPARK_CELL 0
+    #define FUEL_CELL 1
+
+    // The longest fuel window, 10 to 130 deg, wraps past 720 for the cylinders after the first, and is handed over at its own TDC
+    #define MAX_SPARK_CELL MAP_ANGLE(90)
+    #define MAX_FUEL_CELL MAP_ANGLE(120)
+
+    // Errors of set_map_cell
+    #define MAP_NO_CELL 1
+    #define MAP_OUT_OF_RANGE 2
+
+    // Where the map is held in the EEPROM, after the snapshot of the flight recorder, and the version of its layout there
+    #define MAP_EEPROM_ADDRESS 256
+    #define MAP_VERSION 1
 
     #ifdef __cplusplus
     extern "C" {
@@ -30,56 +61,192 @@
         - The spark angle BTDC at which the coil should discharge
         - The duration the injectors should be open for in crank angle degrees
           (This should be replaced with a timer interrupt for greater accuracy)
+
+        Both angles are given in fixed point.
     */
 
     typedef struct operating_point {
         int speed;
-        float spark_btdc;
-        float inj_duration;
+        angle_t spark_btdc;
+        angle_t inj_duration;
     } operating_point;
 
-    #define INVALID_OPERATING_POINT ((operating_point) {-1, -1, -1})
+    // The band the speed in RPM and temperature in deg C can move within before the timings are found again, by default
+    #define RPM_HYSTERESIS 25
+    #define TEMP_HYSTERESIS 2
+
+    /*
+        The spark and fuel windows, given in the frame of each cylinder
+        in fixed point, and the action table they are compiled into for
+        every cylinder.
+    */
+    typedef struct timing_buffer {
+        angle_t spark[2];
+        angle_t fuel[2];
+        action_table table;
+    } timing_buffer;
 
+    /*
+        Definition of the timings type. The timings are held twice: the
+        buffer in force, which the actuators read, and a buffer that new
+        timings are written to. While the engine runs, new timings wait
+        in their buffer until the IPG interrupt swaps it in at TDC. Each
+        output is then handed over to them at the TDC of its own 
+        cylinder over the cycle after (see action_table.h), so a window
+        is never actuated with one edge from each. The buffer replaced 
+        is read until then, so timings found during the handover are 
+        deferred until it ends.
+
+        The speed and temperature the timings were found at are kept, so
+        that they are only found again once either moves out of its band.
+    */
     typedef struct timings {
-        float spark[2];
-        float fuel[2];
+        timing_buffer buffers[2];
+        // The buffer in force, and whether the other holds timings waiting for TDC
+        volatile uint8_t active;
+        volatile bool pending;
+
+        // Whether the outputs are being handed over to the buffer in force, and whether timings wait for that to end
+        volatile bool handover;
+        bool deferred;
+
         bool is_valid;
-        operating_point* o;
+        const operating_point* o;
+
+        // The speed and temperature the timings were found at, and the bands around them, which PARAM can write
+        int rpm, temp;
+        int16_t rpm_band, temp_band;
+
+        // Times the timings were found, and times they were kept as still within the bands
+        uint16_t recomputes, skips;
     } timings;
 
+    // The phase of each cylinder, from CYLINDER_PHASES
+    extern const int cylinder_phases[CYLINDERS];
+
     /*
-        Global variable defining the map of all the known operating points
-        for the CBR600f4i that are optimised for ethanol.
+        Global variables defining the map of all the known operating points
+        for the CBR600f4i that are optimised for ethanol, held in flash.
+
+        The breakpoints of each axis are given in increasing order, along
+        with the reciprocal of the span from each to the next. The spark 
+        angle BTDC and injection duration are given for each temperature
+        (row) and engine speed (column). These are the defaults of the
+        map in use, below.
     */
+    extern const int16_t map_speeds[MAP_SPEEDS] PROGMEM;
+    extern const uint32_t map_speed_spans[MAP_SPEEDS - 1] PROGMEM;
+
+    extern const int16_t map_temps[MAP_TEMPS] PROGMEM;
+    extern const uint32_t map_temp_spans[MAP_TEMPS - 1] PROGMEM;
+
+    extern const int16_t spark_map[MAP_TEMPS][MAP_SPEEDS] PROGMEM;
+    extern const int16_t fuel_map[MAP_TEMPS][MAP_SPEEDS] PROGMEM;
+
+    /*
+        The spark and fuel cells of the map in use, in SRAM, where SET
+        can write them while the engine runs. The axes are fixed, so
+        they stay in flash.
+
+        The map is held in the EEPROM behind its version and dimensions,
+        and followed by the CRC-CCITT of all of it. At start-up it is
+        read in one pass, with the CRC taken as it goes, and the
+        defaults in flash are used in its place if any of it does not
+        match. An edit is saved a byte per pass of the loop, as the
+        EEPROM is ready, comparing the map with what is held and only
+        writing the bytes that differ. The CRC is written last, so a
+        reset partway through leaves the defaults to be loaded.
+    */
+    typedef struct operating_map {
+        int16_t spark[MAP_TEMPS][MAP_SPEEDS];
+        int16_t fuel[MAP_TEMPS][MAP_SPEEDS];
+
+        // Whether the map was loaded from the EEPROM rather than the defaults
+        bool from_eeprom;
 
-   // The firing order of the engine cylinders (1-4-2-3)
-    const int cylinder_phases[4] = {0, 180, 270, 90};
+        // Whether the map has changed since it was saved, the byte to save next and the CRC of those before it
+        bool unsaved;
+        uint8_t save_byte;
+        uint16_t save_crc;
+    } operating_map;
 
-    const operating_point operating_map[7] = {
-        {1000,  7.50,  4.15},
-        {2000, 15.00,  9.57},
-        {3000, 20.00, 23.45},
-        {4000, 23.13, 38.46},
-        {5000, 26.25, 44.64},
-        {6000, 29.38, 51.24},
-        {6250, 32.50, 57.90}
-    };
+    extern operating_map live_map;
+
+    /*
+        Method to load the map from the EEPROM, or the defaults if it
+        holds none. Returns true if it was loaded from the EEPROM.
+    */
+    bool load_operating_map(operating_map* m);
+
+    /*
+        Method to set a cell of the spark or fuel map, at a speed and a
+        temperature that are breakpoints of the map, to an angle in 1/256
+        of a degree. The map is saved over the passes of the loop after.
+        Returns MAP_NO_CELL if there is no such cell, or
+        MAP_OUT_OF_RANGE if the angle is out of its range.
+    */
+    int set_map_cell(operating_map* m, uint8_t which, int rpm, int temp, int16_t angle);
+
+    /*
+        Method called on every pass of the loop to save the next byte of
+        the map, if it has changed and the EEPROM is ready. Returns true
+        if a byte was saved.
+    */
+    bool save_operating_map(operating_map* m);
+
+    void init_timings(timings* t);
 
     /* 
         Method for selecting the optimal spark/fuel timing based on the 
         operating map above.
 
-        Given a target RPM, this function will interpolate the values of 
-        the operating map to determine the best spark timings. 
-        
-        These values are saved to p, a pointer to an operating point.
+        Given an engine speed in RPM and a temperature in deg C, this
+        function will interpolate the values of the operating map to 
+        determine the best spark timings. Points outside the map take
+        the values at its nearest edge.
     */
+    operating_point lookup_operating_point(int rpm, int temp);
 
-    void init_timings(timings* t);
-
+    /*
+        Method to find the timings for an operating point at the speed
+        and temperature of the engine. They are put in force at once if
+        the engine is stopped, and at the next TDC if it is running. If
+        the outputs are still being handed over, they are only checked
+        and are found again by update_operating_point once it ends.
+        Returns non-zero if the timings are invalid.
+    */
     int set_engine_timings(timings* t, const operating_point* o, const engine* e);
 
-    void new_operating_point(unsigned int rpm, operating_point* o, timings* t, engine* e, char* message);
+    /* Method to return the timings the actuators read. */
+    const timing_buffer* timings_in_force(const timings* t);
+
+    /* Method to return the table the outputs not yet handed over still follow, or NULL outside a handover. */
+    const action_table* timings_replaced(const timings* t);
+
+    /*
+        Method called by the IPG interrupt at TDC to end the handover to
+        the timings in force, and to put waiting timings in force.
+    */
+    void swap_timings(timings* t);
+
+    /*
+        Method to evaluate the map at the measured speed and temperature 
+        of the engine and update the timings from it, unless both are
+        still within the band of those the timings were found at, and
+        none were deferred.
+    */
+    int update_operating_point(operating_point* o, timings* t, const engine* e);
+
+    /*
+        Method to set the operating point for a target engine speed at
+        the measured temperature, and the timings from it. A reply is
+        written to message unless it is NULL. Returns non-zero if the 
+        timings are invalid.
+    */
+    int new_operating_point(unsigned int rpm, operating_point* o, timings* t, engine* e, char* message);
+
+    /* As put_engine_info, for the timings. */
+    bool put_timing_info(formatter* f, timings* t, uint8_t line);
 
     void get_timing_info(timings* t, char message[150]);
 
@@ -0,0 +1,224 @@
+#include "flight_recorder.h"
+
+#define MASK (FLIGHT_RECORDS - 1)
+
+// The records of the snapshot follow it in the EEPROM
+#define SNAPSHOT_RECORDS_ADDRESS (FLIGHT_SNAPSHOT_ADDRESS + sizeof(flight_snapshot))
+
+void init_flight_recorder(flight_recorder* r){
+    r->written = 0;
+    r->dropped = 0;
+
+    r->unsaved = 0;
+    r->save_byte = 0;
+    r->snapshot.magic = 0;
+
+    r->dumping = false;
+}
+
+void record_event(flight_recorder* r, uint8_t code, uint32_t time, int16_t crank, int16_t rpm, int16_t temp){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        uint16_t written = r->written;
+
+        // The oldest record is held until the snapshot has saved it
+        if(r->unsaved && (uint16_t) (written - (r->snapshot.written - r->unsaved)) >= FLIGHT_RECORDS){
+            r->dropped++;
+        } else {
+            flight_record* p = &(r->records[written & MASK]);
+            p->time = time;
+            p->code = code;
+            p->temp = temp > INT8_MAX ? INT8_MAX : temp < INT8_MIN ? INT8_MIN : temp;
+            p->crank = crank;
+            p->rpm = rpm;
+
+            r->written = written + 1;
+        }
+    }
+}
+
+/* Whether a snapshot is being written, which it is until its first byte is */
+static bool saving(flight_recorder* r){
+    return r->snapshot.magic != 0;
+}
+
+void snapshot_flight_log(flight_recorder* r, uint8_t cause){
+    if(saving(r)) return;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        r->snapshot.magic = FLIGHT_SNAPSHOT_MAGIC;
+        r->snapshot.cause = cause;
+        r->snapshot.written = r->written;
+        r->snapshot.count = r->written < FLIGHT_RECORDS ? r->written : FLIGHT_RECORDS;
+        r->snapshot.dropped = r->dropped;
+
+        r->unsaved = r->snapshot.count;
+    }
+
+    r->save_byte = 0;
+}
+
+bool save_flight_log(flight_recorder* r){
+    if(!saving(r) || !eeprom_is_ready()) return false;
+
+    uint16_t k = r->save_byte++;
+    uint16_t end = sizeof(flight_snapshot) + r->snapshot.count * sizeof(flight_record);
+    uint8_t* address = (uint8_t*) FLIGHT_SNAPSHOT_ADDRESS + k;
+
+    if(k == 0){
+        // The old snapshot is marked as gone first, and the new one as whole last, so a reset partway leaves neither
+        eeprom_update_byte(address, 0);
+    } else if(k < sizeof(flight_snapshot)){
+        eeprom_update_byte(address, ((const uint8_t*) &(r->snapshot))[k]);
+    } else if(k < end){
+        uint16_t j = (k - sizeof(flight_snapshot)) / sizeof(flight_record);
+        uint8_t offset = (k - sizeof(flight_snapshot)) % sizeof(flight_record);
+        const flight_record* p = &(r->records[(r->snapshot.written - r->snapshot.count + j) & MASK]);
+
+        eeprom_update_byte(address, ((const uint8_t*) p)[offset]);
+
+        // Once saved, the record may be overwritten
+        if(offset == sizeof(flight_record) - 1) r->unsaved--;
+    } else {
+        eeprom_update_byte((uint8_t*) FLIGHT_SNAPSHOT_ADDRESS, FLIGHT_SNAPSHOT_MAGIC);
+        r->snapshot.magic = 0;
+    }
+
+    return true;
+}
+
+bool read_flight_snapshot(flight_snapshot* s){
+    eeprom_read_block(s, (const void*) FLIGHT_SNAPSHOT_ADDRESS, sizeof(flight_snapshot));
+    return s->magic == FLIGHT_SNAPSHOT_MAGIC && s->count <= FLIGHT_RECORDS;
+}
+
+void start_flight_dump(flight_recorder* r, bool eeprom){
+    r->dumping = true;
+    r->dump_eeprom = eeprom;
+    r->dump_started = false;
+}
+
+/* Appends a value of n bytes as hexadecimal, least significant byte first */
+static void put_bytes(formatter* f, uint32_t v, uint8_t n){
+    while(n--){
+        put_hex(f, v & 0xFF);
+        v >>= 8;
+    }
+}
+
+/* Appends the header of the dump, and sets the records it sends */
+static void put_dump_header(flight_recorder* r, formatter* f){
+    uint16_t written, dropped;
+    uint8_t count;
+
+    put_P(f, PSTR("flight log: "));
+
+    if(r->dump_eeprom){
+        flight_snapshot s;
+
+        if(!read_flight_snapshot(&s)){
+            put_P(f, PSTR("eeprom, empty"));
+            r->dump_next = r->dump_end = 0;
+            return;
+        }
+
+        put_P(f, PSTR("eeprom, cause "));
+        put_uint(f, s.cause);
+        put_P(f, PSTR(", "));
+
+        written = s.written;
+        count = s.count;
+        dropped = s.dropped;
+    } else {
+        put_P(f, PSTR("ram, "));
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+            written = r->written;
+            dropped = r->dropped;
+        }
+
+        count = written < FLIGHT_RECORDS ? written : FLIGHT_RECORDS;
+    }
+
+    put_uint(f, count);
+    put_P(f, PSTR(" of "));
+    put_uint(f, written);
+    put_P(f, PSTR(", dropped "));
+    put_uint(f, dropped);
+
+    r->dump_next = written - count;
+    r->dump_end = written;
+}
+
+/* Returns whether the snapshot in the EEPROM is still the one the dump started on, which ends at its written */
+static bool snapshot_kept(flight_recorder* r){
+    flight_snapshot s;
+    return read_flight_snapshot(&s) && s.written == r->dump_end;
+}
+
+/* Reads the record of a number into p. Returns false if it has been overwritten since the dump started */
+static bool get_dump_record(flight_recorder* r, flight_record* p){
+    if(r->dump_eeprom){
+        flight_snapshot s;
+        read_flight_snapshot(&s);
+
+        uint16_t j = r->dump_next - (s.written - s.count);
+        if(j >= s.count) return false;
+
+        eeprom_read_block(p, (const void*) (SNAPSHOT_RECORDS_ADDRESS + j * sizeof(flight_record)), sizeof(flight_record));
+
+        return true;
+    }
+
+    bool kept;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        kept = (uint16_t) (r->written - r->dump_next) <= FLIGHT_RECORDS;
+        if(kept) *p = r->records[r->dump_next & MASK];
+    }
+
+    return kept;
+}
+
+bool stream_flight_dump(flight_recorder* r, serial_port* sp){
+    if(!r->dumping || serial_tx_space(sp) < FLIGHT_LINE_SIZE) return false;
+
+    // The snapshot is not read while it is being written, which would wait on the EEPROM
+    if(r->dump_eeprom && (saving(r) || !eeprom_is_ready())) return false;
+
+    char line[FLIGHT_LINE_SIZE];
+    formatter f;
+    init_formatter(&f, line, FLIGHT_LINE_SIZE);
+
+    flight_record p;
+
+    // A snapshot saved since the dump started holds other records, so what is left of the old one is not sent
+    if(r->dump_eeprom && r->dump_started && !snapshot_kept(r)) r->dump_next = r->dump_end;
+
+    // Records overwritten since the dump started are left out, which the gap in the numbers shows
+    while(r->dump_started && r->dump_next != r->dump_end && !get_dump_record(r, &p)) r->dump_next++;
+
+    if(!r->dump_started){
+        put_dump_header(r, &f);
+        r->dump_started = true;
+    } else if(r->dump_next == r->dump_end){
+        put_P(&f, PSTR("flight log: end"));
+        r->dumping = false;
+    } else {
+        put_char(&f, '@');
+        put_hex(&f, r->dump_next >> 8);
+        put_hex(&f, r->dump_next & 0xFF);
+        put_char(&f, ' ');
+
+        put_bytes(&f, p.time, 4);
+        put_bytes(&f, p.code, 1);
+        put_bytes(&f, (uint8_t) p.temp, 1);
+        put_bytes(&f, (uint16_t) p.crank, 2);
+        put_bytes(&f, (uint16_t) p.rpm, 2);
+
+        r->dump_next++;
+    }
+
+    put_char(&f, '\n');
+
+    return serial_write(sp, line, f.length);
+}
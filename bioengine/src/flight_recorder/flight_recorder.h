@@ -0,0 +1,153 @@
+#ifndef FLIGHT_RECORDER_H
+    #define FLIGHT_RECORDER_H
+
+    #include <Arduino.h>
+    #include <stdio.h>
+    #include <avr/pgmspace.h>
+    #include <avr/eeprom.h>
+    #include <util/atomic.h>
+
+    // Library containing the text formatter
+    #include "../formatter/formatter.h"
+    // Library containing the interrupt-driven serial port
+    #include "../serial_port/serial_port.h"
+
+    /*
+        Ring of binary records of the faults and sync events of the
+        control system, written from the loop or from an interrupt.
+
+        Recording an event copies a few bytes into the ring with
+        interrupts held off, in place of formatting a message for the
+        serial port, so it does not disturb the timing it records. The
+        ring keeps the last FLIGHT_RECORDS events, and each is given
+        the number of events recorded before it since start-up, so a
+        gap in the numbers shows where events were overwritten.
+
+        When the engine is shut down by a fault, the ring is saved to
+        the EEPROM along with the cause, so it survives a reset. The
+        EEPROM takes 3.4 ms to write a byte, so the snapshot is written
+        a byte per pass of the loop, once the last byte has finished.
+        Until a record is saved it is held in the ring, and events that
+        would overwrite it are dropped and counted instead.
+
+        DUMP sends the ring, or the snapshot with DUMP --EEPROM, a
+        record per pass of the loop as the transmit ring has room, each
+        as a line of its number and its fields in hexadecimal, least
+        significant byte first:
+
+            flight log: ram, 16 of 40, dropped 0
+            @0018 a00f0000041e7800b80b
+            ...
+            flight log: end
+
+        The header gives the records sent of those recorded, and for
+        the snapshot the event that caused it. The host decoder in
+        tests/host_build/tools turns a dump into a timeline.
+    */
+
+    // Number of records, a power of 2
+    #define FLIGHT_RECORDS      16
+
+    // Events, by code
+    #define EVENT_BOOT              1
+    #define EVENT_START             2
+    #define EVENT_STOP              3
+    #define EVENT_MISSED_PULSE      4
+    #define EVENT_SYNC_LOCKED       5
+    #define EVENT_SYNC_LOST         6
+    #define EVENT_CRANK_CORRECTED   7
+    #define EVENT_SIGNAL_MISMATCH   8
+    #define EVENT_OVER_TEMPERATURE  9
+    #define EVENT_TIMINGS_ERROR     10
+    #define EVENT_PULSE_OVERRUN     11
+
+    // Where the snapshot is held in the EEPROM, and the first byte of a whole one
+    #define FLIGHT_SNAPSHOT_ADDRESS 0
+    #define FLIGHT_SNAPSHOT_MAGIC   0xF1
+
+    // Bytes of the longest line of a dump with its ending and '\0'
+    #define FLIGHT_LINE_SIZE    48
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct flight_record {
+        // The time of the event in timer ticks
+        uint32_t time;
+        uint8_t code;
+        // The temperature in deg C, held to the range of a byte
+        int8_t temp;
+        // The crank angle in degrees and the speed in RPM
+        int16_t crank;
+        int16_t rpm;
+    } flight_record;
+
+    typedef struct flight_snapshot {
+        uint8_t magic;
+        // The event the snapshot was taken on
+        uint8_t cause;
+        // The records saved
+        uint8_t count;
+        // The number of the record after the last saved
+        uint16_t written;
+        // Events dropped while the last snapshot was written
+        uint16_t dropped;
+    } flight_snapshot;
+
+    typedef struct flight_recorder {
+        flight_record records[FLIGHT_RECORDS];
+        // Events recorded since start-up, the last of which is at (written - 1) % FLIGHT_RECORDS
+        volatile uint16_t written;
+        volatile uint16_t dropped;
+
+        // The snapshot being written, the records of it left to save, and the byte of the snapshot to write next
+        flight_snapshot snapshot;
+        volatile uint8_t unsaved;
+        uint16_t save_byte;
+
+        // Whether a dump is being sent, and whether of the snapshot, the number of the record to send next and past the last
+        bool dumping, dump_eeprom, dump_started;
+        uint16_t dump_next, dump_end;
+    } flight_recorder;
+
+    void init_flight_recorder(flight_recorder* r);
+
+    /*
+        Method to record an event, from the loop or from an interrupt,
+        with the time in timer ticks and the state of the engine then.
+    */
+    void record_event(flight_recorder* r, uint8_t code, uint32_t time, int16_t crank, int16_t rpm, int16_t temp);
+
+    /*
+        Method to start saving the ring to the EEPROM, with the event
+        that caused it. Does nothing if a snapshot is being written.
+    */
+    void snapshot_flight_log(flight_recorder* r, uint8_t cause);
+
+    /*
+        Method called on every pass of the loop to write the next byte
+        of the snapshot, if one is being written and the EEPROM is
+        ready. Returns true if a byte was written.
+    */
+    bool save_flight_log(flight_recorder* r);
+
+    /* Method to start a dump of the ring, or of the snapshot in the EEPROM. */
+    void start_flight_dump(flight_recorder* r, bool eeprom);
+
+    /*
+        As stream_status_report, for the next line of the dump. Reading
+        the snapshot waits for the EEPROM, so it is not read while one
+        is being written. A dump of the snapshot ends early if another
+        has been saved since it started.
+    */
+    bool stream_flight_dump(flight_recorder* r, serial_port* sp);
+
+    /* Method to read the snapshot held in the EEPROM. Returns false if there is none. */
+    bool read_flight_snapshot(flight_snapshot* s);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -0,0 +1,92 @@
+#include "formatter.h"
+
+void init_formatter(formatter* f, char* s, uint8_t size){
+    f->s = s;
+    f->size = size;
+    f->length = 0;
+
+    s[0] = '\0';
+}
+
+/* Appends a byte if there is room for it, leaving the end to the caller */
+static inline void put(formatter* f, char c){
+    if(f->length + 1 < f->size) f->s[f->length++] = c;
+}
+
+void put_char(formatter* f, char c){
+    put(f, c);
+    f->s[f->length] = '\0';
+}
+
+void put_string(formatter* f, const char* s){
+    while(*s) put(f, *s++);
+    f->s[f->length] = '\0';
+}
+
+void put_P(formatter* f, PGM_P s){
+    char c;
+
+    while((c = pgm_read_byte(s++))) put(f, c);
+    f->s[f->length] = '\0';
+}
+
+void put_uint(formatter* f, uint32_t v){
+    char digits[10];
+    uint8_t n = 0;
+
+    // Division of 32 bits is several times slower on the AVR, so it is left as soon as the value fits in 16
+    while(v > UINT16_MAX){
+        digits[n++] = '0' + v % 10;
+        v /= 10;
+    }
+
+    uint16_t w = (uint16_t) v;
+
+    do {
+        digits[n++] = '0' + w % 10;
+        w /= 10;
+    } while(w);
+
+    while(n) put(f, digits[--n]);
+    f->s[f->length] = '\0';
+}
+
+void put_int(formatter* f, int32_t v){
+    if(v < 0) put_char(f, '-');
+
+    // Negated as unsigned, which holds the magnitude of INT32_MIN too
+    put_uint(f, v < 0 ? -(uint32_t) v : (uint32_t) v);
+}
+
+void put_fixed(formatter* f, int32_t v, uint8_t shift, uint8_t decimals){
+    uint32_t m = v < 0 ? -(uint32_t) v : (uint32_t) v;
+    uint32_t mask = (1UL << shift) - 1;
+
+    if(v < 0) put_char(f, '-');
+    put_uint(f, m >> shift);
+
+    if(!decimals) return;
+
+    put_char(f, '.');
+
+    // Each digit is the integer part of ten times the fraction left, which stays below 2^28
+    uint32_t fraction = m & mask;
+
+    while(decimals--){
+        fraction *= 10;
+        put_char(f, '0' + (char) (fraction >> shift));
+        fraction &= mask;
+    }
+}
+
+void put_bool(formatter* f, bool b){
+    put_P(f, b ? PSTR("true") : PSTR("false"));
+}
+
+void put_hex(formatter* f, uint8_t b){
+    static const char digits[] PROGMEM = "0123456789abcdef";
+
+    put(f, pgm_read_byte(&(digits[b >> 4])));
+    put(f, pgm_read_byte(&(digits[b & 0x0F])));
+    f->s[f->length] = '\0';
+}
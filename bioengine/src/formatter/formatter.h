@@ -0,0 +1,58 @@
+#ifndef FORMATTER_H
+    #define FORMATTER_H
+
+    #include <Arduino.h>
+    #include <stdio.h>
+    #include <avr/pgmspace.h>
+
+    /*
+        Text formatter writing into a buffer of fixed size, in place of
+        sprintf, so that the sketch does not link vfprintf.
+
+        Each method appends to what is in the buffer and keeps it ended
+        with '\0'. Whatever does not fit is cut off, so the buffer never
+        overflows. Integers are written in decimal, and fixed-point
+        values as decimal fractions, truncated towards zero.
+    */
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct formatter {
+        char* s;
+        // Bytes in the buffer, with the '\0', and written so far, without
+        uint8_t size, length;
+    } formatter;
+
+    void init_formatter(formatter* f, char* s, uint8_t size);
+
+    void put_char(formatter* f, char c);
+
+    void put_string(formatter* f, const char* s);
+
+    /* Method to append a string held in flash, e.g. with PSTR(). */
+    void put_P(formatter* f, PGM_P s);
+
+    void put_uint(formatter* f, uint32_t v);
+
+    void put_int(formatter* f, int32_t v);
+
+    /*
+        Method to append a fixed-point value with shift fraction bits,
+        up to 24, to a number of decimal places, e.g. put_fixed(f, a,
+        16, 1) for an angle_t to a tenth of a degree.
+    */
+    void put_fixed(formatter* f, int32_t v, uint8_t shift, uint8_t decimals);
+
+    /* Method to append "true" or "false". */
+    void put_bool(formatter* f, bool b);
+
+    /* Method to append a byte as two hexadecimal digits, e.g. "0a". */
+    void put_hex(formatter* f, uint8_t b);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
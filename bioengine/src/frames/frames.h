@@ -0,0 +1,95 @@
+#ifndef FRAMES_H
+    #define FRAMES_H
+
+    #include <Arduino.h>
+    #include <avr/pgmspace.h>
+
+    #include "../messages/messages.h"
+
+    /*
+        Binary command frames, which can be sent on the serial port 
+        alongside the text commands. A frame is laid out as:
+
+            SYNC | TYPE | LENGTH | PAYLOAD (LENGTH bytes) | CRC
+
+        The sync byte is not ASCII, so it can never start a text command.
+        The CRC is a CRC-8 (polynomial 0x07) of the type, length and 
+        payload. Values in the payload are little-endian.
+
+        Commands share the codes of the text instructions, with PARAM 
+        added to write a parameter of the control system:
+
+            START, STOP, STATUS     no payload
+            SET                     int16 target RPM
+            PARAM                   uint8 parameter id, int16 value
+
+        Every command is answered with a frame of the same type with 
+        FRAME_REPLY set. The reply to STATUS carries STATUS_PAYLOAD bytes
+        (see bioengine.ino); the others carry a single FRAME_OK or 
+        FRAME_REJECTED byte.
+    */
+
+    #define FRAME_SYNC          0xA5
+    #define FRAME_REPLY         0x80
+
+    #define PARAM_CODE          0x05
+
+    #define FRAME_OK            0x00
+    #define FRAME_REJECTED      0x01
+
+    #define FRAME_MAX_PAYLOAD   32
+    // Sync, type, length and CRC
+    #define FRAME_OVERHEAD      4
+    #define FRAME_MAX_SIZE      (FRAME_MAX_PAYLOAD + FRAME_OVERHEAD)
+
+    #define STATUS_PAYLOAD      31
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct frame {
+        uint8_t type, length;
+        uint8_t payload[FRAME_MAX_PAYLOAD];
+    } frame;
+
+    /*
+        Definition of the frame decoder, which is fed one byte at a time
+        as they are read from the serial port, and writes the type, 
+        length and payload straight into its frame as they arrive. 
+
+        Frames of an unknown type, of the wrong length for their type, or
+        with a bad CRC are dropped and counted. The firmware only sends
+        replies, so one echoed back is counted and skipped by its length.
+    */
+    typedef struct frame_decoder {
+        uint8_t state;
+        uint8_t index, crc;
+        frame f;
+        uint16_t rejected;
+    } frame_decoder;
+
+    void init_frame_decoder(frame_decoder* d);
+
+    /* Method to decode the next byte. Returns true when it completes a frame, which is left in d->f. */
+    bool decode_frame_byte(frame_decoder* d, uint8_t c);
+
+    /* Returns true if the decoder is waiting for the start of a frame. */
+    bool frame_idle(const frame_decoder* d);
+
+    /* Method to write a frame into out, which must hold FRAME_MAX_SIZE bytes. Returns its size. */
+    uint8_t encode_frame(uint8_t* out, uint8_t type, const uint8_t* payload, uint8_t length);
+
+    uint8_t crc8_update(uint8_t crc, uint8_t c);
+
+    /* Methods to write and read little-endian values in a payload */
+    uint8_t* put_uint16(uint8_t* p, uint16_t v);
+    uint8_t* put_uint32(uint8_t* p, uint32_t v);
+
+    uint16_t get_uint16(const uint8_t* p);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -0,0 +1,57 @@
+#include "memory.h"
+
+// The top of the heap, or 0 if nothing has been allocated, kept by malloc
+extern char* __brkval;
+
+#define SRAM_SIZE (RAMEND - RAMSTART + 1)
+
+static char* heap_end(void){
+    return __brkval ? __brkval : __malloc_heap_start;
+}
+
+void paint_stack(void){
+    // The stack pointer is the next free byte, so it and everything below it are unused
+    for(char* p = heap_end(); p <= (char*) SP; p++) *p = STACK_CANARY;
+}
+
+size_t static_memory(void){
+    return __malloc_heap_start - (char*) RAMSTART;
+}
+
+size_t free_memory(void){
+    return (char*) SP - heap_end() + 1;
+}
+
+size_t stack_headroom(void){
+    char* p = heap_end();
+
+    while(p <= (char*) SP && *(volatile uint8_t*) p == STACK_CANARY) p++;
+
+    return p - heap_end();
+}
+
+/* Appends a line of the report, given a label held in flash */
+static void put_bytes(formatter* f, PGM_P label, size_t bytes){
+    put_P(f, PSTR("\n    "));
+    put_P(f, label);
+    put_P(f, PSTR(": "));
+    put_uint(f, bytes);
+    put_P(f, PSTR(" bytes"));
+}
+
+void get_memory_info(char message[150]){
+    size_t heap = heap_end() - __malloc_heap_start;
+    size_t headroom = stack_headroom();
+
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    put_P(&f, PSTR("memory:"));
+    put_bytes(&f, PSTR("SRAM"), SRAM_SIZE);
+    put_bytes(&f, PSTR("static"), static_memory());
+    put_bytes(&f, PSTR("heap"), heap);
+    put_bytes(&f, PSTR("free"), free_memory());
+    put_bytes(&f, PSTR("stack peak"), SRAM_SIZE - static_memory() - heap - headroom);
+    put_bytes(&f, PSTR("headroom"), headroom);
+    put_char(&f, '\n');
+}
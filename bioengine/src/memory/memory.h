@@ -0,0 +1,51 @@
+#ifndef MEMORY_H
+    #define MEMORY_H
+
+    #include <Arduino.h>
+    #include <stdio.h>
+    #include <avr/pgmspace.h>
+
+    // Library containing the text formatter
+    #include "../formatter/formatter.h"
+
+    /*
+        Usage of the 2.5 KB of SRAM, which holds, from the bottom up:
+
+        - The data and bss of the sketch, whose size is fixed at link
+          time.
+        - The heap, from __malloc_heap_start to __brkval, which stays
+          empty as nothing is allocated.
+        - Free memory.
+        - The stack, which grows down from RAMEND to the stack pointer.
+
+        So that the deepest the stack has ever reached can be told, the
+        free memory is painted with a canary byte at start-up. Whatever 
+        the stack has since written over is no longer the canary, and
+        the painted bytes left above the heap are the headroom that has
+        never been used.
+    */
+
+    // The byte free memory is painted with
+    #define STACK_CANARY        0xC5
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    /* Method to paint the free memory below the stack with the canary, called first thing at start-up. */
+    void paint_stack(void);
+
+    // Bytes of data and bss, which is the start of the heap
+    size_t static_memory(void);
+    // Bytes between the heap and the stack pointer now
+    size_t free_memory(void);
+    // Bytes of free memory the stack has never reached since it was painted
+    size_t stack_headroom(void);
+
+    void get_memory_info(char message[150]);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -1,90 +1,180 @@
 #include "messages.h"
 
-void get_message_keywords(const char message[], keywords kws){
-    if(!message || !kws) return;
-    size_t i = 0, j = 0, k = 0;
-    while(message[i] != '\n' && k != MAX_KEYWORDS){
-        if(message[i] == ' '){
-            if(i > 0 && j > 0){
-                kws[k][j] = '\0';
-                j = 0; k++;
-            }
-        } else if(j < MAX_KEYWORD_LENGTH){
-            kws[k][j] = message[i];
-            j++;
-        }
+static const char invalid_keyword[] PROGMEM = INVALID_KEYWORD;
+static const char start_keyword[] PROGMEM = START_KEYWORD;
+static const char stop_keyword[] PROGMEM = STOP_KEYWORD;
+static const char set_keyword[] PROGMEM = SET_KEYWORD;
+static const char status_keyword[] PROGMEM = STATUS_KEYWORD;
+static const char dump_keyword[] PROGMEM = DUMP_KEYWORD;
+// The code of the PARAM frame, which no keyword matches
+static const char no_keyword[] PROGMEM = "";
+
+// The keyword of each instruction, by code
+static const char* const type_keywords[] PROGMEM = {
+    invalid_keyword, start_keyword, stop_keyword, set_keyword, status_keyword, no_keyword, dump_keyword
+};
+
+#define TYPES (sizeof(type_keywords) / sizeof(type_keywords[0]))
+
+static const char speed_flag[] PROGMEM = SPEED_FLAG;
+static const char profile_flag[] PROGMEM = PROFILE_FLAG;
+static const char memory_flag[] PROGMEM = MEMORY_FLAG;
+static const char eeprom_flag[] PROGMEM = EEPROM_FLAG;
+static const char temp_flag[] PROGMEM = TEMP_FLAG;
+static const char spark_flag[] PROGMEM = SPARK_FLAG;
+static const char fuel_flag[] PROGMEM = FUEL_FLAG;
+
+static bool keyword_end(char c){
+    return c == ' ' || c == '\n' || c == '\0';
+}
 
-        i++;
-    }
-    kws[k][j] = '\0';
+/* Returns the length of the keyword at the start of s */
+static size_t keyword_length(const char* s){
+    size_t n = 0;
+    while(!keyword_end(s[n])) n++;
+    return n;
+}
+
+/* Returns the start of the keyword after the one at the start of s */
+static const char* next_keyword(const char* s){
+    s += keyword_length(s);
+    while(*s == ' ') s++;
+    return s;
+}
+
+/* Whether the n characters at s are a keyword held in flash */
+static bool is_keyword(const char* s, size_t n, PGM_P keyword){
+    return n > 0 && n == strlen_P(keyword) && !strncmp_P(s, keyword, n);
 }
 
-char get_type(keywords k){
-    if(!strcmp(k[0], START_KEYWORD)){
-        return START_CODE;
-    } else if(!strcmp(k[0], STOP_KEYWORD)){
-        return STOP_CODE;
-    } else if(!strcmp(k[0], SET_KEYWORD)){
-        return SET_CODE;
-    } else if(!strcmp(k[0], STATUS_KEYWORD)){
-        return STATUS_CODE;
+static int get_type(const char* s, size_t n){
+    for(uint8_t code = 1; code < TYPES; code++){
+        if(is_keyword(s, n, (PGM_P) pgm_read_ptr(&(type_keywords[code])))) return code;
     }
 
     return INVALID_CODE;
 }
 
-int get_flag_index(keywords k, char* flag){
-    for(size_t i = 1; i < MAX_KEYWORDS - 1; i++){
-        if(!strcmp(k[i], flag)) return i;
-    }
+static int get_flag_value(const char* s){
+    long v = strtol(s, NULL, 0);
+    return v != 0 && v < INT16_MAX ? (int) v : -1;
+}
 
-    return -1;
+static int get_temp_value(const char* s){
+    char* end;
+    long v = strtol(s, &end, 10);
+    return end != s && keyword_end(*end) && v > INT8_MIN && v < INT8_MAX ? (int) v : NOT_GIVEN;
 }
 
-int get_flag_value(keywords k, char* flag){
-    int i = get_flag_index(k, SPEED_FLAG);
+/*
+    Reads an angle in degrees, with up to three decimal places, in
+    1/256 of a degree. An angle too large for 16 bits or not a number
+    is BAD_ANGLE.
+*/
+static int16_t get_angle_value(const char* s){
+    bool negative = *s == '-';
+    if(negative) s++;
+
+    // In thousandths of a degree
+    int32_t v = 0;
+    int32_t scale = 1000;
+    bool digits = false, point = false;
+
+    for(; !keyword_end(*s); s++){
+        if(*s == '.' && !point){
+            point = true;
+        } else if(*s >= '0' && *s <= '9' && v < 128000L){
+            if(point){
+                if(scale == 1) continue;
+                scale /= 10;
+            } else {
+                v *= 10;
+            }
 
-    if(i == -1) return -1;
-    
-    long v = strtol(k[i + 1], NULL, 0);
-    return v != 0 && v < INT16_MAX ? (int) v : -1;
+            v += (*s - '0') * (point ? scale : 1000);
+            digits = true;
+        } else {
+            return BAD_ANGLE;
+        }
+    }
+
+    if(!digits || v >= 128000L) return BAD_ANGLE;
+
+    int16_t angle = (int16_t) ((v * 256 + 500) / 1000);
+    return negative ? -angle : angle;
 }
 
 instr get_instruction(const char* message){
     if(!message) return INVALID_INSTR;
 
-    keywords kws;
-
-    get_message_keywords(message, kws);
+    instr i = INVALID_INSTR;
+
+    const char* k = message;
+    while(*k == ' ') k++;
+
+    i.type = get_type(k, keyword_length(k));
+
+    bool speed_given = false;
+
+    for(k = next_keyword(k); *k != '\n' && *k != '\0'; k = next_keyword(k)){
+        size_t n = keyword_length(k);
+
+        // The speed is the keyword after the first speed flag
+        if(is_keyword(k, n, speed_flag)){
+            if(!speed_given) i.speed = get_flag_value(next_keyword(k));
+            speed_given = true;
+        } else if(is_keyword(k, n, profile_flag)){
+            i.profile = true;
+        } else if(is_keyword(k, n, memory_flag)){
+            i.memory = true;
+        } else if(is_keyword(k, n, eeprom_flag)){
+            i.eeprom = true;
+        } else if(is_keyword(k, n, temp_flag)){
+            i.temp = get_temp_value(next_keyword(k));
+        } else if(is_keyword(k, n, spark_flag)){
+            i.spark = get_angle_value(next_keyword(k));
+        } else if(is_keyword(k, n, fuel_flag)){
+            i.fuel = get_angle_value(next_keyword(k));
+        }
+    }
 
-    return (instr) {
-        .type = get_type(kws),
-        .speed = get_flag_value(kws, SPEED_FLAG),
-    };
+    return i;
 }
 
 void get_instruction_message(instr* i, char message[150]){
-    char type_name[10] = INVALID_KEYWORD;
-    char speed_string[50] = "not given";
-
-    switch(i->type){
-        case START_CODE:
-            sprintf(type_name, START_KEYWORD);
-            break;
-        case STOP_CODE:
-            sprintf(type_name, STOP_KEYWORD);
-            break;
-        case SET_CODE:
-            sprintf(type_name, SET_KEYWORD);
-            break;
-        case STATUS_CODE:
-            sprintf(type_name, STATUS_KEYWORD);
-    }
+    int type = i->type >= 0 && i->type < (int) TYPES ? i->type : INVALID_CODE;
+
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    put_P(&f, PSTR("\nnew instruction:\n    type: "));
+    put_P(&f, (PGM_P) pgm_read_ptr(&(type_keywords[type])));
+    put_P(&f, PSTR("\n    speed: "));
 
     if(i->type == SET_CODE && i->speed != -1){
-        sprintf(speed_string, "%i rpm", i->speed);
+        put_int(&f, i->speed);
+        put_P(&f, PSTR(" rpm\n"));
+    } else {
+        put_P(&f, PSTR("not given\n"));
     }
 
-    sprintf(message, "\nnew instruction:\n    type: %s\n    speed: %s\n", 
-        type_name, speed_string);
-}
\ No newline at end of file
+    if(i->type != SET_CODE) return;
+
+    if(i->temp != NOT_GIVEN){
+        put_P(&f, PSTR("    temp: "));
+        put_int(&f, i->temp);
+        put_P(&f, PSTR(" deg C\n"));
+    }
+
+    if(i->spark != NOT_GIVEN){
+        put_P(&f, PSTR("    spark: "));
+        put_fixed(&f, i->spark, 8, 2);
+        put_P(&f, PSTR(" deg\n"));
+    }
+
+    if(i->fuel != NOT_GIVEN){
+        put_P(&f, PSTR("    fuel: "));
+        put_fixed(&f, i->fuel, 8, 2);
+        put_P(&f, PSTR(" deg\n"));
+    }
+}
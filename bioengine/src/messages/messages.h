@@ -8,18 +8,27 @@
     #include "../control_system/control_system.h"
 
     #define SPEED_FLAG          "--RPM"
+    #define PROFILE_FLAG        "--PROFILE"
+    #define MEMORY_FLAG         "--MEM"
+    #define EEPROM_FLAG         "--EEPROM"
+    #define TEMP_FLAG           "--TEMP"
+    #define SPARK_FLAG          "--SPARK"
+    #define FUEL_FLAG           "--FUEL"
 
     #define INVALID_KEYWORD     "INVALID"
     #define START_KEYWORD       "START"
     #define STOP_KEYWORD        "STOP"
     #define SET_KEYWORD         "SET"
     #define STATUS_KEYWORD      "STATUS"
+    #define DUMP_KEYWORD        "DUMP"
 
     #define INVALID_CODE        0x00
     #define START_CODE          0x01
     #define STOP_CODE           0x02
     #define SET_CODE            0x03
     #define STATUS_CODE         0x04
+    // 0x05 is the PARAM frame, which has no text command
+    #define DUMP_CODE           0x06
 
     #ifdef __cplusplus
     extern "C" {
@@ -28,17 +37,35 @@
     #define MAX_KEYWORDS        10
     #define MAX_KEYWORD_LENGTH  15
 
+    // Size of the buffer messages are read into, which replies are also written to
     #define MESSAGE_SIZE (MAX_KEYWORDS * MAX_KEYWORD_LENGTH)
 
-    typedef char keywords[MAX_KEYWORDS][MAX_KEYWORD_LENGTH + 1];
+    // The value of a temperature or angle flag that was not given, and of an angle that could not be read
+    #define NOT_GIVEN           INT16_MIN
+    #define BAD_ANGLE           INT16_MAX
 
     typedef struct instr {
         int type;
         int speed;
+        // Whether STATUS should give the loop profile or the memory usage instead
+        bool profile;
+        bool memory;
+        // Whether DUMP should send the snapshot in the EEPROM instead of the flight log
+        bool eeprom;
+        // The temperature in deg C of the cell of the map SET writes, and its spark and fuel angles in 1/256 of a degree
+        int temp;
+        int16_t spark;
+        int16_t fuel;
     } instr;
 
-    #define INVALID_INSTR ((instr) {INVALID_CODE, -1})
+    #define INVALID_INSTR ((instr) {INVALID_CODE, -1, false, false, false, NOT_GIVEN, NOT_GIVEN, NOT_GIVEN})
 
+    /*
+        Method to read an instruction from a message of keywords 
+        separated by spaces and ended by a line ending. The keywords 
+        are compared where they lie in the message, against names held
+        in flash, rather than copied out.
+    */
     instr get_instruction(const char* message);
 
     void get_instruction_message(instr* i, char message[150]);
@@ -0,0 +1,91 @@
+#include "profiler.h"
+
+static const char serial_name[] PROGMEM = "serial";
+static const char pulses_name[] PROGMEM = "pulses";
+static const char timings_name[] PROGMEM = "timings";
+static const char temperature_name[] PROGMEM = "temperature";
+static const char actuation_name[] PROGMEM = "actuation";
+static const char loop_name[] PROGMEM = "loop";
+
+static const char* const stage_names[PROFILE_STAGES] PROGMEM = {
+    serial_name, pulses_name, timings_name, temperature_name, actuation_name, loop_name
+};
+
+void init_profiler(profiler* pf){
+    for(uint8_t i = 0; i < PROFILE_STAGES; i++){
+        stage_profile* sp = &(pf->stages[i]);
+
+        for(uint8_t k = 0; k < PROFILE_BUCKETS; k++) sp->buckets[k] = 0;
+
+        sp->count = 0;
+        sp->min = UINT32_MAX;
+        sp->max = 0;
+    }
+
+    pf->held = false;
+}
+
+uint32_t profile_stage(profiler* pf, uint8_t stage, uint32_t start, uint32_t end){
+    if(pf->held) return end;
+
+    stage_profile* sp = &(pf->stages[stage]);
+    uint32_t ticks = end - start;
+
+    uint8_t k = 0;
+    while(k < PROFILE_BUCKETS - 1 && (ticks >> (k + 1))) k++;
+
+    if(sp->buckets[k] != UINT16_MAX) sp->buckets[k]++;
+
+    sp->count++;
+    if(ticks < sp->min) sp->min = ticks;
+    if(ticks > sp->max) sp->max = ticks;
+
+    return end;
+}
+
+/* Appends a time in ticks as microseconds, to the half */
+static void put_ticks(formatter* f, uint32_t ticks){
+    put_uint(f, ticks >> 1);
+    if(ticks & 1) put_P(f, PSTR(".5"));
+}
+
+void get_profile_info(profiler* pf, uint8_t stage, char message[150]){
+    stage_profile* sp = &(pf->stages[stage]);
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    put_P(&f, PSTR("    "));
+    put_P(&f, (PGM_P) pgm_read_ptr(&(stage_names[stage])));
+    put_P(&f, PSTR(": "));
+    put_uint(&f, sp->count);
+
+    if(sp->count){
+        put_P(&f, PSTR(", "));
+        put_ticks(&f, sp->min);
+        put_char(&f, '-');
+        put_ticks(&f, sp->max);
+        put_P(&f, PSTR(" us,"));
+
+        // Each bucket by the time it is below in us, 2^(k + 1) ticks
+        for(uint8_t k = 0; k < PROFILE_BUCKETS; k++){
+            if(!sp->buckets[k]) continue;
+
+            // Room for the longest bucket and the end of the message
+            if(f.length > 150 - 16){
+                put_P(&f, PSTR(" ..."));
+                break;
+            }
+
+            if(k == PROFILE_BUCKETS - 1){
+                put_P(&f, PSTR(" >"));
+                put_uint(&f, 1UL << (k - 1));
+            } else {
+                put_P(&f, PSTR(" <"));
+                put_uint(&f, 1UL << k);
+            }
+
+            put_char(&f, ':');
+            put_uint(&f, sp->buckets[k]);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef PROFILER_H
+    #define PROFILER_H
+
+    #include <Arduino.h>
+    #include <stdio.h>
+    #include <avr/pgmspace.h>
+
+    // Library containing the text formatter
+    #include "../formatter/formatter.h"
+
+    /*
+        Timing histograms of the stages of the loop.
+
+        The loop reads the timer at the end of each stage it profiles, 
+        and the time since the last reading is added to the histogram of
+        the stage, so every probe costs a single reading of the timer. 
+        Times are in timer ticks of 0.5 us, and each histogram counts
+        them in buckets of powers of 2: bucket k holds the times from 
+        2^k up to 2^(k + 1) ticks, except that bucket 0 also holds 0 and
+        the last bucket every time longer than it.
+
+        On the board, a probe takes roughly 100 cycles (about 6 us): the
+        reading of the 32 bit count under ATOMIC_BLOCK, the search for 
+        the bucket and the update of the counts.
+
+        The histograms are held as they are while they are printed, a
+        stage per pass of the loop, so that every line covers the same
+        passes.
+    */
+
+    #define STAGE_SERIAL        0
+    #define STAGE_PULSES        1
+    #define STAGE_TIMINGS       2
+    #define STAGE_TEMPERATURE   3
+    #define STAGE_ACTUATION     4
+    // The whole pass of the loop, from the first reading to the last
+    #define STAGE_LOOP          5
+
+    #define PROFILE_STAGES      6
+
+    // Bucket 15 holds every time from 2^15 ticks, 16 ms, up
+    #define PROFILE_BUCKETS     16
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct stage_profile {
+        // Counts stop at 65535 rather than wrapping
+        uint16_t buckets[PROFILE_BUCKETS];
+        uint32_t count;
+        uint32_t min, max;
+    } stage_profile;
+
+    typedef struct profiler {
+        stage_profile stages[PROFILE_STAGES];
+        // Whether the probes are left out of the histograms, while they are printed
+        bool held;
+    } profiler;
+
+    /* Method to empty every histogram, and let the probes add to them again. */
+    void init_profiler(profiler* pf);
+
+    /*
+        Method to add the time from start to end, in timer ticks, to the
+        histogram of a stage, unless it is held. Returns end, as the start
+        of the next stage.
+    */
+    uint32_t profile_stage(profiler* pf, uint8_t stage, uint32_t start, uint32_t end);
+
+    /* Method to print the histogram of a stage on one line, with its times in us. */
+    void get_profile_info(profiler* pf, uint8_t stage, char message[150]);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
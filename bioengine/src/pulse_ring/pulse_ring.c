@@ -0,0 +1,87 @@
+#include "pulse_ring.h"
+
+#define MASK (PULSE_RING_SIZE - 1)
+
+// Keeps the compiler from moving the access to a record across the update of an index
+#define BARRIER() __asm__ __volatile__("" ::: "memory")
+
+void init_pulse_ring(pulse_ring* r){
+    r->head = r->tail = 0;
+    r->sequence = 0;
+    r->overruns = 0;
+}
+
+bool push_pulse(pulse_ring* r, uint32_t time, int16_t crank, uint8_t pulses, bool cpg){
+    uint8_t head = r->head;
+    uint8_t next = (head + 1) & MASK;
+
+    r->sequence++;
+
+    if(next == r->tail){
+        r->overruns++;
+        return false;
+    }
+
+    pulse_record* p = &(r->records[head]);
+    p->time = time;
+    p->crank = crank;
+    p->pulses = pulses;
+    p->sequence = r->sequence;
+    p->cpg = cpg;
+
+    BARRIER();
+    r->head = next;
+
+    return true;
+}
+
+bool pop_pulse(pulse_ring* r, pulse_record* p){
+    uint8_t tail = r->tail;
+
+    if(tail == r->head) return false;
+
+    BARRIER();
+    *p = r->records[tail];
+    BARRIER();
+
+    r->tail = (tail + 1) & MASK;
+
+    return true;
+}
+
+void shift_pulse_cranks(pulse_ring* r, int angle){
+    for(uint8_t i = r->tail; i != r->head; i = (i + 1) & MASK){
+        r->records[i].crank = (r->records[i].crank + angle + 720) % 720;
+    }
+}
+
+uint16_t pulse_overruns(pulse_ring* r){
+    uint16_t overruns;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        overruns = r->overruns;
+    }
+
+    return overruns;
+}
+
+bool put_pulse_info(formatter* f, pulse_ring* r, uint8_t line){
+    switch(line){
+        case 0:
+            put_P(f, PSTR("IPG pulses:"));
+            return true;
+        case 1:
+            put_P(f, PSTR("    overruns: "));
+            put_uint(f, pulse_overruns(r));
+            return true;
+    }
+
+    return false;
+}
+
+void get_pulse_info(pulse_ring* r, char message[150]){
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    for(uint8_t line = 0; put_pulse_info(&f, r, line); line++) put_char(&f, '\n');
+}
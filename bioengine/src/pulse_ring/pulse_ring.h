@@ -0,0 +1,83 @@
+#ifndef PULSE_RING_H
+    #define PULSE_RING_H
+
+    #include <Arduino.h>
+    #include <stdio.h>
+    #include <avr/pgmspace.h>
+    #include <util/atomic.h>
+
+    // Library containing the text formatter
+    #include "../formatter/formatter.h"
+
+    /*
+        Single-producer, single-consumer ring of IPG pulse records, 
+        written by the IPG interrupt and read by the loop.
+
+        Each record holds the time, crank angle and pulse count of one
+        pulse as the interrupt saw them together, so the loop never reads
+        a value the interrupt is halfway through writing, and sees every
+        pulse even when a pass of the loop spans several of them.
+
+        Only the interrupt writes the head and only the loop writes the
+        tail, and both are single bytes, so neither side has to disable
+        interrupts. A pulse that arrives while the ring is full is 
+        dropped and counted as an overrun.
+    */
+
+    // Number of records, a power of 2
+    #define PULSE_RING_SIZE     8
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct pulse_record {
+        // The time of the pulse in timer ticks, latched by the input capture unit
+        uint32_t time;
+        // The crank angle after the pulse in degrees
+        int16_t crank;
+        // The IPG pulses since the last CPG pulse, including this one
+        uint8_t pulses;
+        // Counts every pulse, so a gap shows one was dropped
+        uint8_t sequence;
+        // Whether the CPG was high at the pulse
+        bool cpg;
+    } pulse_record;
+
+    typedef struct pulse_ring {
+        pulse_record records[PULSE_RING_SIZE];
+        volatile uint8_t head, tail;
+        uint8_t sequence;
+        volatile uint16_t overruns;
+    } pulse_ring;
+
+    void init_pulse_ring(pulse_ring* r);
+
+    /*
+        Method called by the IPG interrupt to add a pulse, which is given
+        the next sequence number. Returns false if it was dropped.
+    */
+    bool push_pulse(pulse_ring* r, uint32_t time, int16_t crank, uint8_t pulses, bool cpg);
+
+    /* Method to take the oldest pulse. Returns false if there is none. */
+    bool pop_pulse(pulse_ring* r, pulse_record* p);
+
+    /*
+        Method to add an angle to the crank of every pulse still in the
+        ring, when the crank angle has been corrected after they were 
+        recorded. Must be called with interrupts disabled.
+    */
+    void shift_pulse_cranks(pulse_ring* r, int angle);
+
+    uint16_t pulse_overruns(pulse_ring* r);
+
+    /* As put_engine_info, for the pulses the ring has lost. */
+    bool put_pulse_info(formatter* f, pulse_ring* r, uint8_t line);
+
+    void get_pulse_info(pulse_ring* r, char message[150]);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -0,0 +1,190 @@
+#include "scheduler.h"
+
+#define NEXT(i) (((i) + 1) & (SCHEDULE_SIZE - 1))
+
+void init_scheduler(scheduler* s){
+    s->head = 0;
+    s->tail = 0;
+    s->next_segment = -1;
+    s->dropped = 0;
+
+    TIMSK1 &= ~_BV(OCIE1A);
+}
+
+void cancel_actuations(scheduler* s){
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        TIMSK1 &= ~_BV(OCIE1A);
+        s->head = s->tail;
+        s->next_segment = -1;
+    }
+}
+
+void run_actuations(scheduler* s, timer* tm){
+    port_batch b;
+    init_port_batch(&b);
+
+    for(;;){
+        uint32_t now = timer_ticks(tm);
+
+        // Edges due together are written with one write per port
+        while(s->head != s->tail && TICK_REACHED(now, s->queue[s->head].at)){
+            const actuation* a = &(s->queue[s->head]);
+            batch_write(&b, a->reg, a->mask, a->close);
+            s->head = NEXT(s->head);
+        }
+
+        commit_port_batch(&b);
+
+        if(s->head == s->tail){
+            TIMSK1 &= ~_BV(OCIE1A);
+            return;
+        }
+
+        uint32_t at = s->queue[s->head].at;
+
+        if(at - now > MAX_COMPARE_TICKS){
+            // Wake part of the way there and arm again
+            OCR1A = (uint16_t) (now + MAX_COMPARE_TICKS);
+            TIMSK1 |= _BV(OCIE1A);
+            return;
+        }
+
+        OCR1A = (uint16_t) at;
+        TIMSK1 |= _BV(OCIE1A);
+
+        // If the count passed the edge while the unit was being armed, the match was missed
+        if(!TICK_REACHED(timer_ticks(tm), at)) return;
+    }
+}
+
+/* Queues an edge, or returns false if the queue is full. */
+static bool enqueue(scheduler* s, const action_table* a, const table_edge* edge, uint32_t at){
+    if(NEXT(s->tail) == s->head) return false;
+
+    actuation* q = &(s->queue[s->tail]);
+
+    q->at = at;
+    q->reg = a->ports[edge->port];
+    q->mask = edge->mask;
+    q->close = edge->close;
+
+    s->tail = NEXT(s->tail);
+
+    return true;
+}
+
+/* Empties the queue and opens every output of the table, once an edge has been dropped. */
+static void drop_actuations(scheduler* s, const action_table* a){
+    TIMSK1 &= ~_BV(OCIE1A);
+    s->head = s->tail;
+    s->dropped++;
+
+    port_batch b;
+    init_port_batch(&b);
+
+    for(uint8_t p = 0; p < a->port_count; p++){
+        batch_write(&b, a->ports[p], a->managed[p], false);
+    }
+
+    commit_port_batch(&b);
+}
+
+/*
+    The fraction of the time through a segment at which a fraction of its
+    angle is reached, out of 65536. This inverts the mapping of 
+    estimate_angle, u - k * u * (1 - u), to first order in the bend k.
+*/
+static uint16_t time_fraction(uint16_t fraction, int32_t bend){
+    int32_t bow = (int32_t) (((uint32_t) fraction * (65536UL - fraction)) >> 16);
+    int32_t u = fraction + ((bend * bow) >> 16);
+
+    if(u < 0) u = 0;
+    if(u > 0xFFFF) u = 0xFFFF;
+
+    return u;
+}
+
+/*
+    The ticks into a segment of period ticks at which a fraction of the
+    time through it out of 65536 is reached. The period is split in two
+    16 bit halves so that no product overflows 32 bits, however slowly
+    the engine turns.
+*/
+static uint32_t ticks_into(uint32_t period, uint16_t fraction){
+    return (period >> 16) * fraction + (((period & 0xFFFF) * fraction) >> 16);
+}
+
+/*
+    Whether the output of an edge follows the new table in segment k: 
+    segments after the current one are left over from the cycle before
+    the handover began.
+*/
+static bool handed_over(const table_edge* edge, int8_t k, int8_t current){
+    return k <= current && edge->handover <= k;
+}
+
+void schedule_actuations(scheduler* s, timer* tm, const action_table* a, const action_table* before, int crank, uint32_t pulse_tick, uint32_t period, int32_t bend){
+    int8_t current = crank / IPG_PULSE_ANGLE;
+    int8_t k = s->next_segment < 0 ? current : s->next_segment;
+
+    // Edges still queued from earlier segments are behind the crankshaft
+    for(uint8_t i = s->head; i != s->tail; i = NEXT(i)){
+        if(!TICK_REACHED(pulse_tick, s->queue[i].at)) s->queue[i].at = pulse_tick;
+    }
+
+    for(;;){
+        uint8_t i = a->first[k], j = before ? before->first[k] : 0;
+        uint8_t i_end = a->first[k + 1], j_end = before ? before->first[k + 1] : 0;
+
+        for(;;){
+            // Skip the edges of outputs that follow the other table
+            while(before && i < i_end && !handed_over(&(a->edges[i]), k, current)) i++;
+            while(j < j_end && handed_over(&(before->edges[j]), k, current)) j++;
+
+            if(i == i_end && j == j_end) break;
+
+            // Take the earlier edge of the two tables
+            bool take_a = j == j_end || (i < i_end && a->edges[i].fraction <= before->edges[j].fraction);
+            const action_table* from = take_a ? a : before;
+            const table_edge* edge = take_a ? &(a->edges[i++]) : &(before->edges[j++]);
+
+            uint32_t at = k == current 
+                ? pulse_tick + ticks_into(period, time_fraction(edge->fraction, bend))
+                : pulse_tick;
+
+            if(!enqueue(s, from, edge, at)){
+                drop_actuations(s, a);
+                s->next_segment = (current + 1) % SEGMENTS;
+                return;
+            }
+        }
+
+        if(k == current) break;
+        k = (k + 1) % SEGMENTS;
+    }
+
+    s->next_segment = (current + 1) % SEGMENTS;
+
+    run_actuations(s, tm);
+}
+
+bool put_schedule_info(formatter* f, scheduler* s, uint8_t line){
+    switch(line){
+        case 0:
+            put_P(f, PSTR("actuations:"));
+            return true;
+        case 1:
+            put_P(f, PSTR("    dropped: "));
+            put_uint(f, s->dropped);
+            return true;
+    }
+
+    return false;
+}
+
+void get_schedule_info(scheduler* s, char message[150]){
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    for(uint8_t line = 0; put_schedule_info(&f, s, line); line++) put_char(&f, '\n');
+}
@@ -0,0 +1,110 @@
+#ifndef SCHEDULER_H
+    #define SCHEDULER_H
+
+    #include <Arduino.h>
+
+    // Library containing basic methods for opening/closing circuits or measuring pulses
+    #include "../control_system/control_system.h"
+    // Library containing the table of output states by crank angle
+    #include "../action_table/action_table.h"
+    // Library containing the Timer1 time base
+    #include "../timer/timer.h"
+    // Library containing the text formatter
+    #include "../formatter/formatter.h"
+
+    /*
+        The coils and injectors are switched by the Timer1 compare 
+        interrupt rather than by the control loop, so that the error in
+        the angle an edge is placed at depends on the timer rather than
+        on how long the loop takes.
+
+        At each IPG pulse, the interrupt queues the edges of the segment
+        that has just begun from the action table, timed from the pulse
+        using the length of the last segment carried on by the change and
+        bend the speed tracker predicts for the acceleration, and the 
+        fraction of the way through the segment of each edge. The loop 
+        hands the prediction over a pulse ahead (publish_prediction), and
+        if it has fallen behind, the length of the last segment is used
+        as it is. This is integer arithmetic only, and does not
+        wait for the loop. The compare unit is armed for the earliest 
+        queued edge, and its interrupt applies every edge that is due 
+        before re-arming it.
+
+        While a new table is being handed over, each output follows the
+        table it is replaced from until the segment holding the TDC of 
+        its cylinder (see action_table.h), and the edges of both tables
+        are merged in order within each segment.
+
+        Each pulse schedules from where the last left off, so if a pulse
+        is missed, the edges of the skipped segment are applied at once
+        rather than lost. Edges still queued from an earlier segment are
+        also due at once, as the crankshaft has already passed them.
+
+        If an edge finds the queue full, the edges queued can no longer
+        be trusted to close and open each output in turn, so the queue 
+        is emptied and every output of the table is opened. The drop is
+        counted for STATUS, and the next pulse schedules afresh.
+    */
+
+    // Number of edges per engine cycle: an open and close for each coil and injector
+    #define ACTUATIONS_PER_CYCLE    TABLE_EDGES
+
+    // Capacity of the queue, a power of 2
+    #define SCHEDULE_SIZE           32
+
+    // Longest wait the 16 bit compare unit is armed for at once
+    #define MAX_COMPARE_TICKS       0x7FFF
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct actuation {
+        uint32_t at;
+        volatile uint8_t* reg;
+        uint8_t mask;
+        bool close;
+    } actuation;
+
+    typedef struct scheduler {
+        actuation queue[SCHEDULE_SIZE];
+        volatile uint8_t head, tail;
+
+        // The segment the next pulse schedules from, or -1 if none has been scheduled
+        int8_t next_segment;
+
+        // Times an edge found the queue full
+        uint16_t dropped;
+    } scheduler;
+
+    void init_scheduler(scheduler* s);
+
+    /*
+        Method to queue the edges up to the end of the segment beginning
+        at crank, given the time of its IPG pulse, its predicted length 
+        in timer ticks and its bend, as estimate_angle takes it. If a is
+        being handed over, before is the table it replaces, or NULL 
+        otherwise. This is called by the IPG interrupt.
+    */
+    void schedule_actuations(scheduler* s, timer* tm, const action_table* a, const action_table* before, int crank, uint32_t pulse_tick, uint32_t period, int32_t bend);
+
+    /* Method to empty the queue, e.g. before shutting the engine down. */
+    void cancel_actuations(scheduler* s);
+
+    /*
+        Method to apply every queued edge that is due and arm the
+        compare unit for the next. This is called by the Timer1 
+        compare A interrupt.
+    */
+    void run_actuations(scheduler* s, timer* tm);
+
+    /* As put_engine_info, for the edges the queue has dropped. */
+    bool put_schedule_info(formatter* f, scheduler* s, uint8_t line);
+
+    void get_schedule_info(scheduler* s, char message[150]);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
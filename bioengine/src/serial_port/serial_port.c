@@ -0,0 +1,152 @@
+#include "serial_port.h"
+
+#define NEXT(i, size) ((i) + 1 == (size) ? 0 : (i) + 1)
+
+void init_serial_port(serial_port* p, unsigned long baud){
+    p->baud = baud;
+
+    p->tx_head = p->tx_tail = 0;
+    p->rx_head = p->rx_tail = 0;
+
+    p->tx_dropped = 0;
+    p->rx_dropped = 0;
+
+    // Double speed mode, which gives the closer baud rates at 16 MHz
+    UBRR1 = (F_CPU / 4 / baud - 1) / 2;
+    UCSR1A = _BV(U2X1);
+    UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+    UCSR1B = _BV(RXEN1) | _BV(TXEN1) | _BV(RXCIE1);
+}
+
+size_t serial_tx_space(serial_port* p){
+    uint16_t head = p->tx_head, tail;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        tail = p->tx_tail;
+    }
+
+    // One byte is left empty, to tell a full ring from an empty one
+    return tail > head ? tail - head - 1 : SERIAL_TX_SIZE - 1 - (head - tail);
+}
+
+/* Queues a message, from SRAM or from flash, and an ending after it, both or neither */
+static bool queue(serial_port* p, const char* s, size_t n, bool flash, const char* end, size_t m){
+    uint16_t head = p->tx_head;
+
+    if(n + m > serial_tx_space(p)){
+        p->tx_dropped++;
+        return false;
+    }
+
+    for(size_t i = 0; i < n; i++){
+        p->tx[head] = flash ? pgm_read_byte(s + i) : s[i];
+        head = NEXT(head, SERIAL_TX_SIZE);
+    }
+
+    for(size_t i = 0; i < m; i++){
+        p->tx[head] = end[i];
+        head = NEXT(head, SERIAL_TX_SIZE);
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        p->tx_head = head;
+    }
+
+    // The interrupt fires at once if the data register is empty
+    UCSR1B |= _BV(UDRIE1);
+
+    return true;
+}
+
+bool serial_write(serial_port* p, const char* s, size_t n){
+    return queue(p, s, n, false, NULL, 0);
+}
+
+bool serial_print(serial_port* p, const char* s){
+    return queue(p, s, strlen(s), false, NULL, 0);
+}
+
+bool serial_println(serial_port* p, const char* s){
+    return queue(p, s, strlen(s), false, "\r\n", 2);
+}
+
+bool serial_print_P(serial_port* p, PGM_P s){
+    return queue(p, s, strlen_P(s), true, NULL, 0);
+}
+
+bool serial_println_P(serial_port* p, PGM_P s){
+    return queue(p, s, strlen_P(s), true, "\r\n", 2);
+}
+
+int serial_read(serial_port* p){
+    uint8_t tail = p->rx_tail;
+
+    if(tail == p->rx_head) return -1;
+
+    char c = p->rx[tail];
+    p->rx_tail = NEXT(tail, SERIAL_RX_SIZE);
+
+    return (unsigned char) c;
+}
+
+void serial_transmit(serial_port* p){
+    uint16_t tail = p->tx_tail;
+
+    if(tail == p->tx_head){
+        UCSR1B &= ~_BV(UDRIE1);
+        return;
+    }
+
+    UDR1 = (uint8_t) p->tx[tail];
+    p->tx_tail = NEXT(tail, SERIAL_TX_SIZE);
+}
+
+void serial_receive(serial_port* p){
+    // Reading the data register clears the interrupt
+    uint8_t c = UDR1;
+    uint8_t head = p->rx_head;
+    uint8_t next = NEXT(head, SERIAL_RX_SIZE);
+
+    if(next == p->rx_tail){
+        p->rx_dropped++;
+        return;
+    }
+
+    p->rx[head] = c;
+    p->rx_head = next;
+}
+
+bool put_serial_info(formatter* f, serial_port* p, uint8_t line){
+    uint16_t rx_dropped;
+
+    switch(line){
+        case 0:
+            put_P(f, PSTR("serial port:"));
+            return true;
+        case 1:
+            put_P(f, PSTR("    baud: "));
+            put_uint(f, p->baud);
+            put_P(f, PSTR(" Bd"));
+            return true;
+        case 2:
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+                rx_dropped = p->rx_dropped;
+            }
+
+            put_P(f, PSTR("    dropped: "));
+            put_uint(f, p->tx_dropped);
+            put_P(f, PSTR(" sent, "));
+            put_uint(f, rx_dropped);
+            put_P(f, PSTR(" received"));
+            return true;
+    }
+
+    return false;
+}
+
+void get_serial_info(serial_port* p, char message[150]){
+    formatter f;
+    init_formatter(&f, message, 150);
+
+    for(uint8_t line = 0; put_serial_info(&f, p, line); line++) put_char(&f, '\n');
+}
@@ -0,0 +1,89 @@
+#ifndef SERIAL_PORT_H
+    #define SERIAL_PORT_H
+
+    #include <Arduino.h>
+    #include <stdio.h>
+    #include <avr/pgmspace.h>
+    #include <util/atomic.h>
+
+    // Library containing the text formatter
+    #include "../formatter/formatter.h"
+
+    /*
+        Interrupt-driven serial port on USART1, the hardware UART of the
+        board (RX on pin 0, TX on pin 1).
+
+        Messages written from the loop are copied into a transmit ring 
+        and sent byte by byte from the data register empty interrupt, 
+        so that a write never waits on the line. A message that does not
+        fit in the space left in the ring is dropped whole and counted,
+        rather than blocking the loop until it does.
+
+        Received bytes are held in a receive ring by the receive complete
+        interrupt until the loop reads them. Bytes that arrive while it 
+        is full are dropped and counted.
+    */
+
+    // Sizes of the rings in bytes. The transmit ring holds the longest reply (150 bytes) with a line of a report or dump queued behind it
+    #define SERIAL_TX_SIZE      256
+    #define SERIAL_RX_SIZE      64
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct serial_port {
+        unsigned long baud;
+
+        char tx[SERIAL_TX_SIZE];
+        volatile uint16_t tx_head, tx_tail;
+
+        char rx[SERIAL_RX_SIZE];
+        volatile uint8_t rx_head, rx_tail;
+
+        // Messages dropped from the transmit ring and bytes from the receive ring
+        uint16_t tx_dropped;
+        volatile uint16_t rx_dropped;
+    } serial_port;
+
+    /* Sets the baud rate of USART1 and enables it, with 8 data bits, no parity and 1 stop bit. */
+    void init_serial_port(serial_port* p, unsigned long baud);
+
+    /*
+        Method to queue a message for transmission. Either the whole
+        message is queued or, if there is not room for it, none of it
+        is and the drop is counted. Returns true if it was queued.
+    */
+    bool serial_write(serial_port* p, const char* s, size_t n);
+
+    /* Returns the bytes a message can take in the transmit ring now. */
+    size_t serial_tx_space(serial_port* p);
+
+    bool serial_print(serial_port* p, const char* s);
+
+    /* Queues a message followed by a line ending, as a single message. */
+    bool serial_println(serial_port* p, const char* s);
+
+    /* As serial_print and serial_println, for a message held in flash, e.g. with PSTR(). */
+    bool serial_print_P(serial_port* p, PGM_P s);
+    bool serial_println_P(serial_port* p, PGM_P s);
+
+    /* Returns the next received byte, or -1 if there is none. */
+    int serial_read(serial_port* p);
+
+    /* Method called by the USART1 data register empty interrupt. */
+    void serial_transmit(serial_port* p);
+
+    /* Method called by the USART1 receive complete interrupt. */
+    void serial_receive(serial_port* p);
+
+    /* As put_engine_info, for the port. */
+    bool put_serial_info(formatter* f, serial_port* p, uint8_t line);
+
+    void get_serial_info(serial_port* p, char message[150]);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -0,0 +1,85 @@
+#include "speed_tracker.h"
+
+#define NEXT(i) (((i) + 1) & (TRACKER_SIZE - 1))
+
+void init_speed_tracker(speed_tracker* tr){
+    tr->head = 0;
+    tr->count = 0;
+
+    tr->sum = 0;
+    tr->weighted_sum = 0;
+
+    tr->slope = 0;
+    tr->last = 0;
+    tr->next = 0;
+    tr->ahead = 0;
+}
+
+/* Adds an interval to the window, dropping the oldest when it is full, and updates the sums. */
+static void push_interval(speed_tracker* tr, uint16_t interval){
+    if(tr->count < TRACKER_SIZE){
+        tr->intervals[(tr->head + tr->count) & (TRACKER_SIZE - 1)] = interval;
+        tr->weighted_sum += (uint32_t) tr->count * interval;
+        tr->sum += interval;
+        tr->count++;
+        return;
+    }
+
+    uint16_t oldest = tr->intervals[tr->head];
+
+    tr->intervals[tr->head] = interval;
+    tr->head = NEXT(tr->head);
+
+    // Every interval left moves down a place
+    tr->weighted_sum -= tr->sum - oldest;
+    tr->weighted_sum += (uint32_t) (TRACKER_SIZE - 1) * interval;
+    tr->sum += interval;
+    tr->sum -= oldest;
+}
+
+void track_interval(speed_tracker* tr, uint32_t interval){
+    if(interval == 0) return;
+    if(interval > MAX_INTERVAL) interval = MAX_INTERVAL;
+
+    if(tr->count){
+        uint32_t predicted = tr->next >> 8;
+
+        if(interval > 2 * predicted || 2 * interval < predicted){
+            init_speed_tracker(tr);
+        }
+    }
+
+    push_interval(tr, interval);
+
+    int32_t n = tr->count;
+
+    // Least squares slope: (12 * sum(i * x) - 6 * (n - 1) * sum(x)) / (n * (n^2 - 1))
+    if(n >= 3){
+        int32_t num = 12 * (int32_t) tr->weighted_sum - 6 * (n - 1) * (int32_t) tr->sum;
+        int32_t den = n * (n * n - 1);
+
+        // Divided in two steps to keep the 1/256 tick within 32 bits
+        tr->slope = (num / den) * 256 + ((num % den) * 256) / den;
+    } else {
+        tr->slope = 0;
+    }
+
+    int32_t mean = (int32_t) ((tr->sum << 8) / n);
+
+    // The line at the place of the last interval, and one and two places on
+    int32_t last = mean + (tr->slope * (n - 1)) / 2;
+    int32_t next = last + tr->slope;
+    int32_t ahead = next + tr->slope;
+
+    // A fit that predicts an interval less than half the one before is not to be trusted
+    if(next < last / 2) next = last / 2;
+    if(ahead < next / 2) ahead = next / 2;
+
+    last = constrain(last, 256, (int32_t) MAX_INTERVAL << 8);
+    next = constrain(next, 256, (int32_t) MAX_INTERVAL << 8);
+    ahead = constrain(ahead, 256, (int32_t) MAX_INTERVAL << 8);
+
+    tr->last = last;
+    tr->next = next;
+    tr->ahead = ahead;
+}
@@ -0,0 +1,63 @@
+#ifndef SPEED_TRACKER_H
+    #define SPEED_TRACKER_H
+
+    #include <Arduino.h>
+
+    /*
+        Tracks the shaft speed over the last TRACKER_SIZE intervals 
+        between IPG pulses, rather than the last interval alone, so that
+        the error in the timing of a single tooth is averaged out.
+
+        A straight line is fitted through the intervals in the window by
+        least squares, against their pulse number. Its level gives the 
+        speed and its slope the acceleration, as the change in interval
+        per pulse, so a steady change in speed does not make the 
+        estimate lag behind. The sums the fit is made from are kept as
+        the window slides, so each pulse costs the same however large 
+        the window is.
+
+        Intervals are given in ticks of the timer, 0.5 us each, and the
+        fitted intervals are kept in 1/256 of a tick.
+    */
+
+    // Number of intervals in the window, a power of 2
+    #define TRACKER_SIZE    8
+
+    // Longest interval tracked, in ticks (about 33 ms, or 150 RPM); longer intervals are limited to this
+    #define MAX_INTERVAL    0xFFFF
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct speed_tracker {
+        // Ring of the intervals in the window, oldest first from head
+        uint16_t intervals[TRACKER_SIZE];
+        uint8_t head, count;
+
+        // Sum of the intervals, and of each interval times its place in the window
+        uint32_t sum, weighted_sum;
+
+        // Change in interval per pulse, in 1/256 tick
+        int32_t slope;
+
+        // The fitted length of the last interval, and the predicted lengths of the next and the one after it, in 1/256 tick
+        uint32_t last, next, ahead;
+    } speed_tracker;
+
+    /* Method to empty the window. */
+    void init_speed_tracker(speed_tracker* tr);
+
+    /*
+        Method to add the latest interval between IPG pulses to the 
+        window and fit the line again. An interval less than half or 
+        more than double the one predicted, as after a stall, empties 
+        the window first.
+    */
+    void track_interval(speed_tracker* tr, uint32_t interval);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
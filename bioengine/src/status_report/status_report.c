@@ -0,0 +1,56 @@
+#include "status_report.h"
+
+void init_status_report(status_report* r, engine* e, timings* t, serial_port* sp, pulse_ring* pr, crank_sync* cs, scheduler* s){
+    r->e = e;
+    r->t = t;
+    r->sp = sp;
+    r->pr = pr;
+    r->cs = cs;
+    r->s = s;
+
+    r->section = STATUS_SECTIONS;
+    r->line = 0;
+}
+
+void start_status_report(status_report* r){
+    r->section = 0;
+    r->line = 0;
+}
+
+bool status_report_done(status_report* r){
+    return r->section == STATUS_SECTIONS;
+}
+
+/* Appends the next line of the section, or returns false at its end */
+static bool put_status_line(status_report* r, formatter* f){
+    switch(r->section){
+        case 0: return put_engine_info(f, r->e, r->line);
+        case 1: return put_timing_info(f, r->t, r->line);
+        case 2: return put_serial_info(f, r->sp, r->line);
+        case 3: return put_pulse_info(f, r->pr, r->line);
+        case 4: return put_sync_info(f, r->cs, r->line);
+        case 5: return put_schedule_info(f, r->s, r->line);
+    }
+
+    return false;
+}
+
+bool stream_status_report(status_report* r){
+    if(status_report_done(r) || serial_tx_space(r->sp) < STATUS_LINE_SIZE) return false;
+
+    char line[STATUS_LINE_SIZE];
+    formatter f;
+    init_formatter(&f, line, STATUS_LINE_SIZE);
+
+    if(put_status_line(r, &f)){
+        put_char(&f, '\n');
+        r->line++;
+    } else {
+        // Each section ends as serial_println ended the block it was sent in
+        put_P(&f, PSTR("\r\n"));
+        r->section++;
+        r->line = 0;
+    }
+
+    return serial_write(r->sp, line, f.length);
+}
@@ -0,0 +1,73 @@
+#ifndef STATUS_REPORT_H
+    #define STATUS_REPORT_H
+
+    #include <Arduino.h>
+    #include <stdio.h>
+    #include <avr/pgmspace.h>
+
+    // Library containing basic methods for opening/closing circuits or measuring pulses
+    #include "../control_system/control_system.h"
+    // Library containing methods for evaluating the correct spark/fuel timings
+    #include "../engine_map/engine_map.h"
+    // Library containing the interrupt-driven serial port
+    #include "../serial_port/serial_port.h"
+    // Library containing the ring of IPG pulses handed from the interrupt to the loop
+    #include "../pulse_ring/pulse_ring.h"
+    // Library containing the state machine placing the crank angle from the CPG pulses
+    #include "../crank_sync/crank_sync.h"
+    // Library containing the queue of coil/injector edges switched by the Timer1 compare interrupt
+    #include "../scheduler/scheduler.h"
+
+    /*
+        The reply to STATUS, streamed to the serial port a line at a
+        time across passes of the loop rather than formatted and queued
+        whole in one pass.
+
+        Each pass sends at most one line, and only once the transmit
+        ring has room for the longest, so the cost of a pass is bounded
+        by that of formatting one line. Each line is read from the
+        engine as it is sent. The sections of the report are the same
+        as the blocks the reply was sent in, and so are the bytes sent.
+    */
+
+    // Bytes of the longest line with its ending and '\0'
+    #define STATUS_LINE_SIZE    48
+
+    // Engine, timings, serial port, IPG pulses, crank sync and actuations
+    #define STATUS_SECTIONS     6
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct status_report {
+        engine* e;
+        timings* t;
+        serial_port* sp;
+        pulse_ring* pr;
+        crank_sync* cs;
+        scheduler* s;
+
+        // The line to send next, and its section, which is STATUS_SECTIONS once the report is sent
+        uint8_t section, line;
+    } status_report;
+
+    void init_status_report(status_report* r, engine* e, timings* t, serial_port* sp, pulse_ring* pr, crank_sync* cs, scheduler* s);
+
+    /* Method to start the report over from the first line. */
+    void start_status_report(status_report* r);
+
+    bool status_report_done(status_report* r);
+
+    /*
+        Method called on every pass of the loop to send the next line of
+        the report, if one is left and the transmit ring has room for
+        it. Returns true if a line was sent.
+    */
+    bool stream_status_report(status_report* r);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -0,0 +1,47 @@
+#include "thermistor.h"
+
+/* Temperature in 1/16 deg C at every 16 ADC counts */
+const int16_t thermistor_table[THERMISTOR_ENTRIES] PROGMEM = {
+    -1003,  -794,  -635,  -515,  -424,  -355,  -302,  -260,
+     -224,  -193,  -164,  -136,  -107,   -78,   -48,   -17,
+       15,    47,    78,   109,   139,   168,   195,   220,
+      244,   266,   286,   304,   322,   338,   355,   371,
+      387,   405,   424,   444,   466,   490,   516,   545,
+      576,   609,   643,   679,   716,   753,   791,   828,
+      865,   900,   935,   970,  1005,  1042,  1082,  1128,
+     1184,  1255,  1345,  1463,  1616,  1817,  2077,  2413,
+     2841
+};
+
+int16_t thermistor_temperature(uint16_t count){
+    if(count >= THERMISTOR_COUNTS) count = THERMISTOR_COUNTS - 1;
+
+    uint8_t i = count >> THERMISTOR_COUNT_BITS;
+    uint8_t fraction = count & (THERMISTOR_COUNT_STEP - 1);
+
+    int16_t low = pgm_read_word(&(thermistor_table[i]));
+    int16_t high = pgm_read_word(&(thermistor_table[i + 1]));
+
+    return low + (((high - low) * fraction) >> THERMISTOR_COUNT_BITS);
+}
+
+int16_t thermistor_temperature_fine(uint16_t count, uint8_t fraction_bits){
+    uint8_t shift = THERMISTOR_COUNT_BITS + fraction_bits;
+    uint16_t top = (uint16_t) THERMISTOR_COUNTS << fraction_bits;
+
+    if(count >= top) count = top - 1;
+
+    uint8_t i = count >> shift;
+    uint8_t fraction = count & ((1 << shift) - 1);
+
+    int16_t low = pgm_read_word(&(thermistor_table[i]));
+    int16_t high = pgm_read_word(&(thermistor_table[i + 1]));
+
+    // The widest step of the table, 428, times a fraction below 64 still fits in an int
+    return low + (((high - low) * fraction) >> shift);
+}
+
+int adc_to_temperature(uint16_t count){
+    int16_t t = thermistor_temperature(count);
+    return (t + (1 << (THERMISTOR_SCALE_BITS - 1))) >> THERMISTOR_SCALE_BITS;
+}
@@ -0,0 +1,55 @@
+#ifndef THERMISTOR_H
+    #define THERMISTOR_H
+
+    #include <Arduino.h>
+    #include <avr/pgmspace.h>
+
+    /*
+        Conversion of the ADC count of the thermistor potential divider
+        to the internal temperature of the control system.
+
+        The thermistor curve is tabulated in flash at every 
+        THERMISTOR_COUNT_STEP counts, and the table is indexed directly 
+        by the top bits of the count and interpolated with the bottom 
+        bits, in integer arithmetic.
+
+        The table is generated from the polynomial fit of the thermistor
+        datasheet by tests/host_build/tools/thermistor_tables.cpp, and 
+        should be regenerated rather than edited.
+    */
+
+    // Number of ADC counts
+    #define THERMISTOR_COUNTS       1024
+
+    // ADC counts between entries of the table, a power of 2
+    #define THERMISTOR_COUNT_BITS   4
+    #define THERMISTOR_COUNT_STEP   (1 << THERMISTOR_COUNT_BITS)
+
+    #define THERMISTOR_ENTRIES      (THERMISTOR_COUNTS / THERMISTOR_COUNT_STEP + 1)
+
+    // Temperatures in the table are held in 1/16 deg C
+    #define THERMISTOR_SCALE_BITS   4
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    extern const int16_t thermistor_table[THERMISTOR_ENTRIES] PROGMEM;
+
+    /* Method to return the temperature in 1/16 deg C at an ADC count. */
+    int16_t thermistor_temperature(uint16_t count);
+
+    /*
+        Method to return the temperature in 1/16 deg C at an oversampled
+        count, with fraction_bits below a count, up to 2.
+    */
+    int16_t thermistor_temperature_fine(uint16_t count, uint8_t fraction_bits);
+
+    /* Method to return the temperature in deg C at an ADC count, to the nearest degree. */
+    int adc_to_temperature(uint16_t count);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -0,0 +1,47 @@
+#include "timer.h"
+
+void init_timer(timer* tm){
+    tm->overflows = 0;
+
+    TCCR1A = 0;
+    TCCR1B = _BV(CS11);
+    TIMSK1 |= _BV(TOIE1);
+}
+
+void timer_overflow(timer* tm){
+    tm->overflows++;
+}
+
+uint32_t timer_ticks(timer* tm){
+    uint16_t count, high;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        count = TCNT1;
+        high = tm->overflows;
+
+        // The counter has wrapped but the overflow has not been serviced yet
+        if((TIFR1 & _BV(TOV1)) && count < 0x8000) high++;
+    }
+
+    return ((uint32_t) high << 16) | count;
+}
+
+void init_capture(void){
+    TCCR1B |= _BV(ICNC1) | _BV(ICES1);
+    TIFR1 = _BV(ICF1);
+    TIMSK1 |= _BV(ICIE1);
+}
+
+uint32_t timer_capture(timer* tm){
+    uint16_t count = ICR1;
+    uint16_t high = tm->overflows;
+
+    /*
+        The capture interrupt runs before a pending overflow, so the count
+        may have wrapped since the overflows were counted. A capture from
+        the low half of the count was made after the wrap.
+    */
+    if((TIFR1 & _BV(TOV1)) && count < 0x8000) high++;
+
+    return ((uint32_t) high << 16) | count;
+}
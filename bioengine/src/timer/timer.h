@@ -0,0 +1,61 @@
+#ifndef TIMER_H
+    #define TIMER_H
+
+    #include <Arduino.h>
+    #include <util/atomic.h>
+
+    /*
+        Timer1 is run freely at F_CPU / 8, giving a count every 0.5 us,
+        and extended to 32 bits by counting its overflows. The 32 bit
+        count wraps roughly every 35 minutes, so times are compared 
+        with signed differences.
+
+        Timer1 is used as the time base for scheduling the coils and
+        injectors, whose edges are placed with its compare unit, and 
+        for timestamping the IPG signal, whose rising edges are latched
+        by its input capture unit on ICP1 (pin D4). The capture holds 
+        the count at the edge itself, to the half microsecond, however
+        long the interrupt takes to be serviced.
+    */
+
+    #define TIMER_PRESCALER     8
+    #define TICKS_PER_US        (F_CPU / TIMER_PRESCALER / 1000000UL)
+
+    // True if tick a is at or after tick b
+    #define TICK_REACHED(a, b)  ((int32_t) ((a) - (b)) >= 0)
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct timer {
+        volatile uint16_t overflows;
+    } timer;
+
+    /* Starts Timer1 in normal mode with the overflow interrupt enabled. */
+    void init_timer(timer* tm);
+
+    /* Method called by the Timer1 overflow interrupt. */
+    void timer_overflow(timer* tm);
+
+    /* Returns the current 32 bit count of the timer. */
+    uint32_t timer_ticks(timer* tm);
+
+    /* 
+        Starts capturing the count on every rising edge of ICP1, with 
+        the noise canceller and the capture interrupt enabled. 
+    */
+    void init_capture(void);
+
+    /*
+        Method called by the capture interrupt. Returns the 32 bit count
+        of the timer at the captured edge, extended with the overflows
+        counted up to it.
+    */
+    uint32_t timer_capture(timer* tm);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -2,6 +2,11 @@
 #include <SoftwareSerial.h>
 
 #include "src/messages/messages.h"
+#include "src/thermistor/thermistor.h"
+#include "src/waveform/waveform.h"
+
+// Step the CPG/IPG from loop() by polling micros() instead of from Timer3
+//#define POLLED_WAVEFORM
 
 #define IPG_HIGH_ANGLE 15
 
@@ -15,17 +20,10 @@
 #define CPG_PIN 12
 #define IPG_PIN 13
 
-#define THERMISTOR_VOLTAGE(T) \
-    - (2 * pow(10, -12) * pow(T, 6)) \
-    + (6 * pow(10, -10) * pow(T, 5)) \
-    - (3 * pow(10, -8) * pow(T, 4)) \
-    - (6 * pow(10, -6) * pow(T, 3)) \
-    + (4 * pow(10, -4) * pow(T, 2)) \
-    + (0.0462 * T) + 1.1977
-
-#define SUPPLY ((double) 5.0)
+// Supply voltage in millivolts
+#define SUPPLY 5000UL
 
-const int cpg_pulse_angles[3] = {0, 60, 360};
+const unsigned int cpg_pulse_angles[3] = {0, 60, 360};
 
 size_t buffer = 0;
 char message[MESSAGE_SIZE];
@@ -39,9 +37,18 @@ unsigned long pulse_width = 0;
 
 bool is_running = false;
 
+#ifdef POLLED_WAVEFORM
 unsigned long counter;
 
 unsigned long last_pulse = micros();
+#else
+// The CPG/IPG waveform, stepped by the Timer3 compare interrupt
+waveform w;
+
+ISR(TIMER3_COMPA_vect){
+    step_waveform(&w);
+}
+#endif
 
 char pin_state(int address){
     return (REGISTER >> address) & 1;
@@ -56,8 +63,7 @@ void close_circuit(int address){
 }
 
 void set_temperature_pwm(void){
-    double temp_supply_ratio = (THERMISTOR_VOLTAGE((double) temp)) / 5.0;
-    int temp_pwm = temp_supply_ratio * 255;
+    int temp_pwm = temperature_to_millivolts(temp) * 255UL / SUPPLY;
 
     analogWrite(TEMP_PIN, temp_pwm);
 }
@@ -67,7 +73,11 @@ void start_simulation(void){
     if(temp > 0 && speed > 0){
         angle = 0;
         is_running = true;
+        #ifdef POLLED_WAVEFORM
         counter = micros();
+        #else
+        start_waveform(&w);
+        #endif
         set_temperature_pwm();
     } else {
         Serial.println("Temperature and/or speed have not been set!\n");
@@ -79,6 +89,10 @@ void start_simulation(void){
 void stop_simulation(void){
     Serial.println("Stopping simulation.\n");
 
+    #ifndef POLLED_WAVEFORM
+    stop_waveform(&w);
+    #endif
+
     open_circuit(TEMP_ADDRESS);
     open_circuit(CPG_ADDRESS);
     open_circuit(IPG_ADDRESS);
@@ -88,9 +102,16 @@ void stop_simulation(void){
 
 void set_simulation(instr* i){
     if(i->speed > 0){
+        #ifdef POLLED_WAVEFORM
         speed = i->speed;
         uint32_t pulses_per_second = (speed / 60) * (360 / IPG_HIGH_ANGLE);
         pulse_width = pow(10, 6) / pulses_per_second;   
+        #else
+        set_waveform_speed(&w, i->speed, i->ramp > 0 ? i->ramp : 0);
+        speed = w.target;
+        // The step at the target, rounded to the microsecond
+        pulse_width = (WAVEFORM_STEP_PRODUCT / ((uint32_t) speed << WAVEFORM_PERIOD_BITS) + 16) >> (WAVEFORM_PERIOD_BITS + 1);
+        #endif
     }
 
     if(i->temp > 0){
@@ -102,13 +123,19 @@ void set_simulation(instr* i){
 }
 
 void print_simulator_info(char* message){
-    float voltage = THERMISTOR_VOLTAGE((double) temp);
-    int voltage_integer = (int) voltage;
-    int voltage_decimal = (voltage - voltage_integer) * 10;
+    uint16_t voltage = temperature_to_millivolts(temp);
+    int voltage_integer = voltage / 1000;
+    int voltage_decimal = (voltage % 1000) / 100;
+
+    #ifdef POLLED_WAVEFORM
+    unsigned int speed_now = speed;
+    #else
+    unsigned int speed_now = waveform_speed(&w);
+    #endif
 
     sprintf(message, 
-        "simulator info:\n    is running: %s\n    temp: %u deg C (~%i.%i V)\n    speed: %u RPM\n    pulse width: %lu us\n",
-        is_running ? "true" : "false", temp, voltage_integer, voltage_decimal, speed, pulse_width);
+        "simulator info:\n    is running: %s\n    temp: %u deg C (~%i.%i V)\n    speed: %u RPM (now %u)\n    pulse width: %lu us\n",
+        is_running ? "true" : "false", temp, voltage_integer, voltage_decimal, speed, speed_now, pulse_width);
 }
 
 void setup(void){
@@ -119,6 +146,10 @@ void setup(void){
     pinMode(CPG_PIN, OUTPUT);
     pinMode(IPG_PIN, OUTPUT);
 
+    #ifndef POLLED_WAVEFORM
+    init_waveform(&w, &REGISTER, IPG_ADDRESS, CPG_ADDRESS);
+    #endif
+
     Serial.println("Setup successful.\n");
 }
 
@@ -161,6 +192,7 @@ void loop(void){
         message_available = false;
     }
 
+    #ifdef POLLED_WAVEFORM
     if(is_running && micros() - counter > pulse_width){
         counter = micros();
 
@@ -185,4 +217,5 @@ void loop(void){
             open_circuit(IPG_ADDRESS);
         }
     }
+    #endif
 }
\ No newline at end of file
@@ -62,7 +62,8 @@ instr get_instruction(const char* message){
     return (instr) {
         .type = get_type(kws),
         .speed = get_flag_value(kws, SPEED_FLAG),
-        .temp = get_flag_value(kws, TEMP_FLAG)
+        .temp = get_flag_value(kws, TEMP_FLAG),
+        .ramp = get_flag_value(kws, RAMP_FLAG)
     };
 }
 
@@ -70,6 +71,7 @@ void get_instruction_message(instr* i, char message[150]){
     char type_name[10] = INVALID_KEYWORD;
     char speed_string[50] = "not given";
     char temp_string[50] = "not given";
+    char ramp_string[50] = "at once";
 
     switch(i->type){
         case START_CODE:
@@ -93,6 +95,10 @@ void get_instruction_message(instr* i, char message[150]){
         sprintf(temp_string, "%i deg C", i->temp);
     }
 
-    sprintf(message, "\nnew instruction:\n    type: %s\n    speed: %s\n    temp: %s\n", 
-        type_name, speed_string, temp_string);
+    if(i->type == SET_CODE && i->ramp != -1){
+        sprintf(ramp_string, "%i RPM/s", i->ramp);
+    }
+
+    sprintf(message, "\nnew instruction:\n    type: %s\n    speed: %s\n    temp: %s\n    ramp: %s\n", 
+        type_name, speed_string, temp_string, ramp_string);
 }
\ No newline at end of file
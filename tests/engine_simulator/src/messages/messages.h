@@ -7,6 +7,7 @@
 
     #define TEMP_FLAG           "--TEMP"
     #define SPEED_FLAG          "--SPEED"
+    #define RAMP_FLAG           "--RAMP"
 
     #define INVALID_KEYWORD     "INVALID"
     #define START_KEYWORD       "START"
@@ -34,9 +35,11 @@
     typedef struct instr {
         char type;
         int speed, temp;
+        // RPM a second the speed is moved at, or -1 to move it at once
+        int ramp;
     } instr;
 
-    #define INVALID_INSTR ((instr) {INVALID_CODE, -1, -1})
+    #define INVALID_INSTR ((instr) {INVALID_CODE, -1, -1, -1})
 
     instr get_instruction(const char* message);
 
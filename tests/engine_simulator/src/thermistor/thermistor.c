@@ -0,0 +1,23 @@
+#include "thermistor.h"
+
+/* Divider voltage in millivolts at every 4 deg C from 0 deg C */
+const uint16_t thermistor_millivolts[THERMISTOR_TEMPS] PROGMEM = {
+    1213, 1371, 1533, 1710, 1918, 2179, 2484, 2750,
+    2956, 3126, 3275, 3413, 3546, 3681, 3819, 3962,
+    4103, 4229, 4332, 4412, 4477, 4531, 4576, 4615,
+    4649, 4680, 4708, 4733, 4757, 4779, 4799
+};
+
+uint16_t temperature_to_millivolts(unsigned int temp){
+    if(temp >= THERMISTOR_MAX_TEMP){
+        return pgm_read_word(&(thermistor_millivolts[THERMISTOR_TEMPS - 1]));
+    }
+
+    uint8_t i = temp / THERMISTOR_TEMP_STEP;
+    uint8_t fraction = temp % THERMISTOR_TEMP_STEP;
+
+    uint16_t low = pgm_read_word(&(thermistor_millivolts[i]));
+    uint16_t high = pgm_read_word(&(thermistor_millivolts[i + 1]));
+
+    return low + ((uint32_t) (high - low) * fraction + THERMISTOR_TEMP_STEP / 2) / THERMISTOR_TEMP_STEP;
+}
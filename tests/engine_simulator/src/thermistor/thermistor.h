@@ -0,0 +1,35 @@
+#ifndef ENGINE_SIMULATOR_THERMISTOR_H
+    #define ENGINE_SIMULATOR_THERMISTOR_H
+
+    #include <Arduino.h>
+    #include <avr/pgmspace.h>
+
+    /*
+        Voltage of the thermistor potential divider of the control system
+        by temperature, tabulated in flash every THERMISTOR_TEMP_STEP deg C.
+
+        The table is the inverse of the curve the control system converts
+        the voltage back with, generated by 
+        tests/host_build/tools/thermistor_tables.cpp, so that a simulated 
+        temperature reads back as the same temperature.
+    */
+
+    #define THERMISTOR_TEMP_STEP    4
+    #define THERMISTOR_TEMPS        31
+
+    #define THERMISTOR_MAX_TEMP     ((THERMISTOR_TEMPS - 1) * THERMISTOR_TEMP_STEP)
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    extern const uint16_t thermistor_millivolts[THERMISTOR_TEMPS] PROGMEM;
+
+    /* Method to return the divider voltage in millivolts at a temperature in deg C. */
+    uint16_t temperature_to_millivolts(unsigned int temp);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
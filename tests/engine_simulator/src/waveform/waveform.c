@@ -0,0 +1,125 @@
+#include "waveform.h"
+
+static const int cpg_pulse_angles[3] = {0, 60, 360};
+
+#define FRACTION_MASK ((1 << WAVEFORM_PERIOD_BITS) - 1)
+
+/* The period of a step at a speed in 1/65536 RPM */
+static uint32_t step_period(uint32_t speed){
+    return WAVEFORM_STEP_PRODUCT / (speed >> (16 - WAVEFORM_PERIOD_BITS));
+}
+
+void init_waveform(waveform* w, volatile uint8_t* port, uint8_t ipg_bit, uint8_t cpg_bit){
+    w->port = port;
+    w->mask = _BV(ipg_bit) | _BV(cpg_bit);
+
+    for(uint8_t i = 0; i < WAVEFORM_STEPS; i++){
+        int angle = i * WAVEFORM_STEP_ANGLE;
+        uint8_t level = 0;
+
+        if(angle % (2 * WAVEFORM_STEP_ANGLE) == 0) level |= _BV(ipg_bit);
+
+        for(uint8_t k = 0; k < 3; k++){
+            if(angle == cpg_pulse_angles[k]) level |= _BV(cpg_bit);
+        }
+
+        w->levels[i] = level;
+    }
+
+    w->step = 0;
+    w->target = WAVEFORM_MIN_SPEED;
+    w->speed = (uint32_t) WAVEFORM_MIN_SPEED << 16;
+    w->ramp = 0;
+    w->period = step_period(w->speed);
+    w->carry = 0;
+    w->running = false;
+}
+
+void start_waveform(waveform* w){
+    TIMSK3 &= ~_BV(OCIE3A);
+
+    w->step = 0;
+    w->carry = 0;
+
+    // The speed is not ramped from that of the last run
+    w->speed = (uint32_t) w->target << 16;
+    w->ramp = 0;
+    w->period = step_period(w->speed);
+
+    TCCR3A = 0;
+    TCCR3B = _BV(CS31);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        OCR3A = TCNT3 + (uint16_t) (w->period >> WAVEFORM_PERIOD_BITS);
+        TIFR3 = _BV(OCF3A);
+        TIMSK3 |= _BV(OCIE3A);
+    }
+
+    w->running = true;
+}
+
+void stop_waveform(waveform* w){
+    TIMSK3 &= ~_BV(OCIE3A);
+    w->running = false;
+
+    *(w->port) &= ~(w->mask);
+}
+
+void set_waveform_speed(waveform* w, unsigned int speed, unsigned int rate){
+    speed = constrain(speed, WAVEFORM_MIN_SPEED, WAVEFORM_MAX_SPEED);
+    if(rate > WAVEFORM_MAX_RAMP) rate = WAVEFORM_MAX_RAMP;
+
+    // RPM a second over counts a second, in 1/2^24 RPM
+    uint32_t ramp = ((uint32_t) rate << 16) / (WAVEFORM_TICKS_PER_SECOND >> 8);
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        w->target = speed;
+
+        if(w->running && ramp){
+            w->ramp = ramp;
+        } else {
+            w->speed = (uint32_t) speed << 16;
+            w->ramp = 0;
+            w->period = step_period(w->speed);
+        }
+    }
+}
+
+unsigned int waveform_speed(waveform* w){
+    uint32_t speed;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+        speed = w->speed;
+    }
+
+    return (speed + 0x8000) >> 16;
+}
+
+/* Moves the speed towards the target by the ramp over the step just scheduled */
+static void ramp_waveform(waveform* w){
+    uint32_t target = (uint32_t) w->target << 16;
+    uint32_t change = (w->ramp * (w->period >> WAVEFORM_PERIOD_BITS)) >> 8;
+
+    if(w->speed < target){
+        w->speed = target - w->speed > change ? w->speed + change : target;
+    } else {
+        w->speed = w->speed - target > change ? w->speed - change : target;
+    }
+
+    if(w->speed == target) w->ramp = 0;
+
+    w->period = step_period(w->speed);
+}
+
+void step_waveform(waveform* w){
+    // The edge first, so that it lies the same time after the match whatever follows
+    *(w->port) = (*(w->port) & ~(w->mask)) | w->levels[w->step];
+
+    if(++(w->step) == WAVEFORM_STEPS) w->step = 0;
+
+    uint32_t period = w->period + w->carry;
+    OCR3A += (uint16_t) (period >> WAVEFORM_PERIOD_BITS);
+    w->carry = period & FRACTION_MASK;
+
+    if(w->ramp) ramp_waveform(w);
+}
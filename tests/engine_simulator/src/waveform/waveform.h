@@ -0,0 +1,100 @@
+#ifndef ENGINE_SIMULATOR_WAVEFORM_H
+    #define ENGINE_SIMULATOR_WAVEFORM_H
+
+    #include <Arduino.h>
+    #include <util/atomic.h>
+
+    /*
+        The CPG and IPG signals of the engine, written to their port by
+        the Timer3 compare A interrupt walking a table of the levels of
+        both at every 15 degrees of a 720 degree cycle.
+
+        Timer3 runs freely at F_CPU / 8, a count every 0.5 us. Each
+        interrupt writes the levels of the next step before anything
+        else, so every edge lies the same few cycles after its match
+        however long the loop spends on the serial port, then moves the
+        match on by the period of a step. The period is held in 1/16 of
+        a count and the fraction carried from step to step, so the speed
+        is kept to the fraction rather than the whole count.
+
+        A ramp moves the speed towards its target by the rate times the
+        period of every step, and the period of the next step is found
+        from the new speed, so the speed changes tooth by tooth. That
+        takes a division in the interrupt while ramping, which must end
+        before the next match: the step at WAVEFORM_MAX_SPEED is 125 us.
+        The step at WAVEFORM_MIN_SPEED is the most the 16 bit match can
+        be moved by.
+    */
+
+    #define WAVEFORM_STEP_ANGLE     15
+    #define WAVEFORM_STEPS          (720 / WAVEFORM_STEP_ANGLE)
+
+    #define WAVEFORM_TICKS_PER_SECOND (F_CPU / 8)
+
+    // Bits of the period below a count
+    #define WAVEFORM_PERIOD_BITS    4
+
+    // The period of a step in 1/16 counts times the speed in 1/16 RPM
+    #define WAVEFORM_STEP_PRODUCT   ((60UL * WAVEFORM_TICKS_PER_SECOND / (360 / WAVEFORM_STEP_ANGLE)) << (2 * WAVEFORM_PERIOD_BITS))
+
+    // Speeds in RPM, and the fastest ramp in RPM a second
+    #define WAVEFORM_MIN_SPEED      100
+    #define WAVEFORM_MAX_SPEED      20000
+    #define WAVEFORM_MAX_RAMP       10000
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    typedef struct waveform {
+        volatile uint8_t* port;
+        // The bits of the port the signals are on, and their levels at each step
+        uint8_t mask;
+        uint8_t levels[WAVEFORM_STEPS];
+        // The step written next
+        uint8_t step;
+
+        // The speed in 1/65536 RPM, and the speed ramped towards in RPM
+        uint32_t speed;
+        uint16_t target;
+        // The change of the speed every timer count of a ramp in 1/2^24 RPM, 0 once the target is reached
+        uint32_t ramp;
+
+        // The period of a step in 1/16 counts, and the fraction of a count carried from the last
+        uint32_t period;
+        uint8_t carry;
+
+        volatile bool running;
+    } waveform;
+
+    /*
+        Fills the table with the levels of the IPG, high every 30 degrees,
+        and the CPG, high with it at 0, 60 and 360 degrees, on the bits
+        of a port.
+    */
+    void init_waveform(waveform* w, volatile uint8_t* port, uint8_t ipg_bit, uint8_t cpg_bit);
+
+    /* Starts Timer3 and the signals at 0 degrees, a step from now. */
+    void start_waveform(waveform* w);
+
+    /* Stops the signals and leaves both low. */
+    void stop_waveform(waveform* w);
+
+    /*
+        Sets the speed in RPM, moved to at a rate in RPM a second while
+        running, or at once if the rate is 0. Both are held to their
+        limits.
+    */
+    void set_waveform_speed(waveform* w, unsigned int speed, unsigned int rate);
+
+    /* Returns the speed of the signals in RPM, which lags the target while ramping. */
+    unsigned int waveform_speed(waveform* w);
+
+    /* Method called by the Timer3 compare A interrupt. */
+    void step_waveform(waveform* w);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
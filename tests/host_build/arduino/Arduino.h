@@ -0,0 +1,139 @@
+#ifndef HOST_ARDUINO_H
+    #define HOST_ARDUINO_H
+
+    /*
+        Host stand-in for the Arduino core, used to build the control
+        system natively on Linux/gcc.
+
+        Only the parts of the core used by the sketches are provided.
+        Time is virtual: it is measured in CPU cycles of a 16 MHz
+        ATmega32u4 and only moves forward when the harness advances it
+        (see host.h), or when a call that blocks on real hardware
+        (Serial, analogRead, delay) would have taken time.
+    */
+
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+    #include <stdlib.h>
+    #include <string.h>
+    #include <stdio.h>
+    #include <math.h>
+
+    #include <avr/io.h>
+    #include <avr/interrupt.h>
+    #include <avr/pgmspace.h>
+
+    #define F_CPU           16000000UL
+
+    #define HIGH            1
+    #define LOW             0
+
+    #define INPUT           0
+    #define OUTPUT          1
+    #define INPUT_PULLUP    2
+
+    #define CHANGE          1
+    #define FALLING         2
+    #define RISING          3
+
+    #define DEC             10
+    #define HEX             16
+
+    #define NOT_AN_INTERRUPT -1
+
+    /* Analog pin numbering of the Arduino Micro */
+    #define A0              18
+    #define A1              19
+    #define A2              20
+    #define A3              21
+    #define A4              22
+    #define A5              23
+
+    #define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+    #define digitalPinToInterrupt(p) \
+        ((p) == 3 ? 0 : (p) == 2 ? 1 : (p) == 0 ? 2 : (p) == 1 ? 3 : (p) == 7 ? 4 : NOT_AN_INTERRUPT)
+
+    #define EXTERNAL_NUM_INTERRUPTS 5
+
+    typedef uint8_t byte;
+    typedef bool boolean;
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    unsigned long micros(void);
+    unsigned long millis(void);
+    void delay(unsigned long ms);
+    void delayMicroseconds(unsigned int us);
+
+    void pinMode(uint8_t pin, uint8_t mode);
+    void digitalWrite(uint8_t pin, uint8_t value);
+    int digitalRead(uint8_t pin);
+
+    int analogRead(uint8_t pin);
+    void analogWrite(uint8_t pin, int value);
+
+    void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode);
+    void detachInterrupt(uint8_t interrupt);
+
+    void interrupts(void);
+    void noInterrupts(void);
+
+    #define sei() interrupts()
+    #define cli() noInterrupts()
+
+    // Start of the heap in the model of SRAM, declared by stdlib.h on the board
+    extern char* __malloc_heap_start;
+
+    #ifdef __cplusplus
+    }
+
+    /*
+        Serial port model. Output is captured for the harness and costs
+        virtual time: bytes leave the transmit buffer at the configured
+        baud rate, and a write to a full buffer blocks (while interrupts
+        continue to be serviced), as it would on the board.
+    */
+    class host_serial {
+        public:
+            void begin(unsigned long baud);
+            void end(void);
+
+            int available(void);
+            int read(void);
+            int peek(void);
+
+            int availableForWrite(void);
+            void flush(void);
+
+            size_t write(uint8_t c);
+            size_t write(const uint8_t* buffer, size_t size);
+            size_t write(const char* s);
+
+            size_t print(const char* s);
+            size_t print(char c);
+            size_t print(int n, int base = DEC);
+            size_t print(unsigned int n, int base = DEC);
+            size_t print(long n, int base = DEC);
+            size_t print(unsigned long n, int base = DEC);
+            size_t print(double n, int digits = 2);
+
+            size_t println(void);
+            size_t println(const char* s);
+            size_t println(char c);
+            size_t println(int n, int base = DEC);
+            size_t println(unsigned int n, int base = DEC);
+            size_t println(long n, int base = DEC);
+            size_t println(unsigned long n, int base = DEC);
+            size_t println(double n, int digits = 2);
+
+            operator bool() { return true; }
+    };
+
+    extern host_serial Serial;
+    #endif
+
+#endif
@@ -0,0 +1,7 @@
+#ifndef HOST_SOFTWARE_SERIAL_H
+    #define HOST_SOFTWARE_SERIAL_H
+
+    /* Included by the sketches but not used by them. */
+    #include <Arduino.h>
+
+#endif
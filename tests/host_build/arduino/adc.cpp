@@ -0,0 +1,175 @@
+/*
+    Model of the ADC: a conversion of the channel selected by ADMUX and
+    MUX5 in ADCSRB takes 13 ADC clocks at the prescaler set in ADCSRA,
+    or 25 for the first after it is enabled, and then writes the result
+    to ADC and raises the conversion complete interrupt if it is
+    enabled. In free running mode (ADATE set, ADTS = 0) the next
+    conversion starts as each finishes, so ADSC stays set.
+
+    Each conversion samples the level of its analog input, which may
+    lie between counts, with Gaussian noise added and the result
+    rounded and limited to 10 bits, so oversampling the input gains
+    the resolution it would on the board. analogRead converts through
+    the same model, without touching the registers.
+
+    Only the channels of the Arduino Micro's analog pins are connected;
+    any other converts as ground. Conversions started by ADSC are seen
+    when the model is next polled. The flag ADIF is the model's own,
+    restored whenever it is polled, and is cleared when the vector
+    returns, so writing it has no effect.
+*/
+#include "host.h"
+
+#include <random>
+
+volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0, DIDR2;
+volatile uint16_t ADC;
+
+#define ANALOG_INPUTS       6
+
+// Clocks of a conversion, and of the first after the ADC is enabled
+#define CONVERSION_CLOCKS   13
+#define FIRST_CLOCKS        25
+
+static double levels[ANALOG_INPUTS];
+static double noise;
+static std::mt19937 noise_source;
+static unsigned long conversions;
+
+/* The analog input A0-A5 of each channel ADC0-ADC7, or -1 */
+static const int channel_inputs[8] = {5, 4, -1, -1, 3, 2, 1, 0};
+
+/* Samples an analog input as a single conversion would. */
+int host_adc_convert(uint8_t input){
+    conversions++;
+
+    if(input >= ANALOG_INPUTS) return 0;
+
+    double v = levels[input];
+    if(noise > 0) v += std::normal_distribution<double>(0, noise)(noise_source);
+
+    long count = lround(v);
+    return count < 0 ? 0 : count > 1023 ? 1023 : (int) count;
+}
+
+static uint64_t clock_cycles(void){
+    uint8_t ps = ADCSRA & 0x07;
+    return ps ? 1ULL << ps : 2;
+}
+
+class adc : public host_peripheral {
+    public:
+        // Whether the ADC was enabled when last polled, and whether a conversion is running and when it ends
+        bool enabled;
+        bool converting;
+        uint64_t done_at;
+
+        // Whether the conversion complete flag is raised, and its interrupt requested but not run
+        bool flag;
+        bool requested;
+
+        void reset(void){
+            enabled = false;
+            converting = false;
+            done_at = 0;
+            flag = false;
+            requested = false;
+        }
+
+        void poll(void){
+            ADCSRA = (ADCSRA & ~_BV(ADIF)) | (flag ? _BV(ADIF) : 0);
+
+            bool first = !enabled;
+            enabled = ADCSRA & _BV(ADEN);
+
+            if(!enabled){
+                converting = false;
+                ADCSRA &= ~_BV(ADSC);
+            } else if(!converting && (ADCSRA & _BV(ADSC))){
+                converting = true;
+                done_at = host_cycles() + (first ? FIRST_CLOCKS : CONVERSION_CLOCKS) * clock_cycles();
+            }
+        }
+
+        uint64_t next_event(void){
+            poll();
+
+            uint64_t next = converting ? done_at : HOST_NEVER;
+            if(flag && !requested && (ADCSRA & _BV(ADIE))) next = host_cycles();
+
+            return next;
+        }
+
+        void fire(uint64_t now);
+};
+
+static adc a;
+
+static void conversion_vector(void){
+    a.requested = false;
+    a.flag = false;
+    if(ADC_vect) ADC_vect();
+    a.poll();
+}
+
+void adc::fire(uint64_t now){
+    if(converting && done_at <= now){
+        uint8_t channel = (ADMUX & 0x07) | ((ADCSRB & _BV(MUX5)) ? 8 : 0);
+        int input = channel < 8 ? channel_inputs[channel] : -1;
+
+        ADC = input < 0 ? 0 : host_adc_convert(input);
+        flag = true;
+
+        if((ADCSRA & _BV(ADATE)) && !(ADCSRB & 0x0F)){
+            done_at = now + CONVERSION_CLOCKS * clock_cycles();
+        } else {
+            converting = false;
+            ADCSRA &= ~_BV(ADSC);
+        }
+
+        ADCSRA |= _BV(ADIF);
+    }
+
+    if(flag && !requested && (ADCSRA & _BV(ADIE))){
+        requested = true;
+        host_request_isr(conversion_vector);
+    }
+}
+
+host_peripheral* host_adc_reset(void){
+    ADMUX = 0;
+    ADCSRA = 0;
+    ADCSRB = 0;
+    DIDR0 = 0;
+    DIDR2 = 0;
+    ADC = 0;
+
+    for(size_t i = 0; i < ANALOG_INPUTS; i++){
+        levels[i] = 0;
+    }
+
+    noise = 0;
+    noise_source.seed(1);
+    conversions = 0;
+
+    a.reset();
+
+    return &a;
+}
+
+void host_set_analog(uint8_t pin, int value){
+    host_set_analog_level(pin, value);
+}
+
+void host_set_analog_level(uint8_t pin, double count){
+    if(pin >= A0) pin -= A0;
+    if(pin < ANALOG_INPUTS) levels[pin] = count;
+}
+
+void host_set_adc_noise(double rms){
+    noise = rms;
+}
+
+unsigned long host_adc_conversions(void){
+    return conversions;
+}
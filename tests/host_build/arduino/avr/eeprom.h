@@ -0,0 +1,43 @@
+#ifndef HOST_AVR_EEPROM_H
+    #define HOST_AVR_EEPROM_H
+
+    /*
+        The 1 KB EEPROM of the ATmega32u4, kept by the host across
+        resets of the virtual board (see host.h), with addresses given
+        as pointers from 0, as avr-libc takes them.
+
+        A byte takes EEPROM_WRITE_CYCLES to write, as on the board, and
+        the write runs on in the background. A read or a write started
+        before the last write has finished waits for it, moving the
+        clock on, as avr-libc does, so eeprom_is_ready() tells whether
+        either would block.
+    */
+
+    #include <stdint.h>
+    #include <stdbool.h>
+    #include <stddef.h>
+
+    #define E2END               0x3FF
+
+    // 3.4 ms per byte, erase and write, at 16 MHz
+    #define EEPROM_WRITE_CYCLES (34UL * 1600)
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    bool eeprom_is_ready(void);
+
+    uint8_t eeprom_read_byte(const uint8_t* p);
+    void eeprom_read_block(void* dst, const void* src, size_t n);
+
+    void eeprom_write_byte(uint8_t* p, uint8_t value);
+
+    /* Writes a byte only if it differs from the one held, which takes no time otherwise. */
+    void eeprom_update_byte(uint8_t* p, uint8_t value);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef HOST_AVR_INTERRUPT_H
+    #define HOST_AVR_INTERRUPT_H
+
+    /*
+        Interrupt vectors are ordinary functions on the host. Those
+        defined by a sketch with ISR() are called by the peripheral
+        models when their interrupt is enabled and its flag is raised.
+    */
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    void TIMER1_COMPA_vect(void) __attribute__((weak));
+    void TIMER1_COMPB_vect(void) __attribute__((weak));
+    void TIMER1_COMPC_vect(void) __attribute__((weak));
+    void TIMER1_OVF_vect(void) __attribute__((weak));
+    void TIMER1_CAPT_vect(void) __attribute__((weak));
+
+    void TIMER3_COMPA_vect(void) __attribute__((weak));
+    void TIMER3_COMPB_vect(void) __attribute__((weak));
+    void TIMER3_COMPC_vect(void) __attribute__((weak));
+    void TIMER3_OVF_vect(void) __attribute__((weak));
+
+    void USART1_RX_vect(void) __attribute__((weak));
+    void USART1_UDRE_vect(void) __attribute__((weak));
+
+    void ADC_vect(void) __attribute__((weak));
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+    #define ISR(vector, ...) void vector(void)
+
+#endif
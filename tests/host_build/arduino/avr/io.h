@@ -0,0 +1,167 @@
+#ifndef HOST_AVR_IO_H
+    #define HOST_AVR_IO_H
+
+    /*
+        Registers of the ATmega32u4 used by the sketches.
+
+        TCNT1 reads the count of Timer1 from the virtual clock, so
+        writes to it are ignored. Timer1 counts from cycle 0 at the
+        prescaler currently selected in TCCR1B. TCNT3 and Timer3 are
+        the same.
+
+        UDR1 is wider than on the board, so that the USART1 model can 
+        tell a byte written to it from one it has left there to be read
+        (see usart1.cpp). A byte written must be cast to uint8_t.
+
+        ADC holds the whole result, as ADCW does on the board, and is
+        written by the ADC model at the end of each conversion.
+    */
+
+    #include <stdint.h>
+
+    #define _BV(bit) (1 << (bit))
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    /* I/O ports */
+    extern volatile uint8_t PINB, PORTB, DDRB;
+    extern volatile uint8_t PINC, PORTC, DDRC;
+    extern volatile uint8_t PIND, PORTD, DDRD;
+    extern volatile uint8_t PINE, PORTE, DDRE;
+    extern volatile uint8_t PINF, PORTF, DDRF;
+
+    /* Timer/Counter1 */
+    extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C;
+    extern volatile uint8_t TIMSK1, TIFR1;
+    extern volatile uint16_t OCR1A, OCR1B, OCR1C, ICR1;
+
+    volatile uint16_t* host_timer1_count(void);
+
+    #define TCNT1 (*host_timer1_count())
+
+    /* Timer/Counter3, as Timer1 without its input capture */
+    extern volatile uint8_t TCCR3A, TCCR3B, TCCR3C;
+    extern volatile uint8_t TIMSK3, TIFR3;
+    extern volatile uint16_t OCR3A, OCR3B, OCR3C;
+
+    volatile uint16_t* host_timer3_count(void);
+
+    #define TCNT3 (*host_timer3_count())
+
+    /* USART1 */
+    extern volatile uint8_t UCSR1A, UCSR1B, UCSR1C;
+    extern volatile uint16_t UBRR1;
+
+    volatile uint16_t* host_usart1_data(void);
+
+    #define UDR1 (*host_usart1_data())
+
+    /* ADC */
+    extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0, DIDR2;
+    extern volatile uint16_t ADC;
+
+    #define ADCW ADC
+
+    /*
+        SRAM. The host keeps a model of the 2.5 KB of SRAM of the board,
+        from RAMSTART to RAMEND, laid out as the board's: the data and
+        bss of the sketch, then the heap from __malloc_heap_start, then
+        free memory, then the stack, growing down from RAMEND to SP. 
+        The sketch's own variables live on the host, so the model only
+        holds the layout and what is written into it (see host.h).
+    */
+    extern uint8_t host_sram[];
+
+    #define RAMSTART ((uintptr_t) host_sram + 0x100)
+    #define RAMEND   ((uintptr_t) host_sram + 0xAFF)
+
+    uint8_t* host_stack_pointer(void);
+
+    #define SP ((uintptr_t) host_stack_pointer())
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+    /* TCCR1B */
+    #define CS10    0
+    #define CS11    1
+    #define CS12    2
+    #define WGM12   3
+    #define WGM13   4
+    #define ICES1   6
+    #define ICNC1   7
+
+    /* TIMSK1 */
+    #define TOIE1   0
+    #define OCIE1A  1
+    #define OCIE1B  2
+    #define OCIE1C  3
+    #define ICIE1   5
+
+    /* TIFR1 */
+    #define TOV1    0
+    #define OCF1A   1
+    #define OCF1B   2
+    #define OCF1C   3
+    #define ICF1    5
+
+    /* TCCR3B */
+    #define CS30    0
+    #define CS31    1
+    #define CS32    2
+
+    /* TIMSK3 */
+    #define TOIE3   0
+    #define OCIE3A  1
+    #define OCIE3B  2
+    #define OCIE3C  3
+
+    /* TIFR3 */
+    #define TOV3    0
+    #define OCF3A   1
+    #define OCF3B   2
+    #define OCF3C   3
+
+    /* UCSR1A */
+    #define U2X1    1
+    #define DOR1    3
+    #define UDRE1   5
+    #define TXC1    6
+    #define RXC1    7
+
+    /* UCSR1B */
+    #define TXEN1   3
+    #define RXEN1   4
+    #define UDRIE1  5
+    #define TXCIE1  6
+    #define RXCIE1  7
+
+    /* UCSR1C */
+    #define UCSZ10  1
+    #define UCSZ11  2
+
+    /* ADMUX */
+    #define MUX0    0
+    #define ADLAR   5
+    #define REFS0   6
+    #define REFS1   7
+
+    /* ADCSRA */
+    #define ADPS0   0
+    #define ADPS1   1
+    #define ADPS2   2
+    #define ADIE    3
+    #define ADIF    4
+    #define ADATE   5
+    #define ADSC    6
+    #define ADEN    7
+
+    /* ADCSRB */
+    #define ADTS0   0
+    #define MUX5    5
+    #define ADHSM   7
+
+#endif
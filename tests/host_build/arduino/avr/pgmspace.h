@@ -0,0 +1,34 @@
+#ifndef HOST_AVR_PGMSPACE_H
+    #define HOST_AVR_PGMSPACE_H
+
+    /*
+        The host has a single address space, so data placed in flash
+        with PROGMEM is ordinary constant data, read directly, and the
+        _P functions are the ordinary ones.
+    */
+
+    #include <stdint.h>
+    #include <stdio.h>
+    #include <string.h>
+
+    #define PROGMEM
+
+    #define PSTR(s)                 (s)
+
+    typedef const char* PGM_P;
+
+    #define pgm_read_byte(addr)     (*(const uint8_t*) (addr))
+    #define pgm_read_word(addr)     (*(const uint16_t*) (addr))
+    #define pgm_read_dword(addr)    (*(const uint32_t*) (addr))
+    #define pgm_read_ptr(addr)      (*(const void* const*) (addr))
+
+    #define strlen_P                strlen
+    #define strcpy_P                strcpy
+    #define strcat_P                strcat
+    #define strcmp_P                strcmp
+    #define strncmp_P               strncmp
+    #define memcpy_P                memcpy
+    #define sprintf_P               sprintf
+    #define snprintf_P              snprintf
+
+#endif
@@ -0,0 +1,76 @@
+/*
+    Model of the EEPROM of the ATmega32u4. Its contents outlive
+    host_reset, as they outlive a reset of the board, and are only
+    cleared by host_eeprom_erase.
+*/
+#include "host.h"
+
+#include <avr/eeprom.h>
+
+static uint8_t host_eeprom[E2END + 1];
+
+// The cycle the write in progress finishes at
+static uint64_t ready_at = 0;
+
+// Bytes written since the EEPROM was last erased
+static unsigned long writes = 0;
+
+static bool erased = false;
+
+void host_eeprom_erase(void){
+    memset(host_eeprom, 0xFF, sizeof(host_eeprom));
+    ready_at = 0;
+    writes = 0;
+    erased = true;
+}
+
+void host_eeprom_reset(void){
+    // An erased part reads 0xFF, which is how a board is shipped
+    if(!erased) host_eeprom_erase();
+
+    // A write cut short by the reset is taken to have finished
+    ready_at = 0;
+}
+
+unsigned long host_eeprom_writes(void){
+    return writes;
+}
+
+/* Waits for the write in progress, as avr-libc does before touching the EEPROM */
+static void wait_ready(void){
+    if(host_cycles() < ready_at) host_run_until(ready_at);
+}
+
+static size_t address(const void* p){
+    return (uintptr_t) p & E2END;
+}
+
+extern "C" {
+
+bool eeprom_is_ready(void){
+    return host_cycles() >= ready_at;
+}
+
+uint8_t eeprom_read_byte(const uint8_t* p){
+    wait_ready();
+    return host_eeprom[address(p)];
+}
+
+void eeprom_read_block(void* dst, const void* src, size_t n){
+    wait_ready();
+    for(size_t i = 0; i < n; i++) ((uint8_t*) dst)[i] = host_eeprom[address((const uint8_t*) src + i)];
+}
+
+void eeprom_write_byte(uint8_t* p, uint8_t value){
+    wait_ready();
+
+    host_eeprom[address(p)] = value;
+    ready_at = host_cycles() + EEPROM_WRITE_CYCLES;
+    writes++;
+}
+
+void eeprom_update_byte(uint8_t* p, uint8_t value){
+    if(eeprom_read_byte(p) != value) eeprom_write_byte(p, value);
+}
+
+}
@@ -0,0 +1,461 @@
+#include "host.h"
+
+#include <util/atomic.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#define SERIAL_TX_BUFFER_SIZE   64
+
+// 13 ADC clocks at the 125 kHz ADC clock used by the Arduino core
+#define ANALOG_READ_CYCLES      (13 * 128)
+
+volatile uint8_t PINB, PORTB, DDRB;
+volatile uint8_t PINC, PORTC, DDRC;
+volatile uint8_t PIND, PORTD, DDRD;
+volatile uint8_t PINE, PORTE, DDRE;
+volatile uint8_t PINF, PORTF, DDRF;
+
+host_serial Serial;
+
+/* Timer1, Timer3 and USART1, defined in timer1.cpp, timer3.cpp and usart1.cpp */
+host_peripheral* host_timer1_reset(void);
+host_peripheral* host_timer3_reset(void);
+host_peripheral* host_usart1_reset(void);
+
+/* The ADC and its analog inputs, defined in adc.cpp */
+host_peripheral* host_adc_reset(void);
+int host_adc_convert(uint8_t input);
+
+/* The model of SRAM, defined in sram.cpp */
+void host_sram_reset(void);
+
+/* The model of EEPROM, defined in eeprom.cpp */
+void host_eeprom_reset(void);
+
+static uint64_t now = 0;
+
+static std::vector<host_peripheral*> peripherals;
+
+static void (*external_isrs[EXTERNAL_NUM_INTERRUPTS])(void);
+
+static bool interrupts_enabled = true;
+static std::vector<void (*)(void)> pending_isrs;
+static void (*isr_return_hook)(void) = NULL;
+
+static unsigned long serial_baud = 0;
+static unsigned int tx_level = 0;
+static uint64_t tx_mark = 0;
+static std::deque<char> rx;
+static std::string tx;
+static bool echo = false;
+
+/* Digital pin to port mapping of the Arduino Micro */
+typedef struct port_pin {
+    volatile uint8_t* port;
+    volatile uint8_t* in;
+    volatile uint8_t* ddr;
+    uint8_t bit;
+} port_pin;
+
+static const port_pin micro_pins[] = {
+    {&PORTD, &PIND, &DDRD, 2}, {&PORTD, &PIND, &DDRD, 3}, {&PORTD, &PIND, &DDRD, 1},
+    {&PORTD, &PIND, &DDRD, 0}, {&PORTD, &PIND, &DDRD, 4}, {&PORTC, &PINC, &DDRC, 6},
+    {&PORTD, &PIND, &DDRD, 7}, {&PORTE, &PINE, &DDRE, 6}, {&PORTB, &PINB, &DDRB, 4},
+    {&PORTB, &PINB, &DDRB, 5}, {&PORTB, &PINB, &DDRB, 6}, {&PORTB, &PINB, &DDRB, 7},
+    {&PORTD, &PIND, &DDRD, 6}, {&PORTC, &PINC, &DDRC, 7}, {&PORTB, &PINB, &DDRB, 3},
+    {&PORTB, &PINB, &DDRB, 1}, {&PORTB, &PINB, &DDRB, 2}, {&PORTB, &PINB, &DDRB, 0},
+    {&PORTF, &PINF, &DDRF, 7}, {&PORTF, &PINF, &DDRF, 6}, {&PORTF, &PINF, &DDRF, 5},
+    {&PORTF, &PINF, &DDRF, 4}, {&PORTF, &PINF, &DDRF, 1}, {&PORTF, &PINF, &DDRF, 0},
+};
+
+#define MICRO_PINS (sizeof(micro_pins) / sizeof(micro_pins[0]))
+
+void host_reset(void){
+    now = 0;
+
+    PINB = PORTB = DDRB = 0;
+    PINC = PORTC = DDRC = 0;
+    PIND = PORTD = DDRD = 0;
+    PINE = PORTE = DDRE = 0;
+    PINF = PORTF = DDRF = 0;
+
+    peripherals.clear();
+    peripherals.push_back(host_timer1_reset());
+    peripherals.push_back(host_timer3_reset());
+    peripherals.push_back(host_usart1_reset());
+    peripherals.push_back(host_adc_reset());
+
+    host_sram_reset();
+    host_eeprom_reset();
+
+    for(size_t i = 0; i < EXTERNAL_NUM_INTERRUPTS; i++){
+        external_isrs[i] = NULL;
+    }
+
+    interrupts_enabled = true;
+    pending_isrs.clear();
+    isr_return_hook = NULL;
+
+    serial_baud = 0;
+    tx_level = 0;
+    tx_mark = 0;
+    rx.clear();
+    tx.clear();
+}
+
+uint64_t host_cycles(void){
+    return now;
+}
+
+void host_run_until(uint64_t c){
+    for(;;){
+        host_peripheral* next = NULL;
+        uint64_t next_cycle = HOST_NEVER;
+
+        for(host_peripheral* p : peripherals){
+            uint64_t e = p->next_event();
+            if(e < next_cycle){
+                next = p;
+                next_cycle = e;
+            }
+        }
+
+        if(!next || next_cycle > c) break;
+
+        if(next_cycle > now) now = next_cycle;
+        next->fire(now);
+    }
+
+    if(c > now) now = c;
+}
+
+void host_run_for(uint64_t c){
+    host_run_until(now + c);
+}
+
+void host_attach(host_peripheral* p){
+    peripherals.push_back(p);
+}
+
+void host_detach(host_peripheral* p){
+    peripherals.erase(std::remove(peripherals.begin(), peripherals.end(), p), peripherals.end());
+}
+
+static void run_pending_isrs(void){
+    while(interrupts_enabled && !pending_isrs.empty()){
+        void (*isr)(void) = pending_isrs.front();
+        pending_isrs.erase(pending_isrs.begin());
+
+        interrupts_enabled = false;
+        isr();
+        interrupts_enabled = true;
+
+        if(isr_return_hook) isr_return_hook();
+    }
+}
+
+void host_request_isr(void (*isr)(void)){
+    if(!isr) return;
+
+    // A flag that is already pending is not raised twice
+    if(std::find(pending_isrs.begin(), pending_isrs.end(), isr) == pending_isrs.end()){
+        pending_isrs.push_back(isr);
+    }
+
+    run_pending_isrs();
+}
+
+void host_raise_interrupt(int interrupt){
+    if(interrupt < 0 || interrupt >= EXTERNAL_NUM_INTERRUPTS) return;
+    host_request_isr(external_isrs[interrupt]);
+}
+
+void host_on_isr_return(void (*hook)(void)){
+    isr_return_hook = hook;
+}
+
+void host_serial_feed(const char* s){
+    while(*s) rx.push_back(*s++);
+}
+
+void host_serial_feed(const std::string& s){
+    rx.insert(rx.end(), s.begin(), s.end());
+}
+
+std::string host_serial_take(void){
+    std::string s;
+    s.swap(tx);
+    return s;
+}
+
+void host_serial_echo(bool on){
+    echo = on;
+}
+
+/* The line shared by Serial and USART1, used by usart1.cpp */
+
+int host_line_receive(void){
+    if(rx.empty()) return -1;
+
+    char c = rx.front();
+    rx.pop_front();
+    return (unsigned char) c;
+}
+
+void host_line_transmit(char c){
+    tx.push_back(c);
+    if(echo) putchar(c);
+}
+
+/* Arduino core */
+
+extern "C" {
+
+unsigned long micros(void){
+    // The core's micros() counts in steps of 4 us at 16 MHz
+    return (unsigned long) (now / HOST_CYCLES_PER_US) & ~3UL;
+}
+
+unsigned long millis(void){
+    return (unsigned long) (now / (HOST_CYCLES_PER_US * 1000));
+}
+
+void delay(unsigned long ms){
+    host_run_for((uint64_t) ms * HOST_CYCLES_PER_US * 1000);
+}
+
+void delayMicroseconds(unsigned int us){
+    host_run_for((uint64_t) us * HOST_CYCLES_PER_US);
+}
+
+void pinMode(uint8_t pin, uint8_t mode){
+    if(pin >= MICRO_PINS) return;
+
+    const port_pin* p = &micro_pins[pin];
+
+    if(mode == OUTPUT){
+        *(p->ddr) |= 1 << p->bit;
+    } else {
+        *(p->ddr) &= ~(1 << p->bit);
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value){
+    if(pin >= MICRO_PINS) return;
+
+    const port_pin* p = &micro_pins[pin];
+
+    if(value){
+        *(p->port) |= 1 << p->bit;
+    } else {
+        *(p->port) &= ~(1 << p->bit);
+    }
+}
+
+int digitalRead(uint8_t pin){
+    if(pin >= MICRO_PINS) return LOW;
+
+    const port_pin* p = &micro_pins[pin];
+    return (*(p->in) >> p->bit) & 1;
+}
+
+int analogRead(uint8_t pin){
+    host_run_for(ANALOG_READ_CYCLES);
+
+    if(pin >= A0) pin -= A0;
+    return host_adc_convert(pin);
+}
+
+void analogWrite(uint8_t pin, int value){
+    digitalWrite(pin, value > 127);
+}
+
+void attachInterrupt(uint8_t interrupt, void (*isr)(void), int mode){
+    (void) mode;
+    if(interrupt < EXTERNAL_NUM_INTERRUPTS) external_isrs[interrupt] = isr;
+}
+
+void detachInterrupt(uint8_t interrupt){
+    if(interrupt < EXTERNAL_NUM_INTERRUPTS) external_isrs[interrupt] = NULL;
+}
+
+void interrupts(void){
+    interrupts_enabled = true;
+    run_pending_isrs();
+}
+
+void noInterrupts(void){
+    interrupts_enabled = false;
+}
+
+uint8_t host_atomic_enter(void){
+    uint8_t state = interrupts_enabled;
+    interrupts_enabled = false;
+    return state;
+}
+
+void host_atomic_exit(uint8_t state){
+    if(state) interrupts();
+}
+
+}
+
+/* Serial */
+
+static uint64_t tx_byte_cycles(void){
+    return serial_baud ? (uint64_t) F_CPU * 10 / serial_baud : 0;
+}
+
+static void tx_update(void){
+    uint64_t b = tx_byte_cycles();
+
+    if(!b || !tx_level){
+        tx_level = 0;
+        tx_mark = now;
+        return;
+    }
+
+    uint64_t drained = (now - tx_mark) / b;
+
+    if(drained >= tx_level){
+        tx_level = 0;
+        tx_mark = now;
+    } else {
+        tx_level -= drained;
+        tx_mark += drained * b;
+    }
+}
+
+void host_serial::begin(unsigned long baud){
+    serial_baud = baud;
+    tx_level = 0;
+    tx_mark = now;
+}
+
+void host_serial::end(void){
+    flush();
+    serial_baud = 0;
+}
+
+int host_serial::available(void){
+    return (int) rx.size();
+}
+
+int host_serial::read(void){
+    if(rx.empty()) return -1;
+
+    char c = rx.front();
+    rx.pop_front();
+    return (unsigned char) c;
+}
+
+int host_serial::peek(void){
+    return rx.empty() ? -1 : (unsigned char) rx.front();
+}
+
+int host_serial::availableForWrite(void){
+    tx_update();
+    return SERIAL_TX_BUFFER_SIZE - tx_level;
+}
+
+void host_serial::flush(void){
+    tx_update();
+    if(tx_level) host_run_until(tx_mark + tx_level * tx_byte_cycles());
+    tx_update();
+}
+
+size_t host_serial::write(uint8_t c){
+    tx_update();
+
+    // Blocks until the oldest byte has left the buffer
+    while(tx_level >= SERIAL_TX_BUFFER_SIZE){
+        host_run_until(tx_mark + tx_byte_cycles());
+        tx_update();
+    }
+
+    if(tx_byte_cycles()) tx_level++;
+
+    tx.push_back((char) c);
+    if(echo) putchar(c);
+
+    return 1;
+}
+
+size_t host_serial::write(const uint8_t* buffer, size_t size){
+    for(size_t i = 0; i < size; i++) write(buffer[i]);
+    return size;
+}
+
+size_t host_serial::write(const char* s){
+    return write((const uint8_t*) s, strlen(s));
+}
+
+size_t host_serial::print(const char* s){
+    return write(s);
+}
+
+size_t host_serial::print(char c){
+    return write((uint8_t) c);
+}
+
+static size_t print_number(host_serial* s, const char* format_dec, const char* format_hex, long long n, int base){
+    char b[24];
+    snprintf(b, sizeof(b), base == HEX ? format_hex : format_dec, n);
+    return s->write(b);
+}
+
+size_t host_serial::print(int n, int base){
+    return print_number(this, "%lld", "%llX", n, base);
+}
+
+size_t host_serial::print(unsigned int n, int base){
+    return print_number(this, "%llu", "%llX", n, base);
+}
+
+size_t host_serial::print(long n, int base){
+    return print_number(this, "%lld", "%llX", n, base);
+}
+
+size_t host_serial::print(unsigned long n, int base){
+    return print_number(this, "%llu", "%llX", (long long) n, base);
+}
+
+size_t host_serial::print(double n, int digits){
+    char b[40];
+    snprintf(b, sizeof(b), "%.*f", digits, n);
+    return write(b);
+}
+
+size_t host_serial::println(void){
+    return write("\r\n");
+}
+
+size_t host_serial::println(const char* s){
+    return print(s) + println();
+}
+
+size_t host_serial::println(char c){
+    return print(c) + println();
+}
+
+size_t host_serial::println(int n, int base){
+    return print(n, base) + println();
+}
+
+size_t host_serial::println(unsigned int n, int base){
+    return print(n, base) + println();
+}
+
+size_t host_serial::println(long n, int base){
+    return print(n, base) + println();
+}
+
+size_t host_serial::println(unsigned long n, int base){
+    return print(n, base) + println();
+}
+
+size_t host_serial::println(double n, int digits){
+    return print(n, digits) + println();
+}
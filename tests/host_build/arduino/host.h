@@ -0,0 +1,111 @@
+#ifndef HOST_H
+    #define HOST_H
+
+    #include <Arduino.h>
+
+    #include <string>
+
+    /*
+        Harness-side control of the virtual microcontroller.
+
+        Time is counted in CPU cycles (F_CPU per second) and is advanced
+        with host_run_until/host_run_for. Anything that happens at a
+        particular time, such as an engine signal edge, is modelled as
+        a peripheral: the harness attaches it and it is fired at the
+        cycle it asks for, in time order with every other peripheral.
+    */
+
+    #define HOST_NEVER UINT64_MAX
+
+    #define HOST_CYCLES_PER_US (F_CPU / 1000000UL)
+
+    struct host_peripheral {
+        virtual ~host_peripheral() {}
+
+        // The absolute cycle of the next event, or HOST_NEVER
+        virtual uint64_t next_event(void) = 0;
+
+        // Called with the clock set to the cycle returned by next_event
+        virtual void fire(uint64_t now) = 0;
+    };
+
+    /* Resets the clock, registers, serial port and interrupt table. */
+    void host_reset(void);
+
+    uint64_t host_cycles(void);
+
+    /* Fires every peripheral event up to and including cycle c, then sets the clock to c. */
+    void host_run_until(uint64_t c);
+    void host_run_for(uint64_t c);
+
+    void host_attach(host_peripheral* p);
+    void host_detach(host_peripheral* p);
+
+    /*
+        Requests an interrupt service routine. It runs immediately when
+        interrupts are enabled, otherwise it is held pending until they
+        are re-enabled, as the hardware flag would be.
+    */
+    void host_request_isr(void (*isr)(void));
+
+    /* Requests the routine attached to an external interrupt number. */
+    void host_raise_interrupt(int interrupt);
+
+    /*
+        Sets a function called after every interrupt service routine
+        returns, e.g. to watch the outputs it has written.
+    */
+    void host_on_isr_return(void (*hook)(void));
+
+    /* Cycles per count of Timer1 at its selected prescaler, or 0 if it is stopped. */
+    unsigned int host_timer1_prescaler(void);
+
+    /*
+        Drives the input capture pin of Timer1, ICP1 (PD4, pin D4), to a 
+        level. An edge in the direction selected by ICES1 latches the 
+        count into ICR1 and raises the capture interrupt.
+    */
+    void host_timer1_input(bool level);
+
+    /* Sets the level of an analog input A0-A5, in ADC counts. */
+    void host_set_analog(uint8_t pin, int value);
+    // Also between counts, as the voltage on the pin may be
+    void host_set_analog_level(uint8_t pin, double count);
+
+    /* Adds Gaussian noise of an RMS in counts to every conversion of the ADC, none at reset. */
+    void host_set_adc_noise(double rms);
+
+    /* Conversions of the ADC since reset, by the free-running model or analogRead. */
+    unsigned long host_adc_conversions(void);
+
+    // Bytes of stack in use at reset, as by the calls into setup() and loop()
+    #define HOST_STACK_DEPTH 64
+
+    /* Moves the stack pointer of the model of SRAM to depth bytes below RAMEND. */
+    void host_set_stack(size_t depth);
+
+    /*
+        Writes over the stack of the model of SRAM down to depth bytes 
+        below RAMEND, as a call that deep would, and leaves the stack 
+        pointer where it was.
+    */
+    void host_use_stack(size_t depth);
+
+    /* Erases the EEPROM, which is otherwise kept across host_reset, as across a reset of the board. */
+    void host_eeprom_erase(void);
+
+    /* Bytes written to the EEPROM since it was erased. */
+    unsigned long host_eeprom_writes(void);
+
+    /* Queues characters on the serial line, to be read by Serial or USART1. */
+    void host_serial_feed(const char* s);
+    // Also for binary data, which may hold zero bytes
+    void host_serial_feed(const std::string& s);
+
+    /* Everything written to Serial or sent by USART1 since the last call. */
+    std::string host_serial_take(void);
+
+    /* Mirrors serial output to stdout as it is written. */
+    void host_serial_echo(bool on);
+
+#endif
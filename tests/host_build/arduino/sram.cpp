@@ -0,0 +1,52 @@
+/*
+    Model of the SRAM of the ATmega32u4: 2.5 KB from 0x100 to 0xAFF,
+    above the registers, holding the data and bss of the sketch, the
+    heap and the stack.
+
+    The host does not lay the sketch's variables out in it, so their
+    size is taken to be HOST_STATIC_SIZE bytes, which is about what the
+    sketch takes on the board with the rings of its serial port, and
+    the heap starts after them. Nothing
+    is allocated from the heap. The stack is moved and written by the
+    harness, with host_set_stack and host_use_stack.
+*/
+#include "host.h"
+
+#include "src/serial_port/serial_port.h"
+
+// Bytes of data and bss taken to be used by the sketch, besides the rings of the serial port
+#define HOST_SKETCH_SIZE    1024
+#define HOST_STATIC_SIZE    (HOST_SKETCH_SIZE + SERIAL_TX_SIZE + SERIAL_RX_SIZE)
+
+uint8_t host_sram[0xB00];
+
+char* __malloc_heap_start;
+
+// The top of the heap, or NULL if nothing has been allocated, which the sketch declares itself
+extern "C" {
+    char* __brkval;
+}
+
+static uint8_t* stack_pointer;
+
+uint8_t* host_stack_pointer(void){
+    return stack_pointer;
+}
+
+void host_set_stack(size_t depth){
+    stack_pointer = (uint8_t*) RAMEND - depth;
+}
+
+void host_use_stack(size_t depth){
+    for(uint8_t* p = (uint8_t*) RAMEND - depth + 1; p <= (uint8_t*) RAMEND; p++) *p = 0;
+}
+
+void host_sram_reset(void){
+    // Power-on contents, which are undefined on the board
+    for(size_t i = 0; i < sizeof(host_sram); i++) host_sram[i] = 0xFF;
+
+    __malloc_heap_start = (char*) RAMSTART + HOST_STATIC_SIZE;
+    __brkval = NULL;
+
+    host_set_stack(HOST_STACK_DEPTH);
+}
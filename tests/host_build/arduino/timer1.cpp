@@ -0,0 +1,154 @@
+/*
+    Model of Timer/Counter1 in normal mode: a 16 bit counter clocked
+    from the CPU clock through the prescaler in TCCR1B, raising the
+    overflow, output compare and input capture interrupts when they 
+    are enabled.
+
+    Flags are cleared when their vector runs. Writes to TIFR1 are
+    stored as they are, rather than clearing the flags written with a
+    one, so the model only relies on the flags it raises itself.
+*/
+#include "host.h"
+
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C;
+volatile uint8_t TIMSK1, TIFR1;
+volatile uint16_t OCR1A, OCR1B, OCR1C, ICR1;
+
+static volatile uint16_t count;
+
+// The level of the ICP1 pin, and the cycle a capture waits for the noise canceller until
+static bool icp1;
+static uint64_t capture_at;
+
+static const unsigned int prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+unsigned int host_timer1_prescaler(void){
+    return prescalers[TCCR1B & 0x07];
+}
+
+volatile uint16_t* host_timer1_count(void){
+    unsigned int p = host_timer1_prescaler();
+    count = p ? (uint16_t) (host_cycles() / p) : 0;
+    return &count;
+}
+
+/* The hardware clears the flag of an interrupt when its vector is executed */
+static void overflow_vector(void){
+    TIFR1 &= ~_BV(TOV1);
+    if(TIMER1_OVF_vect) TIMER1_OVF_vect();
+}
+
+static void compare_a_vector(void){
+    TIFR1 &= ~_BV(OCF1A);
+    if(TIMER1_COMPA_vect) TIMER1_COMPA_vect();
+}
+
+static void compare_b_vector(void){
+    TIFR1 &= ~_BV(OCF1B);
+    if(TIMER1_COMPB_vect) TIMER1_COMPB_vect();
+}
+
+static void compare_c_vector(void){
+    TIFR1 &= ~_BV(OCF1C);
+    if(TIMER1_COMPC_vect) TIMER1_COMPC_vect();
+}
+
+static void capture_vector(void){
+    TIFR1 &= ~_BV(ICF1);
+    if(TIMER1_CAPT_vect) TIMER1_CAPT_vect();
+}
+
+// The count is latched even if the last capture has not been read
+static void capture(uint64_t now){
+    ICR1 = (uint16_t) (now / host_timer1_prescaler());
+    TIFR1 |= _BV(ICF1);
+
+    if(TIMSK1 & _BV(ICIE1)) host_request_isr(capture_vector);
+}
+
+void host_timer1_input(bool level){
+    bool edge = level != icp1;
+    icp1 = level;
+
+    if(!edge || !host_timer1_prescaler() || level != (bool) (TCCR1B & _BV(ICES1))) return;
+
+    // The noise canceller delays the capture by four cycles of the clock
+    if(TCCR1B & _BV(ICNC1)){
+        capture_at = host_cycles() + 4;
+    } else {
+        capture(host_cycles());
+    }
+}
+
+typedef struct source {
+    uint8_t enable;
+    uint8_t flag;
+    volatile uint16_t* match;
+    void (*vector)(void);
+} source;
+
+// A NULL match is the overflow, which happens when the count wraps to 0
+static const source sources[] = {
+    {TOIE1, TOV1, NULL, overflow_vector},
+    {OCIE1A, OCF1A, &OCR1A, compare_a_vector},
+    {OCIE1B, OCF1B, &OCR1B, compare_b_vector},
+    {OCIE1C, OCF1C, &OCR1C, compare_c_vector},
+};
+
+#define SOURCES (sizeof(sources) / sizeof(sources[0]))
+
+class timer1 : public host_peripheral {
+    public:
+        // The next tick after tick at which the count equals value
+        static uint64_t next_match(uint64_t tick, uint16_t value){
+            return tick + (uint16_t) (value - (uint16_t) tick - 1) + 1;
+        }
+
+        uint64_t next_event(void){
+            unsigned int p = host_timer1_prescaler();
+            if(!p) return HOST_NEVER;
+
+            uint64_t tick = host_cycles() / p;
+            uint64_t next = capture_at;
+
+            for(size_t i = 0; i < SOURCES; i++){
+                if(!(TIMSK1 & _BV(sources[i].enable))) continue;
+
+                uint64_t m = next_match(tick, sources[i].match ? *(sources[i].match) : 0);
+                if(m * p < next) next = m * p;
+            }
+
+            return next;
+        }
+
+        void fire(uint64_t now){
+            unsigned int p = host_timer1_prescaler();
+            uint16_t c = (uint16_t) (now / p);
+
+            for(size_t i = 0; i < SOURCES; i++){
+                uint16_t match = sources[i].match ? *(sources[i].match) : 0;
+
+                if(c == match && now % p == 0){
+                    TIFR1 |= _BV(sources[i].flag);
+                    if(TIMSK1 & _BV(sources[i].enable)) host_request_isr(sources[i].vector);
+                }
+            }
+
+            if(now == capture_at){
+                capture_at = HOST_NEVER;
+                capture(now);
+            }
+        }
+};
+
+static timer1 t1;
+
+host_peripheral* host_timer1_reset(void){
+    TCCR1A = TCCR1B = TCCR1C = 0;
+    TIMSK1 = TIFR1 = 0;
+    OCR1A = OCR1B = OCR1C = ICR1 = 0;
+    icp1 = false;
+    capture_at = HOST_NEVER;
+
+    return &t1;
+}
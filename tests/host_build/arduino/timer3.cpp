@@ -0,0 +1,114 @@
+/*
+    Model of Timer/Counter3 in normal mode, as timer1.cpp without the
+    input capture unit: a 16 bit counter clocked from the CPU clock
+    through the prescaler in TCCR3B, raising the overflow and output
+    compare interrupts when they are enabled.
+
+    Flags are cleared when their vector runs. Writes to TIFR3 are
+    stored as they are, as for Timer1.
+*/
+#include "host.h"
+
+volatile uint8_t TCCR3A, TCCR3B, TCCR3C;
+volatile uint8_t TIMSK3, TIFR3;
+volatile uint16_t OCR3A, OCR3B, OCR3C;
+
+static volatile uint16_t count;
+
+static const unsigned int prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+
+static unsigned int prescaler(void){
+    return prescalers[TCCR3B & 0x07];
+}
+
+volatile uint16_t* host_timer3_count(void){
+    unsigned int p = prescaler();
+    count = p ? (uint16_t) (host_cycles() / p) : 0;
+    return &count;
+}
+
+static void overflow_vector(void){
+    TIFR3 &= ~_BV(TOV3);
+    if(TIMER3_OVF_vect) TIMER3_OVF_vect();
+}
+
+static void compare_a_vector(void){
+    TIFR3 &= ~_BV(OCF3A);
+    if(TIMER3_COMPA_vect) TIMER3_COMPA_vect();
+}
+
+static void compare_b_vector(void){
+    TIFR3 &= ~_BV(OCF3B);
+    if(TIMER3_COMPB_vect) TIMER3_COMPB_vect();
+}
+
+static void compare_c_vector(void){
+    TIFR3 &= ~_BV(OCF3C);
+    if(TIMER3_COMPC_vect) TIMER3_COMPC_vect();
+}
+
+typedef struct source {
+    uint8_t enable;
+    uint8_t flag;
+    volatile uint16_t* match;
+    void (*vector)(void);
+} source;
+
+// A NULL match is the overflow, which happens when the count wraps to 0
+static const source sources[] = {
+    {TOIE3, TOV3, NULL, overflow_vector},
+    {OCIE3A, OCF3A, &OCR3A, compare_a_vector},
+    {OCIE3B, OCF3B, &OCR3B, compare_b_vector},
+    {OCIE3C, OCF3C, &OCR3C, compare_c_vector},
+};
+
+#define SOURCES (sizeof(sources) / sizeof(sources[0]))
+
+class timer3 : public host_peripheral {
+    public:
+        // The next tick after tick at which the count equals value
+        static uint64_t next_match(uint64_t tick, uint16_t value){
+            return tick + (uint16_t) (value - (uint16_t) tick - 1) + 1;
+        }
+
+        uint64_t next_event(void){
+            unsigned int p = prescaler();
+            if(!p || !TIMSK3) return HOST_NEVER;
+
+            uint64_t tick = host_cycles() / p;
+            uint64_t next = HOST_NEVER;
+
+            for(size_t i = 0; i < SOURCES; i++){
+                if(!(TIMSK3 & _BV(sources[i].enable))) continue;
+
+                uint64_t m = next_match(tick, sources[i].match ? *(sources[i].match) : 0);
+                if(m * p < next) next = m * p;
+            }
+
+            return next;
+        }
+
+        void fire(uint64_t now){
+            unsigned int p = prescaler();
+            uint16_t c = (uint16_t) (now / p);
+
+            for(size_t i = 0; i < SOURCES; i++){
+                uint16_t match = sources[i].match ? *(sources[i].match) : 0;
+
+                if(c == match && now % p == 0){
+                    TIFR3 |= _BV(sources[i].flag);
+                    if(TIMSK3 & _BV(sources[i].enable)) host_request_isr(sources[i].vector);
+                }
+            }
+        }
+};
+
+static timer3 t3;
+
+host_peripheral* host_timer3_reset(void){
+    TCCR3A = TCCR3B = TCCR3C = 0;
+    TIMSK3 = TIFR3 = 0;
+    OCR3A = OCR3B = OCR3C = 0;
+
+    return &t3;
+}
@@ -0,0 +1,173 @@
+/*
+    Model of USART1 in asynchronous mode: bytes written to the data
+    register are moved to the shift register and sent, and bytes are
+    received, at the baud rate set by UBRR1, raising the data register
+    empty and receive complete interrupts when they are enabled.
+
+    The line is shared with Serial: bytes queued by host_serial_feed
+    are received here once the receiver is enabled, and bytes sent are
+    returned by host_serial_take.
+
+    UDR1 is 16 bits wide on the host. Whenever the model leaves a byte
+    in it to be read, the top byte is set to a marker that any byte 
+    written by the sketch overwrites, so a write is told from a read 
+    whatever its value. Writes are taken when an interrupt vector 
+    returns or the model is next polled. The receive complete flag is
+    cleared when its vector returns, as reading UDR1 in it would.
+
+    The flags in UCSR1A are read only on the board, so the model sets
+    them again from its own state whenever it is polled, in case the
+    sketch has written over them.
+*/
+#include "host.h"
+
+volatile uint8_t UCSR1A, UCSR1B, UCSR1C;
+volatile uint16_t UBRR1;
+
+static volatile uint16_t data;
+
+#define UNWRITTEN   0x5A00
+
+/* The line, defined in host.cpp */
+int host_line_receive(void);
+void host_line_transmit(char c);
+
+volatile uint16_t* host_usart1_data(void){
+    return &data;
+}
+
+static uint64_t byte_cycles(void){
+    // A start bit, 8 data bits and a stop bit
+    return 10ULL * ((UCSR1A & _BV(U2X1)) ? 8 : 16) * (UBRR1 + 1);
+}
+
+class usart1 : public host_peripheral {
+    public:
+        // The last byte received, left in the data register
+        uint8_t received;
+
+        // The byte arriving on the line and the cycle its stop bit ends, if any
+        int incoming;
+        uint64_t incoming_at;
+
+        // The byte waiting in the data register for the shift register, if any
+        int waiting;
+        // The cycle the shift register finishes sending its byte
+        uint64_t shift_free;
+
+        // Whether a received byte is waiting to be read
+        bool unread;
+
+        // Whether the data register empty interrupt has been requested but not run
+        bool requested;
+
+        void reset(void){
+            received = 0;
+            incoming = -1;
+            incoming_at = 0;
+            waiting = -1;
+            shift_free = 0;
+            unread = false;
+            requested = false;
+            data = UNWRITTEN;
+        }
+
+        void restore_flags(void){
+            uint8_t flags = (waiting < 0 ? _BV(UDRE1) : 0) | (unread ? _BV(RXC1) : 0);
+            UCSR1A = (UCSR1A & ~(_BV(UDRE1) | _BV(RXC1))) | flags;
+        }
+
+        /* Takes a byte written to the data register since it was last looked at */
+        void take_write(void){
+            restore_flags();
+
+            if((data & 0xFF00) == UNWRITTEN) return;
+
+            uint8_t c = (uint8_t) data;
+            data = UNWRITTEN | received;
+
+            if(!(UCSR1B & _BV(TXEN1))) return;
+
+            if(waiting < 0 && shift_free <= host_cycles()){
+                host_line_transmit(c);
+                shift_free = host_cycles() + byte_cycles();
+            } else if(waiting < 0){
+                waiting = c;
+                UCSR1A &= ~_BV(UDRE1);
+            }
+            // A byte written while the data register is full is lost, as on the board
+        }
+
+        uint64_t next_event(void){
+            take_write();
+
+            uint64_t now = host_cycles();
+            uint64_t next = HOST_NEVER;
+
+            if(incoming < 0 && (UCSR1B & _BV(RXEN1))){
+                incoming = host_line_receive();
+                if(incoming >= 0) incoming_at = (incoming_at > now ? incoming_at : now) + byte_cycles();
+            }
+
+            if(incoming >= 0) next = incoming_at;
+            if(waiting >= 0 && shift_free < next) next = shift_free;
+
+            if(!requested && (UCSR1B & _BV(UDRIE1)) && (UCSR1A & _BV(UDRE1))) next = now;
+
+            return next;
+        }
+
+        void fire(uint64_t now);
+};
+
+static usart1 u1;
+
+static void data_empty_vector(void){
+    u1.requested = false;
+    if(USART1_UDRE_vect) USART1_UDRE_vect();
+    u1.take_write();
+}
+
+static void receive_vector(void){
+    if(USART1_RX_vect) USART1_RX_vect();
+    u1.unread = false;
+    UCSR1A &= ~_BV(RXC1);
+    u1.take_write();
+}
+
+void usart1::fire(uint64_t now){
+    if(waiting >= 0 && shift_free <= now){
+        host_line_transmit((char) waiting);
+        shift_free = now + byte_cycles();
+        waiting = -1;
+        UCSR1A |= _BV(UDRE1);
+    }
+
+    if(incoming >= 0 && incoming_at <= now){
+        received = (uint8_t) incoming;
+        data = UNWRITTEN | received;
+        incoming = -1;
+
+        if(unread) UCSR1A |= _BV(DOR1);
+        unread = true;
+        UCSR1A |= _BV(RXC1);
+
+        if(UCSR1B & _BV(RXCIE1)) host_request_isr(receive_vector);
+    }
+
+    if(!requested && (UCSR1B & _BV(UDRIE1)) && (UCSR1A & _BV(UDRE1))){
+        requested = true;
+        host_request_isr(data_empty_vector);
+    }
+}
+
+host_peripheral* host_usart1_reset(void){
+    UCSR1A = _BV(UDRE1);
+    UCSR1B = 0;
+    UCSR1C = _BV(UCSZ11) | _BV(UCSZ10);
+    UBRR1 = 0;
+
+    u1.reset();
+
+    return &u1;
+}
@@ -0,0 +1,28 @@
+#ifndef HOST_UTIL_ATOMIC_H
+    #define HOST_UTIL_ATOMIC_H
+
+    #include <stdint.h>
+
+    #ifdef __cplusplus
+    extern "C" {
+    #endif
+
+    /* Disables interrupts, returning whether they were enabled. */
+    uint8_t host_atomic_enter(void);
+
+    /* Restores the interrupt state returned by host_atomic_enter. */
+    void host_atomic_exit(uint8_t state);
+
+    #ifdef __cplusplus
+    }
+    #endif
+
+    #define ATOMIC_RESTORESTATE 0
+    #define ATOMIC_FORCEON      1
+
+    #define ATOMIC_BLOCK(type) \
+        for(uint8_t host_atomic_state = host_atomic_enter(), host_atomic_once = 1; \
+            host_atomic_once; \
+            host_atomic_exit((type) == ATOMIC_FORCEON ? 1 : host_atomic_state), host_atomic_once = 0)
+
+#endif
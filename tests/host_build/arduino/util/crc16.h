@@ -0,0 +1,18 @@
+#ifndef HOST_UTIL_CRC16_H
+    #define HOST_UTIL_CRC16_H
+
+    /*
+        The CRC-CCITT of avr-libc, as given in the documentation of
+        util/crc16.h, which the board has in assembly.
+    */
+
+    #include <stdint.h>
+
+    static inline uint16_t _crc_ccitt_update(uint16_t crc, uint8_t data){
+        data ^= (uint8_t) (crc & 0xFF);
+        data ^= (uint8_t) (data << 4);
+
+        return ((((uint16_t) data << 8) | (crc >> 8)) ^ (uint8_t) (data >> 4) ^ ((uint16_t) data << 3));
+    }
+
+#endif
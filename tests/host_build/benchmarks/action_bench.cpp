@@ -0,0 +1,196 @@
+/*
+    Crank angle action table benchmark.
+
+    Compares looking up the state of every coil and injector in the
+    action table with the per-cylinder path it replaced, which wraps
+    the angle with fmod and tests it against the spark and fuel windows
+    of each cylinder in turn.
+
+    The table is first checked against the windows, taken modulo 720
+    degrees, at every step of a sweep over the cycle. This is done for
+    the timings of the engine map and for a spark window that wraps
+    past 0. Both paths are then timed on the host.
+
+    usage: action_bench [--rpm N] [--step DEG] [--calls N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "driver.h"
+
+// Angles closer than this to an edge are not checked, as they fall within the rounding of the table
+#define EDGE_MARGIN 0.001
+
+static double wrap(double a){
+    a = fmod(a, 720);
+    return a < 0 ? a + 720 : a;
+}
+
+static bool in_window(double angle, const angle_t bounds[2], int phase){
+    double start = wrap(ANGLE_TO_FLOAT(bounds[0]) - phase);
+    double length = wrap(ANGLE_TO_FLOAT(bounds[1]) - ANGLE_TO_FLOAT(bounds[0]));
+    return wrap(angle - start) < length;
+}
+
+static bool near_edge(double angle, const angle_t bounds[2], int phase){
+    for(int k = 0; k < 2; k++){
+        double d = wrap(angle - (ANGLE_TO_FLOAT(bounds[k]) - phase));
+        if(d < EDGE_MARGIN || 720 - d < EDGE_MARGIN) return true;
+    }
+
+    return false;
+}
+
+/* Sweeps the cycle, returning the number of angles at which the table and the windows disagree. */
+static unsigned long check_table(const angle_t spark[2], const angle_t fuel[2], double step, unsigned long* checked){
+    action_table a;
+
+    if(compile_action_table(&a, spark, fuel, cylinder_phases, &e)){
+        fprintf(stderr, "could not compile the table\n");
+        exit(1);
+    }
+
+    unsigned long mismatches = 0;
+    *checked = 0;
+
+    for(double angle = 0; angle < 720; angle += step){
+        const uint8_t* state = action_state(&a, ANGLE_TO_TABLE(ANGLE(angle)));
+
+        for(int c = 0; c < 2 * CYLINDERS; c++){
+            const pin* p = c < CYLINDERS ? &(e.coils[c]) : &(e.injs[c - CYLINDERS]);
+            const angle_t* bounds = c < CYLINDERS ? spark : fuel;
+            int phase = cylinder_phases[c % CYLINDERS];
+
+            if(near_edge(angle, bounds, phase)) continue;
+
+            bool expected = in_window(angle, bounds, phase);
+            bool actual = false;
+
+            for(uint8_t k = 0; k < a.port_count; k++){
+                if(a.ports[k] == p->reg) actual = state[k] & (1 << p->num);
+            }
+
+            (*checked)++;
+
+            if(actual != expected){
+                if(mismatches < 10){
+                    printf("  mismatch at %.3f deg: %s %d is %s\n",
+                        angle, c < CYLINDERS ? "coil" : "injector", c % CYLINDERS, actual ? "closed" : "open");
+                }
+                mismatches++;
+            }
+        }
+    }
+
+    return mismatches;
+}
+
+/* The windows in degrees, as used by the per-cylinder update of loop() before the table */
+static float spark[2], fuel[2];
+
+static bool within_window(float angle, const float bounds[2]){
+    return angle < bounds[1] && angle > bounds[0];
+}
+
+static void update_circuit(float angle, const float bounds[2], pin* p){
+    if(pin_state(p) && !within_window(angle, bounds)){
+        open_circuit(p);
+    } else if(!pin_state(p) && within_window(angle, bounds)){
+        close_circuit(p);
+    }
+}
+
+static void update_polled(double estimated_crank){
+    for(int c = 0; c < CYLINDERS; c++){
+        float a = fmod((float) estimated_crank + cylinder_phases[c], 720);
+
+        update_circuit(a, spark, &(e.coils[c]));
+        update_circuit(a, fuel, &(e.injs[c]));
+    }
+}
+
+static void update_table(double estimated_crank){
+    // Converted here, as the sketch has the angle in fixed point already
+    static volatile angle_t angle;
+    angle = ANGLE(estimated_crank);
+
+    write_action_state(&(timings_in_force(&t)->table), action_state(&(timings_in_force(&t)->table), ANGLE_TO_TABLE(angle)));
+}
+
+static double time_calls(void (*update)(double), unsigned long calls){
+    auto start = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        // A prime step visits every part of the cycle
+        update((double) ((i * 7919) % 72000) / 100);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / calls;
+}
+
+int main(int argc, char** argv){
+    unsigned int rpm = 3000;
+    double step = 0.01;
+    unsigned long calls = 2000000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--step")){
+            step = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    boot();
+
+    // The timings depend on the measured speed
+    update_velocity(&e, RPM_PERIOD_PRODUCT / rpm);
+
+    char reply[MESSAGE_SIZE];
+    new_operating_point(rpm, &o, &t, &e, reply);
+
+    if(!t.is_valid){
+        fprintf(stderr, "no valid timings at %u RPM\n", rpm);
+        return 1;
+    }
+
+    for(int k = 0; k < 2; k++){
+        spark[k] = ANGLE_TO_FLOAT(timings_in_force(&t)->spark[k]);
+        fuel[k] = ANGLE_TO_FLOAT(timings_in_force(&t)->fuel[k]);
+    }
+
+    printf("action_bench: %u RPM, spark %.2f to %.2f deg, fuel %.2f to %.2f deg, %u edges in %u segments\n\n",
+        rpm, spark[0], spark[1], fuel[0], fuel[1], timings_in_force(&t)->table.edge_count, (unsigned) SEGMENTS);
+
+    unsigned long checked;
+    unsigned long mismatches = check_table(timings_in_force(&t)->spark, timings_in_force(&t)->fuel, step, &checked);
+    printf("engine map windows: %lu mismatches in %lu checks\n", mismatches, checked);
+
+    // A dwell that starts before the top of the cycle, so the coil window wraps past 0
+    const angle_t wrapped_spark[2] = {ANGLE(-30), ANGLE(20)};
+    unsigned long wrapped = check_table(wrapped_spark, timings_in_force(&t)->fuel, step, &checked);
+    printf("wrapped spark window: %lu mismatches in %lu checks\n\n", wrapped, checked);
+
+    double polled_ns = time_calls(update_polled, calls);
+    double table_ns = time_calls(update_table, calls);
+
+    printf("%-28s %10s\n", "", "ns/call");
+    printf("%-28s %10.1f\n", "fmod and windows", polled_ns);
+    printf("%-28s %10.1f\n", "action table", table_ns);
+
+    if(mismatches || wrapped){
+        printf("\nFAIL: the table disagrees with the windows\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,286 @@
+/*
+    Free-running ADC benchmark.
+
+    Checks that the model of the ADC converts freely, a conversion
+    every 104 us, and that a steady input gives its count in the top
+    bits of the sampler's blocks. It then runs the engine with the
+    temperature taken every cycle, and checks that the loop takes it
+    without waiting on a conversion, against the 104 us analogRead
+    took in the loop before.
+
+    The thermistor is then set to temperatures between ADC counts,
+    with Gaussian noise on every conversion, and the temperature of a
+    single conversion, as the loop read before, is compared with that
+    of a block of oversampled conversions, for the error from the true
+    temperature and the readings over the maximum just below it. The
+    true temperature is that of the firmware's own table, so only the
+    ADC is measured. Last, the temperature is ramped up through the
+    maximum on a running engine, and the temperature the engine is
+    shut down at is given, against the first at which the check before,
+    a single conversion rounded to the degree, would have shut it down
+    on the same ramp.
+
+    usage: adc_bench [--rpm N] [--noise F] [--reads N] [--ramps N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_signal.h"
+#include "stats.h"
+
+// A conversion at the 125 kHz ADC clock, and a block of them
+#define CONVERSION_CYCLES   (13 * 128)
+#define BLOCK_CYCLES        (ADC_SAMPLER_SAMPLES * CONVERSION_CYCLES)
+
+// The temperature below the maximum held to count the readings over it
+#define BELOW_MAX           0.5
+
+/* The ADC count, between counts, at a temperature in deg C on the firmware's table */
+static double count_at(double temp){
+    double t = temp * (1 << THERMISTOR_SCALE_BITS);
+
+    for(int i = 0; i < THERMISTOR_ENTRIES - 1; i++){
+        double low = (int16_t) pgm_read_word(&(thermistor_table[i]));
+        double high = (int16_t) pgm_read_word(&(thermistor_table[i + 1]));
+
+        if(t <= high) return (i + (t - low) / (high - low)) * THERMISTOR_COUNT_STEP;
+    }
+
+    return THERMISTOR_COUNTS - 1;
+}
+
+static void set_temperature(double temp){
+    host_set_analog_level(e.thermistor.pin, count_at(temp));
+}
+
+/* The temperature of a single conversion in 1/16 deg C, as get_internal_temp reads it */
+static int16_t single_temperature(void){
+    return thermistor_temperature(analogRead(e.thermistor.pin));
+}
+
+/* The temperature of the next block begun after now, in 1/16 deg C */
+static int16_t block_temperature(void){
+    uint16_t count;
+
+    take_adc_sample(&as, &count);
+    host_run_for(2 * BLOCK_CYCLES + CONVERSION_CYCLES);
+    take_adc_sample(&as, &count);
+
+    return thermistor_temperature_fine(count, ADC_SAMPLER_BITS);
+}
+
+static double degrees(int16_t t){
+    return t / (double) (1 << THERMISTOR_SCALE_BITS);
+}
+
+static double rms(const std::vector<double>& v){
+    double sum = 0;
+    for(double x : v) sum += x * x;
+    return v.empty() ? 0 : sqrt(sum / v.size());
+}
+
+static double max_abs(const std::vector<double>& v){
+    double m = 0;
+    for(double x : v) m = fabs(x) > m ? fabs(x) : m;
+    return m;
+}
+
+typedef struct trip {
+    // The true temperature the engine was shut down at, and the check before would have
+    double now, before;
+} trip;
+
+/*
+    Ramps the temperature up from start at rate deg C a second on a running
+    engine, until it is shut down and the check before has been met.
+    Returns false if either did not happen before the ramp passed the
+    maximum by 3 degrees.
+*/
+static bool ramp(double rpm, double noise, double start, double rate, uint64_t loop_cycles, trip* tr){
+    boot();
+
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+    host_attach(&signal);
+
+    set_temperature(start);
+    if(!start_engine(loop_cycles, 5 * F_CPU)){
+        host_detach(&signal);
+        return false;
+    }
+
+    host_set_adc_noise(noise);
+    temp_tacho = 1;
+
+    uint64_t t0 = host_cycles();
+    uint32_t taken = pf.stages[STAGE_TEMPERATURE].count;
+    bool shut_down = false, before = false;
+
+    for(;;){
+        double temp = start + rate * (host_cycles() - t0) / F_CPU;
+        if(temp > max_temp + 3) break;
+
+        set_temperature(temp);
+        run_loop(loop_cycles);
+
+        if(!shut_down && !e.is_running){
+            shut_down = true;
+            tr->now = temp;
+        }
+
+        // Each time the loop takes the temperature, the check before on a conversion of its own, which waited on it
+        if(pf.stages[STAGE_TEMPERATURE].count != taken){
+            taken = pf.stages[STAGE_TEMPERATURE].count;
+
+            if(!before && adc_to_temperature(analogRead(e.thermistor.pin)) > max_temp){
+                before = true;
+                tr->before = temp;
+            }
+        }
+
+        if(shut_down && before) break;
+    }
+
+    host_detach(&signal);
+    return shut_down && before;
+}
+
+int main(int argc, char** argv){
+    double rpm = 3000;
+    double noise = 1.0;
+    unsigned long reads = 5000;
+    unsigned long ramps = 8;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--noise")){
+            noise = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--reads")){
+            reads = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--ramps")){
+            ramps = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(rpm <= 0 || noise < 0 || reads < 1 || ramps < 1){
+        fprintf(stderr, "--rpm, --reads and --ramps must be positive\n");
+        return 2;
+    }
+
+    uint64_t loop_cycles = DEFAULT_LOOP_CYCLES;
+
+    printf("adc_bench: %.0f RPM, noise %.2f counts RMS, %lu reads, %lu ramps\n\n", rpm, noise, reads, ramps);
+
+    // The ADC left to itself
+    boot();
+    host_set_analog(e.thermistor.pin, 500);
+
+    uint16_t count;
+    take_adc_sample(&as, &count);
+
+    unsigned long conversions = host_adc_conversions();
+    host_run_for(F_CPU / 10);
+    conversions = host_adc_conversions() - conversions;
+
+    bool steady = take_adc_sample(&as, &count) && count == (500 << ADC_SAMPLER_BITS);
+
+    // The loop taking the temperature every cycle, and a conversion as analogRead made it before
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+    host_attach(&signal);
+
+    bool running = start_engine(loop_cycles, 5 * F_CPU);
+    temp_tacho = 1;
+    init_profiler(&pf);
+
+    run_loops_until(host_cycles() + F_CPU, loop_cycles);
+
+    stage_profile* taken = &(pf.stages[STAGE_TEMPERATURE]);
+    running = running && e.is_running;
+
+    host_detach(&signal);
+
+    uint64_t start = host_cycles();
+    get_internal_temp(&e);
+    double read_us = (host_cycles() - start) / (double) HOST_CYCLES_PER_US;
+
+    printf("%-40s %12s %12s\n", "", "analogRead", "free-running");
+    printf("%-40s %12.0f %12.0f\n", "conversions a second", 1e6 / read_us, conversions * 10.0);
+    printf("%-40s %12.1f %12.1f\n", "temperature read in the loop, max [us]", read_us, taken->max / (double) TICKS_PER_US);
+    printf("\n");
+
+    // Single conversions against blocks of them, between counts and with noise
+    host_set_adc_noise(noise);
+
+    std::vector<double> single_error, block_error;
+
+    for(double temp = 60; temp <= 90; temp += 0.1){
+        set_temperature(temp);
+
+        single_error.push_back(degrees(single_temperature()) - temp);
+        block_error.push_back(degrees(block_temperature()) - temp);
+    }
+
+    // Just below the maximum, where only noise reads over it
+    set_temperature(max_temp - BELOW_MAX);
+
+    unsigned long single_over = 0, block_over = 0;
+
+    for(unsigned long n = 0; n < reads; n++){
+        if(adc_to_temperature(analogRead(e.thermistor.pin)) > max_temp) single_over++;
+        if(block_temperature() > (max_temp << THERMISTOR_SCALE_BITS)) block_over++;
+    }
+
+    double per_count = 1 / (count_at(max_temp + 0.5) - count_at(max_temp - 0.5));
+
+    printf("%-40s %12s %12s\n", "", "single", "oversampled");
+    printf("%-40s %12d %12d\n", "bits", 10, 10 + ADC_SAMPLER_BITS);
+    printf("%-40s %12.3f %12.3f\n", "step at the maximum [deg C]", per_count, per_count / (1 << ADC_SAMPLER_BITS));
+    printf("%-40s %12.3f %12.3f\n", "error 60-90 deg C, RMS [deg C]", rms(single_error), rms(block_error));
+    printf("%-40s %12.3f %12.3f\n", "error 60-90 deg C, max [deg C]", max_abs(single_error), max_abs(block_error));
+    printf("%-40s %12lu %12lu\n", "over the maximum, 0.5 deg C below it", single_over, block_over);
+    printf("\n");
+
+    // Ramps up through the maximum
+    std::vector<double> now, before;
+    unsigned long tripped = 0;
+
+    for(unsigned long k = 0; k < ramps; k++){
+        trip tr = {0, 0};
+
+        // Each from a little higher, so the reads fall at other temperatures
+        if(ramp(rpm, noise, max_temp - 1.0 + 0.07 * k, 0.5, loop_cycles, &tr)){
+            now.push_back(tr.now - max_temp);
+            before.push_back(tr.before - max_temp);
+            tripped++;
+        }
+    }
+
+    summary sn = summarise(now), sb = summarise(before);
+
+    printf("shut down past the maximum on a ramp of 0.5 deg C/s [deg C]\n");
+    print_summary_header(stdout);
+    print_summary(stdout, "before", &sb);
+    print_summary(stdout, "now", &sn);
+    printf("\n");
+
+    // 961.5 in 100 ms, less the 12 clocks more the first takes
+    check(conversions >= 960 && conversions <= 962, "conversions run freely, one every 104 us");
+    check(steady, "a steady input gives its count in the top bits");
+    check(running && taken->count > 0, "the engine runs with the temperature every cycle");
+    check(taken->max < 104 * TICKS_PER_US, "the loop takes the temperature without waiting");
+    check(rms(block_error) < rms(single_error) / 2, "blocks are closer to the temperature than one read");
+    check(block_over == 0, "no block reads over the maximum just below it");
+    check(tripped == ramps, "every ramp shuts the engine down");
+    check(tripped == ramps && sn.min >= -0.25 && sn.max <= 0.25, "the engine is shut down within 0.25 deg C of it");
+
+    return check_status();
+}
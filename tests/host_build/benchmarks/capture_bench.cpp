@@ -0,0 +1,170 @@
+/*
+    IPG timestamp jitter report.
+
+    Drives the IPG signal at a set of constant speeds while other
+    interrupts and atomic sections hold off the IPG interrupt for a
+    random time, as the coil/injector and serial interrupts do on the
+    board. Every pulse is timestamped twice: by the input capture unit
+    of Timer1, as the control system does, and by micros() on entry to
+    the interrupt, as it did before. The interval between pulses from
+    each is compared with the true interval of the signal, as is the
+    speed of the engine given by a single interval.
+
+    usage: capture_bench [--latency US] [--pulses N] [--max-error US]
+
+    --latency is the longest time the IPG interrupt is held off.
+
+    --max-error fails the run if any captured interval is further than
+    US microseconds from the truth.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "driver.h"
+#include "engine_signal.h"
+#include "stats.h"
+
+/*
+    Holds interrupts off for a random time up to a limit, at random
+    times a few hundred microseconds apart.
+*/
+class interrupt_blocker : public host_peripheral {
+    public:
+        interrupt_blocker(double latency_us)
+            : latency(latency_us * HOST_CYCLES_PER_US), seed(1), blocking(false){
+            next = host_cycles() + gap();
+        }
+
+        uint64_t next_event(void){ return next; }
+
+        void fire(uint64_t now){
+            if(blocking){
+                interrupts();
+                next = now + gap();
+            } else {
+                noInterrupts();
+                next = now + 1 + (uint64_t) (latency * random());
+            }
+
+            blocking = !blocking;
+        }
+
+    private:
+        double latency;
+        uint32_t seed;
+        bool blocking;
+        uint64_t next;
+
+        // Uniform in [0, 1)
+        double random(void){
+            seed = seed * 1664525UL + 1013904223UL;
+            return (seed >> 8) / (double) (1 << 24);
+        }
+
+        uint64_t gap(void){
+            return (uint64_t) ((50 + 450 * random()) * HOST_CYCLES_PER_US);
+        }
+};
+
+// The timestamps of the pulses taken from the ring, and micros() as each was pushed
+static std::vector<uint32_t> captured;
+static std::vector<unsigned long> entered;
+
+static void take_pulses(void){
+    pulse_record p;
+
+    while(pop_pulse(&pr, &p)){
+        captured.push_back(p.time);
+        entered.push_back(micros());
+    }
+}
+
+int main(int argc, char** argv){
+    double latency = 10;
+    unsigned long pulses = 20000;
+    double max_error = 0.6;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--latency")){
+            latency = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--pulses")){
+            pulses = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--max-error")){
+            max_error = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    static const double speeds[] = {1000, 3000, 6000, 10000};
+
+    printf("capture_bench: %lu pulses per speed, IPG interrupt held off up to %.1f us\n\n", pulses, latency);
+    print_summary_header(stdout);
+
+    double worst = 0;
+
+    for(size_t k = 0; k < sizeof(speeds) / sizeof(speeds[0]); k++){
+        double rpm = speeds[k];
+        double interval = RPM_PERIOD_PRODUCT / TICKS_PER_US / rpm;
+
+        boot();
+
+        captured.clear();
+        entered.clear();
+
+        // The ISR has no duration on the host, so micros() on return is micros() on entry
+        host_on_isr_return(take_pulses);
+
+        engine_signal signal(&e.ipg, &e.cpg, rpm);
+        interrupt_blocker blocker(latency);
+
+        host_attach(&signal);
+        host_attach(&blocker);
+
+        host_run_until(host_cycles() + (uint64_t) ((pulses + 1) * interval * HOST_CYCLES_PER_US));
+
+        host_detach(&blocker);
+        host_detach(&signal);
+        host_on_isr_return(NULL);
+
+        std::vector<double> capture_error, micros_error, capture_rpm, micros_rpm;
+
+        for(size_t i = 1; i < captured.size(); i++){
+            double c = (double) (uint32_t) (captured[i] - captured[i - 1]) / TICKS_PER_US;
+            double m = (double) (entered[i] - entered[i - 1]);
+
+            capture_error.push_back(fabs(c - interval));
+            micros_error.push_back(fabs(m - interval));
+            capture_rpm.push_back(fabs(RPM_PERIOD_PRODUCT / TICKS_PER_US / c - rpm));
+            micros_rpm.push_back(fabs(RPM_PERIOD_PRODUCT / TICKS_PER_US / m - rpm));
+        }
+
+        char name[40];
+        summary s;
+
+        snprintf(name, sizeof(name), "%.0f RPM capture [us]", rpm);
+        s = summarise(capture_error);
+        print_summary(stdout, name, &s);
+        if(s.max > worst) worst = s.max;
+
+        s = summarise(micros_error);
+        print_summary(stdout, "  micros() [us]", &s);
+
+        s = summarise(capture_rpm);
+        print_summary(stdout, "  capture speed [RPM]", &s);
+
+        s = summarise(micros_rpm);
+        print_summary(stdout, "  micros() speed [RPM]", &s);
+    }
+
+    if(max_error >= 0 && worst > max_error){
+        printf("\nFAIL: captured interval is %.3f us from the truth, more than %.3f us\n", worst, max_error);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+    Coil and injector edge placement benchmark.
+
+    Runs the engine at a constant speed and compares the crankshaft
+    angle at which every coil and injector edge actually happened with
+    the angle the timings ask for. Built twice: edge_bench switches the
+    outputs from the Timer1 scheduler, edge_bench_polled from loop()
+    (POLLED_ACTUATION).
+
+    usage: edge_bench [--rpm N] [--cycles N] [--loop-us N] [--status-every N] [--max-error DEG]
+
+    --status-every sends a STATUS command every N engine cycles, whose
+    replies block the loop while the serial buffer drains.
+
+    --max-error fails the run if any spark (coil opening) is further
+    than DEG degrees from its target.
+
+    The timer build then fills the queue of the scheduler with edges
+    due at a pulse still to come, and fails if the edge that finds it
+    full is not counted, or leaves any output closed.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "driver.h"
+#include "engine_signal.h"
+#include "output_monitor.h"
+#include "stats.h"
+
+static double wrap_error(double a){
+    a = fmod(a, 720);
+    if(a >= 360) a -= 720;
+    if(a < -360) a += 720;
+    return a;
+}
+
+static double target_angle(int circuit, bool closed){
+    const angle_t* bounds = circuit < CYLINDERS ? timings_in_force(&t)->spark : timings_in_force(&t)->fuel;
+    double a = ANGLE_TO_FLOAT(bounds[closed ? 0 : 1]) - cylinder_phases[circuit % CYLINDERS];
+    return fmod(a + 720, 720);
+}
+
+#ifndef POLLED_ACTUATION
+/* Fills the queue with the edges of a cycle at a time until one is dropped, with every output closed before */
+static bool overflow_opens_outputs(unsigned int* dropped){
+    cancel_actuations(&s);
+    uint16_t dropped_before = s.dropped;
+
+    for(int i = 0; i < CYLINDERS; i++){
+        close_circuit(&(e.coils[i]));
+        close_circuit(&(e.injs[i]));
+    }
+
+    // The edges of segments caught up on are due at the pulse, which has not come yet
+    uint32_t pulse_tick = timer_ticks(&tm) + MAX_COMPARE_TICKS;
+
+    for(int k = 0; k < SCHEDULE_SIZE && s.dropped == dropped_before; k++){
+        schedule_actuations(&s, &tm, &(timings_in_force(&t)->table), NULL, 0, pulse_tick, e.period, 0);
+    }
+
+    bool opened = true;
+
+    for(int i = 0; i < CYLINDERS; i++){
+        if(pin_state(&(e.coils[i])) || pin_state(&(e.injs[i]))) opened = false;
+    }
+
+    *dropped = s.dropped - dropped_before;
+
+    return *dropped == 1 && s.head == s.tail && opened;
+}
+#endif
+
+int main(int argc, char** argv){
+    double rpm = 3000;
+    unsigned long engine_cycles = 200;
+    unsigned long loop_us = 50;
+    unsigned long status_every = 25;
+    double max_error = -1;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--cycles")){
+            engine_cycles = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--loop-us")){
+            loop_us = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--status-every")){
+            status_every = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--max-error")){
+            max_error = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    uint64_t loop_cycles = loop_us * HOST_CYCLES_PER_US;
+
+    boot();
+
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+    host_attach(&signal);
+
+    if(!start_engine(loop_cycles, 5 * F_CPU)){
+        fprintf(stderr, "engine did not start\n%s", host_serial_take().c_str());
+        return 1;
+    }
+
+    // Edges are queued at each IPG pulse, so none are until the pulse after the engine starts
+    unsigned long started = signal.edges();
+    while(signal.edges() == started) run_loop(loop_cycles);
+
+    output_monitor monitor;
+
+    unsigned long first_edge = signal.edges();
+    unsigned long last_status = 0;
+
+    while(signal.edges() - first_edge < engine_cycles * 24 && e.is_running){
+        unsigned long cycle = (signal.edges() - first_edge) / 24;
+
+        if(status_every && cycle >= last_status + status_every){
+            host_serial_feed("STATUS\n");
+            last_status = cycle;
+        }
+
+        run_loop(loop_cycles);
+    }
+
+    const char* names[4] = {
+        "spark [deg]", "dwell start [deg]",
+        "injection end [deg]", "injection start [deg]"
+    };
+
+    std::vector<double> errors[4];
+    double worst_spark = 0;
+
+    for(const output_edge& edge : monitor.edges){
+        double actual = signal.angle_at(edge.cycle);
+        double error = wrap_error(actual - target_angle(edge.circuit, edge.closed));
+
+        int kind = (edge.circuit < CYLINDERS ? 0 : 2) + (edge.closed ? 1 : 0);
+        errors[kind].push_back(fabs(error));
+
+        if(kind == 0 && fabs(error) > worst_spark) worst_spark = fabs(error);
+    }
+
+    printf("edge_bench (%s): %.0f RPM, %lu engine cycles, %lu us nominal loop, STATUS every %lu cycles\n",
+        #ifdef POLLED_ACTUATION
+        "polled",
+        #else
+        "timer",
+        #endif
+        rpm, engine_cycles, loop_us, status_every);
+    printf("engine running at end: %s, %zu edges (%lu expected)\n\n",
+        e.is_running ? "true" : "false", monitor.edges.size(), engine_cycles * ACTUATIONS_PER_CYCLE);
+
+    print_summary_header(stdout);
+
+    for(int k = 0; k < 4; k++){
+        summary s = summarise(errors[k]);
+        print_summary(stdout, names[k], &s);
+    }
+
+    if(max_error >= 0 && worst_spark > max_error){
+        printf("\nFAIL: spark error %.2f deg exceeds %.2f deg\n", worst_spark, max_error);
+        return 1;
+    }
+
+    #ifndef POLLED_ACTUATION
+    host_detach(&signal);
+
+    unsigned int dropped;
+    bool opened = overflow_opens_outputs(&dropped);
+
+    printf("\nqueue overflow: %u dropped, every output %s\n", dropped, opened ? "opened" : "not opened");
+
+    if(!opened){
+        printf("\nFAIL: a full queue left outputs closed\n");
+        return 1;
+    }
+    #endif
+
+    return 0;
+}
@@ -0,0 +1,360 @@
+/*
+    Simulation farm benchmark.
+
+    Generates a set of engine scenarios from a seed, in four families:
+
+    - sweep: a clean steady speed, swept from 1000 to 6000 RPM.
+    - ramp: a clean acceleration or deceleration between two speeds.
+    - noisy: a steady speed with tooth timing error and dropped and
+      spurious IPG pulses.
+    - drift: a steady speed with the temperature drifting up, past the
+      maximum for some, over a trace three times as long.
+
+    Each scenario is played to its own copy of the control system, as
+    replay_bench plays its traces, by a pool of worker processes with
+    work stealing (see harness/work_pool.h). Every coil and injector
+    edge is scored against the timings in force, and the shutdowns
+    are counted by their cause in the flight recorder.
+
+    The scenarios are run once for each number of workers, by default
+    from 1 doubling up to the processors of the host, and at least 2.
+    For each it reports the throughput in simulated engine cycles per
+    second of wall-clock time, the speedup over 1 worker and the tasks
+    stolen, then the statistics of each family.
+
+    The run fails if any scenario is not run, if the results differ
+    with the number of workers, if a clean scenario stops or sparks
+    more than the error allowed from its timings, or if a drifting
+    temperature is shut down on when it stays below the maximum, or
+    not when it passes it.
+
+    usage: farm_bench [--scenarios N] [--seconds S] [--workers N] [--max-error DEG] [--loop-us N] [--seed N]
+
+    --workers runs the scenarios only with that number of workers.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_trace.h"
+#include "output_monitor.h"
+#include "timing_score.h"
+#include "work_pool.h"
+#include "stats.h"
+
+#define FAMILIES 4
+
+#define SWEEP   0
+#define RAMP    1
+#define NOISY   2
+#define DRIFT   3
+
+static const char* family_names[FAMILIES] = {"sweep", "ramp", "noisy", "drift"};
+
+// The maximum temperature of the sketch, which MAX_TEMP in bioengine.ino sets
+#define SKETCH_MAX_TEMP 80
+
+typedef struct scenario {
+    int family;
+    trace_options options;
+    // Whether the temperature passes the maximum, for the drift family
+    bool overheats;
+} scenario;
+
+/*
+    The result of a scenario, written by a worker into memory shared
+    with the others, so it is made of plain values only.
+*/
+typedef struct scenario_result {
+    bool started, running;
+    // The event the engine was shut down on, or 0
+    uint8_t shutdown;
+    double engine_cycles;
+    unsigned long sparks;
+    double spark_mean, spark_p99, spark_max, fuel_max, rpm_error;
+    unsigned int corrections, losses;
+} scenario_result;
+
+typedef struct farm {
+    std::vector<scenario> scenarios;
+    uint64_t loop_cycles;
+} farm;
+
+/* Uniform in [0, 1) */
+static double random_unit(uint32_t* seed){
+    *seed = *seed * 1664525UL + 1013904223UL;
+    return (*seed >> 8) / 16777216.0;
+}
+
+static double random_between(uint32_t* seed, double low, double high){
+    return low + (high - low) * random_unit(seed);
+}
+
+/* The scenarios of each family in turn, so the blocks of tasks the workers are given at first take unequal time */
+static std::vector<scenario> make_scenarios(unsigned long n, double seconds, uint32_t seed){
+    std::vector<scenario> scenarios;
+
+    for(unsigned long k = 0; k < n; k++){
+        int family = (int) (k * FAMILIES / n);
+        unsigned long first = (family * n + FAMILIES - 1) / FAMILIES;
+        unsigned long last = ((family + 1) * n + FAMILIES - 1) / FAMILIES;
+        double step = last - first > 1 ? (double) (k - first) / (last - first - 1) : 0;
+
+        uint32_t r = seed * 7919 + (uint32_t) k;
+        scenario sc = {family, {{}, seconds, 0, 0, 0, {}, r}, false};
+
+        switch(family){
+            case SWEEP:
+                sc.options.speeds = {{0, 1000 + 5000 * step}};
+                break;
+            case RAMP: {
+                double from = random_between(&r, 1000, 6000), to = random_between(&r, 1000, 6000);
+                sc.options.speeds = {{0, from}, {seconds / 3, from}, {seconds, to}};
+                break;
+            }
+            case NOISY:
+                sc.options.speeds = {{0, random_between(&r, 1500, 5000)}};
+                sc.options.jitter = random_between(&r, 0, 8);
+                sc.options.drop_rate = random_between(&r, 0, 0.002);
+                sc.options.spurious_rate = random_between(&r, 0, 0.002);
+                break;
+            case DRIFT: {
+                // Hot enough or not by a margin, so the reading at the end is on one side of the maximum
+                double end = step < 0.5 ? random_between(&r, 40, SKETCH_MAX_TEMP - 10) : random_between(&r, SKETCH_MAX_TEMP + 15, 110);
+
+                sc.options.seconds = 3 * seconds;
+                sc.options.speeds = {{0, random_between(&r, 2000, 4000)}};
+                sc.options.temps = {{0, 30}, {seconds, 30}, {2 * seconds, end}};
+                sc.overheats = end > SKETCH_MAX_TEMP;
+                break;
+            }
+        }
+
+        scenarios.push_back(sc);
+    }
+
+    return scenarios;
+}
+
+/* The last shutdown the flight recorder holds, or 0 */
+static uint8_t shutdown_event(void){
+    uint16_t held = fr.written < FLIGHT_RECORDS ? fr.written : FLIGHT_RECORDS;
+
+    for(uint16_t i = 1; i <= held; i++){
+        uint8_t code = fr.records[(fr.written - i) % FLIGHT_RECORDS].code;
+
+        if(code == EVENT_OVER_TEMPERATURE || code == EVENT_SIGNAL_MISMATCH || code == EVENT_TIMINGS_ERROR) return code;
+    }
+
+    return 0;
+}
+
+/* Plays a scenario to the control system of the worker, as replay_bench plays a trace */
+static void run_scenario(size_t task, void* out, void* context){
+    const farm* f = (const farm*) context;
+    const scenario* sc = &(f->scenarios[task]);
+    scenario_result* r = (scenario_result*) out;
+
+    boot();
+
+    engine_trace trace(&(sc->options), host_cycles());
+    trace_player player(&trace, &e.ipg, &e.cpg, &e.thermistor);
+    host_attach(&player);
+
+    r->started = start_engine(f->loop_cycles, trace.end - host_cycles());
+
+    output_monitor monitor;
+    timing_log timings(&trace, sc->options.jitter);
+    std::vector<double> rpm_errors;
+
+    while(r->started && host_cycles() < trace.end){
+        uint64_t cycle = host_cycles();
+        run_loop(f->loop_cycles);
+        timings.update(cycle);
+
+        if(e.is_running) rpm_errors.push_back(fabs(e.rpm - trace.rpm_at(host_cycles())));
+
+        host_serial_take();
+    }
+
+    host_detach(&player);
+
+    std::vector<double> spark, fuel;
+    timings.score(monitor.edges, &spark, &fuel);
+
+    summary s = summarise(spark);
+    summary fs = summarise(fuel);
+
+    r->running = r->started && e.is_running;
+    r->shutdown = r->started && !e.is_running ? shutdown_event() : 0;
+    r->engine_cycles = player.ipg_edges() / (double) (720 / IPG_PULSE_ANGLE);
+    r->sparks = s.n;
+    r->spark_mean = s.n ? s.mean : 0;
+    r->spark_p99 = s.n ? s.p99 : 0;
+    r->spark_max = s.n ? s.max : 0;
+    r->fuel_max = fs.n ? fs.max : 0;
+    r->rpm_error = rpm_errors.empty() ? 0 : summarise(rpm_errors).mean;
+    r->corrections = cs.corrections;
+    r->losses = cs.losses;
+}
+
+static const char* shutdown_name(uint8_t code){
+    switch(code){
+        case EVENT_OVER_TEMPERATURE: return "temperature";
+        case EVENT_SIGNAL_MISMATCH: return "signal";
+        case EVENT_TIMINGS_ERROR: return "timings";
+    }
+
+    return "-";
+}
+
+int main(int argc, char** argv){
+    unsigned long n = 48;
+    double seconds = 2.0;
+    unsigned long only_workers = 0;
+    double max_error = 1.0;
+    unsigned long loop_us = 50;
+    uint32_t seed = 1;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--scenarios")){
+            n = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--seconds")){
+            seconds = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--workers")){
+            only_workers = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--max-error")){
+            max_error = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--loop-us")){
+            loop_us = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--seed")){
+            seed = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(n < FAMILIES || seconds < 1){
+        fprintf(stderr, "--scenarios must be at least %d and --seconds at least 1\n", FAMILIES);
+        return 2;
+    }
+
+    farm f = {make_scenarios(n, seconds, seed), loop_us * HOST_CYCLES_PER_US};
+
+    std::vector<unsigned int> counts;
+
+    if(only_workers){
+        counts.push_back(only_workers);
+    } else {
+        unsigned int most = host_processors() < 2 ? 2 : host_processors();
+        for(unsigned int w = 1; w < most; w *= 2) counts.push_back(w);
+        counts.push_back(most);
+    }
+
+    printf("farm_bench: %lu scenarios of %.1f s, %u processors, %lu us nominal loop\n\n", n, seconds, host_processors(), loop_us);
+    printf("%8s %10s %16s %8s %8s %8s  %s\n", "workers", "wall [s]", "cycles/s", "speedup", "steals", "stolen", "tasks per worker");
+
+    std::vector<scenario_result> results(n), first(n);
+    bool all_run = true, same = true;
+    double one_worker_wall = 0;
+
+    for(size_t k = 0; k < counts.size(); k++){
+        pool_run run = run_pool(n, counts[k], run_scenario, &f, results.data(), sizeof(scenario_result));
+
+        double cycles = 0;
+        for(const scenario_result& r : results) cycles += r.engine_cycles;
+
+        unsigned long steals = 0, stolen = 0;
+        std::string tasks;
+
+        for(const pool_worker& w : run.workers){
+            steals += w.steals;
+            stolen += w.stolen;
+            tasks += std::to_string(w.tasks) + " ";
+        }
+
+        if(counts[k] == 1) one_worker_wall = run.wall;
+
+        char speedup[16] = "-";
+        if(one_worker_wall > 0) snprintf(speedup, sizeof(speedup), "%.2f", one_worker_wall / run.wall);
+
+        printf("%8u %10.2f %16.0f %8s %8lu %8lu  %s\n", counts[k], run.wall, cycles / run.wall, speedup,
+            steals, stolen, tasks.c_str());
+
+        if(!run.ok) all_run = false;
+
+        if(k == 0){
+            first = results;
+        } else if(memcmp(first.data(), results.data(), n * sizeof(scenario_result))){
+            same = false;
+        }
+    }
+
+    if(host_processors() == 1) printf("\nThe host has 1 processor, so more workers share it and cannot be quicker.\n");
+
+    printf("\n%-8s %6s %8s %8s %10s %10s %10s %10s %10s %6s %6s  %s\n", "family", "runs", "started", "running",
+        "cycles", "spark p99", "spark max", "fuel max", "RPM error", "fixed", "lost", "shutdowns");
+
+    bool clean_ok = true, drift_ok = true;
+
+    for(int family = 0; family < FAMILIES; family++){
+        unsigned long runs = 0, started = 0, running = 0, corrections = 0, losses = 0;
+        unsigned long shutdowns[3] = {0, 0, 0};
+        double cycles = 0, spark_max = 0, fuel_max = 0;
+        std::vector<double> p99, rpm_error;
+
+        for(size_t k = 0; k < n; k++){
+            const scenario* sc = &(f.scenarios[k]);
+            const scenario_result* r = &(first[k]);
+
+            if(sc->family != family) continue;
+
+            runs++;
+            started += r->started;
+            running += r->running;
+            cycles += r->engine_cycles;
+            corrections += r->corrections;
+            losses += r->losses;
+
+            if(r->shutdown) shutdowns[r->shutdown == EVENT_OVER_TEMPERATURE ? 0 : r->shutdown == EVENT_SIGNAL_MISMATCH ? 1 : 2]++;
+
+            if(r->running || family != DRIFT){
+                spark_max = fmax(spark_max, r->spark_max);
+                fuel_max = fmax(fuel_max, r->fuel_max);
+                p99.push_back(r->spark_p99);
+                rpm_error.push_back(r->rpm_error);
+            }
+
+            if((family == SWEEP || family == RAMP) && (!r->running || r->spark_max > max_error)) clean_ok = false;
+
+            if(family == DRIFT){
+                bool on_temperature = r->shutdown == EVENT_OVER_TEMPERATURE;
+                if(!r->started || on_temperature != sc->overheats || (!sc->overheats && !r->running)) drift_ok = false;
+            }
+        }
+
+        summary s = summarise(p99);
+        summary re = summarise(rpm_error);
+
+        printf("%-8s %6lu %8lu %8lu %10.0f %10.3f %10.3f %10.3f %10.1f %6lu %6lu  %s %lu, %s %lu, %s %lu\n",
+            family_names[family], runs, started, running, cycles, s.n ? s.max : 0, spark_max, fuel_max, re.n ? re.mean : 0,
+            corrections, losses, shutdown_name(EVENT_OVER_TEMPERATURE), shutdowns[0],
+            shutdown_name(EVENT_SIGNAL_MISMATCH), shutdowns[1], shutdown_name(EVENT_TIMINGS_ERROR), shutdowns[2]);
+    }
+
+    printf("\nspark p99 is the worst of the scenarios of the family\n\n");
+
+    check(all_run, "every scenario was run once by every pool");
+    check(same, "the results do not depend on the workers");
+    check(clean_ok, "clean scenarios keep running within the error");
+    check(drift_ok, "drifting temperatures shut down only past the max");
+
+    return check_status();
+}
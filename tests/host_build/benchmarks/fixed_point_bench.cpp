@@ -0,0 +1,177 @@
+/*
+    Fixed point angle and speed accuracy report.
+
+    Sweeps the engine speed over the range of the operating map and
+    compares the fixed point speed, angle estimate and spark/fuel
+    windows of the control system with the floating point arithmetic
+    they replaced, and with the exact values.
+
+    The angle estimate is scored at every step of the time between two
+    IPG pulses. Times are in ticks of Timer1, as the pulses are captured.
+
+    usage: fixed_point_bench [--rpm-step N] [--time-step US] [--max-error DEG]
+
+    --max-error fails the run if any fixed point angle is further than
+    DEG degrees from the floating point one.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "driver.h"
+#include "stats.h"
+
+// Angle errors are reported in thousandths of a degree
+#define MDEG 1000.0
+
+/* The floating point arithmetic of the control system before fixed point */
+
+// Pulse widths and times were in microseconds
+static float float_speed(float pulse_width){
+    return IPG_PULSE_ANGLE / pulse_width;
+}
+
+static int float_rpm(float speed){
+    return pow(10, 6) * speed * 60 / 360;
+}
+
+static float float_estimate(int crank, float speed, float elapsed){
+    return crank + (speed * elapsed);
+}
+
+int main(int argc, char** argv){
+    unsigned int rpm_step = 5;
+    unsigned long time_step = 4;
+    double max_error = 0.01;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm-step")){
+            rpm_step = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--time-step")){
+            time_step = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--max-error")){
+            max_error = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(!rpm_step || !time_step){
+        fprintf(stderr, "steps must be positive\n");
+        return 2;
+    }
+
+    boot();
+
+    unsigned int min_rpm = map_speeds[0];
+    unsigned int max_rpm = map_speeds[MAP_SPEEDS - 1];
+
+    std::vector<double> angle_fixed_float, angle_float_exact, angle_fixed_exact;
+    std::vector<double> rpm_fixed_float, dwell_fixed_float;
+
+    // A crank angle late in the cycle, where a float has the fewest bits left for the fraction
+    int crank = 690;
+
+    for(unsigned int rpm = min_rpm; rpm <= max_rpm; rpm += rpm_step){
+        uint32_t pulse_width = RPM_PERIOD_PRODUCT / rpm;
+
+        // A single interval, so the speed is that of the interval alone
+        init_speed_tracker(&(e.tracker));
+        update_velocity(&e, pulse_width);
+        set_crank(&e, crank);
+
+        float speed = float_speed((float) pulse_width / TICKS_PER_US);
+
+        rpm_fixed_float.push_back(abs(e.rpm - float_rpm(speed)));
+
+        // The angle turned while the coil charges, as in set_engine_timings
+        double dwell_fixed = ANGLE_TO_FLOAT((DWELL_TIME * TICKS_PER_US * ANGLE_ONE / e.period) * IPG_PULSE_ANGLE);
+        dwell_fixed_float.push_back(MDEG * fabs(dwell_fixed - speed * DWELL_TIME));
+
+        for(uint32_t elapsed = 0; elapsed < pulse_width; elapsed += time_step * TICKS_PER_US){
+            double fixed = ANGLE_TO_FLOAT(estimate_angle(&e, crank, elapsed));
+            double floating = float_estimate(crank, speed, (float) elapsed / TICKS_PER_US);
+            double exact = crank + (double) IPG_PULSE_ANGLE * elapsed / pulse_width;
+
+            angle_fixed_float.push_back(MDEG * fabs(fixed - floating));
+            angle_float_exact.push_back(MDEG * fabs(floating - exact));
+            angle_fixed_exact.push_back(MDEG * fabs(fixed - exact));
+        }
+    }
+
+    printf("fixed_point_bench: %u to %u RPM in steps of %u, angle estimate every %lu us\n\n",
+        min_rpm, max_rpm, rpm_step, time_step);
+
+    print_summary_header(stdout);
+
+    summary s;
+    double worst = 0;
+
+    s = summarise(angle_fixed_float);
+    print_summary(stdout, "angle, fixed - float [mdeg]", &s);
+    worst = s.max / MDEG;
+
+    s = summarise(angle_float_exact);
+    print_summary(stdout, "angle, float - exact [mdeg]", &s);
+
+    s = summarise(angle_fixed_exact);
+    print_summary(stdout, "angle, fixed - exact [mdeg]", &s);
+
+    s = summarise(dwell_fixed_float);
+    print_summary(stdout, "dwell, fixed - float [mdeg]", &s);
+    if(s.max / MDEG > worst) worst = s.max / MDEG;
+
+    s = summarise(rpm_fixed_float);
+    print_summary(stdout, "speed, fixed - float [RPM]", &s);
+
+    // The timings at each point of the operating map, in fixed point and as they were in float
+    printf("\n%-8s %12s %12s %12s %12s\n", "RPM", "spark start", "spark end", "fuel end", "max error");
+
+    for(size_t i = 0; i < MAP_SPEEDS; i++){
+        operating_point point = lookup_operating_point(map_speeds[i], map_temps[0]);
+        const operating_point* p = &point;
+
+        init_speed_tracker(&(e.tracker));
+        update_velocity(&e, RPM_PERIOD_PRODUCT / p->speed);
+
+        if(set_engine_timings(&t, p, &e)){
+            printf("%-8d %12s\n", p->speed, "invalid");
+            continue;
+        }
+
+        static const float spark_btdc[MAP_SPEEDS] = {7.50, 15.00, 20.00, 23.13, 26.25, 29.38, 32.50};
+        static const float inj_duration[MAP_SPEEDS] = {4.15, 9.57, 23.45, 38.46, 44.64, 51.24, 57.90};
+
+        float speed = float_speed((float) e.period / TICKS_PER_US);
+        float spark_end = 360 - spark_btdc[i];
+        float spark_start = spark_end - speed * DWELL_TIME;
+        float fuel_end = MIN_FUEL_START_ANGLE + inj_duration[i];
+
+        double errors[3] = {
+            fabs(ANGLE_TO_FLOAT(timings_in_force(&t)->spark[0]) - spark_start),
+            fabs(ANGLE_TO_FLOAT(timings_in_force(&t)->spark[1]) - spark_end),
+            fabs(ANGLE_TO_FLOAT(timings_in_force(&t)->fuel[1]) - fuel_end)
+        };
+
+        double row_worst = 0;
+
+        for(int k = 0; k < 3; k++){
+            if(errors[k] > row_worst) row_worst = errors[k];
+        }
+
+        if(row_worst > worst) worst = row_worst;
+
+        printf("%-8d %12.4f %12.4f %12.4f %12.6f\n",
+            p->speed, ANGLE_TO_FLOAT(timings_in_force(&t)->spark[0]), ANGLE_TO_FLOAT(timings_in_force(&t)->spark[1]), ANGLE_TO_FLOAT(timings_in_force(&t)->fuel[1]), row_worst);
+    }
+
+    if(max_error >= 0 && worst > max_error){
+        printf("\nFAIL: fixed point angle differs from float by %.6f deg, more than %.6f deg\n", worst, max_error);
+        return 1;
+    }
+
+    return 0;
+}
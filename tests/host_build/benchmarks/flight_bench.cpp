@@ -0,0 +1,361 @@
+/*
+    Flight recorder benchmark.
+
+    Plays a trace with dropped and spurious IPG pulses to the control
+    system and follows the flight recorder as it runs, then runs the
+    engine with passes of the loop long enough for the IPG interrupt
+    to overrun the pulse ring, and checks that:
+
+    - Every loss of the crank sync is recorded, and every overrun,
+      which is recorded by the interrupt.
+    - None of it is printed to the serial port, as it was before.
+    - DUMP sends the ring as it is, and the decoder reads it back.
+
+    It then shuts a running engine down on its temperature and checks
+    that the snapshot of the ring is written to the EEPROM without a
+    pass of the loop waiting on it, that the records it holds are not
+    overwritten until they are saved, that it survives a reset and is
+    sent whole by DUMP --EEPROM, that a snapshot saved partway through
+    the dump ends it rather than mixing the two, and that a reset
+    partway through the writing leaves no snapshot rather than a torn
+    one.
+
+    The time to record an event on the host is given against printing
+    the message that was sent for it before.
+
+    usage: flight_bench [--rpm N] [--seconds S] [--calls N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <avr/eeprom.h>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_signal.h"
+#include "engine_trace.h"
+#include "flight_log.h"
+#include "stats.h"
+
+#include <time.h>
+
+static double wall_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Follows the flight recorder from the loop, tallying each event as it is recorded */
+typedef struct follower {
+    uint16_t seen;
+    unsigned long tally[256];
+    // Events overwritten before they could be seen
+    unsigned long missed;
+} follower;
+
+static void follow(follower* f){
+    uint16_t written = fr.written;
+
+    if((uint16_t) (written - f->seen) > FLIGHT_RECORDS){
+        f->missed += (uint16_t) (written - f->seen) - FLIGHT_RECORDS;
+        f->seen = written - FLIGHT_RECORDS;
+    }
+
+    for(; f->seen != written; f->seen++) f->tally[fr.records[f->seen % FLIGHT_RECORDS].code]++;
+}
+
+/* Sends a command and runs the loop until a whole dump has been sent. Returns the output */
+static std::string dump(const char* command, uint64_t loop_cycles){
+    host_serial_take();
+    host_serial_feed(command);
+
+    std::string out;
+    uint64_t end = host_cycles() + F_CPU;
+
+    while(out.find("flight log: end") == std::string::npos && host_cycles() < end){
+        run_loop(loop_cycles);
+        out += host_serial_take();
+    }
+
+    return out;
+}
+
+/* Whether the events of a dump are the records of a ring, from a number up to another */
+static bool dump_matches(const flight_dump& d, const flight_record* records, uint16_t written){
+    unsigned int count = written < FLIGHT_RECORDS ? written : FLIGHT_RECORDS;
+
+    if(d.events.size() != count || d.count != count || d.written != written || !d.complete) return false;
+
+    for(unsigned int i = 0; i < count; i++){
+        const flight_event& ev = d.events[i];
+        uint16_t number = written - count + i;
+        const flight_record* p = &(records[number % FLIGHT_RECORDS]);
+
+        if(ev.number != number || ev.time != p->time || ev.code != p->code || ev.temp != p->temp
+            || ev.crank != p->crank || ev.rpm != p->rpm){
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Runs an engine at a speed until it is shut down on its temperature. Returns false if it did not start */
+static bool overheat(engine_signal* signal, uint64_t loop_cycles){
+    boot();
+
+    host_attach(signal);
+    if(!start_engine(loop_cycles, 5 * F_CPU)) return false;
+
+    // Any temperature is too hot, and the next cycle reads it
+    max_temp = -100;
+    temp_tacho = 1;
+
+    uint64_t end = host_cycles() + F_CPU;
+    while(e.is_running && host_cycles() < end) run_loop(loop_cycles);
+
+    return !e.is_running;
+}
+
+int main(int argc, char** argv){
+    double rpm = 3000;
+    double seconds = 4.0;
+    unsigned long calls = 1000000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--seconds")){
+            seconds = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(rpm <= 0 || calls < 1){
+        fprintf(stderr, "--rpm and --calls must be positive\n");
+        return 2;
+    }
+
+    uint64_t loop_cycles = 50 * HOST_CYCLES_PER_US;
+
+    printf("flight_bench: %.0f RPM, %.1f s trace, %d records\n\n", rpm, seconds, FLIGHT_RECORDS);
+
+    // A noisy trace, followed as it runs
+    host_eeprom_erase();
+    boot();
+
+    trace_options options = {{{0, rpm}}, seconds, 0, 0.01, 0.01, {}, 7};
+    engine_trace trace(&options, host_cycles());
+    trace_player player(&trace, &e.ipg, &e.cpg, &e.thermistor);
+    host_attach(&player);
+
+    follower f;
+    memset(&f, 0, sizeof(f));
+
+    bool sent_start = false;
+    size_t printed = 0;
+
+    while(host_cycles() < trace.end){
+        run_loop(loop_cycles);
+        follow(&f);
+
+        if(!sent_start && t.is_valid){
+            host_serial_feed("START\n");
+            sent_start = true;
+        }
+
+        std::string out = host_serial_take();
+        for(const char* m : {"Lost crank sync.", "Missed pulse.", "Correcting crankshaft angle."}){
+            for(size_t i = out.find(m); i != std::string::npos; i = out.find(m, i + 1)) printed++;
+        }
+    }
+
+    host_detach(&player);
+
+    std::string ring_dump = dump("DUMP\n", loop_cycles);
+    std::vector<flight_dump> dumps = parse_flight_dumps(ring_dump);
+    bool ring_sent = dumps.size() == 1 && !dumps[0].eeprom && dump_matches(dumps[0], fr.records, fr.written);
+
+    printf("%-40s %10s\n", "event", "recorded");
+    for(int code = FLIGHT_BOOT; code <= FLIGHT_PULSE_OVERRUN; code++){
+        if(f.tally[code]) printf("%-40s %10lu\n", flight_event_name(code), f.tally[code]);
+    }
+
+    printf("%-40s %10u\n", "crank sync losses", cs.losses);
+    printf("%-40s %10lu\n", "fault messages printed", (unsigned long) printed);
+    printf("\n");
+
+    bool losses_recorded = f.missed == 0 && f.tally[FLIGHT_SYNC_LOST] == cs.losses && cs.losses > 0;
+
+    // Passes of the loop long enough to overrun the pulse ring
+    boot();
+
+    engine_signal fast(&e.ipg, &e.cpg, 6000);
+    host_attach(&fast);
+    start_engine(loop_cycles, 5 * F_CPU);
+
+    memset(&f, 0, sizeof(f));
+    f.seen = fr.written;
+
+    uint16_t first_overruns = pulse_overruns(&pr);
+    for(int n = 0; n < 20; n++){
+        run_loop(20000 * HOST_CYCLES_PER_US);
+        follow(&f);
+    }
+
+    unsigned int overruns = pulse_overruns(&pr) - first_overruns;
+    bool overruns_recorded = overruns > 0 && f.tally[FLIGHT_PULSE_OVERRUN] + f.missed >= overruns
+        && f.tally[FLIGHT_PULSE_OVERRUN] <= overruns;
+
+    host_detach(&fast);
+
+    printf("%-40s %10u\n", "pulse overruns, 20 ms passes", overruns);
+    printf("%-40s %10lu\n", "recorded by the interrupt", f.tally[FLIGHT_PULSE_OVERRUN]);
+    printf("%-40s %10lu\n", "overwritten before the loop saw them", f.missed);
+    printf("\n");
+
+    // A shutdown on the temperature, and its snapshot
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+
+    host_eeprom_erase();
+    bool shut_down = overheat(&signal, loop_cycles);
+
+    flight_record at_shutdown[FLIGHT_RECORDS];
+    memcpy(at_shutdown, fr.records, sizeof(at_shutdown));
+    uint16_t written_at_shutdown = fr.written;
+
+    // The signal is stopped along with the engine, so the passes that follow only write the snapshot
+    host_detach(&signal);
+
+    // Events recorded while the snapshot is written, of which those that would overwrite the records it has yet to save are dropped
+    for(int n = 0; n < 40; n++) record_event(&fr, EVENT_PULSE_OVERRUN, 0, 0, 0, 0);
+    unsigned int held = written_at_shutdown < FLIGHT_RECORDS ? written_at_shutdown : FLIGHT_RECORDS;
+    uint16_t dropped = fr.dropped;
+
+    uint64_t save_start = host_cycles();
+    uint64_t blocked = 0;
+    unsigned long writes = host_eeprom_writes();
+
+    while(fr.snapshot.magic != 0 && host_cycles() - save_start < 5 * F_CPU){
+        blocked += run_loop(loop_cycles).blocked_cycles;
+    }
+
+    double save_ms = (host_cycles() - save_start) / (double) HOST_CYCLES_PER_US / 1000;
+    writes = host_eeprom_writes() - writes;
+
+    uint16_t written_before = fr.written;
+    record_event(&fr, EVENT_STOP, 0, 0, 0, 0);
+    bool recording_again = fr.written == written_before + 1;
+
+    // A reset, after which the snapshot is read back
+    boot();
+    run_loops_until(host_cycles() + F_CPU / 100, loop_cycles);
+    std::string boot_output = host_serial_take();
+
+    std::string snapshot_dump = dump("DUMP --EEPROM\n", loop_cycles);
+    dumps = parse_flight_dumps(snapshot_dump);
+
+    bool snapshot_sent = dumps.size() == 1 && dumps[0].eeprom && !dumps[0].empty
+        && dumps[0].cause == FLIGHT_OVER_TEMPERATURE && dump_matches(dumps[0], at_shutdown, written_at_shutdown)
+        && dumps[0].events.back().code == FLIGHT_OVER_TEMPERATURE;
+
+    if(dumps.size() == 1) printf("%s\n", flight_timeline(dumps[0]).c_str());
+
+    // A new snapshot saved partway through the dump, of which no record is sent under the old header
+    host_serial_take();
+    host_serial_feed("DUMP --EEPROM\n");
+
+    std::string partial;
+    uint64_t end = host_cycles() + F_CPU;
+    // Paused once half the records have been sent, as the lines queued for the serial port would be sent whatever follows
+    while(!(fr.dumping && fr.dump_started && (uint16_t) (fr.dump_end - fr.dump_next) <= held / 2) && host_cycles() < end){
+        run_loop(loop_cycles);
+        partial += host_serial_take();
+    }
+
+    flight_snapshot replaced;
+    read_flight_snapshot(&replaced);
+    replaced.written += 5;
+    for(size_t i = 0; i < sizeof(replaced); i++){
+        eeprom_update_byte((uint8_t*) (FLIGHT_SNAPSHOT_ADDRESS + i), ((const uint8_t*) &replaced)[i]);
+    }
+
+    while(partial.find("flight log: end") == std::string::npos && host_cycles() < end){
+        run_loop(loop_cycles);
+        partial += host_serial_take();
+    }
+
+    dumps = parse_flight_dumps(partial);
+
+    bool replaced_left_out = dumps.size() == 1 && dumps[0].complete && dumps[0].events.size() < dumps[0].count;
+    for(size_t i = 0; replaced_left_out && i < dumps[0].events.size(); i++){
+        const flight_event& ev = dumps[0].events[i];
+        const flight_record* p = &(at_shutdown[ev.number % FLIGHT_RECORDS]);
+        replaced_left_out = ev.time == p->time && ev.code == p->code && ev.crank == p->crank;
+    }
+
+    printf("%-40s %10.1f\n", "snapshot written in [ms]", save_ms);
+    printf("%-40s %10lu\n", "bytes written to the EEPROM", writes);
+    printf("%-40s %10.1f\n", "time the passes waited on it [us]", blocked / (double) HOST_CYCLES_PER_US);
+    printf("%-40s %10u\n", "events dropped while it was written", dropped);
+    printf("\n");
+
+    // A reset partway through the writing
+    host_eeprom_erase();
+    bool shut_down_again = overheat(&signal, loop_cycles);
+
+    for(int n = 0; n < 50; n++) run_loop(loop_cycles);
+    run_loops_until(host_cycles() + 50 * EEPROM_WRITE_CYCLES, loop_cycles);
+
+    bool partway = fr.snapshot.magic != 0;
+    host_detach(&signal);
+
+    boot();
+    dumps = parse_flight_dumps(dump("DUMP --EEPROM\n", loop_cycles));
+    bool torn_left_out = partway && dumps.size() == 1 && dumps[0].empty;
+
+    // The cost of recording a fault on the host, against printing its message as before
+    boot();
+
+    double t0 = wall_ns();
+    for(unsigned long n = 0; n < calls; n++) record_event(&fr, EVENT_MISSED_PULSE, n, n % 720, 3000, 40);
+    double record_ns = (wall_ns() - t0) / calls;
+
+    t0 = wall_ns();
+    for(unsigned long n = 0; n < calls; n++){
+        serial_println_P(&sp, PSTR("Missed pulse.\n"));
+
+        // Emptied as the interrupt would, so every message is queued
+        if(serial_tx_space(&sp) < 32) init_serial_port(&sp, 115200);
+    }
+    double print_ns = (wall_ns() - t0) / calls;
+
+    printf("%-40s %10.1f\n", "record an event on the host [ns]", record_ns);
+    printf("%-40s %10.1f\n", "print its message, as before [ns]", print_ns);
+    printf("%-40s %10zu\n", "bytes of the record on the host", sizeof(flight_record));
+    printf("%-40s %10zu\n", "bytes of the message, as before", strlen("Missed pulse.\n") + 2);
+    printf("\n");
+
+    check(losses_recorded, "every loss of sync is recorded");
+    check(printed == 0, "no fault is printed");
+    check(ring_sent, "DUMP sends the ring as it is");
+    check(overruns_recorded, "overruns are recorded by the interrupt");
+    check(shut_down && shut_down_again, "the engine is shut down on its temperature");
+    check(blocked == 0, "no pass waits on the EEPROM");
+    check(dropped == 40 - (FLIGHT_RECORDS - held), "unsaved records are not overwritten");
+    check(recording_again, "events are recorded once the snapshot is saved");
+    check(boot_output.find("DUMP --EEPROM") != std::string::npos, "a held snapshot is announced at start-up");
+    check(snapshot_sent, "DUMP --EEPROM sends the snapshot whole");
+    check(replaced_left_out, "a snapshot saved partway ends the dump");
+    check(torn_left_out, "a reset partway leaves no snapshot");
+
+    return check_status();
+}
@@ -0,0 +1,91 @@
+/*
+    Loop latency benchmark.
+
+    Boots the control system, drives it with a constant-speed CPG/IPG
+    signal until it is running, then records the cost of every pass
+    of loop() over a number of engine cycles.
+
+    usage: loop_bench [--rpm N] [--cycles N] [--loop-us N] [--status-every N]
+
+    --status-every sends a STATUS command every N engine cycles, to
+    include the cost of the serial replies in the measurement. Messages
+    the serial port dropped rather than block are counted.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "driver.h"
+#include "engine_signal.h"
+#include "stats.h"
+
+int main(int argc, char** argv){
+    double rpm = 3000;
+    unsigned long engine_cycles = 200;
+    unsigned long loop_us = 50;
+    unsigned long status_every = 0;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--cycles")){
+            engine_cycles = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--loop-us")){
+            loop_us = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--status-every")){
+            status_every = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    uint64_t loop_cycles = loop_us * HOST_CYCLES_PER_US;
+
+    boot();
+
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+    host_attach(&signal);
+
+    if(!start_engine(loop_cycles, 5 * F_CPU)){
+        fprintf(stderr, "engine did not start\n%s", host_serial_take().c_str());
+        return 1;
+    }
+
+    host_serial_take();
+
+    // One engine cycle is two revolutions, 24 IPG pulses
+    unsigned long first_edge = signal.edges();
+    unsigned long last_status = 0;
+
+    std::vector<double> host_ns, blocked_us;
+
+    while(signal.edges() - first_edge < engine_cycles * 24){
+        unsigned long cycle = (signal.edges() - first_edge) / 24;
+
+        if(status_every && cycle >= last_status + status_every){
+            host_serial_feed("STATUS\n");
+            last_status = cycle;
+        }
+
+        loop_sample s = run_loop(loop_cycles);
+
+        host_ns.push_back(s.host_ns);
+        blocked_us.push_back((double) s.blocked_cycles / HOST_CYCLES_PER_US);
+    }
+
+    printf("loop_bench: %.0f RPM, %lu engine cycles, %zu iterations, %lu us nominal loop\n",
+        rpm, engine_cycles, host_ns.size(), loop_us);
+    printf("engine running at end: %s, serial messages dropped: %u\n\n", e.is_running ? "true" : "false", sp.tx_dropped);
+
+    summary h = summarise(host_ns);
+    summary b = summarise(blocked_us);
+
+    print_summary_header(stdout);
+    print_summary(stdout, "host time per loop [ns]", &h);
+    print_summary(stdout, "blocked per loop [us]", &b);
+
+    return 0;
+}
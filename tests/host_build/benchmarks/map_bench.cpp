@@ -0,0 +1,153 @@
+/*
+    Operating map lookup benchmark.
+
+    Checks lookup_operating_point against a floating point bilinear
+    interpolation of the same map over a grid of engine speeds and
+    temperatures, including points beyond its edges, then times it per
+    call against the linear scan for an exact speed that it replaced.
+
+    usage: map_bench [--calls N] [--max-error DEG]
+
+    --max-error fails the run if any interpolated angle is further than
+    DEG degrees from the floating point one.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "driver.h"
+#include "stats.h"
+
+// Angle errors are reported in thousandths of a degree
+#define MDEG 1000.0
+
+static double clamp(double x, double low, double high){
+    return x < low ? low : x > high ? high : x;
+}
+
+/* Bilinear interpolation of a map in double precision, in degrees */
+static double reference(const int16_t map[MAP_TEMPS][MAP_SPEEDS], double rpm, double temp){
+    rpm = clamp(rpm, map_speeds[0], map_speeds[MAP_SPEEDS - 1]);
+    temp = clamp(temp, map_temps[0], map_temps[MAP_TEMPS - 1]);
+
+    size_t c = 0, r = 0;
+    while(c < MAP_SPEEDS - 2 && rpm >= map_speeds[c + 1]) c++;
+    while(r < MAP_TEMPS - 2 && temp >= map_temps[r + 1]) r++;
+
+    double u = (rpm - map_speeds[c]) / (map_speeds[c + 1] - map_speeds[c]);
+    double v = (temp - map_temps[r]) / (map_temps[r + 1] - map_temps[r]);
+
+    double low = map[r][c] + u * (map[r][c + 1] - map[r][c]);
+    double high = map[r + 1][c] + u * (map[r + 1][c + 1] - map[r + 1][c]);
+
+    return (low + v * (high - low)) / 256;
+}
+
+/* The lookup before interpolation: a linear scan for an exact speed */
+typedef struct scanned_point {
+    int speed;
+    float spark_btdc;
+    float inj_duration;
+} scanned_point;
+
+static const scanned_point scanned_map[MAP_SPEEDS] = {
+    {1000,  7.50,  4.15},
+    {2000, 15.00,  9.57},
+    {3000, 20.00, 23.45},
+    {4000, 23.13, 38.46},
+    {5000, 26.25, 44.64},
+    {6000, 29.38, 51.24},
+    {6250, 32.50, 57.90}
+};
+
+static scanned_point scan_operating_point(unsigned int target_speed){
+    for(size_t i = 0; i < MAP_SPEEDS; i++){
+        if(target_speed == (unsigned int) scanned_map[i].speed){
+            return scanned_map[i];
+        }
+    }
+
+    return (scanned_point) {-1, -1, -1};
+}
+
+int main(int argc, char** argv){
+    unsigned long calls = 2000000;
+    double max_error = 0.01;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--max-error")){
+            max_error = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    std::vector<double> spark_errors, fuel_errors;
+    unsigned long valid = 0, points = 0;
+
+    for(int rpm = 500; rpm <= 7000; rpm += 5){
+        for(int temp = -20; temp <= 100; temp++){
+            operating_point o = lookup_operating_point(rpm, temp);
+
+            spark_errors.push_back(MDEG * fabs(ANGLE_TO_FLOAT(o.spark_btdc) - reference(spark_map, rpm, temp)));
+            fuel_errors.push_back(MDEG * fabs(ANGLE_TO_FLOAT(o.inj_duration) - reference(fuel_map, rpm, temp)));
+        }
+
+        if(rpm >= map_speeds[0] && rpm <= map_speeds[MAP_SPEEDS - 1]){
+            points++;
+            if(scan_operating_point(rpm).speed != -1) valid++;
+        }
+    }
+
+    printf("map_bench: %d speeds by %d temperatures, speeds in the map found by the old scan: %lu of %lu\n\n",
+        MAP_SPEEDS, MAP_TEMPS, valid, points);
+
+    print_summary_header(stdout);
+
+    summary s;
+    double worst = 0;
+
+    s = summarise(spark_errors);
+    print_summary(stdout, "spark BTDC [mdeg]", &s);
+    worst = s.max / MDEG;
+
+    s = summarise(fuel_errors);
+    print_summary(stdout, "injection duration [mdeg]", &s);
+    if(s.max / MDEG > worst) worst = s.max / MDEG;
+
+    // Timed over speeds and temperatures that visit every span of the map
+    volatile int32_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        operating_point o = lookup_operating_point(900 + (i * 7919) % 5500, (int) (i % 97) - 5);
+        sink += o.spark_btdc;
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        scanned_point p = scan_operating_point(900 + (i * 7919) % 5500);
+        sink += p.speed;
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    printf("\n%-28s %10s\n", "", "ns/call");
+    printf("%-28s %10.1f\n", "interpolated lookup", std::chrono::duration<double, std::nano>(middle - start).count() / calls);
+    printf("%-28s %10.1f\n", "exact speed scan", std::chrono::duration<double, std::nano>(end - middle).count() / calls);
+
+    if(max_error >= 0 && worst > max_error){
+        printf("\nFAIL: interpolated angle differs by %.4f deg, more than %.4f deg\n", worst, max_error);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,275 @@
+/*
+    Map store benchmark.
+
+    Boots the control system with an erased EEPROM and checks that the
+    defaults are loaded, then runs the engine at a steady speed and
+    moves the spark angle of its speed for every temperature with SET
+    commands. It checks that:
+
+    - Each edit is put in force at TDC, within two cycles: the next,
+      or the one after if the outputs are still being handed over to
+      the edit before.
+    - The spark angle in force follows the edited cells.
+    - The map is saved to the EEPROM without a pass of the loop
+      waiting on it, and while the engine keeps running.
+    - The map survives a reset, and an edit of one cell after only
+      writes the bytes that changed.
+    - A corrupted byte, or a reset partway through a save, leaves the
+      defaults to be loaded rather than a torn map.
+    - Edits off the breakpoints of the map, or out of the range of a
+      cell, are rejected and leave the map as it was.
+
+    It reports the time taken to save the map, the time from start-up
+    to the first valid timings, given by the sketch, and the time to
+    load the map on the host.
+
+    usage: map_store_bench [--rpm N] [--calls N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include <avr/eeprom.h>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_signal.h"
+#include "stats.h"
+
+// The speed of the cells edited, a breakpoint of the map, and the spark angle they are moved to
+#define EDIT_RPM 3000
+#define EDIT_SPARK 30.0
+
+static double wall_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static bool is_default_map(void){
+    return !memcmp(live_map.spark, spark_map, sizeof(live_map.spark)) && !memcmp(live_map.fuel, fuel_map, sizeof(live_map.fuel));
+}
+
+/* Boots the control system and runs it briefly. Returns what it printed */
+static std::string boot_output(uint64_t loop_cycles){
+    boot();
+    run_loops_until(host_cycles() + F_CPU / 100, loop_cycles);
+    return host_serial_take();
+}
+
+/* Sends a command and runs the loop long enough for the reply to be sent. Returns the output */
+static std::string send(const char* command, uint64_t loop_cycles){
+    host_serial_take();
+    host_serial_feed(command);
+
+    run_loops_until(host_cycles() + F_CPU / 20, loop_cycles);
+    return host_serial_take();
+}
+
+/* Runs the loop until the map is saved. Returns the cycles the passes were blocked */
+static uint64_t save(uint64_t loop_cycles, double* save_ms){
+    uint64_t start = host_cycles(), blocked = 0;
+
+    while(live_map.unsaved && host_cycles() - start < 5 * F_CPU) blocked += run_loop(loop_cycles).blocked_cycles;
+
+    *save_ms = (host_cycles() - start) / (double) HOST_CYCLES_PER_US / 1000;
+    return blocked;
+}
+
+/* Reads the number after a phrase of the output, or -1 */
+static long number_after(const std::string& out, const char* phrase){
+    size_t i = out.find(phrase);
+    return i == std::string::npos ? -1 : strtol(out.c_str() + i + strlen(phrase), NULL, 10);
+}
+
+int main(int argc, char** argv){
+    double rpm = EDIT_RPM;
+    unsigned long calls = 100000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(rpm <= 0 || calls < 1){
+        fprintf(stderr, "--rpm and --calls must be positive\n");
+        return 2;
+    }
+
+    uint64_t loop_cycles = 50 * HOST_CYCLES_PER_US;
+    double cycle_ms = 2 * 60e3 / rpm;
+
+    printf("map_store_bench: %.0f RPM, cells at %d RPM moved to %.1f deg, map of %d by %d\n\n",
+        rpm, EDIT_RPM, EDIT_SPARK, MAP_TEMPS, MAP_SPEEDS);
+
+    // An erased EEPROM holds no map
+    host_eeprom_erase();
+    std::string out = boot_output(loop_cycles);
+    bool defaults_loaded = !live_map.from_eeprom && is_default_map() && out.find("No map held in EEPROM") != std::string::npos;
+
+    // A running engine, whose cells are edited
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+    host_attach(&signal);
+
+    // The clock starts from 0 at start-up
+    bool started = start_engine(loop_cycles, 5 * F_CPU);
+    out = host_serial_take();
+    long first_valid_ms = number_after(out, "Timings valid ");
+    double start_ms = host_cycles() / (double) HOST_CYCLES_PER_US / 1000;
+
+    std::vector<double> latency;
+    unsigned long off_tdc = 0, not_applied = 0, replies = 0;
+    unsigned long writes = host_eeprom_writes();
+
+    for(int r = 0; r < MAP_TEMPS; r++){
+        int temp = pgm_read_word(&(map_temps[r]));
+        char command[64];
+        snprintf(command, sizeof(command), "SET --RPM %d --TEMP %d --SPARK %.2f\n", EDIT_RPM, temp, EDIT_SPARK);
+
+        // Partway through a cycle
+        run_loops_until(host_cycles() + (uint64_t) (cycle_ms * 1000 * (r + 1) / (MAP_TEMPS + 1)) * HOST_CYCLES_PER_US, loop_cycles);
+        host_serial_take();
+
+        uint8_t active = t.active;
+        uint64_t sent = host_cycles();
+
+        host_serial_feed(command);
+
+        while(t.active == active && host_cycles() - sent < 4 * cycle_ms * 1000 * HOST_CYCLES_PER_US) run_loop(loop_cycles);
+
+        if(t.active == active){
+            not_applied++;
+            continue;
+        }
+
+        if(get_crank(&e) != 0) off_tdc++;
+        latency.push_back((host_cycles() - sent) / (double) HOST_CYCLES_PER_US / 1000);
+
+        // The reply is still being sent
+        run_loops_until(host_cycles() + F_CPU / 50, loop_cycles);
+        if(host_serial_take().find("Map cell updated.") != std::string::npos) replies++;
+    }
+
+    double spark_in_force = ANGLE_TO_FLOAT(t.o->spark_btdc);
+    bool followed = fabs(spark_in_force - EDIT_SPARK) < 0.5;
+
+    double save_ms;
+    uint64_t blocked = save(loop_cycles, &save_ms);
+    writes = host_eeprom_writes() - writes;
+
+    bool kept_running = started && e.is_running;
+    host_detach(&signal);
+
+    summary l = summarise(latency);
+
+    printf("%-48s %10.1f\n", "start-up to the engine running [ms]", start_ms);
+    printf("%-48s %10ld\n", "start-up to valid timings, by the sketch [ms]", first_valid_ms);
+    printf("%-48s %10.2f\n", "SET to edit in force, mean [ms]", l.mean);
+    printf("%-48s %10.2f\n", "SET to edit in force, max [ms]", l.max);
+    printf("%-48s %10.2f\n", "spark angle in force after the edits [deg]", spark_in_force);
+    printf("%-48s %10.1f\n", "map saved in [ms]", save_ms);
+    printf("%-48s %10lu\n", "bytes written to the EEPROM, erased before", writes);
+    printf("%-48s %10.1f\n", "time the passes waited on it [us]", blocked / (double) HOST_CYCLES_PER_US);
+
+    // A reset, after which the map is loaded from the EEPROM
+    int16_t edited = MAP_ANGLE(EDIT_SPARK);
+    uint8_t c = 0;
+    while((int16_t) pgm_read_word(&(map_speeds[c])) != EDIT_RPM) c++;
+
+    out = boot_output(loop_cycles);
+    long load_us = number_after(out, "Map loaded from EEPROM in ");
+
+    bool survived = live_map.from_eeprom && load_us >= 0;
+    for(int r = 0; r < MAP_TEMPS; r++) survived = survived && live_map.spark[r][c] == edited;
+
+    // An edit of one cell of a map that is held writes the cell and the CRC
+    unsigned long one_cell_writes = host_eeprom_writes();
+    uint64_t sent = host_cycles();
+
+    host_serial_feed("SET --RPM 3000 --TEMP 25 --FUEL 30\n");
+    while(!live_map.unsaved && host_cycles() - sent < F_CPU) run_loop(loop_cycles);
+    save(loop_cycles, &save_ms);
+
+    one_cell_writes = host_eeprom_writes() - one_cell_writes;
+    save_ms = (host_cycles() - sent) / (double) HOST_CYCLES_PER_US / 1000;
+
+    boot_output(loop_cycles);
+    bool one_cell_kept = live_map.from_eeprom && live_map.fuel[1][c] == MAP_ANGLE(30);
+
+    printf("%-48s %10ld\n", "map loaded at start-up, by the sketch [us]", load_us);
+    printf("%-48s %10.1f\n", "one cell saved in [ms]", save_ms);
+    printf("%-48s %10lu\n", "bytes written for one cell", one_cell_writes);
+
+    // The cost of the load on the host
+    double t0 = wall_ns();
+    for(unsigned long n = 0; n < calls; n++) load_operating_map(&live_map);
+    printf("%-48s %10.1f\n", "load the map on the host [ns]", (wall_ns() - t0) / calls);
+    printf("\n");
+
+    // A corrupted byte
+    uint8_t* cell = (uint8_t*) MAP_EEPROM_ADDRESS + 20;
+    uint8_t held = eeprom_read_byte(cell);
+    eeprom_write_byte(cell, held ^ 0x10);
+
+    out = boot_output(loop_cycles);
+    bool corrupted_left_out = !live_map.from_eeprom && is_default_map() && out.find("No map held in EEPROM") != std::string::npos;
+
+    eeprom_write_byte(cell, held);
+    boot_output(loop_cycles);
+    bool restored = live_map.from_eeprom;
+
+    // A reset partway through a save
+    unsigned long partway_writes = host_eeprom_writes();
+    host_serial_feed("SET --RPM 3000 --TEMP 50 --SPARK 25\n");
+
+    while(host_eeprom_writes() == partway_writes && host_cycles() < F_CPU) run_loop(loop_cycles);
+
+    bool partway = live_map.unsaved;
+    boot_output(loop_cycles);
+    bool torn_left_out = partway && !live_map.from_eeprom && is_default_map();
+
+    // Edits that are rejected
+    boot_output(loop_cycles);
+    operating_map before = live_map;
+
+    std::string off_breakpoint = send("SET --RPM 3100 --TEMP 25 --SPARK 20\n", loop_cycles);
+    std::string no_temp = send("SET --RPM 3000 --SPARK 20\n", loop_cycles);
+    std::string spark_range = send("SET --RPM 3000 --TEMP 25 --SPARK 95\n", loop_cycles);
+    std::string fuel_range = send("SET --RPM 3000 --TEMP 25 --FUEL -1\n", loop_cycles);
+    std::string not_angle = send("SET --RPM 3000 --TEMP 25 --FUEL 2x\n", loop_cycles);
+
+    bool rejected = off_breakpoint.find("No cell of the map") != std::string::npos
+        && no_temp.find("No cell of the map") != std::string::npos
+        && spark_range.find("out of range") != std::string::npos
+        && fuel_range.find("out of range") != std::string::npos
+        && not_angle.find("out of range") != std::string::npos
+        && !memcmp(before.spark, live_map.spark, sizeof(before.spark))
+        && !memcmp(before.fuel, live_map.fuel, sizeof(before.fuel))
+        && !live_map.unsaved;
+
+    check(defaults_loaded, "an erased EEPROM loads the defaults");
+    check(started && kept_running, "the engine runs through the edits and the save");
+    check(not_applied == 0 && replies == MAP_TEMPS && l.max <= 2 * cycle_ms + 1, "every edit is in force within two cycles");
+    check(off_tdc == 0, "edits are only put in force at TDC");
+    check(followed, "the timings follow the edited cells");
+    check(blocked == 0, "no pass waits on the EEPROM");
+    check(first_valid_ms >= 0, "the time to valid timings is reported");
+    check(survived, "the map survives a reset");
+    check(one_cell_kept && one_cell_writes <= 4, "one cell writes only the bytes that changed");
+    check(corrupted_left_out && restored, "a corrupted map loads the defaults");
+    check(torn_left_out, "a reset partway through a save loads the defaults");
+    check(rejected, "edits off the map or out of range are rejected");
+
+    return check_status();
+}
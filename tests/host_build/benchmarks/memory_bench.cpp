@@ -0,0 +1,245 @@
+/*
+    SRAM usage benchmark.
+
+    Checks the instruction parser, which now compares keywords where
+    they lie in the message against names in flash, against the parser
+    it replaced, which copied every keyword into an array on the stack,
+    over random messages, and checks the replies built for them too.
+
+    Then checks STATUS --MEM on the sketch: that the usage it gives
+    adds up to the SRAM of the board, and that the stack peak follows
+    the stack canary when the stack is run deeper. The SRAM of the host
+    is a model (see arduino/sram.cpp), so the static size it gives is
+    not that of the board, which STATUS --MEM gives on the board itself.
+    The model does take the rings of the serial port into the static
+    size, so the headroom given for the transmit ring at its old 512
+    bytes is the headroom given now, less the bytes it was shrunk by,
+    and every reply is checked to fit the ring as it is.
+
+    usage: memory_bench [--messages N] [--depth N] [--calls N]
+
+    --depth is how deep the stack is run, in bytes.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "checks.h"
+#include "driver.h"
+
+/* The parser before, which copied the keywords onto the stack */
+typedef char keywords[MAX_KEYWORDS][MAX_KEYWORD_LENGTH + 1];
+
+static void copied_keywords(const char message[], keywords kws){
+    size_t i = 0, j = 0, k = 0;
+
+    while(message[i] != '\n' && k != MAX_KEYWORDS){
+        if(message[i] == ' '){
+            if(i > 0 && j > 0){
+                kws[k][j] = '\0';
+                j = 0; k++;
+            }
+        } else if(j < MAX_KEYWORD_LENGTH){
+            kws[k][j] = message[i];
+            j++;
+        }
+
+        i++;
+    }
+
+    // The parser wrote one past the array with all ten keywords, which is left out here
+    if(k < MAX_KEYWORDS) kws[k][j] = '\0';
+}
+
+static int copied_flag_index(keywords k, const char* flag){
+    for(size_t i = 1; i < MAX_KEYWORDS - 1; i++){
+        if(!strcmp(k[i], flag)) return i;
+    }
+
+    return -1;
+}
+
+static instr copied_instruction(const char* message){
+    keywords kws = {{'\0'}};
+    copied_keywords(message, kws);
+
+    instr in = INVALID_INSTR;
+
+    if(!strcmp(kws[0], START_KEYWORD)) in.type = START_CODE;
+    else if(!strcmp(kws[0], STOP_KEYWORD)) in.type = STOP_CODE;
+    else if(!strcmp(kws[0], SET_KEYWORD)) in.type = SET_CODE;
+    else if(!strcmp(kws[0], STATUS_KEYWORD)) in.type = STATUS_CODE;
+
+    int i = copied_flag_index(kws, SPEED_FLAG);
+
+    if(i != -1){
+        long v = strtol(kws[i + 1], NULL, 0);
+        in.speed = v != 0 && v < INT16_MAX ? (int) v : -1;
+    }
+
+    in.profile = copied_flag_index(kws, PROFILE_FLAG) != -1;
+    in.memory = copied_flag_index(kws, MEMORY_FLAG) != -1;
+
+    return in;
+}
+
+static void copied_instruction_message(instr* i, char message[150]){
+    char type_name[10] = INVALID_KEYWORD;
+    char speed_string[50] = "not given";
+
+    switch(i->type){
+        case START_CODE: sprintf(type_name, START_KEYWORD); break;
+        case STOP_CODE: sprintf(type_name, STOP_KEYWORD); break;
+        case SET_CODE: sprintf(type_name, SET_KEYWORD); break;
+        case STATUS_CODE: sprintf(type_name, STATUS_KEYWORD);
+    }
+
+    if(i->type == SET_CODE && i->speed != -1) sprintf(speed_string, "%i rpm", i->speed);
+
+    sprintf(message, "\nnew instruction:\n    type: %s\n    speed: %s\n", type_name, speed_string);
+}
+
+// Bytes the parser and the reply kept on the stack before, besides their other locals
+#define COPIED_STACK (sizeof(keywords) + 10 + 50)
+
+// Bytes of the serial transmit ring before it was shrunk
+#define OLD_TX_SIZE 512
+
+static const char* vocabulary[] = {
+    START_KEYWORD, STOP_KEYWORD, SET_KEYWORD, STATUS_KEYWORD, SPEED_FLAG, PROFILE_FLAG, MEMORY_FLAG,
+    "3000", "0x400", "-20", "0", "40000", "abc", "STATU", "STATUSES", "--rpm", "--MEMORY", "A_VERY_LONG_KEYWORD_INDEED"
+};
+
+#define VOCABULARY (sizeof(vocabulary) / sizeof(vocabulary[0]))
+
+/* A message of up to nine keywords, as the old parser read at most ten, with spaces between and around them */
+static std::string random_message(uint32_t* seed){
+    std::string m(random_below(seed, 3), ' ');
+    uint32_t n = random_below(seed, 10);
+
+    for(uint32_t k = 0; k < n; k++){
+        m += vocabulary[random_below(seed, VOCABULARY)];
+        m += std::string(1 + random_below(seed, 2) * random_below(seed, 3), ' ');
+    }
+
+    return m + "\n";
+}
+
+static bool same_instr(const instr* a, const instr* b){
+    return a->type == b->type && a->speed == b->speed && a->profile == b->profile && a->memory == b->memory;
+}
+
+/* Sends a command and returns everything written back within 100 ms */
+static std::string exchange(const char* command){
+    host_serial_take();
+    host_serial_feed(command);
+    run_loops_until(host_cycles() + F_CPU / 10, DEFAULT_LOOP_CYCLES);
+    return host_serial_take();
+}
+
+/* Reads the number of bytes after a label in the reply to STATUS --MEM, or -1 */
+static long memory_field(const std::string& reply, const char* label){
+    std::string key = std::string("    ") + label + ": ";
+    size_t at = reply.find(key);
+
+    return at == std::string::npos ? -1 : strtol(reply.c_str() + at + key.size(), NULL, 10);
+}
+
+int main(int argc, char** argv){
+    unsigned long messages = 200000;
+    size_t depth = 600;
+    unsigned long calls = 1000000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--messages")){
+            messages = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--depth")){
+            depth = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    printf("memory_bench: %lu random messages, stack run %zu bytes deep\n\n", messages, depth);
+
+    uint32_t seed = 1;
+    unsigned long parsed = 0, replied = 0;
+
+    for(unsigned long n = 0; n < messages; n++){
+        std::string m = random_message(&seed);
+
+        instr a = get_instruction(m.c_str());
+        instr b = copied_instruction(m.c_str());
+
+        if(same_instr(&a, &b)) parsed++;
+
+        char reply[150], copied_reply[150];
+        get_instruction_message(&a, reply);
+        copied_instruction_message(&a, copied_reply);
+
+        if(!strcmp(reply, copied_reply)) replied++;
+    }
+
+    check(parsed == messages, "instructions match the copying parser");
+    check(replied == messages, "replies match the copying parser");
+
+    boot();
+
+    std::string reply = exchange("STATUS --MEM\n");
+
+    long sram = memory_field(reply, "SRAM"), fixed = memory_field(reply, "static");
+    long heap = memory_field(reply, "heap"), free = memory_field(reply, "free");
+    long peak = memory_field(reply, "stack peak"), headroom = memory_field(reply, "headroom");
+
+    check(reply.find("memory:") != std::string::npos && sram == RAMEND - RAMSTART + 1, "STATUS --MEM gives the SRAM");
+    check(fixed + heap + headroom + peak == sram, "usage adds up to the SRAM");
+    check(free + fixed + heap + HOST_STACK_DEPTH == sram, "free memory is up to the stack pointer");
+    check(peak == HOST_STACK_DEPTH, "the stack peak is the stack in use");
+
+    host_use_stack(depth);
+    std::string deeper = exchange("STATUS --MEM\n");
+
+    check(memory_field(deeper, "stack peak") == (long) depth, "the stack peak follows the canary");
+    check(memory_field(deeper, "headroom") == headroom - (long) (depth - HOST_STACK_DEPTH), "the headroom shrinks as much");
+
+    std::string status = exchange("STATUS\n");
+    check(status.find("engine status:") != std::string::npos && status.find("memory:") == std::string::npos,
+        "STATUS alone gives the status");
+
+    // The longest replies back to back, none of which may be dropped by the transmit ring
+    uint16_t tx_dropped = sp.tx_dropped;
+    exchange("STATUS --MEM\nSTATUS\nDUMP\n");
+    check(sp.tx_dropped == tx_dropped, "replies fit the transmit ring");
+
+    printf("\n%s", deeper.c_str() + deeper.find("memory:"));
+
+    printf("\n%-44s %10s %10s\n", "", "before", "now");
+    printf("%-44s %10d %10d\n", "serial transmit ring [bytes]", OLD_TX_SIZE, SERIAL_TX_SIZE);
+    long deeper_headroom = memory_field(deeper, "headroom");
+    printf("%-44s %10ld %10ld\n", "headroom given by STATUS --MEM [bytes]", deeper_headroom - (OLD_TX_SIZE - SERIAL_TX_SIZE), deeper_headroom);
+    printf("\n");
+
+    // Parsing a command each way
+    volatile int sink = 0;
+    static const char* commands[4] = {"STATUS\n", "SET --RPM 3000\n", "STATUS --MEM\n", "START\n"};
+
+    auto t0 = std::chrono::steady_clock::now();
+    for(unsigned long i = 0; i < calls; i++) sink += copied_instruction(commands[i & 3]).speed;
+    auto t1 = std::chrono::steady_clock::now();
+    for(unsigned long i = 0; i < calls; i++) sink += get_instruction(commands[i & 3]).speed;
+    auto t2 = std::chrono::steady_clock::now();
+
+    printf("%-44s %10s %10s\n", "", "copied", "in place");
+    printf("%-44s %10zu %10d\n", "stack kept by the parser and reply [bytes]", COPIED_STACK, 0);
+    printf("%-44s %10.1f %10.1f\n", "parse a command on the host [ns]",
+        std::chrono::duration<double, std::nano>(t1 - t0).count() / calls,
+        std::chrono::duration<double, std::nano>(t2 - t1).count() / calls);
+
+    return check_status();
+}
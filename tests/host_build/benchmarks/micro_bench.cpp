@@ -0,0 +1,385 @@
+/*
+    Critical path microbenchmarks.
+
+    Times each function of the control system on the path from an IPG
+    pulse or a command to the outputs, called alone with varied inputs
+    on the host, as the least time per call over the repeats, which go
+    round the whole suite so that every function sees the same stretch
+    of the run. The times are also given relative to a fixed reference
+    kernel timed in the same way, so that they can be compared between
+    hosts.
+
+    The relative costs are checked against the baselines stored in
+    benchmarks/baselines/micro_bench.csv. The run fails if any function
+    is slower than its baseline by more than the tolerance, or if the
+    sum over the suite, which stands for the cost of the path, is
+    slower by more than a tighter one, or if the sum over the functions
+    run on every pulse or in an interrupt is slower by more than a
+    tighter one still, as those are what a pass of the loop is bound
+    by. A function missing from the baselines is reported but not
+    checked.
+
+    usage: micro_bench [--calls N] [--repeats N] [--baseline FILE]
+                       [--tolerance F] [--total-tolerance F]
+                       [--path-tolerance F] [--out FILE]
+
+    --out writes the results as CSV in the format of the baselines, so
+    that a file written on a known good tree can replace them.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <map>
+#include <string>
+
+#include "driver.h"
+
+typedef struct micro {
+    const char* name;
+    // Makes the i-th call, folding anything returned into the result
+    uint32_t (*call)(unsigned long i);
+    // Sets up the state the calls run from, or NULL
+    void (*prepare)(void);
+    // Whether it runs on every pulse or in an interrupt, rather than once per pass of the loop or per command
+    bool pulse_path;
+} micro;
+
+// Speeds and times the calls are varied over
+static const uint32_t periods[8] = {1667, 2500, 3333, 5000, 6667, 8333, 10000, 16667};
+
+static char reply[150];
+
+static void running_engine(void){
+    init_engine(&e);
+
+    for(unsigned long i = 0; i < 8; i++) update_velocity(&e, periods[3]);
+
+    e.temp = 40;
+    e.is_running = true;
+    o = lookup_operating_point(e.rpm, e.temp);
+    set_engine_timings(&t, &o, &e);
+
+    // As if TDC had passed
+    swap_timings(&t);
+}
+
+/* A chain of dependent integer operations, which the other times are given relative to */
+static uint32_t reference(unsigned long i){
+    uint32_t x = (uint32_t) i;
+
+    for(int k = 0; k < 16; k++) x = (x * 1664525UL + 1013904223UL) ^ (x >> 7);
+
+    return x;
+}
+
+static uint32_t call_update_velocity(unsigned long i){
+    update_velocity(&e, periods[i & 7]);
+    return e.period;
+}
+
+static uint32_t call_estimate_angle(unsigned long i){
+    return estimate_angle(&e, (int) (i % 24) * IPG_PULSE_ANGLE, (uint32_t) (i * 97) % 6000);
+}
+
+static uint32_t call_should_open_circuit(unsigned long i){
+    return should_open_circuit(ANGLE(i % 720), timings_in_force(&t)->spark, &(e.coils[i % CYLINDERS]));
+}
+
+static uint32_t call_should_close_circuit(unsigned long i){
+    return should_close_circuit(ANGLE(i % 720), timings_in_force(&t)->fuel, &(e.injs[i % CYLINDERS]));
+}
+
+static uint32_t call_action_state(unsigned long i){
+    return *action_state(&(timings_in_force(&t)->table), ANGLE_TO_TABLE(ANGLE(i % 720)));
+}
+
+static uint32_t call_schedule_actuations(unsigned long i){
+    cancel_actuations(&s);
+    schedule_actuations(&s, &tm, &(timings_in_force(&t)->table), NULL, (int) (i % 24) * IPG_PULSE_ANGLE, timer_ticks(&tm), e.period, e.bend);
+    return s.head;
+}
+
+// The CPG counts of two cycles, the second with a tooth missing from the first
+static const uint8_t cpg_counts[6] = {START_OF_CYCLE_PULSES, REFERENCE_PULSES, MID_CYCLE_PULSES,
+    START_OF_CYCLE_PULSES - 1, REFERENCE_PULSES, MID_CYCLE_PULSES};
+
+static void synced_crank(void){
+    init_crank_sync(&cs);
+
+    for(unsigned long i = 0; i < 3; i++) sync_cpg_pulse(&cs, cpg_counts[i], SYNC_TOLERANCE);
+}
+
+static uint32_t call_sync_cpg_pulse(unsigned long i){
+    return (uint32_t) sync_cpg_pulse(&cs, cpg_counts[i % 6], SYNC_TOLERANCE);
+}
+
+static uint32_t call_lookup_operating_point(unsigned long i){
+    operating_point p = lookup_operating_point(900 + (i * 7919) % 5500, (int) (i % 97) - 5);
+    return p.spark_btdc + p.inj_duration;
+}
+
+static uint32_t call_set_engine_timings(unsigned long i){
+    (void) i;
+    return set_engine_timings(&t, &o, &e);
+}
+
+static uint32_t call_update_operating_point(unsigned long i){
+    (void) i;
+    return update_operating_point(&o, &t, &e);
+}
+
+static uint32_t call_adc_to_temperature(unsigned long i){
+    return adc_to_temperature((uint16_t) (i % 1024));
+}
+
+/* As running_engine, with the free-running ADC stopped, as before the sketch starts it */
+static void idle_adc_engine(void){
+    running_engine();
+    ADCSRA = 0;
+}
+
+static uint32_t call_get_internal_temp(unsigned long i){
+    host_set_analog(e.thermistor.pin, (int) (i % 1024));
+    return get_internal_temp(&e);
+}
+
+static uint32_t call_adc_sample(unsigned long i){
+    ADC = (uint16_t) (i % 1024);
+    adc_sample(&as);
+    return as.sum;
+}
+
+/* As the loop takes the temperature, from a block the interrupt has finished */
+static uint32_t call_take_temperature(unsigned long i){
+    as.value = (uint16_t) (i % (1024 << ADC_SAMPLER_BITS));
+    as.fresh = true;
+
+    uint16_t count;
+    if(take_adc_sample(&as, &count)) set_internal_temp(&e, thermistor_temperature_fine(count, ADC_SAMPLER_BITS));
+    return e.fine_temp;
+}
+
+static const char* commands[4] = {"STATUS\n", "SET --RPM 3000\n", "STATUS --PROFILE\n", "START\n"};
+
+static uint32_t call_get_instruction(unsigned long i){
+    instr in = get_instruction(commands[i & 3]);
+    return in.type + in.speed;
+}
+
+static uint32_t call_get_engine_info(unsigned long i){
+    e.crank = (int) (i % 720);
+    get_engine_info(&e, reply);
+    return reply[40];
+}
+
+static uint32_t call_stream_status_report(unsigned long i){
+    if(status_report_done(&sr)) start_status_report(&sr);
+
+    e.crank = (int) (i % 720);
+    uint32_t sent = stream_status_report(&sr);
+
+    // As if the line had gone out at once
+    sp.tx_tail = sp.tx_head;
+    return sent;
+}
+
+static const micro suite[] = {
+    {"reference",               reference,                  NULL,            false},
+    {"update_velocity",         call_update_velocity,       running_engine,  true},
+    {"estimate_angle",          call_estimate_angle,        running_engine,  false},
+    {"should_open_circuit",     call_should_open_circuit,   running_engine,  false},
+    {"should_close_circuit",    call_should_close_circuit,  running_engine,  false},
+    {"action_state",            call_action_state,          running_engine,  true},
+    {"schedule_actuations",     call_schedule_actuations,   running_engine,  true},
+    {"sync_cpg_pulse",          call_sync_cpg_pulse,        synced_crank,    true},
+    {"lookup_operating_point",  call_lookup_operating_point, NULL,           false},
+    {"set_engine_timings",      call_set_engine_timings,    running_engine,  false},
+    {"update_operating_point",  call_update_operating_point, running_engine, false},
+    {"adc_to_temperature",      call_adc_to_temperature,    NULL,            false},
+    {"get_internal_temp",       call_get_internal_temp,     idle_adc_engine, false},
+    {"adc_sample",              call_adc_sample,            idle_adc_engine, true},
+    {"take_temperature",        call_take_temperature,      idle_adc_engine, false},
+    {"get_instruction",         call_get_instruction,       NULL,            false},
+    {"get_engine_info",         call_get_engine_info,       running_engine,  false},
+    {"stream_status_report",    call_stream_status_report,  running_engine,  false},
+};
+
+#define SUITE (sizeof(suite) / sizeof(suite[0]))
+
+/* The time per call of one repeat, in ns */
+static double time_micro(const micro* m, unsigned long calls){
+    volatile uint32_t sink = 0;
+
+    if(m->prepare) m->prepare();
+
+    uint32_t folded = 0;
+    auto start = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++) folded += m->call(i);
+
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+    sink += folded;
+
+    (void) sink;
+    return ns;
+}
+
+/* Reads the relative cost of each function from a CSV file of results */
+static bool read_baselines(const char* path, std::map<std::string, double>* baselines){
+    FILE* f = fopen(path, "r");
+    if(!f) return false;
+
+    char line[256];
+
+    while(fgets(line, sizeof(line), f)){
+        char name[64];
+        unsigned long calls;
+        double ns, relative;
+
+        if(sscanf(line, "%63[^,],%lu,%lf,%lf", name, &calls, &ns, &relative) == 4){
+            (*baselines)[name] = relative;
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+int main(int argc, char** argv){
+    unsigned long calls = 200000;
+    int repeats = 15;
+    const char* baseline = "benchmarks/baselines/micro_bench.csv";
+    double tolerance = 1.5;
+    double total_tolerance = 0.5;
+    double path_tolerance = 0.15;
+    const char* out = NULL;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--repeats")){
+            repeats = atoi(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--baseline")){
+            baseline = argv[i + 1];
+        } else if(!strcmp(argv[i], "--tolerance")){
+            tolerance = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--total-tolerance")){
+            total_tolerance = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--path-tolerance")){
+            path_tolerance = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--out")){
+            out = argv[i + 1];
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(calls == 0 || repeats < 1){
+        fprintf(stderr, "--calls and --repeats must be positive\n");
+        return 2;
+    }
+
+    std::map<std::string, double> baselines;
+    bool compare = read_baselines(baseline, &baselines);
+
+    // The sketch is set up once for its globals, and then left alone
+    boot();
+
+    double ns[SUITE];
+
+    // The repeats go round the suite, so that the reference and each function are timed over the same stretch of the run
+    for(int r = 0; r < repeats; r++){
+        for(size_t k = 0; k < SUITE; k++){
+            double t = time_micro(&(suite[k]), calls);
+            if(r == 0 || t < ns[k]) ns[k] = t;
+        }
+    }
+
+    printf("micro_bench: least of %d repeats of %lu calls, relative to %.1f ns of reference\n", repeats, calls, ns[0]);
+    if(!compare) printf("no baselines in %s, nothing is checked\n", baseline);
+    printf("\n%-28s %10s %10s %10s  %s\n", "", "ns/call", "relative", "baseline", "result");
+
+    FILE* csv = NULL;
+
+    if(out){
+        csv = fopen(out, "w");
+
+        if(!csv){
+            fprintf(stderr, "cannot open %s\n", out);
+            return 2;
+        }
+
+        fprintf(csv, "function,calls,ns_per_call,relative\n");
+    }
+
+    int failures = 0;
+    double total = 0, total_baseline = 0;
+    double path = 0, path_baseline = 0;
+    bool total_complete = true;
+
+    for(size_t k = 0; k < SUITE; k++){
+        const char* name = suite[k].name;
+        double relative = ns[k] / ns[0];
+
+        if(csv) fprintf(csv, "%s,%lu,%.2f,%.4f\n", name, calls, ns[k], relative);
+
+        if(k == 0){
+            printf("%-28s %10.1f %10.3f\n", name, ns[k], relative);
+            continue;
+        }
+
+        total += relative;
+        if(suite[k].pulse_path) path += relative;
+
+        auto b = baselines.find(name);
+
+        if(b == baselines.end()){
+            total_complete = false;
+            printf("%-28s %10.1f %10.3f %10s  %s\n", name, ns[k], relative, "-", compare ? "no baseline" : "");
+            continue;
+        }
+
+        total_baseline += b->second;
+        if(suite[k].pulse_path) path_baseline += b->second;
+
+        bool ok = relative <= b->second * (1 + tolerance);
+        if(!ok) failures++;
+
+        printf("%-28s %10.1f %10.3f %10.3f  %s\n", name, ns[k], relative, b->second, ok ? "ok" : "FAIL: slower");
+    }
+
+    if(csv) fclose(csv);
+
+    printf("\n%-28s %10s %10.3f", "suite", "", total);
+
+    if(compare && total_complete){
+        bool ok = total <= total_baseline * (1 + total_tolerance);
+        if(!ok) failures++;
+
+        printf(" %10.3f  %s\n", total_baseline, ok ? "ok" : "FAIL: slower");
+    } else {
+        printf("\n");
+    }
+
+    printf("%-28s %10s %10.3f", "pulse path", "", path);
+
+    if(compare && total_complete){
+        bool ok = path <= path_baseline * (1 + path_tolerance);
+        if(!ok) failures++;
+
+        printf(" %10.3f  %s\n", path_baseline, ok ? "ok" : "FAIL: slower");
+    } else {
+        printf("\n");
+    }
+
+    if(failures){
+        printf("\nFAIL: %d costs are above their baselines by more than %.0f%% each, %.0f%% in sum or %.0f%% on the pulse path\n",
+            failures, 100 * tolerance, 100 * total_tolerance, 100 * path_tolerance);
+        return 1;
+    }
+
+    return 0;
+}
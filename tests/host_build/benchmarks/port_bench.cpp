@@ -0,0 +1,192 @@
+/*
+    Batched port write benchmark.
+
+    Checks that a batch of coil and injector changes, committed with
+    one write per port, leaves the ports as writing each change in
+    turn would, including batches that span more ports than a batch
+    holds, and that shutdown opens every output.
+
+    Then runs the engine at a constant speed and counts the changes
+    each compare interrupt applies against the ports it writes, which
+    were one write per change before the changes were batched. The
+    time to open all eight outputs on the host is given each way, and
+    the SRAM the pins of the engine take on the board is given for the
+    compact descriptor against the one with the name in SRAM.
+
+    usage: port_bench [--rpm N] [--cycles N] [--batches N] [--calls N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <set>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_signal.h"
+#include "output_monitor.h"
+
+// Sizes on the board, where pointers and int are 16 bits and structs are not padded
+#define AVR_POINTER     2
+#define AVR_INT         2
+#define OLD_PIN_SIZE    (15 + AVR_POINTER + 1 + AVR_INT)
+#define NEW_PIN_SIZE    (AVR_POINTER + AVR_POINTER + 1 + 1)
+#define ENGINE_PINS     (3 + 2 * CYLINDERS)
+
+/* Applies random changes to ports one at a time and as a batch, and compares the two */
+static bool batches_match(unsigned long batches, uint8_t ports){
+    volatile uint8_t each[MAX_BATCH_PORTS + 1], batched[MAX_BATCH_PORTS + 1];
+    uint32_t seed = ports;
+
+    for(unsigned long n = 0; n < batches; n++){
+        for(uint8_t p = 0; p < ports; p++){
+            each[p] = batched[p] = (uint8_t) random_below(&seed, 256);
+        }
+
+        port_batch b;
+        init_port_batch(&b);
+
+        uint32_t changes = 1 + random_below(&seed, 16);
+
+        for(uint32_t c = 0; c < changes; c++){
+            uint8_t p = (uint8_t) random_below(&seed, ports);
+            uint8_t mask = 1 << random_below(&seed, 8);
+            bool close = random_below(&seed, 2);
+
+            if(close){
+                each[p] |= mask;
+            } else {
+                each[p] &= ~mask;
+            }
+
+            batch_write(&b, &(batched[p]), mask, close);
+        }
+
+        commit_port_batch(&b);
+
+        for(uint8_t p = 0; p < ports; p++){
+            if(each[p] != batched[p]) return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char** argv){
+    double rpm = 6000;
+    unsigned long engine_cycles = 200;
+    unsigned long batches = 100000;
+    unsigned long calls = 1000000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--cycles")){
+            engine_cycles = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--batches")){
+            batches = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    printf("port_bench: %.0f RPM, %lu engine cycles, %lu random batches\n\n", rpm, engine_cycles, batches);
+
+    check(batches_match(batches, MAX_BATCH_PORTS), "batches match writes in turn");
+    check(batches_match(batches, MAX_BATCH_PORTS + 1), "batches over more ports than held match");
+
+    boot();
+
+    for(int c = 0; c < MONITORED_CIRCUITS; c++) close_circuit(monitored_pin(c));
+    shutdown(&e);
+
+    bool all_open = true;
+    for(int c = 0; c < MONITORED_CIRCUITS; c++) all_open = all_open && !pin_state(monitored_pin(c));
+
+    check(all_open, "shutdown opens every output");
+
+    // Changes applied by each compare interrupt, sampled as it returns
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+    host_attach(&signal);
+
+    uint64_t loop_cycles = DEFAULT_LOOP_CYCLES;
+
+    if(!start_engine(loop_cycles, 5 * F_CPU)){
+        fprintf(stderr, "engine did not start\n%s", host_serial_take().c_str());
+        return 1;
+    }
+
+    output_monitor monitor;
+    unsigned long first_edge = signal.edges();
+
+    while(signal.edges() - first_edge < engine_cycles * 24) run_loop(loop_cycles);
+
+    host_detach(&signal);
+
+    unsigned long changes = monitor.edges.size(), writes = 0, interrupts = 0;
+
+    for(size_t i = 0; i < monitor.edges.size(); ){
+        std::set<volatile uint8_t*> ports;
+        uint64_t cycle = monitor.edges[i].cycle;
+
+        while(i < monitor.edges.size() && monitor.edges[i].cycle == cycle){
+            ports.insert(monitored_pin(monitor.edges[i].circuit)->reg);
+            i++;
+        }
+
+        writes += ports.size();
+        interrupts++;
+    }
+
+    // The last cycle may be cut short by the end of the run
+    check(e.is_running && changes >= (engine_cycles - 1) * TABLE_EDGES, "every change is applied");
+
+    std::set<volatile uint8_t*> output_ports;
+    for(int c = 0; c < MONITORED_CIRCUITS; c++) output_ports.insert(monitored_pin(c)->reg);
+
+    printf("\n%-44s %10s %10s\n", "", "per change", "batched");
+    printf("%-44s %10.2f %10.2f\n", "port writes per engine cycle",
+        (double) changes / engine_cycles, (double) writes / engine_cycles);
+    printf("%-44s %10.2f %10.2f\n", "port writes per compare interrupt",
+        (double) changes / interrupts, (double) writes / interrupts);
+    printf("%-44s %10d %10zu\n", "port writes to shut down", MONITORED_CIRCUITS, output_ports.size());
+
+    // All eight outputs opened in turn, as shutdown did, and as a batch
+    volatile uint32_t sink = 0;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        for(int c = 0; c < MONITORED_CIRCUITS; c++) open_circuit(monitored_pin(c));
+        sink += PORTB;
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        port_batch b;
+        init_port_batch(&b);
+
+        for(int c = 0; c < MONITORED_CIRCUITS; c++) batch_open(&b, monitored_pin(c));
+
+        commit_port_batch(&b);
+        sink += PORTB;
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    printf("%-44s %10.1f %10.1f\n", "open 8 outputs on the host [ns]",
+        std::chrono::duration<double, std::nano>(t1 - t0).count() / calls,
+        std::chrono::duration<double, std::nano>(t2 - t1).count() / calls);
+
+    printf("\n%-44s %10s %10s\n", "", "SRAM name", "compact");
+    printf("%-44s %10d %10d\n", "pin descriptor on the board [bytes]", OLD_PIN_SIZE, NEW_PIN_SIZE);
+    printf("%-44s %10d %10d\n", "pins of the engine on the board [bytes]",
+        ENGINE_PINS * OLD_PIN_SIZE, ENGINE_PINS * NEW_PIN_SIZE);
+
+    return check_status();
+}
@@ -0,0 +1,157 @@
+/*
+    Loop profile benchmark.
+
+    Runs the engine at a constant speed, takes the loop profile with
+    STATUS --PROFILE, runs on and takes it again, then checks the
+    second dump: that it covers only the passes since the first, that
+    every stage was timed, and that the temperature stage no longer
+    waits the 104 us the ADC takes to convert, now that it is sampled
+    freely. A plain STATUS is then checked to give the usual status.
+
+    Only the time the loop spends blocked passes on the virtual clock,
+    so waits on the serial port are the only times the host profile 
+    shows. The cost of a probe on the host is
+    reported for reference.
+
+    usage: profile_bench [--rpm N] [--cycles N] [--calls N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_signal.h"
+
+/* Sends a command and returns everything written back within 100 ms */
+static std::string exchange(const char* command, uint64_t loop_cycles){
+    host_serial_take();
+    host_serial_feed(command);
+    run_loops_until(host_cycles() + F_CPU / 10, loop_cycles);
+    return host_serial_take();
+}
+
+typedef struct stage_line {
+    bool found;
+    unsigned long count;
+    double min, max;
+} stage_line;
+
+/* Reads the count and the range of times of a stage from a dump */
+static stage_line parse_stage(const std::string& dump, const char* name){
+    stage_line l = {false, 0, 0, 0};
+    std::string key = std::string("    ") + name + ": ";
+
+    size_t at = dump.find(key);
+    if(at == std::string::npos) return l;
+
+    const char* s = dump.c_str() + at + key.size();
+    l.found = true;
+
+    if(sscanf(s, "%lu, %lf-%lf us", &l.count, &l.min, &l.max) < 1) l.found = false;
+
+    return l;
+}
+
+int main(int argc, char** argv){
+    double rpm = 3000;
+    unsigned long engine_cycles = 200;
+    unsigned long calls = 10000000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--cycles")){
+            engine_cycles = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    uint64_t loop_cycles = DEFAULT_LOOP_CYCLES;
+
+    boot();
+
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+    host_attach(&signal);
+
+    if(!start_engine(loop_cycles, 5 * F_CPU)){
+        fprintf(stderr, "engine did not start\n%s", host_serial_take().c_str());
+        return 1;
+    }
+
+    exchange("STATUS --PROFILE\n", loop_cycles);
+
+    // Counted from the first dump, which resets the histograms as it is taken
+    unsigned long passes = pf.stages[STAGE_LOOP].count;
+    unsigned long first_edge = signal.edges();
+
+    while(signal.edges() - first_edge < engine_cycles * 24){
+        run_loop(loop_cycles);
+        passes++;
+    }
+
+    uint16_t dropped = sp.tx_dropped;
+
+    // The passes until the command is read are counted too
+    host_serial_take();
+    host_serial_feed("STATUS --PROFILE\n");
+
+    while(pf.stages[STAGE_LOOP].count >= passes){
+        run_loop(loop_cycles);
+        passes++;
+    }
+
+    // The dump holds the histograms from the serial stage of the pass, and resets them once it is sent
+    passes--;
+
+    run_loops_until(host_cycles() + F_CPU / 10, loop_cycles);
+    std::string dump = host_serial_take();
+
+    printf("profile_bench: %.0f RPM, %lu engine cycles, %lu passes between dumps\n\n", rpm, engine_cycles, passes);
+
+    size_t start = dump.find("loop profile:");
+    printf("%s", start == std::string::npos ? dump.c_str() : dump.c_str() + start);
+
+    stage_line serial = parse_stage(dump, "serial");
+    stage_line pulses = parse_stage(dump, "pulses");
+    stage_line timings = parse_stage(dump, "timings");
+    stage_line temperature = parse_stage(dump, "temperature");
+    stage_line actuation = parse_stage(dump, "actuation");
+    stage_line loop = parse_stage(dump, "loop");
+
+    check(serial.found && pulses.found && timings.found && temperature.found && actuation.found && loop.found,
+        "every stage is dumped");
+    check(loop.count == passes, "the dump covers the passes since the last");
+    check(serial.count == loop.count && pulses.count == loop.count && actuation.count == loop.count,
+        "serial, pulses and actuation every pass");
+    check(timings.count > 0 && temperature.count > 0, "timings and temperature are timed");
+    check(temperature.max < 104, "temperature does not wait on the ADC");
+    check(loop.max >= temperature.max, "the loop covers its stages");
+    check(sp.tx_dropped == dropped, "the dump fits the transmit ring");
+
+    std::string status = exchange("STATUS\n", loop_cycles);
+    check(status.find("engine status:") != std::string::npos && status.find("loop profile:") == std::string::npos,
+        "STATUS alone gives the status");
+
+    // The probe as the loop makes it: a reading of the timer and the histogram
+    init_profiler(&pf);
+    uint32_t probe = timer_ticks(&tm);
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        probe = profile_stage(&pf, STAGE_SERIAL, probe, timer_ticks(&tm) + (uint32_t) (i & 0x3FF));
+    }
+
+    double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / calls;
+    printf("\n%-44s %.1f\n", "probe on the host [ns]", ns);
+
+    return check_status();
+}
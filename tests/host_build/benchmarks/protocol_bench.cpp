@@ -0,0 +1,209 @@
+/*
+    Binary command frame benchmark.
+
+    Compares the text commands and the binary frames of the control
+    system in bytes on the wire and in the time taken to decode a 
+    command and to build the reply to STATUS, then drives the sketch
+    with frames built by the host encoder, mixed with text commands,
+    and checks every reply.
+
+    usage: protocol_bench [--calls N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_signal.h"
+#include "frame_codec.h"
+
+void send_status_frame(void);
+
+/* Sends bytes to the sketch and returns everything it writes back within 50 ms */
+static std::string exchange(const std::string& bytes, uint64_t loop_cycles){
+    host_serial_take();
+    host_serial_feed(bytes);
+    run_loops_until(host_cycles() + F_CPU / 20, loop_cycles);
+    return host_serial_take();
+}
+
+/* Returns the result byte of the only reply of a type, or -1 */
+static int result_of(const std::string& output, uint8_t type){
+    std::vector<host_frame> frames = decode_frames(output, NULL);
+
+    if(frames.size() != 1 || frames[0].type != (type | CODEC_REPLY) || frames[0].payload.size() != 1) return -1;
+
+    return frames[0].payload[0];
+}
+
+static double ns_per_call(std::chrono::steady_clock::time_point start, unsigned long calls){
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / calls;
+}
+
+int main(int argc, char** argv){
+    unsigned long calls = 1000000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    uint64_t loop_cycles = 50 * HOST_CYCLES_PER_US;
+
+    // The CRC table of the firmware against the bitwise CRC of the host
+    bool crc_match = true;
+
+    for(int c = 0; c < 256; c++){
+        uint8_t b = (uint8_t) c;
+        if(crc8_update(0, b) != codec_crc8(&b, 1)) crc_match = false;
+    }
+
+    boot();
+
+    engine_signal signal(&e.ipg, &e.cpg, 3000);
+    host_attach(&signal);
+
+    run_loops_until(host_cycles() + F_CPU / 2, loop_cycles);
+
+    // Replies as the text commands give them, for their size on the wire
+    std::string text_status = exchange("STATUS\n", loop_cycles);
+    std::string text_set = exchange("SET --RPM 3000\n", loop_cycles);
+
+    std::string start = exchange(encode_start(), loop_cycles);
+    run_loops_until(host_cycles() + F_CPU / 10, loop_cycles);
+
+    // The state of the control system as the reply to STATUS is queued
+    host_serial_take();
+    host_serial_feed(encode_status());
+    while(sp.tx_head == sp.tx_tail) run_loop(loop_cycles);
+
+    engine queued_e = e;
+    timings queued_t = t;
+
+    run_loops_until(host_cycles() + F_CPU / 20, loop_cycles);
+    std::string status = host_serial_take();
+    std::string set = exchange(encode_set(3000), loop_cycles);
+
+    printf("protocol_bench: %zu byte frame overhead, replies at %lu Bd\n\n", (size_t) FRAME_OVERHEAD, sp.baud);
+
+    printf("%-28s %10s %10s\n", "bytes on the wire", "text", "frame");
+    printf("%-28s %10zu %10zu\n", "STATUS", strlen("STATUS\n"), encode_status().size());
+    printf("%-28s %10zu %10zu\n", "SET", strlen("SET --RPM 3000\n"), encode_set(3000).size());
+    printf("%-28s %10zu %10zu\n", "STATUS reply", text_status.size(), status.size());
+    printf("%-28s %10zu %10zu\n", "SET reply", text_set.size(), set.size());
+
+    // Decoding a command
+    volatile int sink = 0;
+    std::string frame_bytes = encode_set(3000);
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        instr in = get_instruction("SET --RPM 3000\n");
+        sink += in.speed;
+    }
+
+    double text_decode = ns_per_call(t0, calls);
+
+    frame_decoder d;
+    init_frame_decoder(&d);
+
+    t0 = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        for(char c : frame_bytes){
+            if(decode_frame_byte(&d, (uint8_t) c)) sink += get_uint16(d.f.payload);
+        }
+    }
+
+    double frame_decode = ns_per_call(t0, calls);
+
+    // Building the reply to STATUS, with the transmit ring emptied before each
+    char reply[MESSAGE_SIZE];
+
+    t0 = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        get_engine_info(&e, reply);
+        get_timing_info(&t, reply);
+        get_serial_info(&sp, reply);
+        sink += reply[0];
+    }
+
+    double text_reply = ns_per_call(t0, calls);
+
+    t0 = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        sp.tx_head = sp.tx_tail = 0;
+        send_status_frame();
+    }
+
+    double frame_reply = ns_per_call(t0, calls);
+    sp.tx_head = sp.tx_tail = 0;
+
+    printf("\n%-28s %10s %10s\n", "ns/call", "text", "frame");
+    printf("%-28s %10.1f %10.1f\n", "decode SET", text_decode, frame_decode);
+    printf("%-28s %10.1f %10.1f\n", "build STATUS reply", text_reply, frame_reply);
+
+    printf("\n");
+
+    check(crc_match, "CRC table matches bitwise CRC");
+    check(result_of(start, CODEC_START) == FRAME_OK && e.is_running, "START frame starts the engine");
+
+    status_reply r;
+    std::vector<host_frame> frames = decode_frames(status, NULL);
+
+    check(frames.size() == 1 && parse_status(frames[0], &r)
+        && r.is_running && r.timings_valid && r.crank_synced && abs(r.rpm - 3000) < 30 && r.rejected == 0,
+        "STATUS frame reply");
+    check(frames.size() == 1 && r.crank == queued_e.crank && r.rpm == queued_e.rpm && r.temp == queued_e.temp
+        && r.spark[0] == ANGLE_TO_FLOAT(timings_in_force(&queued_t)->spark[0]) && r.spark[1] == ANGLE_TO_FLOAT(timings_in_force(&queued_t)->spark[1])
+        && r.fuel[0] == ANGLE_TO_FLOAT(timings_in_force(&queued_t)->fuel[0]) && r.fuel[1] == ANGLE_TO_FLOAT(timings_in_force(&queued_t)->fuel[1]),
+        "STATUS fields match the control system");
+
+    check(result_of(set, CODEC_SET) == FRAME_OK, "SET frame accepted");
+    check(result_of(exchange(encode_set(-5), loop_cycles), CODEC_SET) == FRAME_REJECTED, "SET frame of a negative speed rejected");
+
+    check(result_of(exchange(encode_param(CODEC_MAX_TEMP, 90), loop_cycles), CODEC_PARAM) == FRAME_OK, "PARAM frame accepted");
+    check(result_of(exchange(encode_param(CODEC_MAX_TEMP, 500), loop_cycles), CODEC_PARAM) == FRAME_REJECTED, "PARAM frame out of range rejected");
+    check(result_of(exchange(encode_param(9, 1), loop_cycles), CODEC_PARAM) == FRAME_REJECTED, "PARAM frame of an unknown id rejected");
+    check(result_of(exchange(encode_param(CODEC_SYNC_TOLERANCE, 2), loop_cycles), CODEC_PARAM) == FRAME_OK && sync_tolerance == 2
+        && result_of(exchange(encode_param(CODEC_SYNC_TOLERANCE, 4), loop_cycles), CODEC_PARAM) == FRAME_REJECTED,
+        "PARAM frame sets the sync tolerance");
+
+    // A frame and a text command back to back, in either order
+    size_t skipped = 0;
+    std::string mixed = exchange(encode_status() + "STATUS\n" + encode_status(), loop_cycles);
+    frames = decode_frames(mixed, &skipped);
+
+    check(frames.size() == 2 && mixed.find("engine status:") != std::string::npos, "frames and text commands mixed");
+
+    std::string corrupt = encode_status();
+    corrupt[corrupt.size() - 1] ^= 0x01;
+
+    check(exchange(corrupt, loop_cycles).empty(), "frame with a bad CRC ignored");
+
+    frames = decode_frames(exchange(encode_status(), loop_cycles), NULL);
+    check(frames.size() == 1 && parse_status(frames[0], &r) && r.rejected == 1, "rejected frame counted");
+
+    std::string echo = encode_frame(frames[0].type, frames[0].payload);
+
+    check(exchange(echo, loop_cycles).empty(), "echoed reply frame ignored");
+
+    frames = decode_frames(exchange(encode_status(), loop_cycles), NULL);
+    check(frames.size() == 1 && parse_status(frames[0], &r) && r.rejected == 2, "echoed reply frame counted");
+
+    check(result_of(exchange(encode_stop(), loop_cycles), CODEC_STOP) == FRAME_OK && !e.is_running, "STOP frame stops the engine");
+
+    return check_status();
+}
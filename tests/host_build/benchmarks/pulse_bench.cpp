@@ -0,0 +1,101 @@
+/*
+    IPG pulse handoff benchmark.
+
+    Runs the engine at a constant speed with passes of loop() that take
+    longer and longer, up to many IPG pulses each, and checks that the 
+    loop still sees every pulse through the pulse ring: that the speed
+    it measures stays right, no CPG pulse is missed and the engine keeps
+    running. Pulses are only lost once a single pass takes longer than
+    the ring can hold, which shows as overruns.
+
+    usage: pulse_bench [--rpm N] [--cycles N]
+
+    The run fails if a pass shorter than the ring can hold loses a pulse.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "driver.h"
+#include "engine_signal.h"
+
+static int count(const std::string& s, const char* what){
+    int n = 0;
+
+    for(size_t i = s.find(what); i != std::string::npos; i = s.find(what, i + 1)) n++;
+
+    return n;
+}
+
+int main(int argc, char** argv){
+    double rpm = 6000;
+    unsigned long engine_cycles = 50;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--cycles")){
+            engine_cycles = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    static const unsigned long loop_us[] = {50, 500, 1000, 2500, 5000, 7500, 10000, 20000};
+
+    double period = 60e6 / rpm / (360 / IPG_PULSE_ANGLE);
+    bool failed = false;
+
+    printf("pulse_bench: %.0f RPM (%.0f us between pulses), %lu engine cycles, %d pulse ring\n\n",
+        rpm, period, engine_cycles, PULSE_RING_SIZE);
+
+    printf("%-10s %10s %10s %10s %10s %10s\n", "loop [us]", "pulses", "overruns", "RPM", "missed", "running");
+
+    for(size_t k = 0; k < sizeof(loop_us) / sizeof(loop_us[0]); k++){
+        uint64_t loop_cycles = loop_us[k] * HOST_CYCLES_PER_US;
+
+        boot();
+
+        engine_signal signal(&e.ipg, &e.cpg, rpm);
+        host_attach(&signal);
+
+        // Started with a short loop, so every run starts the same way
+        if(!start_engine(50 * HOST_CYCLES_PER_US, 5 * F_CPU)){
+            fprintf(stderr, "engine did not start\n%s", host_serial_take().c_str());
+            return 1;
+        }
+
+        host_serial_take();
+
+        unsigned long first_edge = signal.edges();
+        uint16_t first_overruns = pulse_overruns(&pr);
+        crank_sync first_sync = cs;
+
+        while(signal.edges() - first_edge < engine_cycles * 24) run_loop(loop_cycles);
+
+        std::string output = host_serial_take();
+        unsigned int overruns = pulse_overruns(&pr) - first_overruns;
+        // A pulse lost to the ring shows as a CPG count the sync had to correct or could not place
+        int missed = (cs.corrections - first_sync.corrections) + (cs.losses - first_sync.losses) + count(output, "don't match");
+
+        printf("%-10lu %10lu %10u %10d %10d %10s\n", loop_us[k], signal.edges() - first_edge,
+            overruns, e.rpm, missed, e.is_running ? "true" : "false");
+
+        host_detach(&signal);
+
+        // The ring holds the pulses of a pass up to one less than its size
+        if(loop_us[k] + period < (PULSE_RING_SIZE - 1) * period && (overruns || missed || !e.is_running)){
+            failed = true;
+        }
+    }
+
+    if(failed){
+        printf("\nFAIL: pulses were lost by a loop shorter than the ring can hold\n");
+        return 1;
+    }
+
+    return 0;
+}
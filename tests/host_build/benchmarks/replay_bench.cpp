@@ -0,0 +1,184 @@
+/*
+    Trace replay benchmark.
+
+    Generates deterministic CPG/IPG/thermistor traces with the trace
+    library in harness/engine_trace.h and plays each to the control
+    system in virtual time: a cranking speed, whose segments are 
+    longer than 16 bits of timer ticks, speed ramps, some sharp, to 
+    score the edges the scheduler places while the engine 
+    accelerates, tooth timing error, dropped and spurious pulses, and
+    a rising temperature. Every coil and injector edge is scored against the
+    crank angle the timings in force at its IPG pulse asked for, at 
+    the true angle of the trace.
+
+    The clean traces must keep the engine running with every spark
+    within the error allowed. The traces with dropped and spurious
+    pulses must keep it running too, through the crank sync, with the
+    sparks around each fault left unscored. The overheating trace must
+    shut the engine down. The CPG pulses the sync corrected and the
+    times it lost the pattern are reported for each trace, as is the
+    host time taken per second of trace, as the throughput of the
+    replay.
+
+    usage: replay_bench [--loop-us N] [--max-error DEG] [--dump FILE]
+
+    --dump writes the edges of every trace to FILE as CSV.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "driver.h"
+#include "engine_trace.h"
+#include "output_monitor.h"
+#include "timing_score.h"
+#include "stats.h"
+
+typedef struct scenario {
+    const char* name;
+    trace_options options;
+    // The message the engine should be shut down with, or NULL if it should keep running
+    const char* shutdown;
+} scenario;
+
+static const scenario scenarios[] = {
+    {"steady 3000",         {{{0, 3000}}, 3.0, 0, 0, 0, {}, 1}, NULL},
+    {"steady 3000 jit",     {{{0, 3000}}, 3.0, 8, 0, 0, {}, 2}, NULL},
+    {"cranking 100",        {{{0, 100}}, 12.0, 0, 0, 0, {}, 10}, NULL},
+    {"ramp 1000-6000",      {{{0, 1000}, {1, 1000}, {3, 6000}}, 4.0, 0, 0, 0, {}, 3}, NULL},
+    {"ramp 6000-1500 jit",  {{{0, 6000}, {1, 6000}, {3, 1500}}, 4.0, 4, 0, 0, {}, 4}, NULL},
+    {"fast 1000-7000",      {{{0, 1000}, {1, 1000}, {1.5, 7000}}, 3.0, 0, 0, 0, {}, 8}, NULL},
+    {"fast 7000-1000 jit",  {{{0, 7000}, {1, 7000}, {1.5, 1000}}, 3.0, 4, 0, 0, {}, 9}, NULL},
+    {"overheat",            {{{0, 3000}}, 8.0, 0, 0, 0, {{0, 30}, {1, 30}, {4, 95}}, 5},
+        "Internal temperature exceeded maximum."},
+    {"dropped pulses",      {{{0, 3000}}, 4.0, 0, 0.002, 0, {}, 6}, NULL},
+    {"spurious pulses",     {{{0, 3000}}, 4.0, 0, 0, 0.002, {}, 7}, NULL},
+};
+
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+int main(int argc, char** argv){
+    unsigned long loop_us = 50;
+    double max_error = 1.0;
+    const char* dump = NULL;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--loop-us")){
+            loop_us = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--max-error")){
+            max_error = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--dump")){
+            dump = argv[i + 1];
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    FILE* csv = NULL;
+
+    if(dump){
+        csv = fopen(dump, "w");
+
+        if(!csv){
+            fprintf(stderr, "cannot open %s\n", dump);
+            return 2;
+        }
+
+        fprintf(csv, "trace,cycle,signal,value,fault\n");
+    }
+
+    uint64_t loop_cycles = loop_us * HOST_CYCLES_PER_US;
+    int failures = 0;
+
+    printf("replay_bench: %lu us nominal loop, sparks within %.2f deg on clean traces\n\n", loop_us, max_error);
+    printf("%-20s %8s %10s %10s %10s %10s %6s %6s %10s  %s\n",
+        "trace", "edges", "spark p99", "spark max", "fuel max", "RPM error", "fixed", "lost", "x realtime", "result");
+
+    for(size_t k = 0; k < SCENARIOS; k++){
+        const scenario* sc = &(scenarios[k]);
+
+        boot();
+
+        engine_trace trace(&(sc->options), host_cycles());
+        trace_player player(&trace, &e.ipg, &e.cpg, &e.thermistor);
+
+        if(csv){
+            static const char* signals[3] = {"IPG", "CPG", "ADC"};
+
+            for(const trace_edge& edge : trace.edges){
+                fprintf(csv, "%s,%llu,%s,%d,%d\n", sc->name, (unsigned long long) (edge.cycle - trace.start),
+                    signals[edge.signal], edge.value, edge.fault);
+            }
+        }
+
+        auto wall_start = std::chrono::steady_clock::now();
+
+        host_attach(&player);
+
+        bool started = start_engine(loop_cycles, trace.end - host_cycles());
+
+        output_monitor monitor;
+        timing_log timings(&trace, sc->options.jitter);
+        std::vector<double> rpm_errors;
+        std::string output = host_serial_take();
+
+        while(started && host_cycles() < trace.end){
+            uint64_t cycle = host_cycles();
+            run_loop(loop_cycles);
+            timings.update(cycle);
+
+            if(e.is_running) rpm_errors.push_back(fabs(e.rpm - trace.rpm_at(host_cycles())));
+
+            output += host_serial_take();
+        }
+
+        host_detach(&player);
+
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+        double realtime = sc->options.seconds / wall;
+
+        // Each edge is scored against the timings it was scheduled with, at the IPG pulse before it
+        std::vector<double> spark, fuel;
+        timings.score(monitor.edges, &spark, &fuel);
+
+        summary s = summarise(spark);
+        summary f = summarise(fuel);
+        summary r = summarise(rpm_errors);
+
+        bool ok;
+        const char* result;
+
+        if(!started){
+            ok = false;
+            result = "did not start";
+        } else if(sc->shutdown){
+            ok = !e.is_running && output.find(sc->shutdown) != std::string::npos;
+            result = ok ? sc->shutdown : "not shut down for the fault";
+        } else {
+            bool faulty = sc->options.drop_rate > 0 || sc->options.spurious_rate > 0;
+
+            ok = e.is_running && (faulty || s.max <= max_error);
+            result = !e.is_running ? "shut down" : ok ? "running" : "spark error";
+        }
+
+        if(!ok) failures++;
+
+        printf("%-20s %8zu %10.3f %10.3f %10.3f %10.1f %6u %6u %10.1f  %s%s\n",
+            sc->name, monitor.edges.size(), s.p99, s.max, f.max, r.mean, cs.corrections, cs.losses,
+            realtime, ok ? "" : "FAIL: ", result);
+    }
+
+    if(csv) fclose(csv);
+
+    if(failures){
+        printf("\nFAIL: %d traces did not replay as expected\n", failures);
+        return 1;
+    }
+
+    return 0;
+}
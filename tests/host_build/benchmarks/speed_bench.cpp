@@ -0,0 +1,190 @@
+/*
+    Crank angle prediction benchmark.
+
+    Feeds the control system the IPG pulses of synthetic speed traces,
+    some at constant speed with tooth timing error and some accelerating
+    or decelerating steadily, and compares the crank angle it estimates
+    between pulses with the true angle of the trace.
+
+    Each trace is scored for estimate_angle, which uses the speed and
+    acceleration fitted by the speed tracker, and for a linear
+    interpolation over the last interval alone, as the control system
+    estimated the angle before the tracker.
+
+    Pulse times are seen in ticks of Timer1, with the 0.5 us resolution
+    of the input capture unit that latches them.
+
+    usage: speed_bench [--jitter US] [--time-step US] [--max-error DEG]
+
+    --jitter is the largest tooth timing error of the jittered traces.
+
+    --max-error fails the run if any angle estimated by the tracker is
+    further than DEG degrees from the truth.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "driver.h"
+#include "stats.h"
+
+// Angle errors are reported in thousandths of a degree
+#define MDEG 1000.0
+
+typedef struct trace {
+    const char* name;
+    double start_rpm, end_rpm;
+    // Time taken to change speed, in seconds
+    double seconds;
+    bool jitter;
+} trace;
+
+static const trace traces[] = {
+    {"steady 3000",         3000, 3000, 0.5, true},
+    {"ramp 1000-6250",      1000, 6250, 1.0, false},
+    {"ramp 6250-1000",      6250, 1000, 1.0, false},
+    {"ramp 1000-6250 jit",  1000, 6250, 1.0, true},
+    {"snap 2000-6000",      2000, 6000, 0.2, false},
+};
+
+#define TRACES (sizeof(traces) / sizeof(traces[0]))
+
+/* Crank angle in degrees and its rate in degrees per microsecond, under constant acceleration */
+typedef struct motion {
+    double speed, acceleration;
+} motion;
+
+static double angle_at(const motion* m, double us){
+    return m->speed * us + 0.5 * m->acceleration * us * us;
+}
+
+/* Time in microseconds at which the crank has turned through an angle */
+static double time_at(const motion* m, double angle){
+    if(m->acceleration == 0) return angle / m->speed;
+
+    return (sqrt(m->speed * m->speed + 2 * m->acceleration * angle) - m->speed) / m->acceleration;
+}
+
+static double wrap_error(double a){
+    a = fmod(a, 720);
+    if(a >= 360) a -= 720;
+    if(a < -360) a += 720;
+    return a;
+}
+
+/* Deterministic tooth timing error, uniform in [-jitter, jitter] */
+static double tooth_error(uint32_t* seed, double jitter){
+    *seed = *seed * 1664525UL + 1013904223UL;
+    return jitter * (((*seed >> 8) / (double) (1 << 24)) * 2 - 1);
+}
+
+int main(int argc, char** argv){
+    double jitter = 8;
+    unsigned long time_step = 4;
+    double max_error = -1;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--jitter")){
+            jitter = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--time-step")){
+            time_step = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--max-error")){
+            max_error = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(!time_step){
+        fprintf(stderr, "time step must be positive\n");
+        return 2;
+    }
+
+    boot();
+
+    printf("speed_bench: tooth timing error up to %.1f us on jittered traces, angle estimate every %lu us\n\n",
+        jitter, time_step);
+
+    print_summary_header(stdout);
+
+    double worst = 0;
+
+    for(size_t k = 0; k < TRACES; k++){
+        const trace* tr = &(traces[k]);
+
+        motion m;
+        m.speed = tr->start_rpm * 360 / 60e6;
+        m.acceleration = (tr->end_rpm - tr->start_rpm) * 360 / 60e6 / (tr->seconds * 1e6);
+
+        init_engine(&e);
+        uint32_t seed = 1;
+
+        // The trace starts on a whole microsecond of the clock
+        double start = (double) host_cycles() / HOST_CYCLES_PER_US + 4;
+
+        std::vector<double> tracked, single;
+
+        unsigned long pulses = (unsigned long) (angle_at(&m, tr->seconds * 1e6) / IPG_PULSE_ANGLE);
+        uint32_t seen = 0, last_seen = 0;
+
+        double error = 0;
+
+        for(unsigned long p = 0; p < pulses; p++){
+            double at = start + time_at(&m, (double) p * IPG_PULSE_ANGLE) + error;
+            error = tr->jitter ? tooth_error(&seed, jitter) : 0;
+
+            host_run_until((uint64_t) (at * HOST_CYCLES_PER_US));
+            last_seen = seen;
+            seen = timer_ticks(&tm);
+
+            set_crank(&e, (p * IPG_PULSE_ANGLE) % 720);
+            if(p > 0) update_velocity(&e, seen - last_seen);
+
+            // Wait for the tracker to fill before scoring
+            if(p < TRACKER_SIZE) continue;
+
+            // Scored up to the next pulse, as it will be seen
+            double next = start + time_at(&m, (double) (p + 1) * IPG_PULSE_ANGLE) + error;
+            uint64_t first = host_cycles() + time_step * HOST_CYCLES_PER_US;
+
+            for(uint64_t c = first; c < next * HOST_CYCLES_PER_US; c += time_step * HOST_CYCLES_PER_US){
+                host_run_until(c);
+
+                double us = (double) c / HOST_CYCLES_PER_US;
+                double truth = angle_at(&m, us - start);
+
+                double estimate = ANGLE_TO_FLOAT(estimate_angle(&e, e.crank, timer_ticks(&tm) - seen));
+                tracked.push_back(MDEG * fabs(wrap_error(estimate - truth)));
+
+                // Linear over the last interval alone
+                double fraction = (double) (timer_ticks(&tm) - seen) / (seen - last_seen);
+                if(fraction > 1) fraction = 1;
+                double linear = e.crank + fraction * IPG_PULSE_ANGLE;
+                single.push_back(MDEG * fabs(wrap_error(linear - truth)));
+            }
+        }
+
+        char name[40];
+        summary s;
+
+        snprintf(name, sizeof(name), "%s [mdeg]", tr->name);
+        s = summarise(tracked);
+        print_summary(stdout, name, &s);
+
+        if(s.max / MDEG > worst) worst = s.max / MDEG;
+
+        snprintf(name, sizeof(name), "  last interval only");
+        s = summarise(single);
+        print_summary(stdout, name, &s);
+    }
+
+    if(max_error >= 0 && worst > max_error){
+        printf("\nFAIL: angle error %.3f deg exceeds %.3f deg\n", worst, max_error);
+        return 1;
+    }
+
+    return 0;
+}
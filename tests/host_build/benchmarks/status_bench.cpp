@@ -0,0 +1,414 @@
+/*
+    Streamed status report benchmark.
+
+    Checks the integer and fixed-point emitters of the formatter, which
+    replaced sprintf in the firmware, against printf over random values,
+    and that a buffer too short for what is written is cut off without
+    being overrun.
+
+    Then checks the reply to STATUS, which is now sent a line per pass
+    of the loop, against the reply formatted whole with sprintf as it
+    was before (with the angles of the timings to a tenth of a degree
+    rather than whole degrees), both in the replies to STATUS on the
+    sketch and over random states of the engine.
+
+    The longest any pass spends on the report on the host is given
+    against the time to format and queue the whole report in one pass,
+    with sprintf and with the formatter. The flash saved on the board is
+    that of vfprintf, which no longer links, and is given by avr-size on
+    a build for the board.
+
+    usage: status_bench [--values N] [--states N] [--repeats N]
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+
+#include "checks.h"
+#include "driver.h"
+
+/* A random 32 bit value, with small magnitudes as likely as large ones */
+static uint32_t random_value(uint32_t* seed){
+    uint32_t v = random_below(seed, 1 << 16) << 16 | random_below(seed, 1 << 16);
+    return v >> random_below(seed, 32);
+}
+
+/* What put_fixed should give, worked out in long double, which holds every value exactly */
+static std::string fixed_reference(int32_t v, uint8_t shift, uint8_t decimals){
+    long double m = fabsl((long double) v) / (long double) (1UL << shift);
+    long double whole = floorl(m);
+    unsigned long long scaled = (unsigned long long) floorl((m - whole) * powl(10, decimals));
+
+    char s[40];
+    snprintf(s, sizeof(s), "%s%llu", v < 0 ? "-" : "", (unsigned long long) whole);
+
+    std::string r = s;
+
+    if(decimals){
+        snprintf(s, sizeof(s), ".%0*llu", decimals, scaled);
+        r += s;
+    }
+
+    return r;
+}
+
+static bool emitters_match(unsigned long values){
+    uint32_t seed = 1;
+    char s[32], expected[32];
+
+    for(unsigned long n = 0; n < values; n++){
+        uint32_t u = random_value(&seed);
+        int32_t i = random_below(&seed, 2) ? -(int32_t) (u >> 1) : (int32_t) u;
+        uint8_t shift = (uint8_t) random_below(&seed, 25);
+        uint8_t decimals = (uint8_t) random_below(&seed, 4);
+
+        formatter f;
+
+        init_formatter(&f, s, sizeof(s));
+        put_uint(&f, u);
+        snprintf(expected, sizeof(expected), "%lu", (unsigned long) u);
+        if(strcmp(s, expected) || f.length != strlen(expected)) return false;
+
+        init_formatter(&f, s, sizeof(s));
+        put_int(&f, i);
+        snprintf(expected, sizeof(expected), "%ld", (long) i);
+        if(strcmp(s, expected)) return false;
+
+        init_formatter(&f, s, sizeof(s));
+        put_fixed(&f, i, shift, decimals);
+        if(fixed_reference(i, shift, decimals) != s) return false;
+    }
+
+    formatter f;
+    const int32_t ends[3] = {INT32_MIN, INT32_MAX, 0};
+
+    for(int k = 0; k < 3; k++){
+        init_formatter(&f, s, sizeof(s));
+        put_int(&f, ends[k]);
+        snprintf(expected, sizeof(expected), "%ld", (long) ends[k]);
+        if(strcmp(s, expected)) return false;
+    }
+
+    return true;
+}
+
+/* Writes more than fits into buffers of every size, which must hold the start of it and nothing past */
+static bool cut_off_in_bounds(void){
+    const char* full = "speed: -12345 RPM, 359.5 deg";
+
+    for(uint8_t size = 1; size < 40; size++){
+        char s[48];
+        memset(s, '#', sizeof(s));
+
+        formatter f;
+        init_formatter(&f, s, size);
+        put_P(&f, PSTR("speed: "));
+        put_int(&f, -12345);
+        put_string(&f, " RPM, ");
+        put_fixed(&f, ANGLE(359.5), 16, 1);
+        put_P(&f, PSTR(" deg"));
+
+        size_t kept = strlen(full) < (size_t) (size - 1) ? strlen(full) : (size_t) (size - 1);
+
+        if(strncmp(s, full, kept) || s[kept] != '\0' || f.length != kept) return false;
+
+        for(size_t k = size; k < sizeof(s); k++){
+            if(s[k] != '#') return false;
+        }
+    }
+
+    return true;
+}
+
+/* An angle to a tenth of a degree, as the timings now give it */
+static std::string tenths(angle_t a){
+    return fixed_reference(a, 16, 1);
+}
+
+/* The reply to STATUS as it was formatted before, block by block with sprintf, with each block ended by serial_println */
+static std::string sprintf_report(void){
+    char message[150];
+    std::string r;
+
+    sprintf(message, "engine status:\n    crank angle: %i deg\n    speed: %i RPM\n    temp: %i deg C\n    is running: %s\n",
+        get_crank(&e), e.rpm, e.temp, e.is_running ? "true" : "false");
+    r += message + std::string("\r\n");
+
+    if(!t.is_valid){
+        sprintf(message, "timings not valid.\n");
+    } else {
+        const timing_buffer* b = timings_in_force(&t);
+        sprintf(message, "timings:\n    map RPM: %i\n    spark: %s to %s deg\n    fuel: %s to %s deg\n    is valid: %s\n"
+            "    found: %u, kept: %u\n",
+            t.o->speed, tenths(b->spark[0]).c_str(), tenths(b->spark[1]).c_str(),
+            tenths(b->fuel[0]).c_str(), tenths(b->fuel[1]).c_str(), "true", t.recomputes, t.skips);
+    }
+    r += message + std::string("\r\n");
+
+    sprintf(message, "serial port:\n    baud: %lu Bd\n    dropped: %u sent, %u received\n",
+        sp.baud, sp.tx_dropped, (unsigned int) sp.rx_dropped);
+    r += message + std::string("\r\n");
+
+    sprintf(message, "IPG pulses:\n    overruns: %u\n", pulse_overruns(&pr));
+    r += message + std::string("\r\n");
+
+    static const char* states[3] = {"none", "pending", "locked"};
+    sprintf(message, "crank sync:\n    state: %s\n    corrected: %u, lost: %u\n",
+        states[cs.state], cs.corrections, cs.losses);
+    r += message + std::string("\r\n");
+
+    sprintf(message, "actuations:\n    dropped: %u\n", s.dropped);
+    r += message + std::string("\r\n");
+
+    return r;
+}
+
+/* Takes everything queued in the transmit ring, as if it had been sent */
+static std::string take_ring(void){
+    std::string r;
+
+    for(uint16_t i = sp.tx_tail; i != sp.tx_head; i = (i + 1) % SERIAL_TX_SIZE) r += sp.tx[i];
+
+    sp.tx_tail = sp.tx_head;
+    return r;
+}
+
+/* Streams the whole report straight from the module, and gives the most bytes one call queued */
+static std::string streamed_report(size_t* most, unsigned int* calls){
+    std::string r;
+    *most = 0;
+    *calls = 0;
+
+    start_status_report(&sr);
+
+    while(!status_report_done(&sr)){
+        stream_status_report(&sr);
+        std::string line = take_ring();
+
+        if(line.size() > *most) *most = line.size();
+        (*calls)++;
+        r += line;
+    }
+
+    return r;
+}
+
+/* Measures a speed from IPG pulses a period apart in ticks, and sets the timings for it at 40 deg C */
+static void running_at(uint32_t period){
+    init_engine(&e);
+
+    for(int k = 0; k < 8; k++) update_velocity(&e, period);
+
+    e.temp = 40;
+    o = lookup_operating_point(e.rpm, e.temp);
+    set_engine_timings(&t, &o, &e);
+}
+
+/* Sets the engine, timings and port to a random state */
+static void random_state(uint32_t* seed){
+    // The timings need the speed measured, which is then replaced by any speed at all
+    running_at((uint32_t) (1000 + random_below(seed, 20000)));
+
+    set_crank(&e, (int) random_below(seed, 720));
+    e.rpm = (int) random_below(seed, 16000);
+    e.temp = (int) random_below(seed, 140) - 40;
+    e.is_running = random_below(seed, 2);
+
+    if(random_below(seed, 8) == 0) t.is_valid = false;
+
+    for(int k = 0; k < 2; k++){
+        t.buffers[t.active].spark[k] = (angle_t) random_below(seed, 720 * ANGLE_ONE);
+        t.buffers[t.active].fuel[k] = (angle_t) random_below(seed, 720 * ANGLE_ONE);
+    }
+
+    t.recomputes = (uint16_t) random_value(seed);
+    t.skips = (uint16_t) random_value(seed);
+
+    sp.tx_dropped = (uint16_t) random_value(seed);
+    sp.rx_dropped = (uint16_t) random_value(seed);
+    pr.overruns = (uint16_t) random_value(seed);
+
+    cs.state = (uint8_t) random_below(seed, 3);
+    cs.corrections = (uint16_t) random_value(seed);
+    cs.losses = (uint16_t) random_value(seed);
+    s.dropped = (uint16_t) random_value(seed);
+}
+
+/* Sends a command and returns everything written back within 100 ms */
+static std::string exchange(const char* command){
+    host_serial_take();
+    host_serial_feed(command);
+    run_loops_until(host_cycles() + F_CPU / 10, DEFAULT_LOOP_CYCLES);
+    return host_serial_take();
+}
+
+/* The least time over the repeats in ns, of the slowest of the calls a report takes when streamed */
+static double slowest_stream_call(int repeats){
+    double slowest[STATUS_SECTIONS * 8] = {0};
+    unsigned int calls = 0;
+
+    for(int r = 0; r < repeats; r++){
+        start_status_report(&sr);
+        calls = 0;
+
+        while(!status_report_done(&sr)){
+            auto t0 = std::chrono::steady_clock::now();
+            stream_status_report(&sr);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+
+            sp.tx_tail = sp.tx_head;
+
+            if(r == 0 || ns < slowest[calls]) slowest[calls] = ns;
+            calls++;
+        }
+    }
+
+    double most = 0;
+    for(unsigned int k = 0; k < calls; k++) most = slowest[k] > most ? slowest[k] : most;
+
+    return most;
+}
+
+int main(int argc, char** argv){
+    unsigned long values = 1000000;
+    unsigned long states = 20000;
+    int repeats = 2000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--values")){
+            values = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--states")){
+            states = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--repeats")){
+            repeats = atoi(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(repeats < 1){
+        fprintf(stderr, "--repeats must be positive\n");
+        return 2;
+    }
+
+    printf("status_bench: %lu random values, %lu random states, least of %d repeats\n\n", values, states, repeats);
+
+    check(emitters_match(values), "integers and fixed point match printf");
+    check(cut_off_in_bounds(), "too long is cut off in bounds");
+
+    boot();
+
+    std::string reply = exchange("STATUS\n");
+    std::string before = sprintf_report();
+
+    check(reply.size() >= before.size() && reply.compare(reply.size() - before.size(), before.size(), before) == 0,
+        "STATUS sends the report as before");
+
+    unsigned long matched = 0;
+    size_t most = 0;
+    unsigned int calls = 0;
+    uint32_t seed = 1;
+
+    for(unsigned long n = 0; n < states; n++){
+        random_state(&seed);
+
+        size_t bytes;
+        std::string streamed = streamed_report(&bytes, &calls);
+
+        if(streamed == sprintf_report()) matched++;
+        if(bytes > most) most = bytes;
+    }
+
+    check(matched == states, "reports match over random states");
+    check(most < STATUS_LINE_SIZE, "no pass queues more than a line");
+
+    // A ring too full for a line holds the report back until it drains
+    start_status_report(&sr);
+    sp.tx_tail = (sp.tx_head + STATUS_LINE_SIZE) % SERIAL_TX_SIZE;
+
+    bool held = !stream_status_report(&sr) && sr.section == 0 && sr.line == 0;
+
+    sp.tx_tail = sp.tx_head;
+    check(held && stream_status_report(&sr), "the report waits for room in the ring");
+
+    // At 3000 RPM, so that every line of the timings is sent
+    running_at(5000);
+    check(t.is_valid, "timings valid for the timed report");
+
+    size_t bytes;
+    std::string whole = streamed_report(&bytes, &calls);
+
+    // One pass of the report each way, with the ring emptied after each
+    char message[150];
+    volatile uint32_t sink = 0;
+    double whole_sprintf = 0, whole_formatter = 0;
+
+    for(int r = 0; r < repeats; r++){
+        auto t0 = std::chrono::steady_clock::now();
+
+        sprintf(message, "engine status:\n    crank angle: %i deg\n    speed: %i RPM\n    temp: %i deg C\n    is running: %s\n",
+            get_crank(&e), e.rpm, e.temp, e.is_running ? "true" : "false");
+        serial_println(&sp, message);
+        if(!t.is_valid){
+            sprintf(message, "timings not valid.\n");
+        } else {
+            const timing_buffer* b = timings_in_force(&t);
+            sprintf(message, "timings:\n    map RPM: %i\n    spark: ~%i to ~%i deg\n    fuel: ~%i to ~%i deg\n    is valid: %s\n"
+                "    found: %u, kept: %u\n",
+                t.o->speed, ANGLE_DEGREES(b->spark[0]), ANGLE_DEGREES(b->spark[1]), ANGLE_DEGREES(b->fuel[0]), ANGLE_DEGREES(b->fuel[1]),
+                t.is_valid ? "true" : "false", t.recomputes, t.skips);
+        }
+        serial_println(&sp, message);
+        sprintf(message, "serial port:\n    baud: %lu Bd\n    dropped: %u sent, %u received\n",
+            sp.baud, sp.tx_dropped, (unsigned int) sp.rx_dropped);
+        serial_println(&sp, message);
+        sprintf(message, "IPG pulses:\n    overruns: %u\n", pulse_overruns(&pr));
+        serial_println(&sp, message);
+        sprintf(message, "crank sync:\n    state: %s\n    corrected: %u, lost: %u\n",
+            cs.state == SYNC_LOCKED ? "locked" : cs.state == SYNC_PENDING ? "pending" : "none", cs.corrections, cs.losses);
+        serial_println(&sp, message);
+        sprintf(message, "actuations:\n    dropped: %u\n", s.dropped);
+        serial_println(&sp, message);
+
+        auto t1 = std::chrono::steady_clock::now();
+        sp.tx_tail = sp.tx_head;
+        auto t2 = std::chrono::steady_clock::now();
+
+        get_engine_info(&e, message);
+        serial_println(&sp, message);
+        get_timing_info(&t, message);
+        serial_println(&sp, message);
+        get_serial_info(&sp, message);
+        serial_println(&sp, message);
+        get_pulse_info(&pr, message);
+        serial_println(&sp, message);
+        get_sync_info(&cs, message);
+        serial_println(&sp, message);
+        get_schedule_info(&s, message);
+        serial_println(&sp, message);
+
+        auto t3 = std::chrono::steady_clock::now();
+        sp.tx_tail = sp.tx_head;
+        sink += message[0];
+
+        double a = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        double b = std::chrono::duration<double, std::nano>(t3 - t2).count();
+
+        if(r == 0 || a < whole_sprintf) whole_sprintf = a;
+        if(r == 0 || b < whole_formatter) whole_formatter = b;
+    }
+
+    double slowest = slowest_stream_call(repeats);
+
+    printf("\n%-44s %10s %10s %10s\n", "", "sprintf", "formatter", "streamed");
+    printf("%-44s %10zu %10zu %10zu\n", "most bytes queued in one pass", whole.size(), whole.size(), most);
+    printf("%-44s %10d %10d %10u\n", "passes to queue the report", 1, 1, calls);
+    printf("%-44s %10.1f %10.1f %10.1f\n", "longest pass on the report on the host [ns]", whole_sprintf, whole_formatter, slowest);
+
+    return check_status();
+}
@@ -0,0 +1,391 @@
+/*
+    Timing swap and recompute benchmark.
+
+    First plays traces of a steady speed, speed ramps and a warming
+    engine to the control system, once as it is, checking the timings
+    every cycle and finding them again only once the speed or the
+    temperature leaves its band, and once as before, finding them
+    every TIMINGS_TACHO cycles whatever happened. For each it reports
+    the times the timings were found, and how far the speed had moved
+    from the one the timings were found at, which is how stale they
+    were.
+
+    Then plays ramps across 5000 to 6000 RPM and back, over which the
+    window of a coil comes to span the TDC of cylinder 1 where the
+    timings are swapped, and a ramp across 3000 RPM with the fuel 
+    cells there SET to their longest, over which the window of an 
+    injector comes to span it too. It checks that every coil and 
+    injector is closed and opened exactly once in each cycle of its 
+    cylinder, from one TDC of its own to the next, across every swap.
+
+    Last, it runs the engine at a steady speed and sends SET commands
+    at random times, alternating between two speeds. For each it 
+    reports the time from the command to the new timings being put in
+    force, and checks that they were only ever put in force at TDC. 
+    For the timings being replaced, it counts the windows of the coils
+    and injectors the command fell inside of, each of which rewriting
+    the timings in place at once, as before, would have actuated with
+    an end from each.
+
+    usage: swap_bench [--sets N] [--loop-us N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <vector>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_signal.h"
+#include "engine_trace.h"
+#include "output_monitor.h"
+#include "stats.h"
+
+// The interval timings were found at before they were checked for change
+#define BEFORE_TACHO 10
+
+// The interval they are checked at now, as TIMINGS_TACHO in the sketch
+#define NOW_TACHO 1
+
+typedef struct scenario {
+    const char* name;
+    trace_options options;
+} scenario;
+
+static const scenario scenarios[] = {
+    {"steady 3000 jit",     {{{0, 3000}}, 4.0, 8, 0, 0, {}, 2}},
+    {"ramp 1000-6000",      {{{0, 1000}, {1, 1000}, {3, 6000}}, 4.0, 0, 0, 0, {}, 3}},
+    {"ramp 6000-1500 jit",  {{{0, 6000}, {1, 6000}, {3, 1500}}, 4.0, 4, 0, 0, {}, 4}},
+    {"warm-up 3000",        {{{0, 3000}}, 8.0, 0, 0, 0, {{0, 20}, {8, 70}}, 5}},
+};
+
+#define SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+typedef struct crossing {
+    const char* name;
+    trace_options options;
+    // The speed of the fuel cells SET to their longest before the trace, or 0 to leave the map
+    int fuel_rpm;
+} crossing;
+
+// Ramps over which a window comes to span the swap at TDC, and stops again
+static const crossing crossings[] = {
+    {"ramp 5000-6000",      {{{0, 5000}, {0.5, 5000}, {2.5, 6000}}, 3.0, 0, 0, 0, {}, 6}, 0},
+    {"ramp 6000-5000 jit",  {{{0, 6000}, {0.5, 6000}, {2.5, 5000}}, 3.0, 4, 0, 0, {}, 7}, 0},
+    {"fuel 2000-4000",      {{{0, 2000}, {0.5, 2000}, {2.5, 4000}}, 3.0, 0, 0, 0, {}, 8}, 3000},
+};
+
+#define CROSSINGS (sizeof(crossings) / sizeof(crossings[0]))
+
+// Cycles of each cylinder left out after start-up, while the crank sync is found
+#define SETTLE_CYCLES 2
+
+typedef struct replay_result {
+    bool running;
+    unsigned long cycles;
+    unsigned int found;
+    // How far the speed was from the one the timings in force were found at, in RPM
+    summary lag;
+} replay_result;
+
+/* Plays a trace with the timings checked every tacho cycles, within bands of rpm_band and temp_band */
+static replay_result replay(const trace_options* options, int16_t tacho, int16_t rpm_band, int16_t temp_band, uint64_t loop_cycles){
+    boot();
+
+    timings_tacho = tacho;
+    t.rpm_band = rpm_band;
+    t.temp_band = temp_band;
+
+    engine_trace trace(options, host_cycles());
+    trace_player player(&trace, &e.ipg, &e.cpg, &e.thermistor);
+    host_attach(&player);
+
+    replay_result r = {false, 0, 0, {}};
+
+    bool started = start_engine(loop_cycles, trace.end - host_cycles());
+
+    unsigned int found_at_start = t.recomputes;
+    unsigned long first_edge = player.ipg_edges();
+    std::vector<double> lag;
+
+    // The speed the timings in force were found at, which the timings found since wait for TDC to replace
+    int found_rpm = t.rpm, waiting_rpm = t.rpm;
+    uint8_t active = t.active;
+
+    while(started && host_cycles() < trace.end){
+        bool was_pending = t.pending;
+        int rpm = t.rpm;
+
+        run_loop(loop_cycles);
+
+        if(t.active != active){
+            found_rpm = was_pending ? waiting_rpm : t.rpm;
+            active = t.active;
+        }
+
+        if(t.rpm != rpm) waiting_rpm = t.rpm;
+        if(e.is_running) lag.push_back(abs(e.rpm - found_rpm));
+
+        host_serial_take();
+    }
+
+    host_detach(&player);
+
+    r.running = started && e.is_running;
+    r.cycles = (player.ipg_edges() - first_edge) / (720 / IPG_PULSE_ANGLE);
+    r.found = t.recomputes - found_at_start;
+    r.lag = summarise(lag);
+
+    return r;
+}
+
+typedef struct crossing_result {
+    bool running;
+    unsigned int swaps;
+    // Cycles of each circuit checked, and those without exactly one close then one open
+    unsigned long cycles, split;
+} crossing_result;
+
+/*
+    Plays a trace with the timings checked every cycle and counts the 
+    cycles of each circuit, from one TDC of its cylinder to the next,
+    in which it was not closed and opened exactly once.
+*/
+static crossing_result cross(const crossing* c, uint64_t loop_cycles){
+    const trace_options* options = &(c->options);
+
+    boot();
+
+    timings_tacho = NOW_TACHO;
+
+    crossing_result r = {false, 0, 0, 0};
+
+    // The fuel window of a cylinder with a phase over 10 deg then wraps past the end of the cycle
+    for(int row = 0; c->fuel_rpm && row < MAP_TEMPS; row++){
+        char command[64];
+        snprintf(command, sizeof(command), "SET --RPM %d --TEMP %d --FUEL %.2f\n", c->fuel_rpm, 
+            (int) pgm_read_word(&(map_temps[row])), MAX_FUEL_CELL / 256.0);
+
+        host_serial_feed(command);
+        run_loops_until(host_cycles() + F_CPU / 50, loop_cycles);
+
+        if(host_serial_take().find("Map cell updated.") == std::string::npos) return r;
+    }
+
+    engine_trace trace(options, host_cycles());
+    trace_player player(&trace, &e.ipg, &e.cpg, &e.thermistor);
+    host_attach(&player);
+
+    bool started = start_engine(loop_cycles, trace.end - host_cycles());
+
+    output_monitor monitor;
+    uint64_t from = host_cycles();
+    uint8_t active = t.active;
+
+    while(started && e.is_running && host_cycles() < trace.end){
+        run_loop(loop_cycles);
+
+        if(t.active != active) r.swaps++;
+        active = t.active;
+
+        host_serial_take();
+    }
+
+    uint64_t to = host_cycles();
+    host_detach(&player);
+
+    // The runs after boot with the defaults
+    host_eeprom_erase();
+
+    r.running = started && e.is_running;
+
+    for(int circuit = 0; circuit < MONITORED_CIRCUITS; circuit++){
+        int tdc = (720 - cylinder_phases[circuit % CYLINDERS]) % 720;
+        uint64_t start = trace.tooth_at(from, tdc);
+
+        for(int k = 0; k < SETTLE_CYCLES; k++){
+            start = trace.tooth_at(start + 1, tdc);
+        }
+
+        for(uint64_t end = trace.tooth_at(start + 1, tdc); end < to; start = end, end = trace.tooth_at(start + 1, tdc)){
+            std::vector<bool> closes;
+
+            for(const output_edge& edge : monitor.edges){
+                if(edge.circuit == circuit && edge.cycle >= start && edge.cycle < end) closes.push_back(edge.closed);
+            }
+
+            r.cycles++;
+            if(closes.size() != 2 || !closes[0] || closes[1]) r.split++;
+        }
+    }
+
+    return r;
+}
+
+/* Whether an angle falls inside the window of a circuit, open from bounds[0] to bounds[1] in the frame of its cylinder */
+static bool inside_window(const angle_t bounds[2], int circuit, double angle){
+    double phase = cylinder_phases[circuit % CYLINDERS];
+    double start = fmod(ANGLE_TO_FLOAT(bounds[0]) - phase + 720, 720);
+    double end = fmod(ANGLE_TO_FLOAT(bounds[1]) - phase + 720, 720);
+
+    return start <= end ? angle > start && angle < end : angle > start || angle < end;
+}
+
+/* The windows of the coils and injectors an angle falls inside of */
+static unsigned int windows_at(const timing_buffer* b, double angle){
+    unsigned int n = 0;
+
+    for(int circuit = 0; circuit < 2 * CYLINDERS; circuit++){
+        n += inside_window(circuit < CYLINDERS ? b->spark : b->fuel, circuit, angle);
+    }
+
+    return n;
+}
+
+/* The windows of the coils and injectors open at the TDC of their own cylinder, where each is handed over */
+static unsigned int windows_at_handover(const timing_buffer* b){
+    unsigned int n = 0;
+
+    for(int circuit = 0; circuit < 2 * CYLINDERS; circuit++){
+        double tdc = (720 - cylinder_phases[circuit % CYLINDERS]) % 720;
+        n += inside_window(circuit < CYLINDERS ? b->spark : b->fuel, circuit, tdc);
+    }
+
+    return n;
+}
+
+int main(int argc, char** argv){
+    unsigned long sets = 200;
+    unsigned long loop_us = 50;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--sets")){
+            sets = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--loop-us")){
+            loop_us = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(sets < 1){
+        fprintf(stderr, "--sets must be positive\n");
+        return 2;
+    }
+
+    uint64_t loop_cycles = loop_us * HOST_CYCLES_PER_US;
+
+    printf("swap_bench: %lu us nominal loop, bands of %d RPM and %d deg C, before every %d cycles\n\n",
+        loop_us, RPM_HYSTERESIS, TEMP_HYSTERESIS, BEFORE_TACHO);
+    printf("%-20s %8s %8s %8s %10s %10s %10s %10s\n", "trace", "cycles", "found", "before",
+        "lag mean", "before", "lag max", "before");
+
+    bool steady_fewer = true, lag_lower = true, all_running = true;
+
+    for(size_t k = 0; k < SCENARIOS; k++){
+        const scenario* sc = &(scenarios[k]);
+
+        replay_result now = replay(&(sc->options), NOW_TACHO, RPM_HYSTERESIS, TEMP_HYSTERESIS, loop_cycles);
+        replay_result before = replay(&(sc->options), BEFORE_TACHO, 0, 0, loop_cycles);
+
+        printf("%-20s %8lu %8u %8u %10.1f %10.1f %10.1f %10.1f\n", sc->name, now.cycles, now.found, before.found,
+            now.lag.mean, before.lag.mean, now.lag.max, before.lag.max);
+
+        if(!now.running || !before.running) all_running = false;
+        if(sc->options.speeds.size() == 1 && now.found >= before.found) steady_fewer = false;
+        if(now.lag.max > before.lag.max) lag_lower = false;
+    }
+
+    printf("\n%-20s %8s %8s %10s\n", "trace", "swaps", "cycles", "split");
+
+    unsigned long split = 0;
+    bool crossings_running = true;
+
+    for(size_t k = 0; k < CROSSINGS; k++){
+        crossing_result r = cross(&(crossings[k]), loop_cycles);
+
+        printf("%-20s %8u %8lu %10lu\n", crossings[k].name, r.swaps, r.cycles, r.split);
+
+        if(!r.running || r.swaps == 0) crossings_running = false;
+        split += r.split;
+    }
+
+    // SET commands at random times, to a running engine
+    boot();
+
+    double rpm = 3000;
+    double cycle_ms = 2 * 60e3 / rpm;
+
+    engine_signal signal(&e.ipg, &e.cpg, rpm);
+    host_attach(&signal);
+
+    if(!start_engine(loop_cycles, 5 * F_CPU)){
+        fprintf(stderr, "engine did not start\n%s", host_serial_take().c_str());
+        return 1;
+    }
+
+    std::vector<double> latency;
+    unsigned long off_tdc = 0, split_before = 0, split_now = 0, not_applied = 0;
+    uint32_t seed = 1;
+
+    for(unsigned long n = 0; n < sets; n++){
+        // Up to two cycles apart, at any angle
+        run_loops_until(host_cycles() + random_below(&seed, (uint32_t) (2 * cycle_ms * 1000)) * HOST_CYCLES_PER_US, loop_cycles);
+        host_serial_take();
+
+        const timing_buffer* replaced = timings_in_force(&t);
+        uint8_t active = t.active;
+        uint64_t sent = host_cycles();
+        bool handled = false;
+
+        host_serial_feed(n % 2 ? "SET --RPM 4500\n" : "SET --RPM 2000\n");
+
+        while(t.active == active && host_cycles() - sent < 4 * cycle_ms * 1000 * HOST_CYCLES_PER_US){
+            run_loop(loop_cycles);
+
+            // Rewritten in place, the timings would have changed here, at whatever angle
+            if(!handled && t.pending){
+                split_before += windows_at(replaced, signal.angle_at(host_cycles()));
+                handled = true;
+            }
+        }
+
+        if(t.active == active){
+            not_applied++;
+            continue;
+        }
+
+        // The swap is made by the IPG pulse at TDC, which a pass of the loop is shorter than the gap after
+        if(get_crank(&e) != 0) off_tdc++;
+
+        split_now += windows_at_handover(replaced) + windows_at_handover(timings_in_force(&t));
+        latency.push_back((host_cycles() - sent) / (double) HOST_CYCLES_PER_US / 1000);
+    }
+
+    host_detach(&signal);
+
+    summary l = summarise(latency);
+
+    printf("\n%lu SET commands at %.0f RPM, a cycle every %.0f ms\n\n", sets, rpm, cycle_ms);
+    printf("%-48s %10.2f\n", "SET to timings in force, mean [ms]", l.mean);
+    printf("%-48s %10.2f\n", "SET to timings in force, max [ms]", l.max);
+    printf("%-48s %10.2f\n", "SET to timings in force, max [cycles]", l.max / cycle_ms);
+    printf("%-48s %10lu\n", "timings put in force away from TDC", off_tdc);
+    printf("%-48s %10lu\n", "windows split, rewritten in place as before", split_before);
+    printf("%-48s %10lu\n", "windows split, handed over at TDC", split_now);
+    printf("\n");
+
+    check(all_running, "every trace kept the engine running");
+    check(steady_fewer, "steady traces find the timings less often");
+    check(lag_lower, "the timings are never staler than before");
+    check(crossings_running, "the ramps across a window at TDC kept running");
+    check(split == 0, "each output switches once a cycle across swaps");
+    check(not_applied == 0 && l.max <= 2 * cycle_ms + 1, "every SET is in force within two cycles");
+    check(off_tdc == 0, "timings are only put in force at TDC");
+    check(split_now == 0, "no window is split by the swap");
+
+    return check_status();
+}
@@ -0,0 +1,263 @@
+/*
+    Crank sync benchmark.
+
+    Plays traces of a healthy engine at a steady speed to the control
+    system, with its IPG made noisy by dropped and spurious pulses at
+    several rates, and with the trace started at a random angle. The
+    engine is started as soon as it can be, and each trace is run
+    with every tolerance of the sync in turn.
+
+    For each rate and tolerance it reports:
+
+    - The engine cycles from the start of the trace to the first lock
+      of the sync.
+    - The engine cycles from each loss of the sync to its next lock.
+    - The CPG pulses the sync corrected and the losses, per trace.
+    - The traces the engine was shut down on. The engine is healthy,
+      so every shutdown is a false one.
+    - The traces the matching from before the sync would have shut
+      the engine down on, found by running it over the pulses of the
+      trace: any CPG pulse at an angle other than the one counted
+      while running was taken for a fault.
+
+    The run fails if a trace is not synced within two cycles, if a
+    clean trace loses sync, or if the default tolerance loses sync for
+    more than a cycle or shuts the engine down at the lower rates.
+
+    usage: sync_bench [--rpm N] [--seconds S] [--seeds N] [--loop-us N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "checks.h"
+#include "driver.h"
+#include "engine_trace.h"
+#include "stats.h"
+
+// The rates below which the default tolerance must ride through every fault
+#define LOW_RATE 0.005
+
+typedef struct fault {
+    const char* name;
+    double drop_rate, spurious_rate;
+} fault;
+
+static const fault faults[] = {
+    {"clean",       0,      0},
+    {"dropped",     0.001,  0},
+    {"dropped",     0.005,  0},
+    {"dropped",     0.02,   0},
+    {"spurious",    0,      0.001},
+    {"spurious",    0,      0.005},
+    {"spurious",    0,      0.02},
+    {"both",        0.005,  0.005},
+};
+
+#define FAULTS (sizeof(faults) / sizeof(faults[0]))
+
+typedef struct trace_run {
+    bool started, shut_down;
+    // In engine cycles, the first lock from the start of the trace, and each lock from the loss before it
+    double first_sync;
+    std::vector<double> relocks;
+    unsigned int corrections, losses;
+    // The cycle the engine was started at
+    uint64_t started_at;
+} trace_run;
+
+/*
+    Runs the matching from before the sync over the pulses of a trace,
+    as the loop saw them, with the engine started at a cycle. Returns
+    whether it would have shut the engine down.
+*/
+static bool old_matching_shuts_down(const engine_trace* trace, uint64_t started_at){
+    int crank = 0;
+    int pulses = 1;
+    bool cpg = false, running = false;
+
+    for(const trace_edge& edge : trace->edges){
+        if(edge.signal == TRACE_CPG) cpg = edge.value;
+        if(edge.signal != TRACE_IPG || !edge.value) continue;
+
+        crank = (crank + IPG_PULSE_ANGLE) % 720;
+        pulses++;
+
+        if(!cpg) continue;
+
+        int true_crank = pulses == START_OF_CYCLE_PULSES ? 0
+            : pulses == REFERENCE_PULSES ? 60
+            : pulses == MID_CYCLE_PULSES ? 360
+            : -1;
+
+        pulses = 0;
+
+        if(true_crank == -1) continue;
+
+        if(crank != true_crank){
+            if(running) return true;
+            crank = true_crank;
+        } else if(edge.cycle >= started_at){
+            running = true;
+        }
+    }
+
+    return false;
+}
+
+static trace_run run_trace(const engine_trace* trace, uint64_t from, uint64_t loop_cycles, double cycles_per_engine_cycle){
+    trace_run run = {false, false, -1, {}, 0, 0, 0};
+
+    trace_player player(trace, &e.ipg, &e.cpg, &e.thermistor);
+    host_attach(&player);
+
+    bool was_synced = false, sent_start = false;
+    uint64_t lost_at = 0;
+
+    while(host_cycles() < trace->end){
+        run_loop(loop_cycles);
+
+        uint64_t now = host_cycles();
+        bool synced = crank_synced(&cs);
+
+        if(synced && !was_synced){
+            double cycles = (now - (run.first_sync < 0 ? from : lost_at)) / cycles_per_engine_cycle;
+
+            if(run.first_sync < 0){
+                run.first_sync = cycles;
+            } else {
+                run.relocks.push_back(cycles);
+            }
+        } else if(!synced && was_synced){
+            lost_at = now;
+        }
+
+        was_synced = synced;
+
+        if(!sent_start && t.is_valid){
+            host_serial_feed("START\n");
+            sent_start = true;
+        }
+
+        if(!run.started && e.is_running){
+            run.started = true;
+            run.started_at = now;
+        }
+
+        if(run.started && !e.is_running) run.shut_down = true;
+
+        host_serial_take();
+    }
+
+    host_detach(&player);
+
+    run.corrections = cs.corrections;
+    run.losses = cs.losses;
+
+    return run;
+}
+
+int main(int argc, char** argv){
+    double rpm = 3000;
+    double seconds = 4.0;
+    unsigned long seeds = 8;
+    unsigned long loop_us = 50;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--rpm")){
+            rpm = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--seconds")){
+            seconds = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--seeds")){
+            seeds = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--loop-us")){
+            loop_us = strtoul(argv[i + 1], NULL, 0);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(seeds < 1 || rpm <= 0){
+        fprintf(stderr, "--seeds and --rpm must be positive\n");
+        return 2;
+    }
+
+    uint64_t loop_cycles = loop_us * HOST_CYCLES_PER_US;
+    double cycles_per_engine_cycle = 2 * 60 / rpm * F_CPU;
+
+    printf("sync_bench: %.0f RPM, %lu traces of %.1f s per row, %lu us nominal loop\n\n", rpm, seeds, seconds, loop_us);
+    printf("%-10s %6s %6s %6s %8s %8s %8s %8s %8s %8s %9s %9s\n", "fault", "rate", "tol",
+        "traces", "sync", "max", "relock", "max", "fixed", "lost", "shutdowns", "before");
+
+    bool slow_sync = false, clean_lost = false, slow_relock = false, false_shutdown = false;
+
+    for(size_t k = 0; k < FAULTS; k++){
+        const fault* f = &(faults[k]);
+
+        for(int tolerance = 0; tolerance <= MAX_SYNC_TOLERANCE; tolerance++){
+            std::vector<double> syncs, relocks;
+            unsigned long corrections = 0, losses = 0, shutdowns = 0, old_shutdowns = 0, started = 0;
+
+            for(uint32_t seed = 1; seed <= seeds; seed++){
+                boot();
+                sync_tolerance = tolerance;
+
+                trace_options options = {{{0, rpm}}, seconds, 0, f->drop_rate, f->spurious_rate, {}, seed};
+                engine_trace trace(&options, host_cycles());
+
+                // The sketch starts counting at an angle of the trace it cannot know
+                uint32_t phase = seed * 7919;
+                uint64_t from = trace.start + random_below(&phase, (uint32_t) cycles_per_engine_cycle);
+
+                size_t skip = 0;
+                while(skip < trace.edges.size() && trace.edges[skip].cycle < from) skip++;
+                trace.edges.erase(trace.edges.begin(), trace.edges.begin() + skip);
+
+                trace_run run = run_trace(&trace, from, loop_cycles, cycles_per_engine_cycle);
+
+                syncs.push_back(run.first_sync < 0 ? seconds * rpm / 120 : run.first_sync);
+                relocks.insert(relocks.end(), run.relocks.begin(), run.relocks.end());
+                corrections += run.corrections;
+                losses += run.losses;
+
+                if(run.started) started++;
+                if(run.shut_down) shutdowns++;
+                if(run.started && old_matching_shuts_down(&trace, run.started_at)) old_shutdowns++;
+
+                bool low = f->drop_rate <= LOW_RATE && f->spurious_rate <= LOW_RATE;
+
+                if(low && (run.first_sync < 0 || run.first_sync > 2)) slow_sync = true;
+                if(f->drop_rate == 0 && f->spurious_rate == 0 && (run.losses || run.corrections)) clean_lost = true;
+
+                if(low && tolerance == SYNC_TOLERANCE){
+                    if(!run.started || run.shut_down) false_shutdown = true;
+
+                    for(double r : run.relocks){
+                        if(r > 1) slow_relock = true;
+                    }
+                }
+            }
+
+            summary s = summarise(syncs);
+            summary r = summarise(relocks);
+            double rate = f->drop_rate + f->spurious_rate;
+
+            printf("%-10s %6.3f %6d %6lu %8.2f %8.2f %8.2f %8.2f %8.1f %8.1f %4lu/%-4lu %4lu/%-4lu\n",
+                f->name, rate, tolerance, seeds, s.mean, s.max, r.n ? r.mean : 0, r.n ? r.max : 0,
+                (double) corrections / seeds, (double) losses / seeds, shutdowns, started, old_shutdowns, started);
+        }
+    }
+
+    printf("\n");
+
+    check(!slow_sync, "every trace at the lower rates synced within 2 cycles");
+    check(!clean_lost, "no clean trace corrected or lost sync");
+    check(!slow_relock, "default tolerance relocks within a cycle");
+    check(!false_shutdown, "default tolerance rides through the lower rates");
+
+    return check_status();
+}
@@ -0,0 +1,131 @@
+/*
+    Thermistor conversion benchmark.
+
+    Checks the temperature the control system reads from the conversion
+    table at every ADC count against the polynomial curve it replaced,
+    then follows every temperature the simulator can be set to through
+    its PWM, the ADC and the control system, with the tables and with 
+    the two polynomial fits they replaced. Finally times the table per
+    call against the polynomial.
+
+    The polynomial is timed in double precision on the host, so the
+    timings understate the gain on the board, where pow() is done in
+    software.
+
+    usage: thermistor_bench [--calls N] [--max-error DEG]
+
+    --max-error fails the run if the table is further than DEG deg C from
+    the curve anywhere within the temperatures of the operating map.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "driver.h"
+#include "stats.h"
+#include "thermistor_curves.h"
+
+#include "../../engine_simulator/src/thermistor/thermistor.h"
+
+/* The ADC count read from a PWM duty out of 255, through the low-pass filter */
+static uint16_t filtered_count(int duty){
+    return (uint16_t) ((long) duty * THERMISTOR_COUNTS / 256);
+}
+
+int main(int argc, char** argv){
+    unsigned long calls = 2000000;
+    double max_error = 0.5;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--calls")){
+            calls = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--max-error")){
+            max_error = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    std::vector<double> table_errors, map_errors, rounded_errors, truncated_errors;
+
+    int low = map_temps[0], high = map_temps[MAP_TEMPS - 1];
+
+    for(uint16_t count = 0; count < THERMISTOR_COUNTS; count++){
+        double curve = count_temperature_curve(count);
+        double table = (double) thermistor_temperature(count) / (1 << THERMISTOR_SCALE_BITS);
+
+        table_errors.push_back(fabs(table - curve));
+        if(curve >= low && curve <= high) map_errors.push_back(fabs(table - curve));
+
+        rounded_errors.push_back(fabs(adc_to_temperature(count) - curve));
+        truncated_errors.push_back(fabs((int) curve - curve));
+    }
+
+    // Temperatures set on the simulator, read back by the control system
+    std::vector<double> round_trip, old_round_trip;
+
+    for(unsigned int temp = 1; temp <= THERMISTOR_MAX_TEMP; temp++){
+        int duty = temperature_to_millivolts(temp) * 255UL / 5000;
+        round_trip.push_back(abs(adc_to_temperature(filtered_count(duty)) - (int) temp));
+
+        int old_duty = simulator_voltage_curve(temp) / CURVE_SUPPLY * 255;
+        old_round_trip.push_back(abs((int) count_temperature_curve(filtered_count(old_duty)) - (int) temp));
+    }
+
+    printf("thermistor_bench: %d entries every %d counts, %d to %d deg C in the operating map\n\n",
+        THERMISTOR_ENTRIES, THERMISTOR_COUNT_STEP, low, high);
+
+    print_summary_header(stdout);
+
+    summary s;
+
+    s = summarise(table_errors);
+    print_summary(stdout, "table - curve [deg C]", &s);
+
+    s = summarise(map_errors);
+    print_summary(stdout, "  within the map [deg C]", &s);
+    double worst = s.max;
+
+    s = summarise(rounded_errors);
+    print_summary(stdout, "rounded table - curve [deg C]", &s);
+
+    s = summarise(truncated_errors);
+    print_summary(stdout, "truncated curve [deg C]", &s);
+
+    s = summarise(round_trip);
+    print_summary(stdout, "simulator round trip [deg C]", &s);
+
+    s = summarise(old_round_trip);
+    print_summary(stdout, "  polynomials [deg C]", &s);
+
+    volatile long sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        sink += adc_to_temperature((i * 617) % THERMISTOR_COUNTS);
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+
+    for(unsigned long i = 0; i < calls; i++){
+        sink += (int) count_temperature_curve((i * 617) % THERMISTOR_COUNTS);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    printf("\n%-28s %10s\n", "", "ns/call");
+    printf("%-28s %10.1f\n", "table", std::chrono::duration<double, std::nano>(middle - start).count() / calls);
+    printf("%-28s %10.1f\n", "polynomial", std::chrono::duration<double, std::nano>(end - middle).count() / calls);
+
+    if(max_error >= 0 && worst > max_error){
+        printf("\nFAIL: table differs from the curve by %.3f deg C, more than %.3f deg C\n", worst, max_error);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,361 @@
+/*
+    Engine simulator waveform benchmark.
+
+    Runs the engine simulator's sketch, not the control system, at a
+    set of constant speeds and records the virtual time of every edge
+    it writes to the CPG and IPG. The IPG changes every 15 degrees, so
+    the speed is given by a line fitted through its edges, and the
+    jitter by how far each edge lies from that line. The CPG pulses are
+    checked to fall with every 2nd, 10th and 12th IPG pulse in turn, as
+    the control system syncs on them. STATUS commands are sent as the
+    engine runs, whose replies block the loop while the serial buffer
+    drains.
+
+    The speed is then ramped from the lowest of the speeds to the
+    highest with --RAMP, and the speed of every IPG pulse through the
+    ramp is compared with a line, for the rate it ramps at and how far
+    any pulse strays from it.
+
+    Built twice: waveform_bench steps the waveform from the Timer3
+    compare interrupt, waveform_bench_polled from loop() by micros()
+    (POLLED_WAVEFORM), which takes no ramp. Only the first is checked.
+
+    usage: waveform_bench [--cycles N] [--loop-us N] [--status-every N] [--rate N]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <string>
+#include <vector>
+
+#include "simulator/sketch.h"
+#include "checks.h"
+#include "stats.h"
+
+#include <host.h>
+
+#define IPG_BIT     5
+#define CPG_BIT     4
+
+// Steps of 15 degrees in a cycle, and IPG pulses in one
+#define CYCLE_STEPS 48
+#define CYCLE_TEETH 24
+
+// Cycles of every IPG edge, of every IPG rising edge and of every CPG rising edge
+static std::vector<uint64_t> ipg_edges, ipg_rises, cpg_rises;
+static uint8_t last_port;
+static bool watching;
+
+/* Records the edges written to the port since it was last seen. */
+static void take_edges(void){
+    if(!watching) return;
+
+    uint8_t port = PORTB;
+    uint8_t changed = port ^ last_port;
+    uint64_t now = host_cycles();
+
+    if(changed & _BV(IPG_BIT)){
+        ipg_edges.push_back(now);
+        if(port & _BV(IPG_BIT)) ipg_rises.push_back(now);
+    }
+
+    if((changed & _BV(CPG_BIT)) && (port & _BV(CPG_BIT))) cpg_rises.push_back(now);
+
+    last_port = port;
+}
+
+static void clear_edges(void){
+    ipg_edges.clear();
+    ipg_rises.clear();
+    cpg_rises.clear();
+}
+
+static void run_loop(uint64_t loop_cycles){
+    loop();
+    take_edges();
+    host_run_for(loop_cycles);
+}
+
+/* Runs the loop until a command has been read and acted on. */
+static void send(const char* command, uint64_t loop_cycles){
+    host_serial_feed(command);
+    while(Serial.available() > 0) run_loop(loop_cycles);
+    run_loop(loop_cycles);
+}
+
+static void run_loops_for(uint64_t cycles, uint64_t loop_cycles){
+    uint64_t end = host_cycles() + cycles;
+    while(host_cycles() < end) run_loop(loop_cycles);
+}
+
+static void boot(void){
+    host_reset();
+    setup();
+    host_on_isr_return(take_edges);
+
+    last_port = PORTB;
+    watching = true;
+    clear_edges();
+}
+
+static double step_seconds(double rpm){
+    return 60.0 / (rpm * CYCLE_STEPS / 2);
+}
+
+typedef struct line {
+    double slope, intercept;
+} line;
+
+static line fit(const std::vector<double>& x, const std::vector<double>& y){
+    double n = x.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+
+    for(size_t i = 0; i < x.size(); i++){
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+    }
+
+    double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+    return (line) {slope, (sy - slope * sx) / n};
+}
+
+/* Whether the IPG pulses between CPG pulses run 2, 10, 12 in turn. */
+static bool cpg_pattern(void){
+    static const size_t gaps[3] = {2, 10, 12};
+
+    if(cpg_rises.size() < 4) return false;
+
+    std::vector<size_t> counts;
+    size_t k = 0;
+
+    for(size_t i = 0; i + 1 < cpg_rises.size(); i++){
+        size_t n = 0;
+        while(k < ipg_rises.size() && ipg_rises[k] < cpg_rises[i]) k++;
+        while(k < ipg_rises.size() && ipg_rises[k] < cpg_rises[i + 1]){
+            k++;
+            n++;
+        }
+        counts.push_back(n);
+    }
+
+    size_t phase = 0;
+    while(phase < 3 && gaps[phase] != counts[0]) phase++;
+    if(phase == 3) return false;
+
+    for(size_t i = 0; i < counts.size(); i++){
+        if(counts[i] != gaps[(phase + i) % 3]) return false;
+    }
+
+    return true;
+}
+
+typedef struct steady {
+    double rpm, error, jitter_p99, jitter_max;
+    bool pattern, status;
+} steady;
+
+static steady run_steady(double rpm, unsigned long cycles, unsigned long status_every, uint64_t loop_cycles){
+    steady s = {0, 0, 0, 0, false, false};
+    char command[64];
+
+    boot();
+
+    snprintf(command, sizeof(command), "SET --TEMP 40 --SPEED %.0f\n", rpm);
+    send(command, loop_cycles);
+    send("START\n", loop_cycles);
+
+    uint64_t cycle = (uint64_t) (CYCLE_STEPS * step_seconds(rpm) * F_CPU);
+
+    // Settled, with the replies to the commands drained
+    run_loops_for(2 * cycle + F_CPU / 2, loop_cycles);
+    host_serial_take();
+    clear_edges();
+
+    uint64_t start = host_cycles();
+
+    for(unsigned long c = 0; c < cycles; c++){
+        if(status_every && c % status_every == 0) host_serial_feed("STATUS\n");
+        run_loops_for(start + (c + 1) * cycle - host_cycles(), loop_cycles);
+    }
+
+    std::string replies = host_serial_take();
+    snprintf(command, sizeof(command), "speed: %.0f RPM", rpm);
+    s.status = !status_every || replies.find(command) != std::string::npos;
+
+    // Stopping drops the signals, which is no edge of the waveform
+    watching = false;
+    send("STOP\n", loop_cycles);
+    host_on_isr_return(NULL);
+
+    if(ipg_edges.size() < 3) return s;
+
+    std::vector<double> x, y;
+
+    for(size_t i = 0; i < ipg_edges.size(); i++){
+        x.push_back(i);
+        y.push_back((ipg_edges[i] - ipg_edges[0]) / (double) HOST_CYCLES_PER_US);
+    }
+
+    line l = fit(x, y);
+
+    std::vector<double> jitter;
+    for(size_t i = 0; i < x.size(); i++) jitter.push_back(fabs(y[i] - (l.intercept + l.slope * x[i])));
+
+    summary sj = summarise(jitter);
+
+    s.rpm = 60e6 / (l.slope * CYCLE_STEPS / 2);
+    s.error = (s.rpm - rpm) / rpm * 100;
+    s.jitter_p99 = sj.p99;
+    s.jitter_max = sj.max;
+    s.pattern = cpg_pattern();
+
+    return s;
+}
+
+typedef struct ramp {
+    size_t teeth;
+    double rate, error_max, step_max, seconds;
+    bool reached;
+} ramp;
+
+static ramp run_ramp(double from, double to, double rate, uint64_t loop_cycles){
+    ramp r = {0, 0, 0, 0, 0, false};
+    char command[64];
+
+    boot();
+
+    snprintf(command, sizeof(command), "SET --TEMP 40 --SPEED %.0f\n", from);
+    send(command, loop_cycles);
+    send("START\n", loop_cycles);
+    run_loops_for(F_CPU / 2, loop_cycles);
+
+    clear_edges();
+
+    snprintf(command, sizeof(command), "SET --SPEED %.0f --RAMP %.0f\n", to, rate);
+    send(command, loop_cycles);
+    run_loops_for((uint64_t) ((fabs(to - from) / rate + 0.5) * F_CPU), loop_cycles);
+
+    // Stopping drops the signals, which is no edge of the waveform
+    watching = false;
+    send("STOP\n", loop_cycles);
+    host_on_isr_return(NULL);
+
+    // The speed of each IPG pulse, at the middle of its period, through the ramp
+    std::vector<double> t, v;
+    double low = fmin(from, to), high = fmax(from, to);
+    double last = 0;
+
+    for(size_t i = 1; i < ipg_rises.size(); i++){
+        double period = (ipg_rises[i] - ipg_rises[i - 1]) / (double) F_CPU;
+        double rpm = 60 / (period * CYCLE_TEETH / 2);
+
+        if(rpm >= high - 1) r.reached = true;
+        if(rpm <= low * 1.02 || rpm >= high * 0.98) continue;
+
+        if(last > 0 && fabs(rpm - last) > r.step_max) r.step_max = fabs(rpm - last);
+        last = rpm;
+
+        t.push_back((ipg_rises[i] + ipg_rises[i - 1]) / 2.0 / F_CPU);
+        v.push_back(rpm);
+    }
+
+    r.teeth = t.size();
+    if(r.teeth < 3) return r;
+
+    line l = fit(t, v);
+
+    for(size_t i = 0; i < t.size(); i++){
+        double e = fabs(v[i] - (l.intercept + l.slope * t[i]));
+        if(e > r.error_max) r.error_max = e;
+    }
+
+    r.rate = fabs(l.slope);
+    r.seconds = t.back() - t.front();
+
+    return r;
+}
+
+int main(int argc, char** argv){
+    unsigned long cycles = 200;
+    double loop_us = 10;
+    unsigned long status_every = 50;
+    double rate = 5000;
+
+    for(int i = 1; i + 1 < argc; i += 2){
+        if(!strcmp(argv[i], "--cycles")){
+            cycles = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--loop-us")){
+            loop_us = atof(argv[i + 1]);
+        } else if(!strcmp(argv[i], "--status-every")){
+            status_every = strtoul(argv[i + 1], NULL, 0);
+        } else if(!strcmp(argv[i], "--rate")){
+            rate = atof(argv[i + 1]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    if(cycles < 4 || loop_us <= 0 || rate <= 0 || rate > WAVEFORM_MAX_RAMP){
+        fprintf(stderr, "--cycles must be at least 4, --loop-us positive and --rate up to %u\n", WAVEFORM_MAX_RAMP);
+        return 2;
+    }
+
+    uint64_t loop_cycles = (uint64_t) (loop_us * HOST_CYCLES_PER_US);
+
+    static const double speeds[] = {1000, 3000, 6000, 10000, 15000};
+    const size_t n = sizeof(speeds) / sizeof(speeds[0]);
+
+    #ifdef POLLED_WAVEFORM
+    const char* build = "polled from loop()";
+    #else
+    const char* build = "Timer3 compare interrupt";
+    #endif
+
+    printf("waveform_bench: %s, %lu cycles per speed, loop %.1f us, STATUS every %lu cycles\n\n", build, cycles, loop_us, status_every);
+    printf("%-10s %12s %12s %14s %14s %10s\n", "speed", "measured", "error [%]", "jitter p99", "jitter max", "CPG");
+
+    bool accurate = true, steady_edges = true, pattern = true, status = true;
+
+    for(size_t k = 0; k < n; k++){
+        steady s = run_steady(speeds[k], cycles, status_every, loop_cycles);
+
+        printf("%-10.0f %12.1f %12.4f %11.2f us %11.2f us %10s\n", speeds[k], s.rpm, s.error, s.jitter_p99, s.jitter_max, s.pattern ? "ok" : "wrong");
+
+        accurate = accurate && fabs(s.error) < 0.01;
+        // Half a count of Timer3, as the carried fraction moves the edges between counts
+        steady_edges = steady_edges && s.jitter_max <= 0.5;
+        pattern = pattern && s.pattern;
+        status = status && s.status;
+    }
+
+    ramp r = run_ramp(speeds[0], speeds[n - 1], rate, loop_cycles);
+
+    printf("\nramp %.0f to %.0f RPM at %.0f RPM/s\n", speeds[0], speeds[n - 1], rate);
+    if(r.teeth < 3){
+        printf("    no ramp: the speed moved in %zu IPG pulses\n", r.teeth);
+    } else {
+        printf("    %-36s %12zu\n", "IPG pulses through it", r.teeth);
+        printf("    %-36s %12.1f\n", "rate [RPM/s]", r.rate);
+        printf("    %-36s %12.3f\n", "time [s]", r.seconds);
+        printf("    %-36s %12.2f\n", "pulse from the line, max [RPM]", r.error_max);
+        printf("    %-36s %12.2f\n", "change between pulses, max [RPM]", r.step_max);
+    }
+    printf("\n");
+
+    #ifndef POLLED_WAVEFORM
+    check(accurate, "every speed is within 0.01% of the one set");
+    check(steady_edges, "no edge strays more than 0.5 us from its time");
+    check(pattern, "CPG pulses fall every 2, 10 and 12 IPG pulses");
+    check(status, "STATUS gives the speed set");
+    check(r.teeth >= 3 && fabs(r.rate - rate) < rate * 0.01, "the speed ramps within 1% of the rate set");
+    check(r.reached, "the ramp reaches the speed set");
+    // The longest pulse of the ramp is at its foot, 5 ms at 1000 RPM, in which the speed moves by 25 RPM at 5000 RPM/s
+    check(r.teeth >= 3 && r.step_max < 2 * rate * 60 / (speeds[0] * CYCLE_TEETH / 2), "no pulse moves the speed by twice the rate");
+    #endif
+
+    return check_status();
+}
@@ -0,0 +1,22 @@
+#include "checks.h"
+
+#include <stdio.h>
+
+int failures = 0;
+
+void check(bool ok, const char* what){
+    printf("%-*s %s\n", CHECK_WIDTH, what, ok ? "ok" : "FAIL");
+    if(!ok) failures++;
+}
+
+int check_status(void){
+    if(!failures) return 0;
+
+    printf("\nFAIL: %d checks failed\n", failures);
+    return 1;
+}
+
+uint32_t random_below(uint32_t* seed, uint32_t n){
+    *seed = *seed * 1664525UL + 1013904223UL;
+    return (*seed >> 8) % n;
+}
@@ -0,0 +1,27 @@
+#ifndef HARNESS_CHECKS_H
+    #define HARNESS_CHECKS_H
+
+    #include <stdint.h>
+
+    /*
+        The pass or fail checks the benchmarks end with, and the
+        deterministic random numbers their cases are drawn from, so 
+        that every run gives the same cases.
+    */
+
+    // Width the name of a check is padded to, wide enough for the longest
+    #define CHECK_WIDTH 56
+
+    // Checks failed so far
+    extern int failures;
+
+    /* Prints a check as ok or FAIL and counts it if it failed. */
+    void check(bool ok, const char* what);
+
+    /* Prints the number of checks failed, if any, and returns the exit status of the benchmark. */
+    int check_status(void);
+
+    /* Uniform in [0, n), from a linear congruential generator. */
+    uint32_t random_below(uint32_t* seed, uint32_t n);
+
+#endif
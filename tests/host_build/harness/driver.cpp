@@ -0,0 +1,64 @@
+#include "driver.h"
+#include "output_monitor.h"
+
+#include <time.h>
+
+static double wall_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+    The PROGRAM_TEST pin set drives each coil and the injector of the
+    same cylinder from one pin. Give the injectors pins of their own
+    on PORTC, so the harness can tell their edges apart.
+*/
+static void separate_outputs(void){
+    for(size_t c = 0; c < CYLINDERS; c++){
+        if(e.injs[c].reg == e.coils[c].reg && e.injs[c].num == e.coils[c].num){
+            e.injs[c].reg = &PORTC;
+            e.injs[c].num = c;
+        }
+    }
+}
+
+void boot(void){
+    host_reset();
+    setup();
+    separate_outputs();
+}
+
+loop_sample run_loop(uint64_t loop_cycles){
+    loop_sample s;
+
+    uint64_t start = host_cycles();
+    double t0 = wall_ns();
+
+    loop();
+
+    s.host_ns = wall_ns() - t0;
+    s.blocked_cycles = host_cycles() - start;
+
+    output_monitor_sample();
+
+    host_run_for(loop_cycles);
+
+    return s;
+}
+
+void run_loops_until(uint64_t c, uint64_t loop_cycles){
+    while(host_cycles() < c) run_loop(loop_cycles);
+}
+
+bool start_engine(uint64_t loop_cycles, uint64_t timeout){
+    uint64_t end = host_cycles() + timeout;
+
+    while(!t.is_valid && host_cycles() < end) run_loop(loop_cycles);
+
+    host_serial_feed("START\n");
+
+    while(!e.is_running && host_cycles() < end) run_loop(loop_cycles);
+
+    return e.is_running;
+}
@@ -0,0 +1,46 @@
+#ifndef HARNESS_DRIVER_H
+    #define HARNESS_DRIVER_H
+
+    #include <host.h>
+
+    #include "sketch.h"
+
+    /*
+        Helpers for driving the sketch in virtual time.
+
+        Every call to loop() is charged a nominal cost in cycles on top
+        of any time it spends blocked (e.g. on a full serial buffer),
+        and the interrupts that fall due in that time are serviced
+        once it returns.
+    */
+
+    // Nominal cost of one pass of loop() on the board, in cycles
+    #define DEFAULT_LOOP_CYCLES (50 * HOST_CYCLES_PER_US)
+
+    typedef struct loop_sample {
+        // Wall-clock time of the call on the host, in nanoseconds
+        double host_ns;
+        // Virtual cycles the call spent blocked
+        uint64_t blocked_cycles;
+    } loop_sample;
+
+    /*
+        Resets the virtual board and runs setup(). The injectors are
+        moved to pins of their own if they share them with the coils.
+    */
+    void boot(void);
+
+    /* Runs a single pass of loop(), then charges it loop_cycles. */
+    loop_sample run_loop(uint64_t loop_cycles);
+
+    /* Runs loop() until the clock reaches cycle c. */
+    void run_loops_until(uint64_t c, uint64_t loop_cycles);
+
+    /*
+        Runs loop() until the timings are valid, sends START and runs
+        until the engine is running. Returns false if that does not
+        happen within timeout cycles.
+    */
+    bool start_engine(uint64_t loop_cycles, uint64_t timeout);
+
+#endif
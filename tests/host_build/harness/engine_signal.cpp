@@ -0,0 +1,36 @@
+#include "engine_signal.h"
+#include "engine_trace.h"
+
+#define STEP_ANGLE 15
+
+engine_signal::engine_signal(const pin* ipg, const pin* cpg, double rpm)
+    : ipg(ipg), cpg(cpg), angle(0), ipg_edges(0){
+    last_step = host_cycles();
+    set_rpm(rpm);
+    next_step = last_step + step_cycles;
+}
+
+void engine_signal::set_rpm(double rpm){
+    // Cycles per 15 degree step: one revolution is 360 degrees
+    step_cycles = (double) F_CPU * 60 / rpm * STEP_ANGLE / 360;
+}
+
+double engine_signal::angle_at(uint64_t cycle) const {
+    double a = angle + (cycle - (double) last_step) / cycles_per_degree();
+    return fmod(a, 720);
+}
+
+uint64_t engine_signal::next_event(void){
+    return (uint64_t) next_step;
+}
+
+void engine_signal::fire(uint64_t now){
+    angle = (angle + STEP_ANGLE) % 720;
+    last_step = now;
+    next_step += step_cycles;
+
+    set_signal_pin(cpg, cpg_level(angle));
+    set_ipg_pin(ipg, ipg_level(angle));
+
+    if(ipg_level(angle)) ipg_edges++;
+}
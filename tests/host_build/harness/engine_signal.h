@@ -0,0 +1,47 @@
+#ifndef HARNESS_ENGINE_SIGNAL_H
+    #define HARNESS_ENGINE_SIGNAL_H
+
+    #include <host.h>
+
+    #include "src/control_system/control_system.h"
+
+    /*
+        Models the CPG and IPG signals of the engine at a constant speed,
+        following the same pattern as tests/engine_simulator:
+
+        - The crankshaft angle advances in steps of 15 degrees.
+        - The IPG is high on every step that is a multiple of 30 degrees
+          and low otherwise. The rising edge raises the IPG interrupt,
+          or is captured by Timer1 if the IPG is on its ICP1 pin.
+        - The CPG is high together with the IPG at 0, 60 and 360 degrees.
+    */
+    class engine_signal : public host_peripheral {
+        public:
+            engine_signal(const pin* ipg, const pin* cpg, double rpm);
+
+            void set_rpm(double rpm);
+
+            // The true crankshaft angle at a given cycle, in degrees [0, 720)
+            double angle_at(uint64_t cycle) const;
+
+            double cycles_per_degree(void) const { return step_cycles / 15; }
+
+            unsigned long edges(void) const { return ipg_edges; }
+
+            uint64_t next_event(void);
+            void fire(uint64_t now);
+
+        private:
+            const pin* ipg;
+            const pin* cpg;
+
+            double step_cycles;
+            double next_step;
+
+            unsigned int angle;
+            uint64_t last_step;
+
+            unsigned long ipg_edges;
+    };
+
+#endif
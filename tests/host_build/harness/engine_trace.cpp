@@ -0,0 +1,241 @@
+#include "engine_trace.h"
+
+#include <algorithm>
+
+#include "../../engine_simulator/src/thermistor/thermistor.h"
+
+#define STEP_ANGLE 15
+
+// A spurious pulse is this long, in us
+#define SPURIOUS_WIDTH 10
+
+static const unsigned int cpg_pulse_angles[3] = {0, 60, 360};
+
+bool ipg_level(unsigned int angle){
+    return angle % (2 * STEP_ANGLE) == 0;
+}
+
+bool cpg_level(unsigned int angle){
+    for(size_t i = 0; i < 3; i++){
+        if(angle == cpg_pulse_angles[i]) return true;
+    }
+
+    return false;
+}
+
+void set_signal_pin(const pin* p, bool high){
+    if(high){
+        *(p->reg) |= 1 << p->num;
+    } else {
+        *(p->reg) &= ~(1 << p->num);
+    }
+}
+
+// The IPG is wired to the input capture pin of Timer1, PD4
+static bool is_icp1(const pin* p){
+    return p->reg == &PIND && p->num == 4;
+}
+
+void set_ipg_pin(const pin* p, bool high){
+    set_signal_pin(p, high);
+
+    if(is_icp1(p)){
+        host_timer1_input(high);
+    } else if(high){
+        host_raise_interrupt(digitalPinToInterrupt(p->pin));
+    }
+}
+
+/* Deterministic uniform random number in [0, 1) */
+static double uniform(uint32_t* seed){
+    *seed = *seed * 1664525UL + 1013904223UL;
+    return (*seed >> 8) / (double) (1 << 24);
+}
+
+/* ADC count of the thermistor divider at a temperature, through the simulator's PWM */
+static int thermistor_count(double temp){
+    if(temp < 0) temp = 0;
+    if(temp > THERMISTOR_MAX_TEMP) temp = THERMISTOR_MAX_TEMP;
+
+    long duty = temperature_to_millivolts((unsigned int) lround(temp)) * 255UL / 5000;
+    return (int) (duty * ADC_MAX / 256);
+}
+
+static double temp_at(const std::vector<temp_point>& temps, double seconds){
+    if(temps.empty()) return -1;
+    if(seconds <= temps.front().seconds) return temps.front().temp;
+
+    for(size_t i = 1; i < temps.size(); i++){
+        if(seconds < temps[i].seconds){
+            const temp_point* a = &(temps[i - 1]);
+            const temp_point* b = &(temps[i]);
+
+            return a->temp + (b->temp - a->temp) * (seconds - a->seconds) / (b->seconds - a->seconds);
+        }
+    }
+
+    return temps.back().temp;
+}
+
+// Degrees per us at a speed
+static double degrees_per_us(double rpm){
+    return rpm * 360 / 60e6;
+}
+
+engine_trace::engine_trace(const trace_options* options, uint64_t start)
+    : start(start), dropped(0), spurious(0){
+    const std::vector<speed_point>& speeds = options->speeds;
+
+    // Constant speed up to the first point, linear ramps between points, constant after the last
+    pieces.push_back((piece) {0, 0, degrees_per_us(speeds.front().rpm), 0});
+
+    for(size_t i = 0; i < speeds.size(); i++){
+        double t = speeds[i].seconds * 1e6;
+        double speed = degrees_per_us(speeds[i].rpm);
+
+        double acceleration = 0;
+
+        if(i + 1 < speeds.size() && speeds[i + 1].seconds * 1e6 > t){
+            acceleration = (degrees_per_us(speeds[i + 1].rpm) - speed) / (speeds[i + 1].seconds * 1e6 - t);
+        }
+
+        piece* last = &(pieces.back());
+
+        if(t > last->t){
+            double dt = t - last->t;
+            double angle = last->angle + last->speed * dt + 0.5 * last->acceleration * dt * dt;
+
+            pieces.push_back((piece) {t, angle, speed, acceleration});
+        } else {
+            last->speed = speed;
+            last->acceleration = acceleration;
+        }
+    }
+
+    uint32_t seed = options->seed;
+    double length = options->seconds * 1e6;
+
+    int last_count = -1;
+    bool drop = false;
+
+    for(unsigned long k = 1; ; k++){
+        double t = time_at((double) k * STEP_ANGLE);
+        if(t > length) break;
+
+        unsigned int angle = (k * STEP_ANGLE) % 720;
+        bool ipg = ipg_level(angle);
+
+        if(ipg) teeth.push_back(start + (uint64_t) llround(t * HOST_CYCLES_PER_US));
+
+        // The same error moves every edge of the tooth
+        double error = options->jitter * (2 * uniform(&seed) - 1);
+        uint64_t cycle = start + (uint64_t) llround((t + error) * HOST_CYCLES_PER_US);
+
+        if(options->temps.size()){
+            int count = thermistor_count(temp_at(options->temps, t / 1e6));
+
+            if(count != last_count){
+                edges.push_back((trace_edge) {cycle, TRACE_ADC, count, false});
+                last_count = count;
+            }
+        }
+
+        edges.push_back((trace_edge) {cycle, TRACE_CPG, cpg_level(angle), false});
+
+        // A dropped pulse misses its rising edge and the falling edge that follows
+        if(ipg){
+            drop = uniform(&seed) < options->drop_rate;
+            if(drop) dropped++;
+        }
+
+        if(!drop) edges.push_back((trace_edge) {cycle, TRACE_IPG, ipg, false});
+
+        // A spurious pulse midway through a step without a tooth
+        if(!ipg && uniform(&seed) < options->spurious_rate){
+            double next = time_at((double) (k + 1) * STEP_ANGLE);
+            uint64_t middle = start + (uint64_t) llround((t + next) / 2 * HOST_CYCLES_PER_US);
+
+            edges.push_back((trace_edge) {middle, TRACE_IPG, 1, true});
+            edges.push_back((trace_edge) {middle + SPURIOUS_WIDTH * HOST_CYCLES_PER_US, TRACE_IPG, 0, true});
+            spurious++;
+        }
+    }
+
+    std::stable_sort(edges.begin(), edges.end(), [](const trace_edge& a, const trace_edge& b){
+        return a.cycle < b.cycle;
+    });
+
+    end = start + (uint64_t) llround(length * HOST_CYCLES_PER_US);
+}
+
+const engine_trace::piece* engine_trace::piece_at(double t) const {
+    size_t i = 0;
+    while(i + 1 < pieces.size() && t >= pieces[i + 1].t) i++;
+    return &(pieces[i]);
+}
+
+double engine_trace::time_at(double angle) const {
+    size_t i = 0;
+    while(i + 1 < pieces.size() && angle >= pieces[i + 1].angle) i++;
+
+    const piece* p = &(pieces[i]);
+    double a = angle - p->angle;
+
+    if(p->acceleration == 0) return p->t + a / p->speed;
+
+    return p->t + (sqrt(p->speed * p->speed + 2 * p->acceleration * a) - p->speed) / p->acceleration;
+}
+
+double engine_trace::angle_at(uint64_t cycle) const {
+    double t = ((double) cycle - start) / HOST_CYCLES_PER_US;
+    const piece* p = piece_at(t);
+    double dt = t - p->t;
+
+    return fmod(p->angle + p->speed * dt + 0.5 * p->acceleration * dt * dt, 720);
+}
+
+double engine_trace::rpm_at(uint64_t cycle) const {
+    double t = ((double) cycle - start) / HOST_CYCLES_PER_US;
+    const piece* p = piece_at(t);
+
+    return (p->speed + p->acceleration * (t - p->t)) * 60e6 / 360;
+}
+
+uint64_t engine_trace::tooth_before(uint64_t cycle) const {
+    auto it = std::upper_bound(teeth.begin(), teeth.end(), cycle);
+    return it == teeth.begin() ? start : *(it - 1);
+}
+
+uint64_t engine_trace::tooth_at(uint64_t cycle, int angle) const {
+    // The teeth lie every 2 steps from the first step after 0
+    for(size_t i = std::lower_bound(teeth.begin(), teeth.end(), cycle) - teeth.begin(); i < teeth.size(); i++){
+        if((int) (((i + 1) * 2 * STEP_ANGLE) % 720) == angle) return teeth[i];
+    }
+
+    return end;
+}
+
+trace_player::trace_player(const engine_trace* trace, const pin* ipg, const pin* cpg, const pin* thermistor)
+    : trace(trace), ipg(ipg), cpg(cpg), thermistor(thermistor), next(0), rising(0){}
+
+uint64_t trace_player::next_event(void){
+    return done() ? HOST_NEVER : trace->edges[next].cycle;
+}
+
+void trace_player::fire(uint64_t now){
+    while(!done() && trace->edges[next].cycle <= now){
+        const trace_edge* edge = &(trace->edges[next++]);
+
+        switch(edge->signal){
+            case TRACE_IPG:
+                set_ipg_pin(ipg, edge->value);
+                if(edge->value) rising++;
+                break;
+            case TRACE_CPG:
+                set_signal_pin(cpg, edge->value);
+                break;
+            case TRACE_ADC:
+                host_set_analog(thermistor->pin, edge->value);
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef HARNESS_ENGINE_TRACE_H
+    #define HARNESS_ENGINE_TRACE_H
+
+    #include <host.h>
+
+    #include <vector>
+
+    #include "src/control_system/control_system.h"
+
+    /*
+        Timestamped traces of the CPG, IPG and thermistor signals, made
+        from the pattern of tests/engine_simulator:
+
+        - The crankshaft angle advances in steps of 15 degrees.
+        - The IPG is high on every step that is a multiple of 30 degrees
+          and low otherwise.
+        - The CPG is high together with the IPG at 0, 60 and 360 degrees.
+
+        Unlike the simulator, the speed follows a profile of linear
+        ramps, and the trace can be given faults: timing error on every
+        tooth, dropped IPG pulses and spurious short IPG pulses between
+        teeth. The temperature follows a profile of its own, and is
+        turned into an ADC count through the simulator's voltage table.
+
+        A trace is generated in full before it is played, from a seed,
+        so the same options always give the same trace.
+    */
+
+    // Levels of the signals over the 15 degree step starting at an angle
+    bool ipg_level(unsigned int angle);
+    bool cpg_level(unsigned int angle);
+
+    /* Sets the level of a signal pin. */
+    void set_signal_pin(const pin* p, bool high);
+
+    /*
+        Sets the level of the IPG pin, and captures or raises the 
+        interrupt of its rising edge as the pin is wired.
+    */
+    void set_ipg_pin(const pin* p, bool high);
+
+    typedef struct speed_point {
+        double seconds, rpm;
+    } speed_point;
+
+    typedef struct temp_point {
+        double seconds, temp;
+    } temp_point;
+
+    typedef struct trace_options {
+        // Speed at each time, in between which it ramps linearly; the last holds until the end
+        std::vector<speed_point> speeds;
+        double seconds;
+
+        // Largest timing error of a tooth, uniform either way, in us
+        double jitter;
+        // Chance of each IPG pulse being missing, and of a spurious pulse in each step without one
+        double drop_rate, spurious_rate;
+
+        // Temperature at each time in deg C, in between which it ramps linearly
+        std::vector<temp_point> temps;
+
+        uint32_t seed;
+    } trace_options;
+
+    #define TRACE_IPG       0
+    #define TRACE_CPG       1
+    #define TRACE_ADC       2
+
+    typedef struct trace_edge {
+        uint64_t cycle;
+        uint8_t signal;
+        // The level of the IPG or CPG, or the ADC count of the thermistor
+        int value;
+        // Whether the edge belongs to a spurious pulse
+        bool fault;
+    } trace_edge;
+
+    class engine_trace {
+        public:
+            // The trace starts at the given cycle, at crank angle 0
+            engine_trace(const trace_options* options, uint64_t start);
+
+            std::vector<trace_edge> edges;
+
+            // The true crankshaft angle at a cycle, in degrees [0, 720)
+            double angle_at(uint64_t cycle) const;
+            // The true speed at a cycle
+            double rpm_at(uint64_t cycle) const;
+
+            // The cycle of the last true IPG tooth at or before a cycle
+            uint64_t tooth_before(uint64_t cycle) const;
+            // The cycle of the first true IPG tooth at or after a cycle that lies at a crank angle, or end if there is none
+            uint64_t tooth_at(uint64_t cycle, int angle) const;
+
+            uint64_t start, end;
+
+            unsigned long dropped, spurious;
+
+        private:
+            // Pieces of constant acceleration, from the start of each
+            typedef struct piece {
+                double t, angle, speed, acceleration;
+            } piece;
+
+            std::vector<piece> pieces;
+            std::vector<uint64_t> teeth;
+
+            const piece* piece_at(double t) const;
+            double time_at(double angle) const;
+    };
+
+    /*
+        Plays a trace to the sketch, from the cycle of its first edge:
+        the IPG through the input capture pin, the CPG on its pin and
+        the thermistor on its analog input.
+    */
+    class trace_player : public host_peripheral {
+        public:
+            trace_player(const engine_trace* trace, const pin* ipg, const pin* cpg, const pin* thermistor);
+
+            bool done(void) const { return next >= trace->edges.size(); }
+
+            unsigned long ipg_edges(void) const { return rising; }
+
+            uint64_t next_event(void);
+            void fire(uint64_t now);
+
+        private:
+            const engine_trace* trace;
+            const pin* ipg;
+            const pin* cpg;
+            const pin* thermistor;
+
+            size_t next;
+            unsigned long rising;
+    };
+
+#endif
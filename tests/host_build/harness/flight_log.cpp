@@ -0,0 +1,133 @@
+#include "flight_log.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sstream>
+
+static const char* const event_names[] = {
+    "unknown", "boot", "start", "stop", "missed pulse", "sync locked", "sync lost",
+    "crank corrected", "signal mismatch", "over temperature", "timings error", "pulse overrun"
+};
+
+#define EVENTS (sizeof(event_names) / sizeof(event_names[0]))
+
+const char* flight_event_name(int code){
+    return code > 0 && code < (int) EVENTS ? event_names[code] : event_names[0];
+}
+
+/* Reads n bytes of hexadecimal, least significant first. Returns false if they are not there */
+static bool read_bytes(const char** s, unsigned int n, uint32_t* v){
+    *v = 0;
+
+    for(unsigned int i = 0; i < n; i++){
+        unsigned int b;
+        if(sscanf(*s, "%2x", &b) != 1 || strlen(*s) < 2) return false;
+
+        *v |= (uint32_t) b << (8 * i);
+        *s += 2;
+    }
+
+    return true;
+}
+
+static bool parse_record(const char* line, flight_event* ev){
+    unsigned int number;
+    if(sscanf(line, "@%4x ", &number) != 1 || strlen(line) < 6) return false;
+
+    const char* s = line + 6;
+    uint32_t time, code, temp, crank, rpm;
+
+    if(!read_bytes(&s, 4, &time) || !read_bytes(&s, 1, &code) || !read_bytes(&s, 1, &temp)
+        || !read_bytes(&s, 2, &crank) || !read_bytes(&s, 2, &rpm)){
+        return false;
+    }
+
+    ev->number = number;
+    ev->time = time;
+    ev->code = (int) code;
+    ev->temp = (int8_t) temp;
+    ev->crank = (int16_t) crank;
+    ev->rpm = (int16_t) rpm;
+
+    return true;
+}
+
+std::vector<flight_dump> parse_flight_dumps(const std::string& stream){
+    std::vector<flight_dump> dumps;
+    bool open = false;
+
+    std::istringstream in(stream);
+    std::string line;
+
+    while(std::getline(in, line)){
+        if(!line.empty() && line.back() == '\r') line.pop_back();
+
+        const char* l = line.c_str();
+
+        if(!strncmp(l, "flight log: end", 15)){
+            if(open) dumps.back().complete = true;
+            open = false;
+        } else if(!strncmp(l, "flight log: ", 12)){
+            flight_dump d = {false, false, 0, 0, 0, 0, {}, false};
+            const char* h = l + 12;
+
+            if(!strncmp(h, "eeprom, empty", 13)){
+                d.eeprom = d.empty = true;
+            } else if(sscanf(h, "eeprom, cause %d, %u of %u, dropped %u", &(d.cause), &(d.count), &(d.written), &(d.dropped)) == 4){
+                d.eeprom = true;
+            } else if(sscanf(h, "ram, %u of %u, dropped %u", &(d.count), &(d.written), &(d.dropped)) != 3){
+                continue;
+            }
+
+            dumps.push_back(d);
+            open = true;
+        } else if(open && l[0] == '@'){
+            flight_event ev;
+            if(parse_record(l, &ev)) dumps.back().events.push_back(ev);
+        }
+    }
+
+    return dumps;
+}
+
+std::string flight_timeline(const flight_dump& d){
+    std::string out;
+    char line[160];
+
+    if(d.eeprom && d.empty){
+        return "no snapshot held\n";
+    }
+
+    if(d.eeprom){
+        snprintf(line, sizeof(line), "snapshot of %s: %zu of %u events, %u dropped\n",
+            flight_event_name(d.cause), d.events.size(), d.written, d.dropped);
+    } else {
+        snprintf(line, sizeof(line), "flight log: %zu of %u events, %u dropped\n", d.events.size(), d.written, d.dropped);
+    }
+
+    out += line;
+    out += "    number        time [ms]      +[ms]  crank    rpm   temp  event\n";
+
+    for(size_t i = 0; i < d.events.size(); i++){
+        const flight_event& ev = d.events[i];
+
+        if(i > 0 && (uint16_t) (ev.number - d.events[i - 1].number) != 1){
+            snprintf(line, sizeof(line), "    ... %u events overwritten\n", (uint16_t) (ev.number - d.events[i - 1].number - 1));
+            out += line;
+        }
+
+        double ms = ev.time / (FLIGHT_TICKS_PER_US * 1000.0);
+        // The timer wraps every 2^32 ticks, which the difference in 32 bits rides over
+        double delta = i > 0 ? (uint32_t) (ev.time - d.events[i - 1].time) / (FLIGHT_TICKS_PER_US * 1000.0) : 0;
+
+        snprintf(line, sizeof(line), "    %6u %16.3f %10.3f %6d %6d %6d  %s\n",
+            ev.number, ms, delta, ev.crank, ev.rpm, ev.temp, flight_event_name(ev.code));
+        out += line;
+    }
+
+    if(!d.complete) out += "    (dump cut short)\n";
+
+    return out;
+}
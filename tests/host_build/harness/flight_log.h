@@ -0,0 +1,70 @@
+#ifndef HARNESS_FLIGHT_LOG_H
+    #define HARNESS_FLIGHT_LOG_H
+
+    #include <stdint.h>
+
+    #include <string>
+    #include <vector>
+
+    /*
+        Host side decoder of the dumps of the flight recorder of the
+        control system (see src/flight_recorder/flight_recorder.h),
+        for turning the lines DUMP sends into a timeline of events.
+
+        It is written separately from the firmware, so the event codes
+        below must match those of flight_recorder.h.
+    */
+
+    #define FLIGHT_BOOT             1
+    #define FLIGHT_START            2
+    #define FLIGHT_STOP             3
+    #define FLIGHT_MISSED_PULSE     4
+    #define FLIGHT_SYNC_LOCKED      5
+    #define FLIGHT_SYNC_LOST        6
+    #define FLIGHT_CRANK_CORRECTED  7
+    #define FLIGHT_SIGNAL_MISMATCH  8
+    #define FLIGHT_OVER_TEMPERATURE 9
+    #define FLIGHT_TIMINGS_ERROR    10
+    #define FLIGHT_PULSE_OVERRUN    11
+
+    // Must match the prescaler of Timer1 in bioengine/src/timer/timer.h
+    #define FLIGHT_TICKS_PER_US     2
+
+    typedef struct flight_event {
+        // The number of the event since start-up, which wraps at 16 bits
+        unsigned int number;
+        uint32_t time;
+        int code;
+        int temp, crank, rpm;
+    } flight_event;
+
+    typedef struct flight_dump {
+        // Whether the dump is of the snapshot in the EEPROM, and whether one was held
+        bool eeprom, empty;
+        // The event the snapshot was taken on
+        int cause;
+        // The records the header said would be sent, the events recorded and dropped
+        unsigned int count, written, dropped;
+        std::vector<flight_event> events;
+        // Whether the end of the dump was seen
+        bool complete;
+    } flight_dump;
+
+    /*
+        Finds every dump in a stream of serial output, skipping any
+        other text, and any line of a dump that cannot be read.
+    */
+    std::vector<flight_dump> parse_flight_dumps(const std::string& stream);
+
+    /* The name of an event, or "unknown". */
+    const char* flight_event_name(int code);
+
+    /*
+        The dump as a timeline, a line per event with its time since
+        start-up and since the event before, the state of the engine
+        and the name of the event, and with the gaps in the numbers of
+        the events marked.
+    */
+    std::string flight_timeline(const flight_dump& d);
+
+#endif
@@ -0,0 +1,108 @@
+#include "frame_codec.h"
+
+// Sync, type, length and CRC
+#define OVERHEAD 4
+
+uint8_t codec_crc8(const uint8_t* data, size_t n){
+    uint8_t crc = 0;
+
+    for(size_t i = 0; i < n; i++){
+        crc ^= data[i];
+
+        for(int b = 0; b < 8; b++){
+            crc = crc & 0x80 ? (uint8_t) ((crc << 1) ^ 0x07) : (uint8_t) (crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+std::string encode_frame(uint8_t type, const std::vector<uint8_t>& payload){
+    std::vector<uint8_t> body;
+    body.push_back(type);
+    body.push_back((uint8_t) payload.size());
+    body.insert(body.end(), payload.begin(), payload.end());
+
+    std::string s(1, (char) CODEC_SYNC);
+    s.append(body.begin(), body.end());
+    s.push_back((char) codec_crc8(body.data(), body.size()));
+
+    return s;
+}
+
+std::string encode_start(void){
+    return encode_frame(CODEC_START, {});
+}
+
+std::string encode_stop(void){
+    return encode_frame(CODEC_STOP, {});
+}
+
+std::string encode_status(void){
+    return encode_frame(CODEC_STATUS, {});
+}
+
+std::string encode_set(int rpm){
+    return encode_frame(CODEC_SET, {(uint8_t) rpm, (uint8_t) (rpm >> 8)});
+}
+
+std::string encode_param(uint8_t id, int value){
+    return encode_frame(CODEC_PARAM, {id, (uint8_t) value, (uint8_t) (value >> 8)});
+}
+
+std::vector<host_frame> decode_frames(const std::string& stream, size_t* skipped){
+    std::vector<host_frame> frames;
+    const uint8_t* b = (const uint8_t*) stream.data();
+    size_t n = stream.size(), i = 0;
+
+    while(i < n){
+        if(b[i] == CODEC_SYNC && i + OVERHEAD <= n){
+            size_t length = b[i + 2];
+
+            if(i + OVERHEAD + length <= n && codec_crc8(b + i + 1, length + 2) == b[i + OVERHEAD - 1 + length]){
+                frames.push_back((host_frame) {b[i + 1], std::vector<uint8_t>(b + i + 3, b + i + 3 + length)});
+                i += OVERHEAD + length;
+                continue;
+            }
+        }
+
+        if(skipped) (*skipped)++;
+        i++;
+    }
+
+    return frames;
+}
+
+static int16_t get16(const uint8_t* p){
+    return (int16_t) (p[0] | (p[1] << 8));
+}
+
+static double get_angle(const uint8_t* p){
+    int32_t a = (int32_t) ((uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24));
+    return a / 65536.0;
+}
+
+bool parse_status(const host_frame& f, status_reply* s){
+    if(f.type != (CODEC_STATUS | CODEC_REPLY) || f.payload.size() != 31) return false;
+
+    const uint8_t* p = f.payload.data();
+
+    s->crank = get16(p);
+    s->rpm = get16(p + 2);
+    s->temp = get16(p + 4);
+    s->is_running = p[6] & 1;
+    s->timings_valid = p[6] & 2;
+    s->crank_synced = p[6] & 4;
+
+    for(int i = 0; i < 2; i++){
+        s->spark[i] = get_angle(p + 7 + 4 * i);
+        s->fuel[i] = get_angle(p + 15 + 4 * i);
+    }
+
+    s->tx_dropped = (uint16_t) get16(p + 23);
+    s->rx_dropped = (uint16_t) get16(p + 25);
+    s->rejected = (uint16_t) get16(p + 27);
+    s->overruns = (uint16_t) get16(p + 29);
+
+    return true;
+}
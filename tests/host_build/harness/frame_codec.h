@@ -0,0 +1,69 @@
+#ifndef HARNESS_FRAME_CODEC_H
+    #define HARNESS_FRAME_CODEC_H
+
+    #include <stdint.h>
+
+    #include <string>
+    #include <vector>
+
+    /*
+        Host side encoder and decoder of the binary command frames of 
+        the control system (see src/frames/frames.h), for sending 
+        commands from tests and tools and checking the replies.
+
+        It is written separately from the firmware's decoder, with a
+        bitwise CRC rather than its table, so that each checks the other.
+    */
+
+    #define CODEC_SYNC          0xA5
+    #define CODEC_REPLY         0x80
+
+    #define CODEC_START         0x01
+    #define CODEC_STOP          0x02
+    #define CODEC_SET           0x03
+    #define CODEC_STATUS        0x04
+    #define CODEC_PARAM         0x05
+
+    // Parameter ids of PARAM frames
+    #define CODEC_MAX_TEMP      0
+    #define CODEC_TIMINGS_TACHO 1
+    #define CODEC_TEMP_TACHO    2
+    #define CODEC_SYNC_TOLERANCE 3
+    #define CODEC_RPM_BAND      4
+    #define CODEC_TEMP_BAND     5
+
+    typedef struct host_frame {
+        uint8_t type;
+        std::vector<uint8_t> payload;
+    } host_frame;
+
+    /* The fields of the reply to STATUS */
+    typedef struct status_reply {
+        int crank, rpm, temp;
+        bool is_running, timings_valid, crank_synced;
+        // Spark and fuel windows in degrees
+        double spark[2], fuel[2];
+        unsigned int tx_dropped, rx_dropped, rejected, overruns;
+    } status_reply;
+
+    uint8_t codec_crc8(const uint8_t* data, size_t n);
+
+    std::string encode_frame(uint8_t type, const std::vector<uint8_t>& payload);
+
+    std::string encode_start(void);
+    std::string encode_stop(void);
+    std::string encode_status(void);
+    std::string encode_set(int rpm);
+    std::string encode_param(uint8_t id, int value);
+
+    /*
+        Finds every well-formed frame in a stream of serial output, 
+        skipping text and anything that fails its CRC. The number of 
+        bytes that were not part of a frame is added to *skipped.
+    */
+    std::vector<host_frame> decode_frames(const std::string& stream, size_t* skipped);
+
+    /* Reads the payload of a reply to STATUS. Returns false if it is the wrong size. */
+    bool parse_status(const host_frame& f, status_reply* s);
+
+#endif
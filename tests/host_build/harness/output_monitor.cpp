@@ -0,0 +1,42 @@
+#include "output_monitor.h"
+
+static output_monitor* active = NULL;
+
+void output_monitor_sample(void){
+    if(active) active->sample();
+}
+
+const pin* monitored_pin(int circuit){
+    return circuit < CYLINDERS ? &(e.coils[circuit]) : &(e.injs[circuit - CYLINDERS]);
+}
+
+static bool pin_closed(const pin* p){
+    return (*(p->reg) >> p->num) & 1;
+}
+
+output_monitor::output_monitor(void){
+    for(int c = 0; c < MONITORED_CIRCUITS; c++){
+        state[c] = pin_closed(monitored_pin(c));
+    }
+
+    active = this;
+    host_on_isr_return(output_monitor_sample);
+}
+
+output_monitor::~output_monitor(void){
+    if(active == this){
+        active = NULL;
+        host_on_isr_return(NULL);
+    }
+}
+
+void output_monitor::sample(void){
+    for(int c = 0; c < MONITORED_CIRCUITS; c++){
+        bool closed = pin_closed(monitored_pin(c));
+
+        if(closed != state[c]){
+            edges.push_back((output_edge) {host_cycles(), c, closed});
+            state[c] = closed;
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef HARNESS_OUTPUT_MONITOR_H
+    #define HARNESS_OUTPUT_MONITOR_H
+
+    #include <host.h>
+
+    #include <vector>
+
+    #include "sketch.h"
+
+    /*
+        Records every change of the coil and injector outputs with the
+        cycle it happened at. Outputs are sampled after each interrupt
+        service routine and after each pass of loop().
+
+        Circuits 0 to CYLINDERS - 1 are the coils and the rest the
+        injectors, of each cylinder in turn.
+    */
+
+    #define MONITORED_CIRCUITS (2 * CYLINDERS)
+
+    typedef struct output_edge {
+        uint64_t cycle;
+        int circuit;
+        bool closed;
+    } output_edge;
+
+    class output_monitor {
+        public:
+            output_monitor(void);
+            ~output_monitor(void);
+
+            void sample(void);
+
+            std::vector<output_edge> edges;
+
+        private:
+            bool state[MONITORED_CIRCUITS];
+    };
+
+    const pin* monitored_pin(int circuit);
+
+    /* Samples the outputs if a monitor exists. */
+    void output_monitor_sample(void);
+
+#endif
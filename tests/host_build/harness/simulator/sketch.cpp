@@ -0,0 +1,11 @@
+/*
+    Builds the engine simulator's engine_simulator.ino as an ordinary
+    C++ translation unit, as sketch.cpp does for the control system.
+    The two sketches share setup() and loop(), so this is only linked
+    into the simulator's own benchmarks, with the Arduino stand-in and
+    the simulator's modules but none of the harness around the control
+    system.
+*/
+#include <Arduino.h>
+
+#include "engine_simulator.ino"
@@ -0,0 +1,25 @@
+#ifndef HARNESS_SIMULATOR_SKETCH_H
+    #define HARNESS_SIMULATOR_SKETCH_H
+
+    #include <Arduino.h>
+
+    #include "../../../engine_simulator/src/messages/messages.h"
+    #include "../../../engine_simulator/src/waveform/waveform.h"
+
+    /*
+        Globals and entry points of engine_simulator.ino, which is
+        compiled into the simulator's benchmarks by simulator/sketch.cpp.
+    */
+
+    extern unsigned int speed;
+    extern unsigned long pulse_width;
+    extern bool is_running;
+
+    #ifndef POLLED_WAVEFORM
+    extern waveform w;
+    #endif
+
+    void setup(void);
+    void loop(void);
+
+#endif
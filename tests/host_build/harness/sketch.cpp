@@ -0,0 +1,13 @@
+/*
+    Builds bioengine.ino as an ordinary C++ translation unit.
+
+    The Arduino builder generates prototypes for every function in a
+    sketch before compiling it, so functions can be used before they
+    are defined. Those used out of order are declared here instead.
+*/
+#include <Arduino.h>
+
+void shutdown_and_print(uint8_t event, PGM_P cause);
+void log_event(uint8_t code);
+
+#include "bioengine.ino"
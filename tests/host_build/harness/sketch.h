@@ -0,0 +1,50 @@
+#ifndef HARNESS_SKETCH_H
+    #define HARNESS_SKETCH_H
+
+    #include <Arduino.h>
+
+    #include "src/control_system/control_system.h"
+    #include "src/engine_map/engine_map.h"
+    #include "src/messages/messages.h"
+    #include "src/timer/timer.h"
+    #include "src/speed_tracker/speed_tracker.h"
+    #include "src/action_table/action_table.h"
+    #include "src/scheduler/scheduler.h"
+    #include "src/serial_port/serial_port.h"
+    #include "src/frames/frames.h"
+    #include "src/pulse_ring/pulse_ring.h"
+    #include "src/profiler/profiler.h"
+    #include "src/memory/memory.h"
+    #include "src/formatter/formatter.h"
+    #include "src/status_report/status_report.h"
+    #include "src/crank_sync/crank_sync.h"
+    #include "src/flight_recorder/flight_recorder.h"
+    #include "src/adc_sampler/adc_sampler.h"
+
+    /*
+        Globals and entry points of bioengine.ino, which is compiled
+        into the harness by sketch.cpp.
+    */
+
+    extern engine e;
+    extern timings t;
+    extern operating_point o;
+    extern timer tm;
+    extern scheduler s;
+    extern serial_port sp;
+    extern frame_decoder fd;
+    extern pulse_ring pr;
+    extern profiler pf;
+    extern status_report sr;
+    extern crank_sync cs;
+    extern flight_recorder fr;
+    extern adc_sampler as;
+    extern int16_t sync_tolerance;
+    extern int16_t timings_tacho;
+    extern int16_t max_temp;
+    extern int16_t temp_tacho;
+
+    void setup(void);
+    void loop(void);
+
+#endif
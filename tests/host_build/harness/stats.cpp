@@ -0,0 +1,40 @@
+#include "stats.h"
+
+#include <algorithm>
+
+static double percentile(const std::vector<double>& sorted, double p){
+    size_t i = (size_t) (p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+summary summarise(std::vector<double> samples){
+    summary s = {0, 0, 0, 0, 0, 0, 0, 0};
+
+    if(samples.empty()) return s;
+
+    std::sort(samples.begin(), samples.end());
+
+    double total = 0;
+    for(double v : samples) total += v;
+
+    s.n = samples.size();
+    s.mean = total / s.n;
+    s.min = samples.front();
+    s.p50 = percentile(samples, 0.50);
+    s.p90 = percentile(samples, 0.90);
+    s.p99 = percentile(samples, 0.99);
+    s.p999 = percentile(samples, 0.999);
+    s.max = samples.back();
+
+    return s;
+}
+
+void print_summary_header(FILE* f){
+    fprintf(f, "%-28s %9s %10s %10s %10s %10s %10s %10s %10s\n",
+        "", "n", "mean", "min", "p50", "p90", "p99", "p99.9", "max");
+}
+
+void print_summary(FILE* f, const char* name, const summary* s){
+    fprintf(f, "%-28s %9zu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+        name, s->n, s->mean, s->min, s->p50, s->p90, s->p99, s->p999, s->max);
+}
@@ -0,0 +1,19 @@
+#ifndef HARNESS_STATS_H
+    #define HARNESS_STATS_H
+
+    #include <stdio.h>
+
+    #include <vector>
+
+    /* Percentile summary of a set of samples. */
+    typedef struct summary {
+        size_t n;
+        double mean, min, p50, p90, p99, p999, max;
+    } summary;
+
+    summary summarise(std::vector<double> samples);
+
+    void print_summary_header(FILE* f);
+    void print_summary(FILE* f, const char* name, const summary* s);
+
+#endif
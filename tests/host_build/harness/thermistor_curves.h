@@ -0,0 +1,59 @@
+#ifndef HARNESS_THERMISTOR_CURVES_H
+    #define HARNESS_THERMISTOR_CURVES_H
+
+    #include <math.h>
+
+    /*
+        The thermistor curves the conversion tables are generated from,
+        as they were evaluated by the control system and the simulator.
+    */
+
+    #define CURVE_SUPPLY    5.0
+    #define CURVE_ADC_MAX   1024
+
+    /*
+        Internal temperature given by analog-in voltage, based off the
+        thermistor datasheet, by polynomial approximation.
+    */
+    static inline double temperature_curve(double v){
+        return + (0.4393133 * pow(v, 7))
+               - (7.3529790 * pow(v, 6))
+               + (49.330662 * pow(v, 5))
+               - (169.47025 * pow(v, 4))
+               + (317.72894 * pow(v, 3))
+               - (324.00960 * pow(v, 2))
+               + (190.78360 * v)
+               -  62.689252;
+    }
+
+    /* Temperature given by the ADC count of the analog-in voltage */
+    static inline double count_temperature_curve(double count){
+        return temperature_curve(CURVE_SUPPLY * count / CURVE_ADC_MAX);
+    }
+
+    /*
+        The inverse of temperature_curve, found by bisection, as it rises
+        over the whole supply range.
+    */
+    static inline double voltage_curve(double t){
+        double low = 0, high = CURVE_SUPPLY;
+
+        for(int i = 0; i < 60; i++){
+            double mid = (low + high) / 2;
+            if(temperature_curve(mid) < t) low = mid; else high = mid;
+        }
+
+        return (low + high) / 2;
+    }
+
+    /* The simulator's own fit of the thermistor voltage given the temperature */
+    static inline double simulator_voltage_curve(double t){
+        return - (2 * pow(10, -12) * pow(t, 6))
+               + (6 * pow(10, -10) * pow(t, 5))
+               - (3 * pow(10, -8) * pow(t, 4))
+               - (6 * pow(10, -6) * pow(t, 3))
+               + (4 * pow(10, -4) * pow(t, 2))
+               + (0.0462 * t) + 1.1977;
+    }
+
+#endif
@@ -0,0 +1,77 @@
+#include "timing_score.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+static double wrap_error(double a){
+    a = fmod(a, 720);
+    if(a >= 360) a -= 720;
+    if(a < -360) a += 720;
+    return a;
+}
+
+static double target_angle(const timing_change* c, int circuit, bool closed){
+    const angle_t* bounds = circuit < CYLINDERS ? c->spark : c->fuel;
+    double a = ANGLE_TO_FLOAT(bounds[closed ? 0 : 1]) - cylinder_phases[circuit % CYLINDERS];
+    return fmod(a + 720, 720);
+}
+
+static timing_change change_from(uint64_t cycle){
+    const timing_buffer* b = timings_in_force(&t);
+    timing_change c = {cycle, {b->spark[0], b->spark[1]}, {b->fuel[0], b->fuel[1]}, {}};
+
+    for(int k = 0; k < CYLINDERS; k++){
+        c.handover[k] = cycle;
+    }
+
+    return c;
+}
+
+timing_log::timing_log(const engine_trace* trace, double jitter) : trace(trace), jitter(jitter){
+    changes.push_back(change_from(0));
+}
+
+void timing_log::update(uint64_t pass_start){
+    const timing_change* last = &(changes.back());
+    const timing_buffer* b = timings_in_force(&t);
+
+    if(!memcmp(last->spark, b->spark, sizeof(b->spark)) && !memcmp(last->fuel, b->fuel, sizeof(b->fuel))) return;
+
+    // Timings found while running are swapped in by the IPG pulse at TDC, which may have come late in the pass,
+    // and up to the timing error of a tooth before the tooth itself
+    uint64_t pulse = trace->tooth_before(host_cycles() + (uint64_t) (jitter * HOST_CYCLES_PER_US));
+    uint64_t from = std::min(pass_start, pulse);
+
+    timing_change c = change_from(from);
+
+    // Each cylinder is handed over at the tooth at its own TDC, unless the engine was stopped
+    if(timings_replaced(&t)){
+        for(int k = 0; k < CYLINDERS; k++){
+            c.handover[k] = trace->tooth_at(from, (720 - cylinder_phases[k]) % 720);
+        }
+    }
+
+    changes.push_back(c);
+}
+
+const timing_change* timing_log::at(uint64_t cycle, int circuit) const {
+    const timing_change* in_force = &(changes.front());
+
+    for(const timing_change& c : changes){
+        if(c.cycle > cycle) break;
+        if(cycle >= c.handover[circuit % CYLINDERS]) in_force = &c;
+    }
+
+    return in_force;
+}
+
+void timing_log::score(const std::vector<output_edge>& edges, std::vector<double>* spark, std::vector<double>* fuel) const {
+    for(const output_edge& edge : edges){
+        const timing_change* c = at(trace->tooth_before(edge.cycle), edge.circuit);
+        double error = fabs(wrap_error(trace->angle_at(edge.cycle) - target_angle(c, edge.circuit, edge.closed)));
+
+        (edge.circuit < CYLINDERS ? spark : fuel)->push_back(error);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef HARNESS_TIMING_SCORE_H
+    #define HARNESS_TIMING_SCORE_H
+
+    #include <host.h>
+
+    #include <vector>
+
+    #include "sketch.h"
+    #include "engine_trace.h"
+    #include "output_monitor.h"
+
+    /*
+        Scores the coil and injector edges of a played trace against
+        the crank angle the timings in force at their IPG pulse asked
+        for, at the true angle of the trace.
+
+        The timings in force are followed after each pass of loop(),
+        and each change is dated from the pass it was seen in, or from
+        the IPG pulse at TDC that swapped it in, if that came first. The
+        outputs of each cylinder only follow a change swapped in at TDC
+        from the tooth at the TDC of the cylinder after it.
+    */
+
+    typedef struct timing_change {
+        uint64_t cycle;
+        angle_t spark[2], fuel[2];
+        // The tooth the outputs of each cylinder are handed over to the change at
+        uint64_t handover[CYLINDERS];
+    } timing_change;
+
+    class timing_log {
+        public:
+            // The timings in force now are taken to hold from cycle 0
+            timing_log(const engine_trace* trace, double jitter);
+
+            /* Records a change of the timings in force, in a pass of the loop from a cycle. */
+            void update(uint64_t pass_start);
+
+            /* Adds the error of each edge in degrees to spark or fuel, by circuit. */
+            void score(const std::vector<output_edge>& edges, std::vector<double>* spark, std::vector<double>* fuel) const;
+
+            std::vector<timing_change> changes;
+
+        private:
+            const engine_trace* trace;
+            // The largest timing error of a tooth of the trace, in us
+            double jitter;
+
+            const timing_change* at(uint64_t cycle, int circuit) const;
+    };
+
+#endif
@@ -0,0 +1,218 @@
+#include "work_pool.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+
+/*
+    The queue of a worker, the tasks from head up to tail, guarded by a
+    spin lock, which is only held long enough to take a task or a half.
+    The atomics are lock-free, so they work across processes.
+*/
+typedef struct queue {
+    std::atomic<bool> locked;
+    size_t head, tail;
+    pool_worker stats;
+} queue;
+
+/* The memory shared by the workers, with the queues followed by the results */
+typedef struct shared {
+    std::atomic<unsigned long> done;
+    queue queues[1];
+} shared;
+
+static void lock(queue* q){
+    while(q->locked.exchange(true, std::memory_order_acquire)) sched_yield();
+}
+
+static void unlock(queue* q){
+    q->locked.store(false, std::memory_order_release);
+}
+
+/* Takes the next task of a worker's own queue */
+static bool take(queue* q, size_t* task){
+    lock(q);
+
+    bool taken = q->head < q->tail;
+    if(taken) *task = q->head++;
+
+    unlock(q);
+    return taken;
+}
+
+/* Moves the later half of the longest other queue into a worker's own. Returns false once every queue is empty */
+static bool steal(shared* s, unsigned int workers, unsigned int self){
+    for(;;){
+        unsigned int victim = self;
+        size_t longest = 0;
+
+        // The lengths may be stale by the time the victim is locked again, which is settled below
+        for(unsigned int w = 0; w < workers; w++){
+            queue* q = &(s->queues[w]);
+
+            lock(q);
+            size_t length = q->tail - q->head;
+            unlock(q);
+
+            if(w != self && length > longest){
+                victim = w;
+                longest = length;
+            }
+        }
+
+        if(victim == self) return false;
+
+        queue* v = &(s->queues[victim]);
+        queue* own = &(s->queues[self]);
+        size_t from = 0, to = 0;
+
+        lock(v);
+
+        if(v->tail > v->head){
+            // Half, rounded up, so a single task left is stolen too
+            from = v->tail - (v->tail - v->head + 1) / 2;
+            to = v->tail;
+            v->tail = from;
+            v->stats.stolen += to - from;
+        }
+
+        unlock(v);
+
+        if(from == to) continue;
+
+        lock(own);
+        own->head = from;
+        own->tail = to;
+        own->stats.steals++;
+        unlock(own);
+
+        return true;
+    }
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start){
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* Runs a task in a process of its own, so it starts from the state the caller forked the worker in. Returns false if it failed */
+static bool run_task(size_t task, pool_task run, void* context, uint8_t* out, size_t result_size){
+    memset(out, 0, result_size);
+
+    pid_t pid = fork();
+
+    if(pid == 0){
+        run(task, out, context);
+        fflush(NULL);
+        _exit(0);
+    }
+
+    int status;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/* Returns false if a task failed */
+static bool work(shared* s, unsigned int workers, unsigned int self, pool_task run, void* context, uint8_t* results, size_t result_size){
+    queue* own = &(s->queues[self]);
+    size_t task;
+    bool ok = true;
+
+    do {
+        while(take(own, &task)){
+            auto start = std::chrono::steady_clock::now();
+
+            if(run_task(task, run, context, results + task * result_size, result_size)){
+                s->done.fetch_add(1);
+            } else {
+                ok = false;
+            }
+
+            // Only this worker writes its own figures
+            own->stats.tasks++;
+            own->stats.busy += seconds_since(start);
+        }
+    } while(steal(s, workers, self));
+
+    return ok;
+}
+
+pool_run run_pool(size_t n, unsigned int workers, pool_task run, void* context, void* results, size_t result_size){
+    pool_run r = {false, 0, {}};
+    if(workers < 1) workers = 1;
+
+    size_t header = sizeof(shared) + (workers - 1) * sizeof(queue);
+    header = (header + 63) & ~(size_t) 63;
+
+    size_t size = header + n * result_size;
+    void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    if(memory == MAP_FAILED){
+        perror("mmap");
+        return r;
+    }
+
+    shared* s = new (memory) shared;
+    s->done.store(0);
+
+    for(unsigned int w = 0; w < workers; w++){
+        queue* q = new (&(s->queues[w])) queue;
+        q->locked.store(false);
+        q->head = n * w / workers;
+        q->tail = n * (w + 1) / workers;
+        memset(&(q->stats), 0, sizeof(q->stats));
+    }
+
+    uint8_t* shared_results = (uint8_t*) memory + header;
+
+    // Anything buffered would be written again by every worker
+    fflush(NULL);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<pid_t> pids;
+    bool forked = true;
+
+    for(unsigned int w = 0; w < workers; w++){
+        pid_t pid = fork();
+
+        if(pid == 0){
+            bool ok = work(s, workers, w, run, context, shared_results, result_size);
+            _exit(ok ? 0 : 1);
+        }
+
+        if(pid < 0){
+            perror("fork");
+            forked = false;
+            break;
+        }
+
+        pids.push_back(pid);
+    }
+
+    bool exited = true;
+
+    for(pid_t pid : pids){
+        int status;
+        if(waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) exited = false;
+    }
+
+    r.wall = seconds_since(start);
+    r.ok = forked && exited && s->done.load() == n;
+
+    for(unsigned int w = 0; w < workers; w++) r.workers.push_back(s->queues[w].stats);
+
+    memcpy(results, shared_results, n * result_size);
+    munmap(memory, size);
+
+    return r;
+}
+
+unsigned int host_processors(void){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned int) n : 1;
+}
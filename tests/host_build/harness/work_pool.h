@@ -0,0 +1,59 @@
+#ifndef HARNESS_WORK_POOL_H
+    #define HARNESS_WORK_POOL_H
+
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #include <vector>
+
+    /*
+        Pool of worker processes that run a set of tasks, numbered from
+        0, with work stealing.
+
+        The sketch and the stand-in for the Arduino core keep their
+        state in globals, as they do on the board, so each worker is a
+        process forked from the caller, and runs each of its tasks in a
+        process forked from itself in turn. A task so has a copy of the
+        virtual board of its own, with its clock, its port registers
+        and every variable of the sketch as the caller left them, as a
+        reset of the board would, which boot() alone does not give for
+        the variables setup() does not set.
+
+        The tasks are shared out in equal blocks at the start,
+        one to a worker, in queues held in memory shared between them.
+        A worker takes its own tasks in order, and once its queue is
+        empty it steals the later half of the longest queue left, so
+        tasks that take longer than others even out across the workers.
+
+        Each task writes a result of a fixed size into a shared array,
+        at its own number, so the results do not depend on the number
+        of workers or on which of them ran a task.
+    */
+
+    typedef struct pool_worker {
+        unsigned long tasks, steals, stolen;
+        // Wall-clock time the worker spent running tasks, in seconds
+        double busy;
+    } pool_worker;
+
+    typedef struct pool_run {
+        // Whether every worker finished and every task was run once
+        bool ok;
+        // Wall-clock time from the first worker starting to the last finishing, in seconds
+        double wall;
+        std::vector<pool_worker> workers;
+    } pool_run;
+
+    /* Runs a task in a worker, writing its result to out, which is zeroed. */
+    typedef void (*pool_task)(size_t task, void* out, void* context);
+
+    /*
+        Runs tasks 0 to n - 1 on a number of workers, and copies the
+        result of each, of result_size bytes, into results.
+    */
+    pool_run run_pool(size_t n, unsigned int workers, pool_task run, void* context, void* results, size_t result_size);
+
+    /* The number of processors the host has online. */
+    unsigned int host_processors(void);
+
+#endif
@@ -0,0 +1,45 @@
+/*
+    Turns the dumps of the flight recorder of the control system, as
+    sent by DUMP and DUMP --EEPROM, into timelines of events. Reads a
+    capture of the serial output, from a file or from stdin, and
+    prints a timeline for every dump found in it.
+
+    usage: flight_decoder [FILE]
+*/
+#include <stdio.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "flight_log.h"
+
+int main(int argc, char** argv){
+    std::stringstream capture;
+
+    if(argc > 1){
+        std::ifstream in(argv[1], std::ios::binary);
+
+        if(!in){
+            fprintf(stderr, "cannot open %s\n", argv[1]);
+            return 2;
+        }
+
+        capture << in.rdbuf();
+    } else {
+        capture << std::cin.rdbuf();
+    }
+
+    std::vector<flight_dump> dumps = parse_flight_dumps(capture.str());
+
+    if(dumps.empty()){
+        fprintf(stderr, "no flight log found\n");
+        return 1;
+    }
+
+    for(size_t i = 0; i < dumps.size(); i++){
+        printf("%s%s", i ? "\n" : "", flight_timeline(dumps[i]).c_str());
+    }
+
+    return 0;
+}
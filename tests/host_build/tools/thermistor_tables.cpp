@@ -0,0 +1,46 @@
+/*
+    Generates the thermistor conversion tables of the control system
+    (bioengine/src/thermistor/thermistor.c) and the engine simulator
+    (tests/engine_simulator/src/thermistor/thermistor.c) from the
+    thermistor curve, and prints them as C to be pasted into the two.
+
+    usage: thermistor_tables
+*/
+#include <stdio.h>
+
+#include "thermistor_curves.h"
+
+// Must match bioengine/src/thermistor/thermistor.h
+#define COUNT_STEP          16
+#define TEMPERATURE_SCALE   16
+
+// Must match tests/engine_simulator/src/thermistor/thermistor.h
+#define TEMP_STEP           4
+#define TEMPS               31
+
+int main(void){
+    printf("/* Temperature in 1/%d deg C at every %d ADC counts */\n", TEMPERATURE_SCALE, COUNT_STEP);
+    printf("const int16_t thermistor_table[THERMISTOR_ENTRIES] PROGMEM = {");
+
+    for(int i = 0; i <= CURVE_ADC_MAX / COUNT_STEP; i++){
+        double t = count_temperature_curve(i * COUNT_STEP);
+
+        printf("%s%5ld%s", i % 8 ? " " : "\n    ", lround(t * TEMPERATURE_SCALE),
+            i < CURVE_ADC_MAX / COUNT_STEP ? "," : "\n");
+    }
+
+    printf("};\n\n");
+
+    printf("/* Divider voltage in millivolts at every %d deg C from 0 deg C */\n", TEMP_STEP);
+    printf("const uint16_t thermistor_millivolts[THERMISTOR_TEMPS] PROGMEM = {");
+
+    for(int i = 0; i < TEMPS; i++){
+        double v = voltage_curve(i * TEMP_STEP);
+
+        printf("%s%4ld%s", i % 8 ? " " : "\n    ", lround(v * 1000), i < TEMPS - 1 ? "," : "\n");
+    }
+
+    printf("};\n");
+
+    return 0;
+}